@@ -50,12 +50,14 @@ CLEAN :
 	-@erase "$(INTDIR)\apr_cstr.obj"
 	-@erase "$(INTDIR)\apr_encode.obj"
 	-@erase "$(INTDIR)\apr_escape.obj"
+	-@erase "$(INTDIR)\apr_flathash.obj"
 	-@erase "$(INTDIR)\apr_fnmatch.obj"
 	-@erase "$(INTDIR)\apr_getpass.obj"
 	-@erase "$(INTDIR)\apr_hash.obj"
 	-@erase "$(INTDIR)\apr_pools.obj"
 	-@erase "$(INTDIR)\apr_random.obj"
 	-@erase "$(INTDIR)\apr_skiplist.obj"
+	-@erase "$(INTDIR)\apr_slab.obj"
 	-@erase "$(INTDIR)\apr_snprintf.obj"
 	-@erase "$(INTDIR)\apr_strings.obj"
 	-@erase "$(INTDIR)\apr_strnatcmp.obj"
@@ -161,6 +163,7 @@ LIB32_OBJS= \
 	"$(INTDIR)\thread_mutex.obj" \
 	"$(INTDIR)\thread_rwlock.obj" \
 	"$(INTDIR)\apr_pools.obj" \
+	"$(INTDIR)\apr_slab.obj" \
 	"$(INTDIR)\charset.obj" \
 	"$(INTDIR)\env.obj" \
 	"$(INTDIR)\errorcodes.obj" \
@@ -199,6 +202,7 @@ LIB32_OBJS= \
 	"$(INTDIR)\apr_strings.obj" \
 	"$(INTDIR)\apr_strnatcmp.obj" \
 	"$(INTDIR)\apr_strtok.obj" \
+	"$(INTDIR)\apr_flathash.obj" \
 	"$(INTDIR)\apr_hash.obj" \
 	"$(INTDIR)\apr_skiplist.obj" \
 	"$(INTDIR)\apr_tables.obj" \
@@ -236,12 +240,14 @@ CLEAN :
 	-@erase "$(INTDIR)\apr_cstr.obj"
 	-@erase "$(INTDIR)\apr_encode.obj"
 	-@erase "$(INTDIR)\apr_escape.obj"
+	-@erase "$(INTDIR)\apr_flathash.obj"
 	-@erase "$(INTDIR)\apr_fnmatch.obj"
 	-@erase "$(INTDIR)\apr_getpass.obj"
 	-@erase "$(INTDIR)\apr_hash.obj"
 	-@erase "$(INTDIR)\apr_pools.obj"
 	-@erase "$(INTDIR)\apr_random.obj"
 	-@erase "$(INTDIR)\apr_skiplist.obj"
+	-@erase "$(INTDIR)\apr_slab.obj"
 	-@erase "$(INTDIR)\apr_snprintf.obj"
 	-@erase "$(INTDIR)\apr_strings.obj"
 	-@erase "$(INTDIR)\apr_strnatcmp.obj"
@@ -347,6 +353,7 @@ LIB32_OBJS= \
 	"$(INTDIR)\thread_mutex.obj" \
 	"$(INTDIR)\thread_rwlock.obj" \
 	"$(INTDIR)\apr_pools.obj" \
+	"$(INTDIR)\apr_slab.obj" \
 	"$(INTDIR)\charset.obj" \
 	"$(INTDIR)\env.obj" \
 	"$(INTDIR)\errorcodes.obj" \
@@ -385,6 +392,7 @@ LIB32_OBJS= \
 	"$(INTDIR)\apr_strings.obj" \
 	"$(INTDIR)\apr_strnatcmp.obj" \
 	"$(INTDIR)\apr_strtok.obj" \
+	"$(INTDIR)\apr_flathash.obj" \
 	"$(INTDIR)\apr_hash.obj" \
 	"$(INTDIR)\apr_skiplist.obj" \
 	"$(INTDIR)\apr_tables.obj" \
@@ -422,12 +430,14 @@ CLEAN :
 	-@erase "$(INTDIR)\apr_cstr.obj"
 	-@erase "$(INTDIR)\apr_encode.obj"
 	-@erase "$(INTDIR)\apr_escape.obj"
+	-@erase "$(INTDIR)\apr_flathash.obj"
 	-@erase "$(INTDIR)\apr_fnmatch.obj"
 	-@erase "$(INTDIR)\apr_getpass.obj"
 	-@erase "$(INTDIR)\apr_hash.obj"
 	-@erase "$(INTDIR)\apr_pools.obj"
 	-@erase "$(INTDIR)\apr_random.obj"
 	-@erase "$(INTDIR)\apr_skiplist.obj"
+	-@erase "$(INTDIR)\apr_slab.obj"
 	-@erase "$(INTDIR)\apr_snprintf.obj"
 	-@erase "$(INTDIR)\apr_strings.obj"
 	-@erase "$(INTDIR)\apr_strnatcmp.obj"
@@ -533,6 +543,7 @@ LIB32_OBJS= \
 	"$(INTDIR)\thread_mutex.obj" \
 	"$(INTDIR)\thread_rwlock.obj" \
 	"$(INTDIR)\apr_pools.obj" \
+	"$(INTDIR)\apr_slab.obj" \
 	"$(INTDIR)\charset.obj" \
 	"$(INTDIR)\env.obj" \
 	"$(INTDIR)\errorcodes.obj" \
@@ -571,6 +582,7 @@ LIB32_OBJS= \
 	"$(INTDIR)\apr_strings.obj" \
 	"$(INTDIR)\apr_strnatcmp.obj" \
 	"$(INTDIR)\apr_strtok.obj" \
+	"$(INTDIR)\apr_flathash.obj" \
 	"$(INTDIR)\apr_hash.obj" \
 	"$(INTDIR)\apr_skiplist.obj" \
 	"$(INTDIR)\apr_tables.obj" \
@@ -608,12 +620,14 @@ CLEAN :
 	-@erase "$(INTDIR)\apr_cstr.obj"
 	-@erase "$(INTDIR)\apr_encode.obj"
 	-@erase "$(INTDIR)\apr_escape.obj"
+	-@erase "$(INTDIR)\apr_flathash.obj"
 	-@erase "$(INTDIR)\apr_fnmatch.obj"
 	-@erase "$(INTDIR)\apr_getpass.obj"
 	-@erase "$(INTDIR)\apr_hash.obj"
 	-@erase "$(INTDIR)\apr_pools.obj"
 	-@erase "$(INTDIR)\apr_random.obj"
 	-@erase "$(INTDIR)\apr_skiplist.obj"
+	-@erase "$(INTDIR)\apr_slab.obj"
 	-@erase "$(INTDIR)\apr_snprintf.obj"
 	-@erase "$(INTDIR)\apr_strings.obj"
 	-@erase "$(INTDIR)\apr_strnatcmp.obj"
@@ -720,6 +734,7 @@ LIB32_OBJS= \
 	"$(INTDIR)\thread_mutex.obj" \
 	"$(INTDIR)\thread_rwlock.obj" \
 	"$(INTDIR)\apr_pools.obj" \
+	"$(INTDIR)\apr_slab.obj" \
 	"$(INTDIR)\charset.obj" \
 	"$(INTDIR)\env.obj" \
 	"$(INTDIR)\errorcodes.obj" \
@@ -758,6 +773,7 @@ LIB32_OBJS= \
 	"$(INTDIR)\apr_strings.obj" \
 	"$(INTDIR)\apr_strnatcmp.obj" \
 	"$(INTDIR)\apr_strtok.obj" \
+	"$(INTDIR)\apr_flathash.obj" \
 	"$(INTDIR)\apr_hash.obj" \
 	"$(INTDIR)\apr_skiplist.obj" \
 	"$(INTDIR)\apr_tables.obj" \
@@ -980,6 +996,12 @@ SOURCE=.\memory\unix\apr_pools.c
 	$(CPP) $(CPP_PROJ) $(SOURCE)
 
 
+SOURCE=.\memory\unix\apr_slab.c
+
+"$(INTDIR)\apr_slab.obj" : $(SOURCE) "$(INTDIR)"
+	$(CPP) $(CPP_PROJ) $(SOURCE)
+
+
 SOURCE=.\misc\win32\apr_app.c
 SOURCE=.\misc\win32\charset.c
 
@@ -1209,6 +1231,12 @@ SOURCE=.\strings\apr_strtok.c
 	$(CPP) $(CPP_PROJ) $(SOURCE)
 
 
+SOURCE=.\tables\apr_flathash.c
+
+"$(INTDIR)\apr_flathash.obj" : $(SOURCE) "$(INTDIR)"
+	$(CPP) $(CPP_PROJ) $(SOURCE)
+
+
 SOURCE=.\tables\apr_hash.c
 
 "$(INTDIR)\apr_hash.obj" : $(SOURCE) "$(INTDIR)"
@@ -66,6 +66,20 @@ struct apr_memnode_t {
 /** Symbolic constants */
 #define APR_ALLOCATOR_MAX_FREE_UNLIMITED 0
 
+/**
+ * @defgroup apr_allocator_flags Allocator creation flags
+ * @{
+ */
+/** Carve the memnodes out of huge page backed regions, see
+ * apr_allocator_create_ex()
+ */
+#define APR_ALLOCATOR_HUGEPAGES     0x01
+/** Keep the free memnodes of the size classes in lock-free lists, see
+ * apr_allocator_create_ex()
+ */
+#define APR_ALLOCATOR_LOCKFREE      0x02
+/** @} */
+
 /**
  * Create a new allocator
  * @param allocator The allocator we have just created.
@@ -74,6 +88,33 @@ struct apr_memnode_t {
 APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
                           __attribute__((nonnull(1)));
 
+/**
+ * Create a new allocator with the given flags
+ * @param allocator The allocator we have just created.
+ * @param flags A bitmask of APR_ALLOCATOR_* flags (or 0)
+ * @remark With APR_ALLOCATOR_HUGEPAGES, the memnodes of up to 20 times
+ *         the allocator's boundary size (e.g. 80K) are carved out of
+ *         2MB regions, mapped with MAP_HUGETLB or else advised for
+ *         transparent huge pages (MADV_HUGEPAGE), to reduce the TLB
+ *         misses of large and long-lived pools.  These memnodes are
+ *         never given back to the system before the allocator is
+ *         destroyed, regardless of apr_allocator_max_free_set().
+ *         The flag is silently ignored where anonymous mmap() is not
+ *         available, or with --enable-allocator-guard-pages.
+ * @remark With APR_ALLOCATOR_LOCKFREE, the free memnodes of up to 20
+ *         times the allocator's boundary size are pushed to and popped
+ *         from lock-free lists, so that threads sharing the allocator do
+ *         not serialize on its mutex (see apr_allocator_mutex_set()) to
+ *         get or give back such memnodes.  These memnodes are never given
+ *         back to the system before the allocator is destroyed, regardless
+ *         of apr_allocator_max_free_set() and apr_allocator_decay_set().
+ *         The flag is silently ignored without threads support, or where
+ *         no double-word compare-and-swap is available.
+ */
+APR_DECLARE(apr_status_t) apr_allocator_create_ex(apr_allocator_t **allocator,
+                                                  apr_uint32_t flags)
+                          __attribute__((nonnull(1)));
+
 /**
  * Destroy an allocator
  * @param allocator The allocator to be destroyed
@@ -148,6 +189,155 @@ APR_DECLARE(void) apr_allocator_max_free_set(apr_allocator_t *allocator,
                                              apr_size_t size)
                   __attribute__((nonnull(1)));
 
+/** Number of size classes reported by apr_allocator_stats_get() */
+#define APR_ALLOCATOR_STATS_BINS 20
+
+/** The usage statistics of an allocator */
+typedef struct apr_allocator_stats_t {
+    /** Size granularity of the blocks, the size class i (i > 0) holds
+     * blocks of (i + 1) * boundary bytes */
+    apr_size_t boundary;
+    /** Number of free blocks per size class, [0] being for the blocks
+     * larger than the largest size class */
+    apr_size_t free_nodes[APR_ALLOCATOR_STATS_BINS];
+    /** Bytes of the free blocks above */
+    apr_size_t free_bytes;
+    /** Bytes of the free blocks in the threads' caches (approximate) */
+    apr_size_t cached_bytes;
+    /** Bytes currently allocated from the system */
+    apr_size_t sys_bytes;
+    /** Number of allocations from the system (malloc() or mmap()) */
+    apr_size_t sys_allocs;
+    /** Number of releases to the system (free() or munmap()) */
+    apr_size_t sys_frees;
+    /** Number of destroyed pools kept for reuse
+     * (@see apr_allocator_pool_cache_set()) */
+    apr_size_t cached_pools;
+} apr_allocator_stats_t;
+
+/**
+ * Get the usage statistics of an allocator
+ * @param allocator The allocator to inspect
+ * @param stats The statistics to fill in
+ */
+APR_DECLARE(void) apr_allocator_stats_get(apr_allocator_t *allocator,
+                                          apr_allocator_stats_t *stats)
+                  __attribute__((nonnull(1,2)));
+
+#include "apr_time.h"
+
+/**
+ * Set the time after which the allocator gives unused blocks back to
+ * the system.
+ * @param allocator The allocator to set the decay time on
+ * @param decay The time a block may stay unused before being released
+ *        (rounded up to the second).  0 == never (the default).
+ * @remark Expired blocks are looked for at most once per second, when
+ *         some blocks are given back to the allocator.  The blocks which
+ *         are mapped (with APR_ALLOCATOR_HUGEPAGES, or when APR is
+ *         built with --enable-allocator-uses-mmap) have their pages
+ *         purged with madvise() (MADV_FREE where available) instead, so
+ *         they can be reclaimed by the system yet stay ready for reuse.
+ * @remark This works in addition to apr_allocator_max_free_set(), which
+ *         releases blocks immediately above some amount of free memory.
+ */
+APR_DECLARE(void) apr_allocator_decay_set(apr_allocator_t *allocator,
+                                          apr_interval_time_t decay)
+                  __attribute__((nonnull(1)));
+
+/**
+ * Give each thread using the allocator its own cache of free blocks.
+ * @param allocator The allocator to set the thread caches up for
+ * @param size The maximum amount of free memory each thread may hold
+ *        in its cache.  0 == disable the caches.
+ * @param pool The pool whose cleanup will give the cached blocks back
+ *        to the allocator and disable the caches
+ * @return APR_ENOTIMPL if APR is compiled without threads support
+ * @remark The thread caches are refilled from and drained to the
+ *         allocator's free lists in batches, so that allocating and
+ *         freeing blocks in steady state does not need the allocator
+ *         mutex (see apr_allocator_mutex_set()).  The blocks held by a
+ *         thread are given back to the allocator when it exits.
+ * @remark This function should be called before any other thread uses
+ *         the allocator, and @a pool must not outlive the allocator;
+ *         the allocator's owner is usually a good fit.
+ */
+APR_DECLARE(apr_status_t) apr_allocator_thread_cache_set(
+                                      apr_allocator_t *allocator,
+                                      apr_size_t size,
+                                      apr_pool_t *pool)
+                          __attribute__((nonnull(1,3)));
+
+/**
+ * Keep the destroyed pools for the creation of new ones.
+ * @param allocator The allocator to set the pool cache up for
+ * @param count The maximum number of pools to keep.  0 == disable the
+ *        cache (the default).
+ * @remark When a pool using the allocator (but not owning it) is
+ *         destroyed, the block holding its structure is kept as is for
+ *         the next apr_pool_create() instead of going back to the free
+ *         lists, which makes short-lived (sub)pools cheaper to create
+ *         and destroy.  The other blocks of the pool are freed as usual.
+ * @remark Lowering @a count gives the blocks above it back to the
+ *         allocator.
+ */
+APR_DECLARE(void) apr_allocator_pool_cache_set(apr_allocator_t *allocator,
+                                               apr_size_t count)
+                  __attribute__((nonnull(1)));
+
+/**
+ * Ask the pools using the allocator to give back the blocks they retain
+ * (@see apr_pool_retain_set()).
+ * @param allocator The allocator
+ * @remark Each pool gives its blocks back on its next apr_pool_clear(),
+ *         so this can be called from any thread.  The same happens when
+ *         the allocator fails to get memory from the system.
+ */
+APR_DECLARE(void) apr_allocator_reclaim(apr_allocator_t *allocator)
+                  __attribute__((nonnull(1)));
+
+/**
+ * Carve all the blocks of the allocator out of one reserved range of
+ * address space (an arena).
+ * @param allocator The allocator, which must not have allocated any
+ *        block yet
+ * @param size The size of the range to reserve, the most memory the
+ *        allocator will ever hand out
+ * @return APR_EINVAL if the allocator already has an arena or allocated
+ *         some blocks, APR_ENOTIMPL where anonymous mmap() is not
+ *         available, or the error from mmap()
+ * @remark The range is reserved inaccessible and its pages are committed
+ *         on demand, in 1MB steps, as the blocks are carved out of it, so
+ *         the memory of the pools is contiguous and never fragmented.
+ *         Allocations fail when the arena is exhausted.
+ * @remark The blocks are never given back to the system one by one, but
+ *         all at once when the allocator is destroyed, without walking
+ *         the free lists, or when apr_allocator_arena_reset() is called.
+ *         apr_allocator_max_free_set() does not apply to them, while
+ *         apr_allocator_decay_set() still purges their pages.
+ * @remark With APR_ALLOCATOR_HUGEPAGES, the arena is advised for
+ *         transparent huge pages (MADV_HUGEPAGE).
+ */
+APR_DECLARE(apr_status_t) apr_allocator_arena_set(apr_allocator_t *allocator,
+                                                  apr_size_t size)
+                          __attribute__((nonnull(1)));
+
+/**
+ * Give all the memory of the allocator's arena back to the system at once,
+ * with a single madvise(), and start carving blocks from its beginning
+ * again.
+ * @param allocator The allocator with an arena
+ * @return APR_EINVAL if the allocator has no arena, or the error from
+ *         madvise()
+ * @warning All the blocks handed out by the allocator must have been
+ *          given back (e.g. all the pools using it destroyed), they are
+ *          forgotten, and no other thread may use the allocator
+ *          meanwhile.
+ */
+APR_DECLARE(apr_status_t) apr_allocator_arena_reset(
+                                      apr_allocator_t *allocator)
+                          __attribute__((nonnull(1)));
+
 #include "apr_thread_mutex.h"
 
 #if APR_HAS_THREADS
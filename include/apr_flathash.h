@@ -0,0 +1,206 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_FLATHASH_H
+#define APR_FLATHASH_H
+
+/**
+ * @file apr_flathash.h
+ * @brief APR Flat Hash Tables
+ */
+
+#include "apr_pools.h"
+#include "apr_hash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup apr_flathash Flat Hash Tables
+ * @ingroup APR
+ * Hash tables with open addressing, where the entries are stored in a
+ * single array probed by groups of 16 control bytes (a byte of the hash
+ * per entry, compared all at once with SSE2 where available).  Unlike
+ * apr_hash_t, there is no allocation per entry, removed entries are
+ * reclaimed when the table is rehashed, and keys and values of a fixed
+ * size can be stored inline rather than as pointers.  This makes them
+ * better suited to large, lookup-heavy tables.
+ * @{
+ */
+
+/**
+ * Abstract type for flat hash tables.
+ */
+typedef struct apr_flathash_t apr_flathash_t;
+
+/**
+ * Abstract type for scanning flat hash tables.
+ */
+typedef struct apr_flathash_index_t apr_flathash_index_t;
+
+/**
+ * Create a flat hash table, of keys and values stored as pointers
+ * (like apr_hash_t).
+ * @param pool The pool to allocate the hash table out of
+ * @return The hash table just created
+ */
+APR_DECLARE(apr_flathash_t *) apr_flathash_make(apr_pool_t *pool);
+
+/**
+ * Create a flat hash table, with inline keys and/or values.
+ * @param pool The pool to allocate the hash table out of
+ * @param nelts The number of entries to make room for, or 0
+ * @param ksize The size of the keys stored inline, or 0 to store
+ *        pointers to keys of any length
+ * @param vsize The size of the values stored inline, or 0 to store
+ *        pointers to the values
+ * @param hash_func A custom hash function, or NULL for the default one
+ * @return The hash table just created
+ * @remark Inline keys and values are copied into the table by
+ *         apr_flathash_set(), and apr_flathash_get() returns a pointer to
+ *         the inline value (suitably aligned for its size).  The pointer
+ *         is valid until the next change to the table.
+ */
+APR_DECLARE(apr_flathash_t *) apr_flathash_make_ex(apr_pool_t *pool,
+                                                   apr_size_t nelts,
+                                                   apr_size_t ksize,
+                                                   apr_size_t vsize,
+                                                   apr_hashfunc_t hash_func);
+
+/**
+ * Make a copy of a flat hash table
+ * @param pool The pool from which to allocate the new hash table
+ * @param fh The hash table to clone
+ * @return The hash table just created
+ * @remark Makes a shallow copy, inline keys and values are copied but
+ *         not what pointer keys and values point to.
+ */
+APR_DECLARE(apr_flathash_t *) apr_flathash_copy(apr_pool_t *pool,
+                                                const apr_flathash_t *fh);
+
+/**
+ * Associate a value with a key in a flat hash table.
+ * @param fh The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the
+ *        string length.  Ignored for inline keys.
+ * @param val Value to associate with the key, or pointer to the value for
+ *        inline values
+ * @remark If @a val is NULL the hash entry is deleted.  Keys stored as
+ *         pointers must have a lifetime at least as long as the hash
+ *         table's pool.
+ * @remark Adding an entry may rehash the table, which invalidates the
+ *         iterations in progress and the pointers to inline values.
+ */
+APR_DECLARE(void) apr_flathash_set(apr_flathash_t *fh, const void *key,
+                                   apr_ssize_t klen, const void *val);
+
+/**
+ * Look up the value associated with a key in a flat hash table.
+ * @param fh The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the
+ *        string length.  Ignored for inline keys.
+ * @return The value, or a pointer to the value for inline values.
+ *         Returns NULL if the key is not present.
+ */
+APR_DECLARE(void *) apr_flathash_get(const apr_flathash_t *fh,
+                                     const void *key, apr_ssize_t klen);
+
+/**
+ * Start iterating over the entries in a flat hash table.
+ * @param p The pool to allocate the apr_flathash_index_t iterator. If this
+ *          pool is NULL, then an internal, non-thread-safe iterator is used.
+ * @param fh The hash table
+ * @return The iteration state
+ * @remark The current entry can be deleted during an iteration, but
+ *         adding entries may rehash the table and is not supported.
+ */
+APR_DECLARE(apr_flathash_index_t *) apr_flathash_first(apr_pool_t *p,
+                                                       apr_flathash_t *fh);
+
+/**
+ * Continue iterating over the entries in a flat hash table.
+ * @param hi The iteration state
+ * @return a pointer to the updated iteration state.  NULL if there are no
+ *         more entries.
+ */
+APR_DECLARE(apr_flathash_index_t *) apr_flathash_next(
+                                                apr_flathash_index_t *hi);
+
+/**
+ * Get the current entry's details from the iteration state.
+ * @param hi The iteration state
+ * @param key Return pointer for the pointer to the key.
+ * @param klen Return pointer for the key length.
+ * @param val Return pointer for the associated value (or the pointer to
+ *        the inline value).
+ * @remark The return pointers should point to a variable that will be set
+ *         to the corresponding data, or they may be NULL if the data isn't
+ *         interesting.
+ */
+APR_DECLARE(void) apr_flathash_this(apr_flathash_index_t *hi,
+                                    const void **key, apr_ssize_t *klen,
+                                    void **val);
+
+/**
+ * Get the current entry's key from the iteration state.
+ * @param hi The iteration state
+ * @return The pointer to the key
+ */
+APR_DECLARE(const void *) apr_flathash_this_key(apr_flathash_index_t *hi);
+
+/**
+ * Get the current entry's key length from the iteration state.
+ * @param hi The iteration state
+ * @return The key length
+ */
+APR_DECLARE(apr_ssize_t) apr_flathash_this_key_len(apr_flathash_index_t *hi);
+
+/**
+ * Get the current entry's value from the iteration state.
+ * @param hi The iteration state
+ * @return The value, or the pointer to the inline value
+ */
+APR_DECLARE(void *) apr_flathash_this_val(apr_flathash_index_t *hi);
+
+/**
+ * Get the number of key/value pairs in the flat hash table.
+ * @param fh The hash table
+ * @return The number of key/value pairs in the hash table.
+ */
+APR_DECLARE(unsigned int) apr_flathash_count(const apr_flathash_t *fh);
+
+/**
+ * Clear any key/value pairs in the flat hash table.
+ * @param fh The hash table
+ * @remark The memory of the table is kept for reuse.
+ */
+APR_DECLARE(void) apr_flathash_clear(apr_flathash_t *fh);
+
+/**
+ * Get a pointer to the pool which the flat hash table was created in
+ */
+APR_POOL_DECLARE_ACCESSOR(flathash);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* !APR_FLATHASH_H */
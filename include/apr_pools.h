@@ -199,6 +199,64 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
                                              apr_allocator_t *allocator)
                           __attribute__((nonnull(1)));
 
+/**
+ * @defgroup apr_pool_flags Pool creation flags
+ * @{
+ */
+/** Carve the pool structure and its first bytes (about 1K in all) out of
+ * a block of the parent pool, instead of a block of at least 8K of its
+ * own, until it needs more memory.  This cuts the footprint of numerous
+ * small and mostly idle subpools (e.g. for keep-alive connections).
+ * The parent reuses the space of destroyed small subpools for the new
+ * ones, and frees it when it is cleared or destroyed.
+ */
+#define APR_POOL_SMALL              0x01
+/** Let several threads allocate from the pool at the same time, with
+ * apr_palloc() and the functions based on it (apr_pcalloc(),
+ * apr_pstrdup(), apr_psprintf(), ...).  The allocations claim their
+ * space with an atomic compare-and-swap, only replacing a full block
+ * takes a (spin) lock.  Everything else, like registering cleanups or
+ * creating subpools, must still be done by one thread at a time, and
+ * clearing or destroying the pool when no other thread uses it.
+ * @see apr_pool_create_concurrent()
+ */
+#define APR_POOL_CONCURRENT         0x02
+/** @} */
+
+/**
+ * Create a new pool with some creation flags.
+ * @param newpool The pool we have just created.
+ * @param parent See apr_pool_create_ex().
+ * @param abort_fn See apr_pool_create_ex().
+ * @param allocator See apr_pool_create_ex().
+ * @param flags A bitmask of APR_POOL_* flags (or 0)
+ * @remark Thread-safe like apr_pool_create_ex().
+ * @remark APR_POOL_SMALL is ignored when APR_POOL_DEBUG is defined or
+ *         when running under valgrind.  APR_POOL_CONCURRENT is ignored
+ *         when APR is compiled without threads support.
+ */
+APR_DECLARE(apr_status_t) apr_pool_create_flags(apr_pool_t **newpool,
+                                                apr_pool_t *parent,
+                                                apr_abortfunc_t abort_fn,
+                                                apr_allocator_t *allocator,
+                                                apr_uint32_t flags)
+                          __attribute__((nonnull(1)));
+
+/**
+ * Create a new pool which several threads can allocate from at the same
+ * time (see APR_POOL_CONCURRENT), e.g. for the results of parallel work
+ * sharing the same lifetime, without a subpool per thread.
+ * @param newpool The pool we have just created.
+ * @param parent See apr_pool_create_ex().
+ */
+#if defined(DOXYGEN)
+APR_DECLARE(apr_status_t) apr_pool_create_concurrent(apr_pool_t **newpool,
+                                                     apr_pool_t *parent);
+#else
+#define apr_pool_create_concurrent(newpool, parent) \
+    apr_pool_create_flags(newpool, parent, NULL, NULL, APR_POOL_CONCURRENT)
+#endif
+
 /**
  * Create a new pool.
  * @deprecated @see apr_pool_create_unmanaged_ex.
@@ -364,6 +422,23 @@ APR_DECLARE(apr_allocator_t *) apr_pool_allocator_get(apr_pool_t *pool)
  */
 APR_DECLARE(void) apr_pool_clear(apr_pool_t *p) __attribute__((nonnull(1)));
 
+/**
+ * Keep some of the pool's memory blocks across apr_pool_clear(), instead
+ * of giving them back to the allocator each time.
+ * @param p The pool
+ * @param size The most bytes of blocks to keep (including the block
+ *        headers), besides the one holding the pool structure.  0 ==
+ *        none (the default).
+ * @remark A pool cleared over and over (e.g. per request) which needs
+ *         a few blocks each time then gets them without going through
+ *         the allocator.  The blocks are kept until the pool is
+ *         destroyed, or until its next clear after apr_allocator_reclaim()
+ *         was called or the allocator ran out of memory.
+ * @remark This is a noop when compiled with APR_POOL_DEBUG.
+ */
+APR_DECLARE(void) apr_pool_retain_set(apr_pool_t *p, apr_size_t size)
+                  __attribute__((nonnull(1)));
+
 /**
  * Debug version of apr_pool_clear.
  * @param p See: apr_pool_clear.
@@ -416,6 +491,45 @@ APR_DECLARE(void) apr_pool_destroy_debug(apr_pool_t *p,
     apr_pool_destroy_debug(p, APR_POOL__FILE_LINE__)
 #endif
 
+/** A savepoint in the allocations of a pool, see apr_pool_mark() */
+typedef struct apr_pool_mark_t apr_pool_mark_t;
+
+/**
+ * Mark the current position in the allocations of a pool, so that the
+ * memory allocated after it can be given back with apr_pool_rewind(),
+ * without having to use a subpool.
+ * @param p The pool to mark
+ * @return The mark, allocated from the pool itself (before the position
+ *         it records), or NULL if it could not be allocated or the pool
+ *         is an APR_POOL_CONCURRENT one
+ * @remark The mark stays valid until the pool is cleared, or rewound to
+ *         an older mark.  Marks must be rewound in the reverse order of
+ *         their creation (that is, rewinding to a mark invalidates the
+ *         more recent ones).
+ */
+APR_DECLARE(apr_pool_mark_t *) apr_pool_mark(apr_pool_t *p)
+                               __attribute__((nonnull(1)));
+
+/**
+ * Give back the memory allocated from a pool since a mark.
+ * @param p The pool to rewind
+ * @param mark The mark, as returned by apr_pool_mark() for @a p
+ * @remark Nothing else is undone: the caller must make sure that nothing
+ *         allocated since the mark is still in use, including the
+ *         cleanups, user data and subprocesses registered with the pool
+ *         in the meantime.  The cleanups and subprocesses whose records
+ *         are given back are forgotten, without being run (or waited
+ *         for), as are all the user data if none was set before the
+ *         mark.  Subpools are not affected.
+ * @remark The pool can be rewound to the same mark any number of times,
+ *         e.g. once per iteration of a loop using scratch memory.
+ * @remark The memory given back is reused by the pool, its blocks being
+ *         returned to the allocator, except when running under valgrind
+ *         where it is held until the pool is cleared.
+ */
+APR_DECLARE(void) apr_pool_rewind(apr_pool_t *p, apr_pool_mark_t *mark)
+                  __attribute__((nonnull(1,2)));
+
 
 /*
  * Memory allocation
@@ -482,6 +596,130 @@ APR_DECLARE(void *) apr_pcalloc_debug(apr_pool_t *p, apr_size_t size,
     apr_pcalloc_debug(p, size, APR_POOL__FILE_LINE__)
 #endif
 
+/**
+ * Resize the most recent allocation from a pool in place when possible,
+ * or else allocate a new block and copy the contents (like realloc()).
+ * @param p The pool @a mem was allocated from
+ * @param mem The memory to resize, or NULL to allocate a new block
+ * @param old_size The size @a mem was allocated with (or resized to)
+ * @param new_size The new size
+ * @return The resized memory, which is @a mem itself or a new block
+ *         holding its first @a old_size bytes (at most @a new_size);
+ *         NULL if a new block could not be allocated
+ * @remark @a mem is resized in place when it is the last allocation
+ *         from the pool's active memory block and there is enough room
+ *         after it, so that a buffer growing repeatedly (e.g. doubling)
+ *         does not have to be copied each time nor waste the previous
+ *         blocks.  Otherwise the previous block is simply not reused
+ *         until the pool is cleared.
+ */
+APR_DECLARE(void *) apr_prealloc(apr_pool_t *p, void *mem,
+                                 apr_size_t old_size, apr_size_t new_size)
+                    __attribute__((nonnull(1)));
+
+/**
+ * The size of a cache line assumed by apr_palloc_isolated(), which is
+ * the common one on current hardware (larger lines are still separated
+ * from adjacent lines of this size when the system reports them).
+ */
+#define APR_CACHELINE_SIZE 64
+
+/**
+ * Allocate a block of memory from a pool, aligned on a given boundary
+ * @param p The pool to allocate from
+ * @param size The amount of memory to allocate
+ * @param alignment The alignment of the memory, a power of two
+ * @return The allocated memory, or NULL if @a alignment is not a power
+ *         of two (or the pool ran out of memory)
+ * @remark The bytes skipped to align the memory in the pool's active
+ *         block are not reused until the pool is cleared, so it is
+ *         better to group the aligned allocations together.
+ */
+APR_DECLARE(void *) apr_palloc_aligned(apr_pool_t *p, apr_size_t size,
+                                       apr_size_t alignment)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Allocate a block of memory from a pool, aligned on a given boundary,
+ * and set all of the memory to 0
+ * @param p The pool to allocate from
+ * @param size The amount of memory to allocate
+ * @param alignment The alignment of the memory, a power of two
+ * @return The allocated memory, or NULL if @a alignment is not a power
+ *         of two (or the pool ran out of memory)
+ */
+APR_DECLARE(void *) apr_pcalloc_aligned(apr_pool_t *p, apr_size_t size,
+                                        apr_size_t alignment)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Allocate a block of memory from a pool on cache lines of its own,
+ * which no other allocation shares (e.g. for data written concurrently
+ * by different threads, to avoid false sharing)
+ * @param p The pool to allocate from
+ * @param size The amount of memory to allocate
+ * @return The allocated memory, or NULL if the pool ran out of memory
+ * @remark The memory is aligned on the system's cache line size (at
+ *         least APR_CACHELINE_SIZE) and its size rounded up to a
+ *         multiple of it.
+ */
+APR_DECLARE(void *) apr_palloc_isolated(apr_pool_t *p, apr_size_t size)
+                    __attribute__((nonnull(1)));
+
+/**
+ * @defgroup apr_pool_inline Inline allocation
+ *
+ * Defining APR_POOL_INLINE before including apr_pools.h makes
+ * apr_palloc() (and apr_pcalloc()) bump allocate inline from the pool's
+ * active memory block, and call into the library only when it is full.
+ *
+ * @remark The code compiled this way depends on the layout of the head
+ *         of the pool structure, apr_pool_inline_t, so unlike the rest of
+ *         the API it may have to be recompiled on APR upgrades.  Code
+ *         which does not define APR_POOL_INLINE is not affected.
+ * @remark This has no effect when compiled with APR_POOL_DEBUG, and the
+ *         library falls back to apr_palloc() itself whenever needed (e.g.
+ *         when running under valgrind).
+ * @{
+ */
+
+/** @internal The head of apr_pool_t, used by the inline apr_palloc() */
+typedef struct apr_pool_inline_t {
+    /** The active memory block */
+    apr_memnode_t *active;
+    /** Bytes requested, see apr_pool_stats_t */
+    apr_size_t     requested;
+    /** Non-zero when all the allocations must go through apr_palloc() */
+    apr_uint32_t   slow;
+} apr_pool_inline_t;
+
+#if defined(APR_POOL_INLINE) && !APR_POOL_DEBUG && !defined(DOXYGEN)
+static APR_INLINE void *apr_palloc_inline(apr_pool_t *p, apr_size_t size)
+{
+    apr_pool_inline_t *head = (apr_pool_inline_t *)p;
+    /* APR_ALIGN_DEFAULT(), which apr_general.h may not have defined yet */
+    apr_size_t aligned = (size + 7) & ~(apr_size_t)7;
+    apr_memnode_t *active;
+    void *mem;
+
+    if (!head->slow && aligned >= size) {
+        active = head->active;
+        if (aligned <= (apr_size_t)(active->endp - active->first_avail)) {
+            mem = active->first_avail;
+            active->first_avail += aligned;
+            head->requested += size;
+            return mem;
+        }
+    }
+
+    return (apr_palloc)(p, size);
+}
+
+#define apr_palloc(p, size) apr_palloc_inline(p, size)
+#endif /* APR_POOL_INLINE */
+
+/** @} */
+
 
 /*
  * Pool Properties
@@ -537,6 +775,171 @@ APR_DECLARE(void) apr_pool_tag(apr_pool_t *pool, const char *tag)
                   __attribute__((nonnull(1)));
 
 
+/*
+ * Pool statistics
+ */
+
+/** The memory usage of a pool (or a set of pools), in bytes */
+typedef struct apr_pool_stats_t {
+    /** Number of pools accounted */
+    apr_size_t pools;
+    /** Bytes asked for (apr_palloc() and friends) since the pool was
+     * created or last cleared */
+    apr_size_t requested;
+    /** Bytes of the memory blocks held by the pool, including the
+     * block headers and the pool structure itself */
+    apr_size_t reserved;
+    /** Number of memory blocks held by the pool */
+    apr_size_t nodes;
+    /** Bytes left unused at the end of the blocks which are not the
+     * active one, because an allocation did not fit in them */
+    apr_size_t wasted;
+    /** Highest value of reserved since the pool was created */
+    apr_size_t peak;
+} apr_pool_stats_t;
+
+/**
+ * Get the memory usage statistics of a pool
+ * @param pool The pool to inspect
+ * @param stats The statistics to fill in
+ * @param recurse Whether to add the statistics of all the subpools
+ * @remark The statistics are maintained by the allocation functions
+ *         without any locking, so the figures of the pools used by other
+ *         threads concurrently are only approximate.
+ * @remark When recursing, the pools' allocators are locked while their
+ *         subpools are walked.
+ * @remark When compiled with APR_POOL_DEBUG, the reserved memory is the
+ *         same as the requested one and peak is not maintained.
+ */
+APR_DECLARE(void) apr_pool_stats_get(apr_pool_t *pool,
+                                     apr_pool_stats_t *stats,
+                                     int recurse)
+                  __attribute__((nonnull(1,2)));
+
+/**
+ * Get the memory usage statistics of a pool and all its subpools,
+ * aggregated by tag (see apr_pool_tag())
+ * @param pool The pool to inspect
+ * @param p The pool to allocate the result from
+ * @return A hash table of apr_pool_stats_t (values) by tag (keys), the
+ *         untagged pools being accounted under the "" tag
+ * @remark The same remarks as for apr_pool_stats_get() apply, @a p may
+ *         be one of the pools inspected.
+ */
+APR_DECLARE(struct apr_hash_t *) apr_pool_stats_by_tag(apr_pool_t *pool,
+                                                      apr_pool_t *p)
+                                 __attribute__((nonnull(1,2)));
+
+
+/*
+ * Allocation tracing
+ */
+
+/**
+ * @defgroup apr_pools_trace Allocation tracing
+ * A compact binary trace of the pools' life and allocations, recorded
+ * in a ring buffer per thread and dumped on demand, for offline
+ * analysis (see test/pooltrace.c).
+ * @{
+ */
+
+/** Magic string at the start of a trace dump (not NUL terminated) */
+#define APR_POOL_TRACE_MAGIC    "APRTRACE"
+/** Version of the trace dump format */
+#define APR_POOL_TRACE_VERSION  1
+
+/** A pool was created */
+#define APR_POOL_TRACE_CREATE   1
+/** Memory was allocated from a pool */
+#define APR_POOL_TRACE_ALLOC    2
+/** A pool was cleared */
+#define APR_POOL_TRACE_CLEAR    3
+/** A pool was destroyed */
+#define APR_POOL_TRACE_DESTROY  4
+
+/**
+ * The header of a trace dump, in the byte order of the machine which
+ * wrote it.  It is followed by the tags, each one as an apr_uint32_t
+ * length and the (not NUL terminated) characters, then by the records.
+ */
+typedef struct apr_pool_trace_header_t {
+    /** APR_POOL_TRACE_MAGIC */
+    char         magic[8];
+    /** APR_POOL_TRACE_VERSION */
+    apr_uint32_t version;
+    /** Number of tags */
+    apr_uint32_t tags;
+    /** Number of records */
+    apr_uint64_t records;
+} apr_pool_trace_header_t;
+
+/** A record of a trace dump */
+typedef struct apr_pool_trace_record_t {
+    /** Time of the event (an apr_time_t) */
+    apr_int64_t  time;
+    /** Address of the pool, which identifies it until it is destroyed */
+    apr_uint64_t pool;
+    /** Address of the code which called the pool function, from outside
+     * of libapr where possible (see apr_pool_trace_start()) */
+    apr_uint64_t pc;
+    /** Bytes requested, for APR_POOL_TRACE_ALLOC */
+    apr_uint64_t size;
+    /** Tag of the pool at the time of the event, as an index in the tags
+     * of the dump starting at 1 (0 == untagged) */
+    apr_uint32_t tag;
+    /** Index of the thread which recorded the event (in the dump) */
+    apr_uint32_t thread;
+    /** APR_POOL_TRACE_* */
+    apr_uint32_t type;
+    /** Unused (0) */
+    apr_uint32_t reserved;
+} apr_pool_trace_record_t;
+
+/**
+ * Start recording the pool events of all threads.
+ * @param entries The number of events each thread keeps, the oldest
+ *        ones being overwritten
+ * @return APR_ENOTIMPL when compiled with APR_POOL_DEBUG (see
+ *         apr_pool_log_event() instead), APR_EINVAL if @a entries is 0,
+ *         or an error creating the tracing resources
+ * @remark Starting discards the events recorded previously.  The threads
+ *         which already recorded events keep their number of entries.
+ * @remark The pools created before the tracing started are not traced
+ *         when allocating with the inline apr_palloc() of
+ *         APR_POOL_INLINE.  apr_pool_rewind() is not traced.
+ * @remark With glibc, a few frames are recorded with each event, so that
+ *         the code which called the pool function through other APR
+ *         functions (e.g. apr_pstrdup()) is dumped rather than these.
+ *         Otherwise, or when libapr is linked statically, the direct
+ *         caller of the pool function is dumped, which may be in APR.
+ */
+APR_DECLARE(apr_status_t) apr_pool_trace_start(apr_size_t entries);
+
+/**
+ * Stop recording the pool events.  The recorded events are kept until
+ * tracing is started again or APR is terminated.
+ */
+APR_DECLARE(void) apr_pool_trace_stop(void);
+
+struct apr_file_t;
+
+/**
+ * Write the recorded pool events of all threads to a file.
+ * @param file The file to write the dump to
+ * @return APR_ENOTIMPL when compiled with APR_POOL_DEBUG, or the error
+ *         writing the file
+ * @remark The tags of the pools must still be valid when dumping.  The
+ *         events recorded concurrently by other threads may be garbled,
+ *         stop tracing first for an exact dump.
+ * @remark The ring buffer of a thread which exited is reused by the next
+ *         new thread, so its events are kept until then only.
+ */
+APR_DECLARE(apr_status_t) apr_pool_trace_dump(struct apr_file_t *file)
+                          __attribute__((nonnull(1)));
+
+/** @} */
+
+
 /*
  * User data management
  */
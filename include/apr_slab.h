@@ -0,0 +1,132 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_SLAB_H
+#define APR_SLAB_H
+
+/**
+ * @file apr_slab.h
+ * @brief APR fixed-size object allocator
+ */
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_pools.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @defgroup apr_slab Fixed-size object allocator
+ * @ingroup APR
+ * Objects of the same size carved out of pool memory, which, unlike
+ * the pool allocations, can be freed individually for reuse.  This
+ * bounds the memory used by long-lived pools which create and destroy
+ * many objects of some type (e.g. connection records).
+ * @{
+ */
+
+/** Opaque structure used to represent a slab allocator */
+typedef struct apr_slab_t apr_slab_t;
+
+/**
+ * @defgroup apr_slab_flags Slab allocator creation flags
+ * @{
+ */
+/** Allocating and freeing objects can be done from multiple threads */
+#define APR_SLAB_THREADSAFE         0x01
+/** @} */
+
+/** The usage statistics of a slab allocator */
+typedef struct apr_slab_stats_t {
+    /** Size of the objects, including the alignment */
+    apr_size_t size;
+    /** Number of objects per slab */
+    apr_size_t per_slab;
+    /** Number of slabs allocated from the pool */
+    apr_size_t slabs;
+    /** Number of objects in use */
+    apr_size_t used;
+    /** Highest number of objects in use at the same time */
+    apr_size_t peak;
+    /** Number of objects freed and available for reuse */
+    apr_size_t free;
+    /** Number of calls to apr_slab_alloc() */
+    apr_size_t allocs;
+} apr_slab_stats_t;
+
+/**
+ * Create a slab allocator
+ * @param slab The new slab allocator
+ * @param size The size of the objects
+ * @param per_slab The number of objects to allocate from the pool at
+ *        once, or 0 for as many as fit in about 8K
+ * @param flags A bitmask of APR_SLAB_* flags (or 0)
+ * @param p The pool to allocate the slabs from
+ * @return APR_ENOTIMPL if APR_SLAB_THREADSAFE is requested and APR is
+ *         compiled without threads support
+ * @remark The memory of the slabs is given back when @a p is cleared or
+ *         destroyed, which invalidates the slab allocator and all its
+ *         objects.  Freed objects are only reused by the same allocator.
+ */
+APR_DECLARE(apr_status_t) apr_slab_create(apr_slab_t **slab,
+                                          apr_size_t size,
+                                          apr_size_t per_slab,
+                                          apr_uint32_t flags,
+                                          apr_pool_t *p)
+                          __attribute__((nonnull(1,5)));
+
+/**
+ * Allocate an object
+ * @param slab The slab allocator to allocate from
+ * @return The object, or NULL if the pool ran out of memory
+ */
+APR_DECLARE(void *) apr_slab_alloc(apr_slab_t *slab)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Allocate an object and set all of its memory to 0
+ * @param slab The slab allocator to allocate from
+ * @return The object, or NULL if the pool ran out of memory
+ */
+APR_DECLARE(void *) apr_slab_calloc(apr_slab_t *slab)
+                    __attribute__((nonnull(1)));
+
+/**
+ * Free an object for reuse
+ * @param slab The slab allocator the object was allocated from
+ * @param obj The object
+ */
+APR_DECLARE(void) apr_slab_free(apr_slab_t *slab, void *obj)
+                  __attribute__((nonnull(1,2)));
+
+/**
+ * Get the usage statistics of a slab allocator
+ * @param slab The slab allocator to inspect
+ * @param stats The statistics to fill in
+ */
+APR_DECLARE(void) apr_slab_stats_get(apr_slab_t *slab,
+                                     apr_slab_stats_t *stats)
+                  __attribute__((nonnull(1,2)));
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !APR_SLAB_H */
@@ -157,6 +157,39 @@ APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr);
  */
 APR_DECLARE(void *) apr_array_pop(apr_array_header_t *arr);
 
+/**
+ * Make room for a number of elements in an array.
+ * @param arr The array to make room in
+ * @param nelts The number of elements, in total, to make room for
+ * @remark Elements can then be pushed until the array holds @a nelts
+ *         elements without allocating.  Nothing is done if there is
+ *         enough room already.
+ */
+APR_DECLARE(void) apr_array_reserve(apr_array_header_t *arr, int nelts);
+
+/**
+ * Add a number of new elements to an array (as a first-in, last-out stack).
+ * @param arr The array to add the elements to.
+ * @param nelts The number of elements to add (0 or more).
+ * @return Location for the first new element in the array, the others
+ *         following it.
+ * @remark Like calling apr_array_push() @a nelts times, but with only
+ *         one check for free spots.
+ */
+APR_DECLARE(void *) apr_array_push_n(apr_array_header_t *arr, int nelts);
+
+/**
+ * Move the elements of an array into another, without copying them.
+ * @param dst The array to move the elements to, whose elements are
+ *            discarded
+ * @param src The array to move the elements from, left empty
+ * @remark The arrays must have the same element size.
+ * @remark The elements are only moved if the pool of @a src is the pool
+ *         of @a dst or one of its ancestors, otherwise they are copied.
+ */
+APR_DECLARE(void) apr_array_move(apr_array_header_t *dst,
+                                 apr_array_header_t *src);
+
 /**
  * Remove all elements from an array.
  * @param arr The array to remove all elements from.
@@ -222,6 +255,78 @@ APR_DECLARE(char *) apr_array_pstrcat(apr_pool_t *p,
 				      const apr_array_header_t *arr,
 				      const char sep);
 
+/**
+ * Declaration prototype for the comparison function of apr_array_sort(),
+ * the same as qsort()'s.
+ * @param a The first element to compare
+ * @param b The second element to compare
+ * @return Less than, equal to or greater than zero if @a a is less
+ *         than, equal to or greater than @a b respectively
+ */
+typedef int (apr_array_cmp_fn_t)(const void *a, const void *b);
+
+/**
+ * Sort the elements of an array.
+ * @param arr The array to sort
+ * @param cmp The function comparing two elements
+ * @remark The sort is not stable, and takes O(n log(n)) comparisons in
+ *         the worst case (introsort).
+ */
+APR_DECLARE(void) apr_array_sort(apr_array_header_t *arr,
+                                 apr_array_cmp_fn_t *cmp);
+
+/**
+ * Sort the elements of a large array using multiple threads.
+ * @param arr The array to sort
+ * @param cmp The function comparing two elements, which must be
+ *        thread-safe
+ * @param nthreads The maximum number of threads to use, including the
+ *        calling one (at most 64)
+ * @return APR_SUCCESS, or APR_ENOMEM if there is not enough memory for
+ *         a copy of the elements
+ * @remark Chunks of the array are sorted by separate threads and then
+ *         merged, with a thread for at most every 64K elements, so
+ *         smaller arrays are sorted by the calling thread like with
+ *         apr_array_sort().  The memory used is allocated from (and
+ *         given back to) a subpool of the array's pool.
+ * @remark Without threads support, the array is always sorted by the
+ *         calling thread.
+ */
+APR_DECLARE(apr_status_t) apr_array_sort_parallel(apr_array_header_t *arr,
+                                                  apr_array_cmp_fn_t *cmp,
+                                                  int nthreads);
+
+/** The keys of apr_array_sort_int() are signed (two's complement) */
+#define APR_ARRAY_SORT_SIGNED 0x01
+
+/**
+ * Sort the elements of an array by an integer key (radix sort).
+ * @param arr The array to sort
+ * @param key_offset The offset of the key in the elements
+ * @param key_size The size of the key: 1, 2, 4 or 8 bytes
+ * @param flags APR_ARRAY_SORT_SIGNED for signed keys, or 0
+ * @return APR_EINVAL if the key is not a supported integer within the
+ *         elements, or APR_ENOMEM if there is not enough memory for a
+ *         copy of the elements
+ * @remark The sort is stable, and takes a pass over the elements for
+ *         each byte of the key which differs between the elements (plus
+ *         one).  The memory used is allocated from (and given back to)
+ *         a subpool of the array's pool.
+ * @see apr_array_sort_ptr
+ */
+APR_DECLARE(apr_status_t) apr_array_sort_int(apr_array_header_t *arr,
+                                             apr_size_t key_offset,
+                                             apr_size_t key_size,
+                                             apr_uint32_t flags);
+
+/**
+ * Sort an array of pointers by address.
+ * @param arr The array to sort
+ * @see apr_array_sort_int
+ */
+#define apr_array_sort_ptr(arr) \
+    apr_array_sort_int(arr, 0, sizeof(void *), 0)
+
 /**
  * Make a new table.
  * @param p The pool to allocate the pool out of
@@ -241,6 +346,26 @@ APR_DECLARE(apr_table_t *) apr_table_make(apr_pool_t *p, int nelts);
 APR_DECLARE(apr_table_t *) apr_table_copy(apr_pool_t *p,
                                           const apr_table_t *t);
 
+/**
+ * Create a new table sharing the entries of another table, until either
+ * table is changed.
+ * @param p The pool to allocate the new table out of
+ * @param t The table to copy
+ * @return A copy of the table passed in
+ * @warning The table keys and respective values are not copied
+ * @remark The entries are only shared when the pool of @a t is an
+ *         ancestor of @a p, otherwise they are copied like with
+ *         apr_table_copy().
+ * @remark While they are shared, the entries of apr_table_elts() must
+ *         not be changed directly (only with the apr_table_*()
+ *         functions), for either table.  They stop being shared by the
+ *         copy when its pool is cleared.
+ * @remark Copies of a table which is not changed meanwhile can be made
+ *         from multiple threads.
+ */
+APR_DECLARE(apr_table_t *) apr_table_copy_shared(apr_pool_t *p,
+                                                 const apr_table_t *t);
+
 /**
  * Create a new table whose contents are deep copied from the given
  * table. A deep copy operation copies all fields, and makes copies
@@ -498,6 +623,99 @@ APR_DECLARE(void) apr_table_overlap(apr_table_t *a, const apr_table_t *b,
  */
 APR_DECLARE(void) apr_table_compress(apr_table_t *t, unsigned flags);
 
+/** A read-only snapshot of a table, @see apr_table_freeze() */
+typedef struct apr_table_frozen_t apr_table_frozen_t;
+
+/**
+ * Make a read-only snapshot of a table, for tables which are built
+ * once and then looked up many times.
+ * @param p The pool to allocate the snapshot out of
+ * @param t The table to take the snapshot of
+ * @return The snapshot, or NULL if no perfect hash of the keys could be
+ *         found (which should not happen in practice)
+ * @remark The keys and values are copied, along with a minimal perfect
+ *         hash of the distinct keys (case-insensitive), all in a single
+ *         block of memory.  Later changes to @a t are not reflected.
+ * @remark Since it is never modified, the snapshot can be looked up from
+ *         multiple threads without any locking, for the lifetime of
+ *         @a p.
+ */
+APR_DECLARE(apr_table_frozen_t *) apr_table_freeze(apr_pool_t *p,
+                                                   const apr_table_t *t);
+
+/**
+ * Get the value associated with a given key from a table snapshot.
+ * @param f The snapshot to search for the key
+ * @param key The key to search for (case does not matter)
+ * @return The value associated with the key, or NULL if the key does not
+ *         exist (or its value is NULL).  If the table had multiple entries
+ *         with the key, the value of the first one is returned, like
+ *         apr_table_get().
+ */
+APR_DECLARE(const char *) apr_table_frozen_get(const apr_table_frozen_t *f,
+                                               const char *key);
+
+/**
+ * Get the elements from a table snapshot.
+ * @param f The snapshot
+ * @return An array of the apr_table_entry_t of the table, in order
+ */
+APR_DECLARE(const apr_array_header_t *) apr_table_frozen_elts(
+                                                const apr_table_frozen_t *f);
+
+/**
+ * A table key with its lookup checksum and hash computed once, for keys
+ * which are looked up in many tables (e.g. well known header names).
+ * @see apr_table_key_init()
+ */
+typedef struct apr_table_key_t {
+    /** The key */
+    const char *key;
+    /** For the apr_table internals, do not use */
+    apr_uint32_t checksum;
+    /** For the apr_table internals, do not use */
+    apr_uint32_t hash;
+} apr_table_key_t;
+
+/**
+ * Initialize a pre-hashed table key.
+ * @param k The key handle to initialize
+ * @param key The key (case does not matter)
+ * @remark @a key is not copied, it must live as long as @a k and as the
+ *         tables it is set in with apr_table_setk().
+ */
+APR_DECLARE(void) apr_table_key_init(apr_table_key_t *k, const char *key);
+
+/**
+ * Get the value associated with a pre-hashed key from a table, like
+ * apr_table_get() without hashing the key again.
+ * @param t The table to search for the key
+ * @param k The key handle, @see apr_table_key_init()
+ * @return The value associated with the key, or NULL if the key does not
+ *         exist.
+ */
+APR_DECLARE(const char *) apr_table_getk(const apr_table_t *t,
+                                         const apr_table_key_t *k);
+
+/**
+ * Add a pre-hashed key to a table, like apr_table_set() without hashing
+ * the key again.
+ * @param t The table to add the data to
+ * @param k The key handle, @see apr_table_key_init()
+ * @param val The value to add
+ * @remark The value is copied, but the key is not (like apr_table_setn()).
+ */
+APR_DECLARE(void) apr_table_setk(apr_table_t *t, const apr_table_key_t *k,
+                                 const char *val);
+
+/**
+ * Remove the data associated with a pre-hashed key from a table, like
+ * apr_table_unset() without hashing the key again.
+ * @param t The table to remove data from
+ * @param k The key handle, @see apr_table_key_init()
+ */
+APR_DECLARE(void) apr_table_unsetk(apr_table_t *t, const apr_table_key_t *k);
+
 /** @} */
 
 #ifdef __cplusplus
@@ -301,6 +301,10 @@ SOURCE=.\locks\win32\thread_rwlock.c
 
 SOURCE=.\memory\unix\apr_pools.c
 # End Source File
+# Begin Source File
+
+SOURCE=.\memory\unix\apr_slab.c
+# End Source File
 # End Group
 # Begin Group "misc"
 
@@ -496,6 +500,10 @@ SOURCE=.\strings\apr_strtok.c
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=.\tables\apr_flathash.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\tables\apr_hash.c
 # End Source File
 # Begin Source File
@@ -745,6 +753,10 @@ SOURCE=.\include\apr_file_io.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_flathash.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_fnmatch.h
 # End Source File
 # Begin Source File
@@ -817,6 +829,10 @@ SOURCE=.\include\apr_skiplist.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\apr_slab.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\apr_strings.h
 # End Source File
 # Begin Source File
@@ -46,12 +46,14 @@ CLEAN :
 	-@erase "$(INTDIR)\apr_cpstr.obj"
 	-@erase "$(INTDIR)\apr_encode.obj"
 	-@erase "$(INTDIR)\apr_escape.obj"
+	-@erase "$(INTDIR)\apr_flathash.obj"
 	-@erase "$(INTDIR)\apr_fnmatch.obj"
 	-@erase "$(INTDIR)\apr_getpass.obj"
 	-@erase "$(INTDIR)\apr_hash.obj"
 	-@erase "$(INTDIR)\apr_pools.obj"
 	-@erase "$(INTDIR)\apr_random.obj"
 	-@erase "$(INTDIR)\apr_skiplist.obj"
+	-@erase "$(INTDIR)\apr_slab.obj"
 	-@erase "$(INTDIR)\apr_snprintf.obj"
 	-@erase "$(INTDIR)\apr_strings.obj"
 	-@erase "$(INTDIR)\apr_strnatcmp.obj"
@@ -202,6 +204,7 @@ LINK32_OBJS= \
 	"$(INTDIR)\thread_mutex.obj" \
 	"$(INTDIR)\thread_rwlock.obj" \
 	"$(INTDIR)\apr_pools.obj" \
+	"$(INTDIR)\apr_slab.obj" \
 	"$(INTDIR)\charset.obj" \
 	"$(INTDIR)\env.obj" \
 	"$(INTDIR)\errorcodes.obj" \
@@ -239,6 +242,7 @@ LINK32_OBJS= \
 	"$(INTDIR)\apr_strings.obj" \
 	"$(INTDIR)\apr_strnatcmp.obj" \
 	"$(INTDIR)\apr_strtok.obj" \
+	"$(INTDIR)\apr_flathash.obj" \
 	"$(INTDIR)\apr_hash.obj" \
 	"$(INTDIR)\apr_tables.obj" \
 	"$(INTDIR)\apr_skiplist.obj" \
@@ -290,12 +294,14 @@ CLEAN :
 	-@erase "$(INTDIR)\apr_cpstr.obj"
 	-@erase "$(INTDIR)\apr_encode.obj"
 	-@erase "$(INTDIR)\apr_escape.obj"
+	-@erase "$(INTDIR)\apr_flathash.obj"
 	-@erase "$(INTDIR)\apr_fnmatch.obj"
 	-@erase "$(INTDIR)\apr_getpass.obj"
 	-@erase "$(INTDIR)\apr_hash.obj"
 	-@erase "$(INTDIR)\apr_pools.obj"
 	-@erase "$(INTDIR)\apr_random.obj"
 	-@erase "$(INTDIR)\apr_skiplist.obj"
+	-@erase "$(INTDIR)\apr_slab.obj"
 	-@erase "$(INTDIR)\apr_snprintf.obj"
 	-@erase "$(INTDIR)\apr_strings.obj"
 	-@erase "$(INTDIR)\apr_strnatcmp.obj"
@@ -446,6 +452,7 @@ LINK32_OBJS= \
 	"$(INTDIR)\thread_mutex.obj" \
 	"$(INTDIR)\thread_rwlock.obj" \
 	"$(INTDIR)\apr_pools.obj" \
+	"$(INTDIR)\apr_slab.obj" \
 	"$(INTDIR)\charset.obj" \
 	"$(INTDIR)\env.obj" \
 	"$(INTDIR)\errorcodes.obj" \
@@ -483,6 +490,7 @@ LINK32_OBJS= \
 	"$(INTDIR)\apr_strings.obj" \
 	"$(INTDIR)\apr_strnatcmp.obj" \
 	"$(INTDIR)\apr_strtok.obj" \
+	"$(INTDIR)\apr_flathash.obj" \
 	"$(INTDIR)\apr_hash.obj" \
 	"$(INTDIR)\apr_tables.obj" \
 	"$(INTDIR)\apr_skiplist.obj" \
@@ -534,12 +542,14 @@ CLEAN :
 	-@erase "$(INTDIR)\apr_cpstr.obj"
 	-@erase "$(INTDIR)\apr_encode.obj"
 	-@erase "$(INTDIR)\apr_escape.obj"
+	-@erase "$(INTDIR)\apr_flathash.obj"
 	-@erase "$(INTDIR)\apr_fnmatch.obj"
 	-@erase "$(INTDIR)\apr_getpass.obj"
 	-@erase "$(INTDIR)\apr_hash.obj"
 	-@erase "$(INTDIR)\apr_pools.obj"
 	-@erase "$(INTDIR)\apr_random.obj"
 	-@erase "$(INTDIR)\apr_skiplist.obj"
+	-@erase "$(INTDIR)\apr_slab.obj"
 	-@erase "$(INTDIR)\apr_snprintf.obj"
 	-@erase "$(INTDIR)\apr_strings.obj"
 	-@erase "$(INTDIR)\apr_strnatcmp.obj"
@@ -690,6 +700,7 @@ LINK32_OBJS= \
 	"$(INTDIR)\thread_mutex.obj" \
 	"$(INTDIR)\thread_rwlock.obj" \
 	"$(INTDIR)\apr_pools.obj" \
+	"$(INTDIR)\apr_slab.obj" \
 	"$(INTDIR)\charset.obj" \
 	"$(INTDIR)\env.obj" \
 	"$(INTDIR)\errorcodes.obj" \
@@ -728,6 +739,7 @@ LINK32_OBJS= \
 	"$(INTDIR)\apr_strings.obj" \
 	"$(INTDIR)\apr_strnatcmp.obj" \
 	"$(INTDIR)\apr_strtok.obj" \
+	"$(INTDIR)\apr_flathash.obj" \
 	"$(INTDIR)\apr_hash.obj" \
 	"$(INTDIR)\apr_tables.obj" \
 	"$(INTDIR)\apr_skiplist.obj" \
@@ -778,12 +790,14 @@ CLEAN :
 	-@erase "$(INTDIR)\apr_cpstr.obj"
 	-@erase "$(INTDIR)\apr_encode.obj"
 	-@erase "$(INTDIR)\apr_escape.obj"
+	-@erase "$(INTDIR)\apr_flathash.obj"
 	-@erase "$(INTDIR)\apr_fnmatch.obj"
 	-@erase "$(INTDIR)\apr_getpass.obj"
 	-@erase "$(INTDIR)\apr_hash.obj"
 	-@erase "$(INTDIR)\apr_pools.obj"
 	-@erase "$(INTDIR)\apr_random.obj"
 	-@erase "$(INTDIR)\apr_skiplist.obj"
+	-@erase "$(INTDIR)\apr_slab.obj"
 	-@erase "$(INTDIR)\apr_snprintf.obj"
 	-@erase "$(INTDIR)\apr_strings.obj"
 	-@erase "$(INTDIR)\apr_strnatcmp.obj"
@@ -934,6 +948,7 @@ LINK32_OBJS= \
 	"$(INTDIR)\thread_mutex.obj" \
 	"$(INTDIR)\thread_rwlock.obj" \
 	"$(INTDIR)\apr_pools.obj" \
+	"$(INTDIR)\apr_slab.obj" \
 	"$(INTDIR)\charset.obj" \
 	"$(INTDIR)\env.obj" \
 	"$(INTDIR)\errorcodes.obj" \
@@ -972,6 +987,7 @@ LINK32_OBJS= \
 	"$(INTDIR)\apr_strings.obj" \
 	"$(INTDIR)\apr_strnatcmp.obj" \
 	"$(INTDIR)\apr_strtok.obj" \
+	"$(INTDIR)\apr_flathash.obj" \
 	"$(INTDIR)\apr_hash.obj" \
 	"$(INTDIR)\apr_tables.obj" \
 	"$(INTDIR)\apr_skiplist.obj" \
@@ -1178,6 +1194,12 @@ SOURCE=.\memory\unix\apr_pools.c
 	$(CPP) $(CPP_PROJ) $(SOURCE)
 
 
+SOURCE=.\memory\unix\apr_slab.c
+
+"$(INTDIR)\apr_slab.obj" : $(SOURCE) "$(INTDIR)" ".\include\apr.h"
+	$(CPP) $(CPP_PROJ) $(SOURCE)
+
+
 SOURCE=.\misc\win32\apr_app.c
 SOURCE=.\misc\win32\charset.c
 
@@ -1407,6 +1429,12 @@ SOURCE=.\strings\apr_strtok.c
 	$(CPP) $(CPP_PROJ) $(SOURCE)
 
 
+SOURCE=.\tables\apr_flathash.c
+
+"$(INTDIR)\apr_flathash.obj" : $(SOURCE) "$(INTDIR)" ".\include\apr.h"
+	$(CPP) $(CPP_PROJ) $(SOURCE)
+
+
 SOURCE=.\tables\apr_hash.c
 
 "$(INTDIR)\apr_hash.obj" : $(SOURCE) "$(INTDIR)" ".\include\apr.h"
@@ -25,6 +25,8 @@
 #include "apr_allocator.h"
 #include "apr_lib.h"
 #include "apr_thread_mutex.h"
+#include "apr_thread_proc.h"
+#include "apr_file_io.h"
 #include "apr_hash.h"
 #include "apr_time.h"
 #include "apr_support.h"
@@ -52,6 +54,42 @@
 #include <sys/mman.h>
 #endif
 
+/* Carving nodes out of (huge page backed) regions needs anonymous mmap(),
+ * and does not play well with per node guard pages.
+ */
+#if HAVE_MMAP && HAVE_SYS_MMAN_H && HAVE_MAP_ANON \
+    && !APR_ALLOCATOR_GUARD_PAGES
+#define ALLOCATOR_HAS_REGIONS 1
+#include <sys/mman.h>
+#else
+#define ALLOCATOR_HAS_REGIONS 0
+#endif
+
+/* Mapped nodes that decay (see apr_allocator_decay_set()) have their
+ * pages purged rather than being unmapped.
+ */
+#if (APR_ALLOCATOR_USES_MMAP || ALLOCATOR_HAS_REGIONS) \
+    && defined(_SC_PAGESIZE)
+#if defined(MADV_FREE)
+#define ALLOCATOR_MADV_PURGE MADV_FREE
+#elif defined(MADV_DONTNEED)
+#define ALLOCATOR_MADV_PURGE MADV_DONTNEED
+#endif
+#endif
+
+#ifdef ALLOCATOR_MADV_PURGE
+static apr_size_t purge_page_size;
+#endif
+
+/* The allocation tracing records a few frames of the callers, to find
+ * the first one outside of libapr when dumping (see pool_trace_caller()).
+ */
+#if defined(__GLIBC__) && HAVE_DLFCN_H
+#include <execinfo.h>
+#include <dlfcn.h>
+#define POOL_TRACE_FRAMES 8
+#endif
+
 #if HAVE_VALGRIND
 #include <valgrind.h>
 #include <memcheck.h>
@@ -119,6 +157,106 @@ static unsigned int boundary_size;
 #define TIMEOUT_USECS    3000000
 #define TIMEOUT_INTERVAL   46875
 
+#if ALLOCATOR_HAS_REGIONS
+/*
+ * Regions
+ *
+ * With APR_ALLOCATOR_HUGEPAGES, the nodes of the size classes (index <
+ * MAX_INDEX) are carved out of REGION_SIZE big mappings, aligned and
+ * sized for a huge page each.  Such nodes are never given back to the
+ * system one by one, the regions are unmapped when the allocator is
+ * destroyed.
+ *
+ * An allocator can also carve all its nodes out of a single arena, see
+ * apr_allocator_arena_set(), whose pages are committed ARENA_COMMIT_SIZE
+ * at a time.
+ */
+#define REGION_SIZE (2 * 1024 * 1024)
+#define ARENA_COMMIT_SIZE (1024 * 1024)
+
+typedef struct allocator_region_t allocator_region_t;
+
+struct allocator_region_t {
+    allocator_region_t *next;
+    char               *base;
+};
+#endif /* ALLOCATOR_HAS_REGIONS */
+
+#if APR_HAS_THREADS
+/*
+ * Per-thread node caches
+ *
+ * A thread cache ("magazine") holds a few free nodes of each size class
+ * for the exclusive use of one thread.  It is refilled from and drained
+ * to the allocator's free lists in batches of TCACHE_BATCH nodes, so the
+ * allocator mutex is only taken once per batch instead of once per node.
+ */
+#define TCACHE_BATCH 8
+
+typedef struct allocator_tcache_t allocator_tcache_t;
+
+/* The states of a thread cache, between its thread's exit and the
+ * allocator's cleanup (whichever comes first drains it).  The cache
+ * itself is always freed by its thread, which finds the caches of all
+ * the allocators it used behind the process-wide tcache_key.
+ */
+#define TCACHE_LIVE     0   /* In use by its thread */
+#define TCACHE_EXITING  1   /* Drained on its thread's exit */
+#define TCACHE_DRAINING 2   /* Drained by the allocator's cleanup */
+#define TCACHE_DEAD     3   /* Drained, to be freed by its thread */
+
+struct allocator_tcache_t {
+    apr_allocator_t     *allocator;
+    /** The list of all the caches of the allocator */
+    allocator_tcache_t  *next;
+    allocator_tcache_t **ref;
+    /** The list of all the caches of the thread */
+    allocator_tcache_t  *tnext;
+    /** One of the TCACHE_* states */
+    volatile apr_uint32_t state;
+    /** Total size (in BOUNDARY_SIZE multiples) of the cached nodes */
+    apr_size_t           size;
+    apr_uint32_t         count[MAX_INDEX];
+    apr_memnode_t       *free[MAX_INDEX];
+};
+#endif /* APR_HAS_THREADS */
+
+/*
+ * Lock-free free lists
+ *
+ * With APR_ALLOCATOR_LOCKFREE, the free nodes of the size classes are
+ * kept in Treiber stacks, whose head (a node and a tag) is compared and
+ * swapped as a whole.  The tag changes on every push and pop, so that a
+ * head popped and pushed back in the meantime (ABA) does not look like
+ * the same one, and its low half counts the nodes (for the statistics).
+ * A pop reads the next node of a head which another thread may have
+ * popped already, hence these nodes stay mapped (never given back to the
+ * system) until the allocator is destroyed.
+ */
+#if APR_HAS_THREADS && APR_SIZEOF_VOIDP == 4
+#define ALLOCATOR_HAS_LOCKFREE 1
+typedef apr_uint64_t lf_word_t;
+#elif APR_HAS_THREADS && defined(__GNUC__) && APR_SIZEOF_VOIDP == 8 \
+      && (defined(__x86_64__) || defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16))
+#define ALLOCATOR_HAS_LOCKFREE 1
+__extension__ typedef unsigned __int128 lf_word_t;
+#else
+#define ALLOCATOR_HAS_LOCKFREE 0
+#endif
+
+#if ALLOCATOR_HAS_LOCKFREE
+typedef union allocator_lfhead_t {
+    struct {
+        apr_memnode_t *node;
+        apr_uintptr_t  tag;
+    } s;
+    lf_word_t word;
+} allocator_lfhead_t;
+
+#define LF_TAG_VERSION ((apr_uintptr_t)1 << (APR_SIZEOF_VOIDP * 4))
+#define LF_TAG_COUNT(tag) ((tag) & (LF_TAG_VERSION - 1))
+#endif /* ALLOCATOR_HAS_LOCKFREE */
+
 /*
  * Allocator
  *
@@ -127,8 +265,8 @@ static unsigned int boundary_size;
  */
 
 struct apr_allocator_t {
-    /** largest used index into free[], always < MAX_INDEX */
-    apr_size_t        max_index;
+    /** Bit i is set when free[i] (i > 0) is not empty */
+    apr_uint32_t      bitmap;
     /** Total size (in BOUNDARY_SIZE multiples) of unused memory before
      * blocks are given back. @see apr_allocator_max_free_set().
      * @note Initialized to APR_ALLOCATOR_MAX_FREE_UNLIMITED,
@@ -142,11 +280,61 @@ struct apr_allocator_t {
     apr_size_t        current_free_index;
 #if APR_HAS_THREADS
     apr_thread_mutex_t *mutex;
+    /** Per-thread node caches, @see apr_allocator_thread_cache_set() */
+    apr_pool_t         *tcache_pool;
+    allocator_tcache_t *tcaches;
+    /** Maximum size (in BOUNDARY_SIZE multiples) of each thread's cache */
+    apr_size_t          tcache_max_index;
 #endif /* APR_HAS_THREADS */
     apr_pool_t         *owner;
+    /** APR_ALLOCATOR_* flags, @see apr_allocator_create_ex() */
+    apr_uint32_t        flags;
+#if ALLOCATOR_HAS_REGIONS
+    /** The regions nodes are carved from, and what is left of the
+     * current one.
+     */
+    allocator_region_t *regions;
+    char               *region_avail;
+    char               *region_endp;
+    /** The arena, if any: reserved up to arena_endp, committed up to
+     * arena_commit and carved up to arena_avail.
+     * @see apr_allocator_arena_set()
+     */
+    char               *arena_base;
+    char               *arena_avail;
+    char               *arena_commit;
+    char               *arena_endp;
+#endif /* ALLOCATOR_HAS_REGIONS */
+    /** Seconds after which unused free nodes are released (0 == never),
+     * and the last time (in seconds) they were looked for.
+     * @see apr_allocator_decay_set()
+     */
+    apr_uint32_t        decay;
+    apr_uint32_t        decay_last;
+    /** Memory allocated from the system, @see apr_allocator_stats_get() */
+    apr_size_t          sys_bytes;
+    apr_size_t          sys_allocs;
+    apr_size_t          sys_frees;
+    /** The first nodes of destroyed pools, kept for the creation of new
+     * pools, @see apr_allocator_pool_cache_set()
+     */
+    apr_memnode_t      *pool_nodes;
+    apr_size_t          pool_nodes_count;
+    apr_size_t          pool_nodes_max;
+    /** Bumped to have the pools give their retained nodes back on their
+     * next clear, @see apr_allocator_reclaim() and apr_pool_retain_set()
+     */
+    volatile apr_uint32_t reclaim_gen;
+#if ALLOCATOR_HAS_LOCKFREE
+    /** The free nodes of the size classes with APR_ALLOCATOR_LOCKFREE,
+     * instead of free[1..MAX_INDEX-1]
+     */
+    allocator_lfhead_t  lf_free[MAX_INDEX];
+#endif /* ALLOCATOR_HAS_LOCKFREE */
     /**
-     * Lists of free nodes. Slot 0 is used for oversized nodes,
-     * and the slots 1..MAX_INDEX-1 contain nodes of sizes
+     * Lists of free nodes. Slot 0 is used for oversized nodes (the sink,
+     * a tree ordered by size, see sink_insert()), and the slots
+     * 1..MAX_INDEX-1 contain nodes of sizes
      * (i+1) * BOUNDARY_SIZE. Example for BOUNDARY_INDEX == 12:
      * slot  0: nodes larger than 81920
      * slot  1: size  8192
@@ -159,11 +347,330 @@ struct apr_allocator_t {
 
 #define SIZEOF_ALLOCATOR_T  APR_ALIGN_DEFAULT(sizeof(apr_allocator_t))
 
+#if MAX_INDEX > 32
+#error MAX_INDEX does not fit the allocator bitmap
+#endif
+#if MAX_INDEX != APR_ALLOCATOR_STATS_BINS
+#error MAX_INDEX does not match APR_ALLOCATOR_STATS_BINS
+#endif
+
+/* While a node is in the free lists (not thread caches), its free_index
+ * holds the time (in seconds) it was given back to the allocator, or
+ * DECAY_PURGED once its pages have been purged.
+ */
+#define DECAY_PURGED APR_UINT32_MAX
+
+#if ALLOCATOR_HAS_REGIONS
+#define allocator_region_node(allocator, node) \
+    ((allocator)->arena_base \
+     || (((allocator)->flags & APR_ALLOCATOR_HUGEPAGES) \
+         && (node)->index < MAX_INDEX))
+#else
+#define allocator_region_node(allocator, node) 0
+#endif
+
+#if ALLOCATOR_HAS_LOCKFREE
+#define allocator_lockfree(allocator) \
+    ((allocator)->flags & APR_ALLOCATOR_LOCKFREE)
+#else
+#define allocator_lockfree(allocator) 0
+#endif
+
 
 /*
  * Allocator
  */
 
+/* Index of the lowest bit set in bits (which must not be zero) */
+static APR_INLINE
+apr_size_t bitmap_first(apr_uint32_t bits)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(bits);
+#else
+    apr_size_t i = 0;
+
+    while (!(bits & 1)) {
+        bits >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+/*
+ * The sink is an AVL tree of the oversized free nodes, keyed by their
+ * index, so that the best fitting node is found in O(log n).  Nodes of
+ * the same size are chained (by their next field) behind the one linked
+ * in the tree, and the tree links are stored at the start of the node's
+ * memory, which is unused while the node is free.
+ */
+typedef struct sink_link_t {
+    apr_memnode_t *left;
+    apr_memnode_t *right;
+    apr_size_t     height;
+} sink_link_t;
+
+#define SINK_LINK(node) \
+    ((sink_link_t *)((char *)(node) + APR_MEMNODE_T_SIZE))
+
+static APR_INLINE
+apr_size_t sink_height(apr_memnode_t *node)
+{
+    return node ? SINK_LINK(node)->height : 0;
+}
+
+static APR_INLINE
+void sink_update(apr_memnode_t *node)
+{
+    sink_link_t *link = SINK_LINK(node);
+    apr_size_t lh = sink_height(link->left);
+    apr_size_t rh = sink_height(link->right);
+
+    link->height = (lh > rh ? lh : rh) + 1;
+}
+
+static apr_memnode_t *sink_rotate_right(apr_memnode_t *node)
+{
+    apr_memnode_t *left = SINK_LINK(node)->left;
+
+    SINK_LINK(node)->left = SINK_LINK(left)->right;
+    SINK_LINK(left)->right = node;
+    sink_update(node);
+    sink_update(left);
+
+    return left;
+}
+
+static apr_memnode_t *sink_rotate_left(apr_memnode_t *node)
+{
+    apr_memnode_t *right = SINK_LINK(node)->right;
+
+    SINK_LINK(node)->right = SINK_LINK(right)->left;
+    SINK_LINK(right)->left = node;
+    sink_update(node);
+    sink_update(right);
+
+    return right;
+}
+
+static apr_memnode_t *sink_balance(apr_memnode_t *node)
+{
+    sink_link_t *link = SINK_LINK(node);
+    apr_size_t lh = sink_height(link->left);
+    apr_size_t rh = sink_height(link->right);
+
+    if (lh > rh + 1) {
+        sink_link_t *left = SINK_LINK(link->left);
+        if (sink_height(left->right) > sink_height(left->left))
+            link->left = sink_rotate_left(link->left);
+        return sink_rotate_right(node);
+    }
+    if (rh > lh + 1) {
+        sink_link_t *right = SINK_LINK(link->right);
+        if (sink_height(right->left) > sink_height(right->right))
+            link->right = sink_rotate_right(link->right);
+        return sink_rotate_left(node);
+    }
+
+    sink_update(node);
+    return node;
+}
+
+/* Add node to the tree, returns the new root */
+static apr_memnode_t *sink_insert(apr_memnode_t *root, apr_memnode_t *node)
+{
+    sink_link_t *link;
+
+    if (root == NULL) {
+        APR_VALGRIND_UNDEFINED(SINK_LINK(node), sizeof(sink_link_t));
+        link = SINK_LINK(node);
+        link->left = link->right = NULL;
+        link->height = 1;
+        node->next = NULL;
+        return node;
+    }
+    if (node->index == root->index) {
+        node->next = root->next;
+        root->next = node;
+        return root;
+    }
+
+    link = SINK_LINK(root);
+    if (node->index < root->index)
+        link->left = sink_insert(link->left, node);
+    else
+        link->right = sink_insert(link->right, node);
+
+    return sink_balance(root);
+}
+
+static apr_memnode_t *sink_remove_min(apr_memnode_t *root,
+                                      apr_memnode_t **min)
+{
+    sink_link_t *link = SINK_LINK(root);
+
+    if (link->left == NULL) {
+        *min = root;
+        return link->right;
+    }
+    link->left = sink_remove_min(link->left, min);
+
+    return sink_balance(root);
+}
+
+/* Unlink the tree node of the given index, returns the new root */
+static apr_memnode_t *sink_remove(apr_memnode_t *root, apr_uint32_t index)
+{
+    sink_link_t *link = SINK_LINK(root);
+    apr_memnode_t *min;
+
+    if (index < root->index) {
+        link->left = sink_remove(link->left, index);
+    }
+    else if (index > root->index) {
+        link->right = sink_remove(link->right, index);
+    }
+    else {
+        if (link->left == NULL)
+            return link->right;
+        if (link->right == NULL)
+            return link->left;
+
+        link->right = sink_remove_min(link->right, &min);
+        SINK_LINK(min)->left = link->left;
+        SINK_LINK(min)->right = link->right;
+        root = min;
+    }
+
+    return sink_balance(root);
+}
+
+/* Find the smallest node of at least the given index */
+static apr_memnode_t *sink_find(apr_memnode_t *root, apr_size_t index)
+{
+    apr_memnode_t *fit = NULL;
+
+    while (root != NULL) {
+        if (root->index == index)
+            return root;
+        if (root->index > index) {
+            fit = root;
+            root = SINK_LINK(root)->left;
+        }
+        else {
+            root = SINK_LINK(root)->right;
+        }
+    }
+
+    return fit;
+}
+
+/* Prepend all the nodes of the tree to list (through their next field) */
+static apr_memnode_t *sink_list(apr_memnode_t *root, apr_memnode_t *list)
+{
+    apr_memnode_t *node, *next;
+
+    while (root != NULL) {
+        apr_memnode_t *left = SINK_LINK(root)->left;
+
+        list = sink_list(SINK_LINK(root)->right, list);
+        for (node = root; node != NULL; node = next) {
+            next = node->next;
+            node->next = list;
+            list = node;
+        }
+        root = left;
+    }
+
+    return list;
+}
+
+/* Count the nodes of the tree and their size */
+static void sink_count(apr_memnode_t *root, apr_size_t *count,
+                       apr_size_t *size)
+{
+    apr_memnode_t *node;
+
+    while (root != NULL) {
+        sink_count(SINK_LINK(root)->right, count, size);
+        for (node = root; node != NULL; node = node->next) {
+            (*count)++;
+            *size += node->endp - (char *)node;
+        }
+        root = SINK_LINK(root)->left;
+    }
+}
+
+#if ALLOCATOR_HAS_LOCKFREE
+/* Read the head of a lock-free list, the node and tag may not match but
+ * then the compare-and-swap fails.
+ */
+static APR_INLINE
+void lf_read(volatile allocator_lfhead_t *head, allocator_lfhead_t *cur)
+{
+    cur->s.tag = head->s.tag;
+    cur->s.node = head->s.node;
+}
+
+/* Swap the head of a lock-free list with a new one if it is still cur,
+ * otherwise reload cur.
+ */
+static APR_INLINE
+int lf_cas(volatile allocator_lfhead_t *head, allocator_lfhead_t *cur,
+           const allocator_lfhead_t *with)
+{
+#if APR_SIZEOF_VOIDP == 4
+    if (apr_atomic_cas64(&head->word, with->word, cur->word) == cur->word)
+        return 1;
+#elif defined(__x86_64__)
+    char swapped;
+
+    __asm__ __volatile__ ("lock; cmpxchg16b %1\n\tsete %0"
+                          : "=q" (swapped), "+m" (head->word),
+                            "+a" (cur->s.node), "+d" (cur->s.tag)
+                          : "b" (with->s.node), "c" (with->s.tag)
+                          : "memory", "cc");
+    if (swapped)
+        return 1;
+#else
+    if (__sync_bool_compare_and_swap(&head->word, cur->word, with->word))
+        return 1;
+#endif
+    lf_read(head, cur);
+    return 0;
+}
+
+static APR_INLINE
+void lf_push(volatile allocator_lfhead_t *head, apr_memnode_t *node)
+{
+    allocator_lfhead_t cur, with;
+
+    lf_read(head, &cur);
+    do {
+        node->next = cur.s.node;
+        with.s.node = node;
+        with.s.tag = cur.s.tag + LF_TAG_VERSION + 1;
+    } while (!lf_cas(head, &cur, &with));
+}
+
+static APR_INLINE
+apr_memnode_t *lf_pop(volatile allocator_lfhead_t *head)
+{
+    allocator_lfhead_t cur, with;
+
+    lf_read(head, &cur);
+    do {
+        if (cur.s.node == NULL)
+            return NULL;
+        with.s.node = cur.s.node->next;
+        with.s.tag = cur.s.tag + LF_TAG_VERSION - 1;
+    } while (!lf_cas(head, &cur, &with));
+
+    return cur.s.node;
+}
+#endif /* ALLOCATOR_HAS_LOCKFREE */
+
 static APR_INLINE
 void allocator_lock(apr_allocator_t *allocator)
 {
@@ -183,6 +690,12 @@ void allocator_unlock(apr_allocator_t *allocator)
 }
 
 APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
+{
+    return apr_allocator_create_ex(allocator, 0);
+}
+
+APR_DECLARE(apr_status_t) apr_allocator_create_ex(apr_allocator_t **allocator,
+                                                  apr_uint32_t flags)
 {
     apr_allocator_t *new_allocator;
 
@@ -193,21 +706,69 @@ APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
 
     memset(new_allocator, 0, SIZEOF_ALLOCATOR_T);
     new_allocator->max_free_index = APR_ALLOCATOR_MAX_FREE_UNLIMITED;
+#if !ALLOCATOR_HAS_REGIONS
+    flags &= ~APR_ALLOCATOR_HUGEPAGES;
+#endif
+#if !ALLOCATOR_HAS_LOCKFREE
+    flags &= ~APR_ALLOCATOR_LOCKFREE;
+#endif
+    new_allocator->flags = flags;
 
     *allocator = new_allocator;
 
     return APR_SUCCESS;
 }
 
+#if APR_HAS_THREADS
+static apr_status_t tcache_cleanup(void *data);
+#endif /* APR_HAS_THREADS */
+
 APR_DECLARE(void) apr_allocator_destroy(apr_allocator_t *allocator)
 {
     apr_size_t index;
     apr_memnode_t *node, **ref;
 
+#if APR_HAS_THREADS
+    /* Give the nodes of the thread caches back to the free lists first */
+    if (allocator->tcache_pool) {
+        apr_pool_cleanup_run(allocator->tcache_pool, allocator,
+                             tcache_cleanup);
+    }
+#endif /* APR_HAS_THREADS */
+
+#if ALLOCATOR_HAS_REGIONS
+    /* All the nodes are in the arena, no need to look at them */
+    if (allocator->arena_base) {
+        munmap(allocator->arena_base,
+               allocator->arena_endp - allocator->arena_base);
+        free(allocator);
+        return;
+    }
+#endif /* ALLOCATOR_HAS_REGIONS */
+
+    /* The cached pool nodes go the way of the free ones */
+    while ((node = allocator->pool_nodes) != NULL) {
+        allocator->pool_nodes = node->next;
+        node->next = allocator->free[node->index];
+        allocator->free[node->index] = node;
+    }
+
+#if ALLOCATOR_HAS_LOCKFREE
+    for (index = 1; index < MAX_INDEX; index++) {
+        while ((node = lf_pop(&allocator->lf_free[index])) != NULL) {
+            node->next = allocator->free[index];
+            allocator->free[index] = node;
+        }
+    }
+#endif /* ALLOCATOR_HAS_LOCKFREE */
+
+    allocator->free[0] = sink_list(allocator->free[0], NULL);
     for (index = 0; index < MAX_INDEX; index++) {
         ref = &allocator->free[index];
         while ((node = *ref) != NULL) {
             *ref = node->next;
+            if (allocator_region_node(allocator, node))
+                continue;
 #if APR_ALLOCATOR_USES_MMAP
             munmap((char *)node - GUARDPAGE_SIZE,
                    2 * GUARDPAGE_SIZE + ((node->index+1) << BOUNDARY_INDEX));
@@ -217,6 +778,15 @@ APR_DECLARE(void) apr_allocator_destroy(apr_allocator_t *allocator)
         }
     }
 
+#if ALLOCATOR_HAS_REGIONS
+    while (allocator->regions) {
+        allocator_region_t *region = allocator->regions;
+        allocator->regions = region->next;
+        munmap(region->base, REGION_SIZE);
+        free(region);
+    }
+#endif /* ALLOCATOR_HAS_REGIONS */
+
     free(allocator);
 }
 
@@ -263,6 +833,70 @@ APR_DECLARE(void) apr_allocator_max_free_set(apr_allocator_t *allocator,
     allocator_unlock(allocator);
 }
 
+APR_DECLARE(void) apr_allocator_decay_set(apr_allocator_t *allocator,
+                                          apr_interval_time_t decay)
+{
+    apr_uint32_t seconds = 0;
+
+    if (decay > 0) {
+        decay = (decay + APR_USEC_PER_SEC - 1) / APR_USEC_PER_SEC;
+        seconds = decay < APR_INT32_MAX ? (apr_uint32_t)decay
+                                        : APR_INT32_MAX;
+    }
+
+#ifdef ALLOCATOR_MADV_PURGE
+    if (!purge_page_size)
+        purge_page_size = sysconf(_SC_PAGESIZE);
+#endif
+
+    allocator_lock(allocator);
+    allocator->decay = seconds;
+    allocator_unlock(allocator);
+}
+
+APR_DECLARE(void) apr_allocator_stats_get(apr_allocator_t *allocator,
+                                          apr_allocator_stats_t *stats)
+{
+    apr_memnode_t *node;
+    apr_size_t index;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->boundary = BOUNDARY_SIZE;
+
+    allocator_lock(allocator);
+
+    for (index = 1; index < MAX_INDEX; index++) {
+        for (node = allocator->free[index]; node; node = node->next) {
+            stats->free_nodes[index]++;
+        }
+#if ALLOCATOR_HAS_LOCKFREE
+        stats->free_nodes[index] +=
+            LF_TAG_COUNT(allocator->lf_free[index].s.tag);
+#endif
+        stats->free_bytes += (stats->free_nodes[index] * (index + 1))
+                             << BOUNDARY_INDEX;
+    }
+    sink_count(allocator->free[0], &stats->free_nodes[0],
+               &stats->free_bytes);
+
+#if APR_HAS_THREADS
+    {
+        allocator_tcache_t *tc;
+
+        for (tc = allocator->tcaches; tc; tc = tc->next) {
+            stats->cached_bytes += tc->size << BOUNDARY_INDEX;
+        }
+    }
+#endif /* APR_HAS_THREADS */
+
+    stats->sys_bytes = allocator->sys_bytes;
+    stats->sys_allocs = allocator->sys_allocs;
+    stats->sys_frees = allocator->sys_frees;
+    stats->cached_pools = allocator->pool_nodes_count;
+
+    allocator_unlock(allocator);
+}
+
 static APR_INLINE
 apr_size_t allocator_align(apr_size_t in_size)
 {
@@ -289,69 +923,546 @@ APR_DECLARE(apr_size_t) apr_allocator_align(apr_allocator_t *allocator,
     return allocator_align(size);
 }
 
-static APR_INLINE
-apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
+#if APR_HAS_THREADS
+static void allocator_free_shared(apr_allocator_t *allocator,
+                                  apr_memnode_t *node);
+
+/* Take all the nodes of a thread cache, must be called with the
+ * allocator locked.
+ */
+static apr_memnode_t *tcache_take(allocator_tcache_t *tc)
 {
-    apr_memnode_t *node, **ref;
-    apr_size_t max_index;
-    apr_size_t size, i, index;
+    apr_memnode_t *node, *freelist = NULL;
+    apr_size_t index;
 
-    /* Round up the block size to the next boundary, but always
-     * allocate at least a certain size (MIN_ALLOC).
-     */
-    size = allocator_align(in_size);
-    if (!size) {
-        return NULL;
+    for (index = 0; index < MAX_INDEX; index++) {
+        while ((node = tc->free[index]) != NULL) {
+            tc->free[index] = node->next;
+            node->next = freelist;
+            freelist = node;
+        }
+        tc->count[index] = 0;
     }
+    tc->size = 0;
 
-    /* Find the index for this node size by
-     * dividing its size by the boundary size
-     */
-    index = (size >> BOUNDARY_INDEX) - 1;
-    
-    if (index > APR_UINT32_MAX) {
-        return NULL;
-    }
+    return freelist;
+}
 
-    /* First see if there are any nodes in the area we know
-     * our node will fit into.
-     */
-    if (index <= allocator->max_index) {
-        allocator_lock(allocator);
+/* The caches of the allocators used by each thread, in a list */
+static apr_threadkey_t *tcache_key = NULL;
 
-        /* Walk the free list to see if there are
-         * any nodes on it of the requested size
-         *
-         * NOTE: an optimization would be to check
-         * allocator->free[index] first and if no
-         * node is present, directly use
-         * allocator->free[max_index].  This seems
-         * like overkill though and could cause
-         * memory waste.
+/* Must be called with the allocator locked */
+static void tcache_unlink(allocator_tcache_t *tc)
+{
+    if ((*tc->ref = tc->next) != NULL)
+        tc->next->ref = tc->ref;
+}
+
+/* Give the cached nodes of a cache back to its allocator, on its
+ * thread's exit.
+ */
+static void tcache_exit(allocator_tcache_t *tc)
+{
+    apr_allocator_t *allocator = tc->allocator;
+    apr_memnode_t *freelist;
+
+    if (apr_atomic_cas32(&tc->state, TCACHE_EXITING, TCACHE_LIVE)
+            != TCACHE_LIVE) {
+        /* The allocator's cleanup got it first, which may be running
+         * concurrently, so wait for it to be done with the cache.
          */
-        max_index = allocator->max_index;
-        ref = &allocator->free[index];
-        i = index;
-        while (*ref == NULL && i < max_index) {
-           ref++;
-           i++;
+        while (apr_atomic_read32(&tc->state) != TCACHE_DEAD)
+            apr_thread_yield();
+        return;
+    }
+
+    allocator_lock(allocator);
+    freelist = tcache_take(tc);
+    allocator_unlock(allocator);
+
+    if (freelist)
+        allocator_free_shared(allocator, freelist);
+
+    /* Unlinked last, the allocator's cleanup waits for it */
+    allocator_lock(allocator);
+    tcache_unlink(tc);
+    allocator_unlock(allocator);
+}
+
+/* Called on thread exit with the caches of the thread */
+static void tcache_destroy(void *data)
+{
+    allocator_tcache_t *tc, *next;
+
+    for (tc = data; tc; tc = next) {
+        next = tc->tnext;
+        tcache_exit(tc);
+        free(tc);
+    }
+}
+
+/* Free the caches of this thread drained by their allocator's cleanup,
+ * return the others.
+ */
+static allocator_tcache_t *tcache_purge(allocator_tcache_t *head)
+{
+    allocator_tcache_t *tc, **ref = &head;
+
+    while ((tc = *ref) != NULL) {
+        if (apr_atomic_read32(&tc->state) == TCACHE_DEAD) {
+            *ref = tc->tnext;
+            free(tc);
         }
+        else {
+            ref = &tc->tnext;
+        }
+    }
 
-        if ((node = *ref) != NULL) {
-            /* If we have found a node and it doesn't have any
-             * nodes waiting in line behind it _and_ we are on
-             * the highest available index, find the new highest
-             * available index
-             */
-            if ((*ref = node->next) == NULL && i >= max_index) {
-                do {
-                    ref--;
-                    max_index--;
-                }
-                while (*ref == NULL && max_index);
+    return head;
+}
+
+static apr_status_t tcache_cleanup(void *data)
+{
+    apr_allocator_t *allocator = data;
+    allocator_tcache_t *tc, *next;
+    apr_memnode_t *node, *freelist = NULL;
+    void *head;
+    int exiting;
+
+    /* No more thread cache will be created from now on */
+    allocator->tcache_pool = NULL;
+
+    /* Drain and detach the caches which are not being destroyed by their
+     * thread, which will free them.
+     */
+    allocator_lock(allocator);
+    for (tc = allocator->tcaches; tc; tc = next) {
+        next = tc->next;
+        if (apr_atomic_cas32(&tc->state, TCACHE_DRAINING, TCACHE_LIVE)
+                != TCACHE_LIVE) {
+            continue;
+        }
+        if ((node = tcache_take(tc)) != NULL) {
+            apr_memnode_t *last = node;
+
+            while (last->next)
+                last = last->next;
+            last->next = freelist;
+            freelist = node;
+        }
+        tcache_unlink(tc);
+        apr_atomic_set32(&tc->state, TCACHE_DEAD);
+    }
+    allocator_unlock(allocator);
+
+    if (freelist)
+        allocator_free_shared(allocator, freelist);
+
+    /* The cache of this thread needs not wait for its exit */
+    if (tcache_key
+            && apr_threadkey_private_get(&head, tcache_key) == APR_SUCCESS
+            && head) {
+        apr_threadkey_private_set(tcache_purge(head), tcache_key);
+    }
+
+    /* Wait for the destructors running to unlink their cache */
+    do {
+        allocator_lock(allocator);
+        exiting = allocator->tcaches != NULL;
+        allocator_unlock(allocator);
+        if (exiting)
+            apr_thread_yield();
+    } while (exiting);
+
+    return APR_SUCCESS;
+}
+
+/* Called on the destruction of the global pool */
+static apr_status_t tcache_terminate(void *data)
+{
+    void *head;
+
+    (void)data;
+
+    if (apr_threadkey_private_get(&head, tcache_key) == APR_SUCCESS) {
+        apr_threadkey_private_set(NULL, tcache_key);
+        tcache_destroy(head);
+    }
+    apr_threadkey_private_delete(tcache_key);
+    tcache_key = NULL;
+
+    return APR_SUCCESS;
+}
+
+/* Create the key of the thread caches, for apr_pool_initialize() */
+static apr_status_t tcache_initialize(apr_pool_t *pool)
+{
+    apr_status_t rv;
+
+    rv = apr_threadkey_private_create(&tcache_key, tcache_destroy, pool);
+    if (rv != APR_SUCCESS) {
+        tcache_key = NULL;
+        return rv;
+    }
+
+    apr_pool_cleanup_register(pool, NULL, tcache_terminate,
+                              apr_pool_cleanup_null);
+
+    return APR_SUCCESS;
+}
+
+static allocator_tcache_t *tcache_create(apr_allocator_t *allocator,
+                                         allocator_tcache_t *head)
+{
+    allocator_tcache_t *tc;
+
+    if ((tc = malloc(sizeof(allocator_tcache_t))) == NULL)
+        return NULL;
+    memset(tc, 0, sizeof(allocator_tcache_t));
+    tc->allocator = allocator;
+    tc->tnext = head;
+
+    if (apr_threadkey_private_set(tc, tcache_key) != APR_SUCCESS) {
+        free(tc);
+        return NULL;
+    }
+
+    /* Now that the new cache is the head, the dead ones can go */
+    tc->tnext = tcache_purge(head);
+
+    allocator_lock(allocator);
+    if ((tc->next = allocator->tcaches) != NULL)
+        tc->next->ref = &tc->next;
+    allocator->tcaches = tc;
+    tc->ref = &allocator->tcaches;
+    allocator_unlock(allocator);
+
+    return tc;
+}
+
+static APR_INLINE
+allocator_tcache_t *allocator_tcache(apr_allocator_t *allocator)
+{
+    allocator_tcache_t *tc;
+    void *head;
+
+    if (!allocator->tcache_pool || !tcache_key)
+        return NULL;
+
+    if (apr_threadkey_private_get(&head, tcache_key) != APR_SUCCESS)
+        return NULL;
+    for (tc = head; tc; tc = tc->tnext) {
+        /* A dead cache may be for a new allocator at the same address */
+        if (tc->allocator == allocator && tc->state == TCACHE_LIVE)
+            return tc;
+    }
+
+    return tcache_create(allocator, head);
+}
+
+/* Move a batch of nodes of the given size from the allocator's free
+ * list to the thread cache, with room left for the one about to be
+ * handed out.
+ */
+static apr_memnode_t *tcache_refill(apr_allocator_t *allocator,
+                                    allocator_tcache_t *tc,
+                                    apr_size_t index)
+{
+    apr_memnode_t *node, **ref;
+    apr_size_t count, n;
+
+    count = 1;
+    if (allocator->tcache_max_index > tc->size) {
+        count += (allocator->tcache_max_index - tc->size) / (index + 1);
+        if (count > TCACHE_BATCH)
+            count = TCACHE_BATCH;
+    }
+
+#if ALLOCATOR_HAS_LOCKFREE
+    if (allocator_lockfree(allocator)) {
+        apr_memnode_t *last = NULL;
 
-                allocator->max_index = max_index;
+        node = NULL;
+        for (n = 0; n < count; n++) {
+            if ((last = lf_pop(&allocator->lf_free[index])) == NULL)
+                break;
+            last->next = node;
+            node = last;
+        }
+        if (!n)
+            return NULL;
+
+        tc->free[index] = node;
+        tc->count[index] = (apr_uint32_t)n;
+        tc->size += n * (index + 1);
+
+        return node;
+    }
+#endif /* ALLOCATOR_HAS_LOCKFREE */
+
+    allocator_lock(allocator);
+
+    n = 0;
+    ref = &allocator->free[index];
+    while (*ref != NULL && n < count) {
+        ref = &(*ref)->next;
+        n++;
+    }
+    if (!n) {
+        allocator_unlock(allocator);
+        return NULL;
+    }
+
+    node = allocator->free[index];
+    if ((allocator->free[index] = *ref) == NULL)
+        allocator->bitmap &= ~((apr_uint32_t)1 << index);
+    *ref = NULL;
+
+    allocator->current_free_index += n * (index + 1);
+    if (allocator->current_free_index > allocator->max_free_index)
+        allocator->current_free_index = allocator->max_free_index;
+
+    allocator_unlock(allocator);
+
+    tc->free[index] = node;
+    tc->count[index] = (apr_uint32_t)n;
+    tc->size += n * (index + 1);
+
+    return node;
+}
+
+/* Keep as many of the given nodes as the thread cache can hold, and
+ * return the others.  When the cache is full a batch of its nodes of
+ * the same size goes along with them, to make room for the next ones.
+ */
+static apr_memnode_t *tcache_absorb(apr_allocator_t *allocator,
+                                    allocator_tcache_t *tc,
+                                    apr_memnode_t *node)
+{
+    apr_memnode_t *next, *rest = NULL;
+    apr_size_t index, n;
+
+    do {
+        next = node->next;
+        index = node->index;
+
+        if (index < MAX_INDEX) {
+            if (tc->size + index + 1 > allocator->tcache_max_index) {
+                n = (tc->count[index] + 1) / 2;
+                if (n > TCACHE_BATCH)
+                    n = TCACHE_BATCH;
+                while (n--) {
+                    apr_memnode_t *spill = tc->free[index];
+                    tc->free[index] = spill->next;
+                    tc->count[index]--;
+                    tc->size -= index + 1;
+                    spill->next = rest;
+                    rest = spill;
+                }
+            }
+            if (tc->size + index + 1 <= allocator->tcache_max_index) {
+                APR_VALGRIND_NOACCESS((char *)node + APR_MEMNODE_T_SIZE,
+                                      (node->index+1) << BOUNDARY_INDEX);
+                node->next = tc->free[index];
+                tc->free[index] = node;
+                tc->count[index]++;
+                tc->size += index + 1;
+                continue;
             }
+        }
+
+        node->next = rest;
+        rest = node;
+    } while ((node = next) != NULL);
+
+    return rest;
+}
+#endif /* APR_HAS_THREADS */
+
+#if ALLOCATOR_HAS_REGIONS
+/* Map a new region, backed by huge pages if possible */
+static apr_status_t region_create(apr_allocator_t *allocator)
+{
+    allocator_region_t *region;
+    char *base = MAP_FAILED, *endp;
+
+    if ((region = malloc(sizeof(allocator_region_t))) == NULL)
+        return APR_ENOMEM;
+
+#ifdef MAP_HUGETLB
+    /* This fails unless huge pages were reserved (vm.nr_hugepages) */
+    base = mmap(NULL, REGION_SIZE, PROT_READ|PROT_WRITE,
+                MAP_PRIVATE|MAP_ANON|MAP_HUGETLB, -1, 0);
+#endif
+    if (base == MAP_FAILED) {
+        /* Fall back to transparent huge pages, which need the region
+         * to be aligned on the huge page size.
+         */
+        base = mmap(NULL, 2 * REGION_SIZE, PROT_READ|PROT_WRITE,
+                    MAP_PRIVATE|MAP_ANON, -1, 0);
+        if (base == MAP_FAILED) {
+            free(region);
+            return errno;
+        }
+
+        endp = base + 2 * REGION_SIZE;
+        region->base = (char *)APR_ALIGN((apr_uintptr_t)base, REGION_SIZE);
+        if (region->base > base)
+            munmap(base, region->base - base);
+        if (region->base + REGION_SIZE < endp)
+            munmap(region->base + REGION_SIZE,
+                   endp - (region->base + REGION_SIZE));
+        base = region->base;
+#ifdef MADV_HUGEPAGE
+        (void)madvise(base, REGION_SIZE, MADV_HUGEPAGE);
+#endif
+    }
+
+    region->base = base;
+    region->next = allocator->regions;
+    allocator->regions = region;
+    allocator->sys_allocs++;
+    allocator->sys_bytes += REGION_SIZE;
+    allocator->region_avail = base;
+    allocator->region_endp = base + REGION_SIZE;
+
+    return APR_SUCCESS;
+}
+
+/* Carve a node of the given size out of the current region,
+ * must be called with the allocator locked.
+ */
+static apr_memnode_t *region_alloc(apr_allocator_t *allocator,
+                                   apr_size_t size)
+{
+    apr_memnode_t *node;
+    apr_size_t rest, index;
+
+    rest = allocator->region_endp - allocator->region_avail;
+    if (rest < size) {
+        /* What is left of the region goes to the free lists */
+        if (rest >= MIN_ALLOC) {
+            node = (apr_memnode_t *)allocator->region_avail;
+            index = (rest >> BOUNDARY_INDEX) - 1;
+            node->index = (apr_uint32_t)index;
+            node->endp = allocator->region_endp;
+            node->free_index = DECAY_PURGED;
+            node->next = allocator->free[index];
+            allocator->free[index] = node;
+            allocator->bitmap |= (apr_uint32_t)1 << index;
+            APR_VALGRIND_NOACCESS((char *)node + APR_MEMNODE_T_SIZE,
+                                  rest - APR_MEMNODE_T_SIZE);
+        }
+        allocator->region_avail = allocator->region_endp = NULL;
+
+        if (region_create(allocator) != APR_SUCCESS)
+            return NULL;
+    }
+
+    node = (apr_memnode_t *)allocator->region_avail;
+    allocator->region_avail += size;
+
+    return node;
+}
+
+/* Carve a node of the given size out of the arena, committing its pages
+ * as needed, must be called with the allocator locked.
+ */
+static apr_memnode_t *arena_alloc(apr_allocator_t *allocator,
+                                  apr_size_t size)
+{
+    char *mem = allocator->arena_avail;
+    apr_size_t need, commit;
+
+    if (size > (apr_size_t)(allocator->arena_endp - mem))
+        return NULL;
+
+    if (size > (apr_size_t)(allocator->arena_commit - mem)) {
+        need = size - (allocator->arena_commit - mem);
+        commit = APR_ALIGN(need, ARENA_COMMIT_SIZE);
+        if (commit < need
+            || commit > (apr_size_t)(allocator->arena_endp
+                                     - allocator->arena_commit))
+            commit = allocator->arena_endp - allocator->arena_commit;
+        if (mprotect(allocator->arena_commit, commit,
+                     PROT_READ|PROT_WRITE) != 0)
+            return NULL;
+        allocator->arena_commit += commit;
+        allocator->sys_allocs++;
+        allocator->sys_bytes += commit;
+    }
+
+    allocator->arena_avail = mem + size;
+
+    return (apr_memnode_t *)mem;
+}
+#endif /* ALLOCATOR_HAS_REGIONS */
+
+static APR_INLINE
+apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
+{
+    apr_memnode_t *node;
+    apr_uint32_t bits;
+    apr_size_t size, i, index;
+#if APR_HAS_THREADS
+    allocator_tcache_t *tc;
+#endif
+
+    /* Round up the block size to the next boundary, but always
+     * allocate at least a certain size (MIN_ALLOC).
+     */
+    size = allocator_align(in_size);
+    if (!size) {
+        return NULL;
+    }
+
+    /* Find the index for this node size by
+     * dividing its size by the boundary size
+     */
+    index = (size >> BOUNDARY_INDEX) - 1;
+    
+    if (index > APR_UINT32_MAX) {
+        return NULL;
+    }
+
+#if APR_HAS_THREADS
+    /* Try this thread's cache first, it does not need the lock. */
+    if (index < MAX_INDEX && (tc = allocator_tcache(allocator)) != NULL) {
+        if ((node = tc->free[index]) == NULL)
+            node = tcache_refill(allocator, tc, index);
+
+        if (node) {
+            tc->free[index] = node->next;
+            tc->count[index]--;
+            tc->size -= index + 1;
+
+            goto have_node;
+        }
+    }
+#endif /* APR_HAS_THREADS */
+
+#if ALLOCATOR_HAS_LOCKFREE
+    /* Same best fit from the lock-free lists, without the bitmap */
+    if (index < MAX_INDEX && allocator_lockfree(allocator)) {
+        for (i = index; i < MAX_INDEX; i++) {
+            if ((node = lf_pop(&allocator->lf_free[i])) != NULL)
+                goto have_node;
+        }
+    }
+#endif /* ALLOCATOR_HAS_LOCKFREE */
+
+    /* First see if there are any nodes in the area we know
+     * our node will fit into, the first non-empty bin from
+     * index is the best fit.
+     */
+    if (index < MAX_INDEX && (allocator->bitmap >> index)) {
+        allocator_lock(allocator);
+
+        if ((bits = allocator->bitmap >> index) != 0) {
+            i = index + bitmap_first(bits);
+            node = allocator->free[i];
+            if ((allocator->free[i] = node->next) == NULL)
+                allocator->bitmap &= ~((apr_uint32_t)1 << i);
 
             allocator->current_free_index += node->index + 1;
             if (allocator->current_free_index > allocator->max_free_index)
@@ -368,18 +1479,22 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
     /* If we found nothing, seek the sink (at index 0), if
      * it is not empty.
      */
-    else if (allocator->free[0]) {
+    if (allocator->free[0]) {
         allocator_lock(allocator);
 
-        /* Walk the free list to see if there are
-         * any nodes on it of the requested size
+        /* Look for the smallest node of (at least) the requested size,
+         * preferably one waiting in line so that the tree is unchanged.
          */
-        ref = &allocator->free[0];
-        while ((node = *ref) != NULL && index > node->index)
-            ref = &node->next;
-
-        if (node) {
-            *ref = node->next;
+        if ((node = sink_find(allocator->free[0], index)) != NULL) {
+            if (node->next) {
+                apr_memnode_t *same = node->next;
+                node->next = same->next;
+                node = same;
+            }
+            else {
+                allocator->free[0] = sink_remove(allocator->free[0],
+                                                 node->index);
+            }
 
             allocator->current_free_index += node->index + 1;
             if (allocator->current_free_index > allocator->max_free_index)
@@ -396,6 +1511,27 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
     /* If we haven't got a suitable node, malloc a new one
      * and initialize it.
      */
+#if ALLOCATOR_HAS_REGIONS
+    if (allocator->arena_base) {
+        allocator_lock(allocator);
+        node = arena_alloc(allocator, size);
+        allocator_unlock(allocator);
+        if (node == NULL)
+            goto no_memory;
+
+        goto new_node;
+    }
+    if ((allocator->flags & APR_ALLOCATOR_HUGEPAGES) && index < MAX_INDEX) {
+        allocator_lock(allocator);
+        node = region_alloc(allocator, size);
+        allocator_unlock(allocator);
+        if (node == NULL)
+            goto no_memory;
+
+        goto new_node;
+    }
+#endif /* ALLOCATOR_HAS_REGIONS */
+
 #if APR_ALLOCATOR_GUARD_PAGES
     if ((node = mmap(NULL, size + 2 * GUARDPAGE_SIZE, PROT_NONE,
                      MAP_PRIVATE|MAP_ANON, -1, 0)) == MAP_FAILED)
@@ -407,14 +1543,22 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
 #else
     if ((node = malloc(size)) == NULL)
 #endif
-        return NULL;
+        goto no_memory;
 
 #if APR_ALLOCATOR_GUARD_PAGES
     node = (apr_memnode_t *)((char *)node + GUARDPAGE_SIZE);
     if (mprotect(node, size, PROT_READ|PROT_WRITE) != 0) {
         munmap((char *)node - GUARDPAGE_SIZE, size + 2 * GUARDPAGE_SIZE);
-        return NULL;
+        goto no_memory;
     }
+#endif
+    allocator_lock(allocator);
+    allocator->sys_allocs++;
+    allocator->sys_bytes += size;
+    allocator_unlock(allocator);
+
+#if ALLOCATOR_HAS_REGIONS
+new_node:
 #endif
     node->index = (apr_uint32_t)index;
     node->endp = (char *)node + size;
@@ -426,18 +1570,170 @@ have_node:
     APR_VALGRIND_UNDEFINED(node->first_avail, size - APR_MEMNODE_T_SIZE);
 
     return node;
+
+no_memory:
+    /* Short of memory, take back what the pools retain. */
+    apr_atomic_inc32(&allocator->reclaim_gen);
+    return NULL;
 }
 
+#ifdef ALLOCATOR_MADV_PURGE
+/* Let the system reclaim the pages of a mapped node, but its first one
+ * which holds the node header (and sink links).  Returns non-zero if the
+ * node can stay in the free lists.
+ */
+static int allocator_purge(apr_allocator_t *allocator, apr_memnode_t *node)
+{
+    apr_uintptr_t begin, end;
+    int rc;
+
+#if !APR_ALLOCATOR_USES_MMAP
+    if (!allocator_region_node(allocator, node))
+        return 0;
+#endif
+
+    begin = APR_ALIGN((apr_uintptr_t)node + APR_MEMNODE_T_SIZE + 1,
+                      purge_page_size);
+    end = (apr_uintptr_t)node->endp & ~(apr_uintptr_t)(purge_page_size - 1);
+    if (begin >= end)
+        return 1;
+
+    rc = madvise((void *)begin, end - begin, ALLOCATOR_MADV_PURGE);
+#if defined(MADV_FREE) && defined(MADV_DONTNEED)
+    /* MADV_FREE is not supported by older kernels */
+    if (rc != 0 && errno == EINVAL)
+        rc = madvise((void *)begin, end - begin, MADV_DONTNEED);
+#endif
+
+    return rc == 0;
+}
+#else
+#define allocator_purge(allocator, node) 0
+#endif /* ALLOCATOR_MADV_PURGE */
+
+/* Returns whether the free node has been unused for long enough */
+static APR_INLINE
+int decay_expired(apr_allocator_t *allocator, apr_memnode_t *node,
+                  apr_uint32_t now)
+{
+    return node->free_index != DECAY_PURGED
+           && (apr_int32_t)(now - node->free_index)
+              >= (apr_int32_t)allocator->decay;
+}
+
+/* Release (or purge) the free nodes unused for the decay time, must be
+ * called with the allocator locked.  The released nodes are prepended to
+ * freelist, to be given back to the system once unlocked.
+ */
+static apr_memnode_t *allocator_decay(apr_allocator_t *allocator,
+                                      apr_uint32_t now,
+                                      apr_memnode_t *freelist)
+{
+    apr_memnode_t *node, *next, **ref;
+    apr_size_t index, current_free_index;
+
+    current_free_index = allocator->current_free_index;
+
+    for (index = 1; index < MAX_INDEX; index++) {
+        if (!(allocator->bitmap & ((apr_uint32_t)1 << index)))
+            continue;
+
+        ref = &allocator->free[index];
+        while ((node = *ref) != NULL) {
+            if (!decay_expired(allocator, node, now)) {
+                ref = &node->next;
+                continue;
+            }
+            /* The nodes of a region can't be given back to the system,
+             * they stay (not retried) even if they can't be purged.
+             */
+            if (allocator_purge(allocator, node)
+                || allocator_region_node(allocator, node)) {
+                node->free_index = DECAY_PURGED;
+                ref = &node->next;
+                continue;
+            }
+
+            *ref = node->next;
+            node->next = freelist;
+            freelist = node;
+            current_free_index += index + 1;
+            allocator->sys_frees++;
+            allocator->sys_bytes -= node->endp - (char *)node;
+        }
+        if (allocator->free[index] == NULL)
+            allocator->bitmap &= ~((apr_uint32_t)1 << index);
+    }
+
+    /* The sink is rebuilt with the nodes which stay */
+    node = sink_list(allocator->free[0], NULL);
+    allocator->free[0] = NULL;
+    for (; node != NULL; node = next) {
+        next = node->next;
+        if (decay_expired(allocator, node, now)) {
+            if (!allocator_purge(allocator, node)
+                && !allocator_region_node(allocator, node)) {
+                node->next = freelist;
+                freelist = node;
+                current_free_index += node->index + 1;
+                allocator->sys_frees++;
+                allocator->sys_bytes -= node->endp - (char *)node;
+                continue;
+            }
+            node->free_index = DECAY_PURGED;
+        }
+        allocator->free[0] = sink_insert(allocator->free[0], node);
+    }
+
+    if (current_free_index > allocator->max_free_index)
+        current_free_index = allocator->max_free_index;
+    allocator->current_free_index = current_free_index;
+
+    return freelist;
+}
+
+#if APR_HAS_THREADS
+static void allocator_free_shared(apr_allocator_t *allocator,
+                                  apr_memnode_t *node)
+#else
 static APR_INLINE
 void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
+#endif
 {
     apr_memnode_t *next, *freelist = NULL;
-    apr_size_t index, max_index;
+    apr_size_t index;
     apr_size_t max_free_index, current_free_index;
+    apr_uint32_t bitmap, now = 0;
+
+#if ALLOCATOR_HAS_LOCKFREE
+    if (allocator_lockfree(allocator)) {
+        apr_memnode_t *rest = NULL;
+
+        /* Only the nodes for the sink need the lock */
+        do {
+            next = node->next;
+            if (node->index < MAX_INDEX) {
+                APR_VALGRIND_NOACCESS((char *)node + APR_MEMNODE_T_SIZE,
+                                      (node->index+1) << BOUNDARY_INDEX);
+                lf_push(&allocator->lf_free[node->index], node);
+            }
+            else {
+                node->next = rest;
+                rest = node;
+            }
+        } while ((node = next) != NULL);
+
+        if ((node = rest) == NULL)
+            return;
+    }
+#endif /* ALLOCATOR_HAS_LOCKFREE */
+
+    if (allocator->decay)
+        now = (apr_uint32_t)apr_time_sec(apr_time_now());
 
     allocator_lock(allocator);
 
-    max_index = allocator->max_index;
+    bitmap = allocator->bitmap;
     max_free_index = allocator->max_free_index;
     current_free_index = allocator->current_free_index;
 
@@ -448,56 +1744,239 @@ void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
         next = node->next;
         index = node->index;
 
-        APR_VALGRIND_NOACCESS((char *)node + APR_MEMNODE_T_SIZE,
-                              (node->index+1) << BOUNDARY_INDEX);
+        APR_VALGRIND_NOACCESS((char *)node + APR_MEMNODE_T_SIZE,
+                              (node->index+1) << BOUNDARY_INDEX);
+
+        if (max_free_index != APR_ALLOCATOR_MAX_FREE_UNLIMITED
+            && index + 1 > current_free_index
+            && !allocator_region_node(allocator, node)) {
+            node->next = freelist;
+            freelist = node;
+            allocator->sys_frees++;
+            allocator->sys_bytes -= node->endp - (char *)node;
+        }
+        else if (index < MAX_INDEX) {
+            /* Add the node to the appropriate 'size' bucket, and
+             * mark it as non-empty.
+             */
+            node->free_index = now;
+            node->next = allocator->free[index];
+            allocator->free[index] = node;
+            bitmap |= (apr_uint32_t)1 << index;
+            if (current_free_index >= index + 1)
+                current_free_index -= index + 1;
+            else
+                current_free_index = 0;
+        }
+        else {
+            /* This node is too large to keep in a specific size bucket,
+             * just add it to the sink (at index 0).
+             */
+            node->free_index = now;
+            allocator->free[0] = sink_insert(allocator->free[0], node);
+            if (current_free_index >= index + 1)
+                current_free_index -= index + 1;
+            else
+                current_free_index = 0;
+        }
+    } while ((node = next) != NULL);
+
+    allocator->bitmap = bitmap;
+    allocator->current_free_index = current_free_index;
+
+    /* Look for the unused nodes at most once per second */
+    if (allocator->decay && now != allocator->decay_last) {
+        allocator->decay_last = now;
+        freelist = allocator_decay(allocator, now, freelist);
+    }
+
+    allocator_unlock(allocator);
+
+    while (freelist != NULL) {
+        node = freelist;
+        freelist = node->next;
+#if APR_ALLOCATOR_USES_MMAP
+        munmap((char *)node - GUARDPAGE_SIZE,
+               2 * GUARDPAGE_SIZE + ((node->index+1) << BOUNDARY_INDEX));
+#else
+        free(node);
+#endif
+    }
+}
+
+#if APR_HAS_THREADS
+static APR_INLINE
+void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
+{
+    allocator_tcache_t *tc;
+
+    if ((tc = allocator_tcache(allocator)) != NULL) {
+        if ((node = tcache_absorb(allocator, tc, node)) == NULL)
+            return;
+    }
+
+    allocator_free_shared(allocator, node);
+}
+#endif /* APR_HAS_THREADS */
+
+/* Take the node of a destroyed pool, if any, for a new pool */
+static APR_INLINE
+apr_memnode_t *allocator_pool_node_get(apr_allocator_t *allocator)
+{
+    apr_memnode_t *node;
+
+    if (!allocator->pool_nodes)
+        return NULL;
+
+    allocator_lock(allocator);
+    if ((node = allocator->pool_nodes) != NULL) {
+        allocator->pool_nodes = node->next;
+        allocator->pool_nodes_count--;
+    }
+    allocator_unlock(allocator);
+
+    if (node) {
+        node->next = NULL;
+        node->first_avail = (char *)node + APR_MEMNODE_T_SIZE;
+    }
+
+    return node;
+}
+
+/* Keep the (first) node of a destroyed pool for a new pool, returns
+ * whether it was.
+ */
+static APR_INLINE
+int allocator_pool_node_put(apr_allocator_t *allocator, apr_memnode_t *node)
+{
+    int kept = 0;
+
+    if (!allocator->pool_nodes_max)
+        return 0;
+
+    allocator_lock(allocator);
+    if (allocator->pool_nodes_count < allocator->pool_nodes_max) {
+        node->next = allocator->pool_nodes;
+        allocator->pool_nodes = node;
+        allocator->pool_nodes_count++;
+        kept = 1;
+    }
+    allocator_unlock(allocator);
+
+    return kept;
+}
+
+APR_DECLARE(void) apr_allocator_pool_cache_set(apr_allocator_t *allocator,
+                                               apr_size_t count)
+{
+    apr_memnode_t *node, *freelist = NULL;
+
+    allocator_lock(allocator);
+    allocator->pool_nodes_max = count;
+    while (allocator->pool_nodes_count > count) {
+        node = allocator->pool_nodes;
+        allocator->pool_nodes = node->next;
+        allocator->pool_nodes_count--;
+        node->next = freelist;
+        freelist = node;
+    }
+    allocator_unlock(allocator);
+
+    if (freelist)
+        allocator_free(allocator, freelist);
+}
+
+APR_DECLARE(void) apr_allocator_reclaim(apr_allocator_t *allocator)
+{
+    apr_atomic_inc32(&allocator->reclaim_gen);
+}
+
+APR_DECLARE(apr_status_t) apr_allocator_arena_set(apr_allocator_t *allocator,
+                                                  apr_size_t size)
+{
+#if ALLOCATOR_HAS_REGIONS
+    char *base;
+    int flags = MAP_PRIVATE|MAP_ANON;
+
+    if (allocator->arena_base || allocator->sys_allocs)
+        return APR_EINVAL;
+
+    size = APR_ALIGN(size, ARENA_COMMIT_SIZE);
+    if (!size)
+        return APR_EINVAL;
+
+#ifdef MAP_NORESERVE
+    flags |= MAP_NORESERVE;
+#endif
+    base = mmap(NULL, size, PROT_NONE, flags, -1, 0);
+    if (base == MAP_FAILED)
+        return errno;
+#ifdef MADV_HUGEPAGE
+    if (allocator->flags & APR_ALLOCATOR_HUGEPAGES)
+        (void)madvise(base, size, MADV_HUGEPAGE);
+#endif
+
+    allocator_lock(allocator);
+    allocator->arena_base = allocator->arena_avail = base;
+    allocator->arena_commit = base;
+    allocator->arena_endp = base + size;
+    allocator_unlock(allocator);
+
+    return APR_SUCCESS;
+#else
+    (void)allocator;
+    (void)size;
+    return APR_ENOTIMPL;
+#endif /* ALLOCATOR_HAS_REGIONS */
+}
+
+APR_DECLARE(apr_status_t) apr_allocator_arena_reset(
+                                      apr_allocator_t *allocator)
+{
+#if ALLOCATOR_HAS_REGIONS
+    apr_size_t used;
 
-        if (max_free_index != APR_ALLOCATOR_MAX_FREE_UNLIMITED
-            && index + 1 > current_free_index) {
-            node->next = freelist;
-            freelist = node;
-        }
-        else if (index < MAX_INDEX) {
-            /* Add the node to the appropriate 'size' bucket.  Adjust
-             * the max_index when appropriate.
-             */
-            if ((node->next = allocator->free[index]) == NULL
-                && index > max_index) {
-                max_index = index;
-            }
-            allocator->free[index] = node;
-            if (current_free_index >= index + 1)
-                current_free_index -= index + 1;
-            else
-                current_free_index = 0;
-        }
-        else {
-            /* This node is too large to keep in a specific size bucket,
-             * just add it to the sink (at index 0).
-             */
-            node->next = allocator->free[0];
-            allocator->free[0] = node;
-            if (current_free_index >= index + 1)
-                current_free_index -= index + 1;
-            else
-                current_free_index = 0;
+    if (!allocator->arena_base)
+        return APR_EINVAL;
+
+    allocator_lock(allocator);
+
+    /* Forget about all the free nodes, wherever they are */
+#if APR_HAS_THREADS
+    {
+        allocator_tcache_t *tc;
+
+        for (tc = allocator->tcaches; tc; tc = tc->next) {
+            memset(tc->free, 0, sizeof(tc->free));
+            memset(tc->count, 0, sizeof(tc->count));
+            tc->size = 0;
         }
-    } while ((node = next) != NULL);
+    }
+#endif /* APR_HAS_THREADS */
+#if ALLOCATOR_HAS_LOCKFREE
+    memset(allocator->lf_free, 0, sizeof(allocator->lf_free));
+#endif
+    memset(allocator->free, 0, sizeof(allocator->free));
+    allocator->bitmap = 0;
+    allocator->pool_nodes = NULL;
+    allocator->pool_nodes_count = 0;
+    allocator->current_free_index = allocator->max_free_index;
 
-    allocator->max_index = max_index;
-    allocator->current_free_index = current_free_index;
+    used = allocator->arena_avail - allocator->arena_base;
+    allocator->arena_avail = allocator->arena_base;
+    if (used)
+        allocator->sys_frees++;
 
     allocator_unlock(allocator);
 
-    while (freelist != NULL) {
-        node = freelist;
-        freelist = node->next;
-#if APR_ALLOCATOR_USES_MMAP
-        munmap((char *)node - GUARDPAGE_SIZE,
-               2 * GUARDPAGE_SIZE + ((node->index+1) << BOUNDARY_INDEX));
+    if (used && madvise(allocator->arena_base, used, MADV_DONTNEED) != 0)
+        return errno;
+
+    return APR_SUCCESS;
 #else
-        free(node);
-#endif
-    }
+    (void)allocator;
+    return APR_ENOTIMPL;
+#endif /* ALLOCATOR_HAS_REGIONS */
 }
 
 APR_DECLARE(apr_memnode_t *) apr_allocator_alloc(apr_allocator_t *allocator,
@@ -512,6 +1991,40 @@ APR_DECLARE(void) apr_allocator_free(apr_allocator_t *allocator,
     allocator_free(allocator, node);
 }
 
+APR_DECLARE(apr_status_t) apr_allocator_thread_cache_set(
+                                      apr_allocator_t *allocator,
+                                      apr_size_t size,
+                                      apr_pool_t *pool)
+{
+#if APR_HAS_THREADS
+    if (allocator->tcache_pool) {
+        if (size) {
+            allocator->tcache_max_index = APR_ALIGN(size, BOUNDARY_SIZE)
+                                          >> BOUNDARY_INDEX;
+            return APR_SUCCESS;
+        }
+
+        return apr_pool_cleanup_run(allocator->tcache_pool, allocator,
+                                    tcache_cleanup);
+    }
+    if (!size)
+        return APR_SUCCESS;
+
+    allocator->tcache_pool = pool;
+    allocator->tcache_max_index = APR_ALIGN(size, BOUNDARY_SIZE)
+                                  >> BOUNDARY_INDEX;
+    apr_pool_cleanup_register(pool, allocator, tcache_cleanup,
+                              apr_pool_cleanup_null);
+
+    return APR_SUCCESS;
+#else
+    (void)allocator;
+    (void)size;
+    (void)pool;
+    return APR_ENOTIMPL;
+#endif /* APR_HAS_THREADS */
+}
+
 
 
 /*
@@ -566,12 +2079,27 @@ struct debug_node_t {
  * to see how it is used.
  */
 struct apr_pool_t {
+    /* The head of the pool is also accessed by the inline apr_palloc(),
+     * see apr_pool_inline_t.
+     */
+    apr_memnode_t        *active;
+    apr_size_t            stat_requested;
+    apr_uint32_t          slow;
+
     apr_pool_t           *parent;
     apr_pool_t           *child;
     apr_pool_t           *sibling;
     apr_pool_t          **ref;
     cleanup_t            *cleanups;
     cleanup_t            *free_cleanups;
+    /* Hash index of the cleanups, once they are numerous */
+    cleanup_t           **cleanup_index;
+    apr_uint32_t          cleanup_mask;
+    apr_uint32_t          ncleanups;
+    /* The number of cleanups and subprocesses records allocated from the
+     * pool, so that apr_pool_rewind() knows whether to look for them.
+     */
+    apr_uint32_t          list_allocs;
     apr_allocator_t      *allocator;
     struct process_chain *subprocesses;
     apr_abortfunc_t       abort_fn;
@@ -579,9 +2107,34 @@ struct apr_pool_t {
     const char           *tag;
 
 #if !APR_POOL_DEBUG
-    apr_memnode_t        *active;
     apr_memnode_t        *self; /* The node containing the pool itself */
     char                 *self_first_avail;
+    /* Statistics, @see apr_pool_stats_get() */
+    apr_size_t            stat_reserved;
+    apr_size_t            stat_nodes;
+    apr_size_t            stat_wasted;
+    apr_size_t            stat_peak;
+    /* Set by apr_pool_mark(), the nodes allocated since then are kept
+     * in front of the ring in allocation order, for apr_pool_rewind().
+     */
+    apr_byte_t            marked;
+    /* For an APR_POOL_SMALL pool, the pool whose small_nodes its own node
+     * was carved from.  For the latter, the blocks the small subpools are
+     * carved from, and the chunks given back by the destroyed ones.
+     */
+    apr_pool_t           *small_owner;
+    apr_memnode_t        *small_nodes;
+    void                 *small_free;
+    /* The most bytes of nodes kept across clears, and the allocator's
+     * reclaim_gen they were last kept at, @see apr_pool_retain_set().
+     */
+    apr_size_t            retain_max;
+    apr_uint32_t          retain_gen;
+    /* Set for an APR_POOL_CONCURRENT pool, whose node replacements are
+     * serialized by concurrent_lock, @see pool_palloc_concurrent().
+     */
+    apr_uint32_t          concurrent;
+    volatile apr_uint32_t concurrent_lock;
 
 #else /* APR_POOL_DEBUG */
     apr_pool_t           *joined; /* the caller has guaranteed that this pool
@@ -613,6 +2166,33 @@ struct apr_pool_t {
 
 #define SIZEOF_POOL_T       APR_ALIGN_DEFAULT(sizeof(apr_pool_t))
 
+/* A savepoint, see apr_pool_mark() */
+struct apr_pool_mark_t {
+#if !APR_POOL_DEBUG
+    apr_memnode_t        *node;
+    char                 *first_avail;
+    apr_size_t            stat_requested;
+    apr_size_t            stat_reserved;
+    apr_size_t            stat_nodes;
+    apr_size_t            stat_wasted;
+#else /* APR_POOL_DEBUG */
+    debug_node_t         *node;
+    apr_size_t            index;
+    unsigned int          stat_alloc;
+#endif /* APR_POOL_DEBUG */
+    cleanup_t           **cleanup_index;
+    apr_uint32_t          list_allocs;
+};
+
+/* Make sure that the head of apr_pool_t matches apr_pool_inline_t */
+typedef char apr_pool_inline_check_t[
+    (APR_OFFSETOF(apr_pool_t, active)
+         == APR_OFFSETOF(apr_pool_inline_t, active)
+     && APR_OFFSETOF(apr_pool_t, stat_requested)
+         == APR_OFFSETOF(apr_pool_inline_t, requested)
+     && APR_OFFSETOF(apr_pool_t, slow)
+         == APR_OFFSETOF(apr_pool_inline_t, slow)) ? 1 : -1];
+
 
 /*
  * Variables
@@ -640,7 +2220,9 @@ static apr_status_t apr_pool_cleanup_file_stderr(void *data)
  */
 
 static void run_cleanups(cleanup_t **c);
+static void run_pool_cleanups(apr_pool_t *p);
 static void free_proc_chain(struct process_chain *procs);
+static void pool_rewind_lists(apr_pool_t *pool, const apr_pool_mark_t *mark);
 
 #if APR_POOL_DEBUG
 static void pool_destroy_debug(apr_pool_t *pool, const char *file_line);
@@ -695,123 +2277,617 @@ APR_DECLARE(apr_status_t) apr_pool_initialize(void)
         return rv;
     }
 
-#if APR_HAS_THREADS
-    {
-        apr_thread_mutex_t *mutex;
+#if APR_HAS_THREADS
+    {
+        apr_thread_mutex_t *mutex;
+
+        if ((rv = apr_thread_mutex_create(&mutex,
+                                          APR_THREAD_MUTEX_DEFAULT,
+                                          global_pool)) != APR_SUCCESS) {
+            return rv;
+        }
+
+        apr_allocator_mutex_set(global_allocator, mutex);
+
+        if ((rv = tcache_initialize(global_pool)) != APR_SUCCESS) {
+            return rv;
+        }
+    }
+#endif /* APR_HAS_THREADS */
+
+    apr_allocator_owner_set(global_allocator, global_pool);
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void) apr_pool_terminate(void)
+{
+    if (!apr_pools_initialized)
+        return;
+
+    if (--apr_pools_initialized)
+        return;
+
+    apr_pool_destroy(global_pool); /* This will also destroy the mutex */
+    global_pool = NULL;
+
+    global_allocator = NULL;
+}
+
+
+/* Node list management helper macros; list_insert() inserts 'node'
+ * before 'point'. */
+#define list_insert(node, point) do {           \
+    node->ref = point->ref;                     \
+    *node->ref = node;                          \
+    node->next = point;                         \
+    point->ref = &node->next;                   \
+} while (0)
+
+/* list_remove() removes 'node' from its list. */
+#define list_remove(node) do {                  \
+    *node->ref = node->next;                    \
+    node->next->ref = node->ref;                \
+} while (0)
+
+/* Returns the amount of free space in the given node. */
+#define node_free_space(node_) ((apr_size_t)(node_->endp - node_->first_avail))
+
+/* Account for a new node in the pool's statistics. */
+static APR_INLINE void pool_stat_node(apr_pool_t *pool, apr_memnode_t *node)
+{
+    pool->stat_reserved += node->endp - (char *)node;
+    pool->stat_nodes++;
+    if (pool->stat_peak < pool->stat_reserved)
+        pool->stat_peak = pool->stat_reserved;
+}
+
+/* Reset the pool's statistics to its own node only. */
+static APR_INLINE void pool_stat_reset(apr_pool_t *pool)
+{
+    pool->stat_requested = 0;
+    pool->stat_reserved = 0;
+    pool->stat_nodes = 0;
+    pool->stat_wasted = 0;
+    pool_stat_node(pool, pool->self);
+}
+
+/*
+ * Helpers to mark pool as in-use/free. Used for finding thread-unsafe
+ * concurrent accesses from different threads.
+ */
+#if APR_POOL_CONCURRENCY_CHECK
+
+static const char * const in_use_string[] = { "idle", "in use", "destroyed" };
+
+static void pool_concurrency_abort(apr_pool_t *pool, apr_uint32_t new, apr_uint32_t old)
+{
+    fprintf(stderr, "pool concurrency check: pool %p(%s), thread cur %lx "
+                    "in use by %lx, state %s -> %s \n",
+                    pool, pool->tag, (unsigned long)apr_os_thread_current(),
+                    (unsigned long)pool->in_use_by,
+                    in_use_string[old], in_use_string[new]);
+    abort();
+}
+
+static APR_INLINE void pool_concurrency_set_used(apr_pool_t *pool)
+{
+    apr_uint32_t old;
+
+    old = apr_atomic_cas32(&pool->in_use, IN_USE, IDLE);
+
+    if (old != IDLE)
+        pool_concurrency_abort(pool, IN_USE, old);
+
+    pool->in_use_by = apr_os_thread_current();
+}
+
+static APR_INLINE void pool_concurrency_set_idle(apr_pool_t *pool)
+{
+    apr_uint32_t old;
+
+    old = apr_atomic_cas32(&pool->in_use, IDLE, IN_USE);
+
+    if (old != IN_USE)
+        pool_concurrency_abort(pool, IDLE, old);
+}
+
+static APR_INLINE void pool_concurrency_init(apr_pool_t *pool)
+{
+    pool->in_use = IDLE;
+}
+
+static APR_INLINE void pool_concurrency_set_destroyed(apr_pool_t *pool)
+{
+    apr_uint32_t old;
+
+    old = apr_atomic_cas32(&pool->in_use, DESTROYED, IDLE);
+
+    if (old != IDLE)
+        pool_concurrency_abort(pool, DESTROYED, old);
+    pool->in_use_by = apr_os_thread_current();
+}
+#else
+static APR_INLINE void pool_concurrency_init(apr_pool_t *pool)          { }
+static APR_INLINE void pool_concurrency_set_used(apr_pool_t *pool)      { }
+static APR_INLINE void pool_concurrency_set_idle(apr_pool_t *pool)      { }
+static APR_INLINE void pool_concurrency_set_destroyed(apr_pool_t *pool) { }
+#endif /* APR_POOL_CONCURRENCY_CHECK */
+
+/*
+ * Allocation tracing
+ */
+
+/* An event as recorded, see apr_pool_trace_record_t for the dump */
+typedef struct pool_trace_entry_t {
+    apr_time_t          time;
+    const void         *pool;
+    const void         *pc;
+    const char         *tag;
+    apr_size_t          size;
+    apr_uint32_t        type;
+#ifdef POOL_TRACE_FRAMES
+    int                 nframes;
+    void               *frames[POOL_TRACE_FRAMES];
+#endif
+} pool_trace_entry_t;
+
+/* The ring buffer of a thread, reused by a new thread once it exits */
+typedef struct pool_trace_ring_t pool_trace_ring_t;
+struct pool_trace_ring_t {
+    pool_trace_ring_t  *next;
+    apr_size_t          size;
+    /* Number of events recorded so far, the next one goes at
+     * entries[pos % size].
+     */
+    apr_size_t          pos;
+    /* The value of pos when dumping */
+    apr_size_t          dump_pos;
+    int                 owned;
+    pool_trace_entry_t  entries[1];
+};
+
+static volatile apr_uint32_t pool_tracing = 0;
+static int pool_trace_ready = 0;
+static apr_size_t pool_trace_entries;
+static pool_trace_ring_t *pool_trace_rings;
+#if APR_HAS_THREADS
+static apr_threadkey_t *pool_trace_key;
+static apr_thread_mutex_t *pool_trace_mutex;
+#else
+static pool_trace_ring_t *pool_trace_ring;
+#endif
+
+/* The direct caller of the pool function, which is recorded unless a
+ * caller outside of libapr is found in the frames.
+ */
+#if defined(__GNUC__)
+#define POOL_TRACE_PC() __builtin_return_address(0)
+#else
+#define POOL_TRACE_PC() NULL
+#endif
+
+#if APR_HAS_THREADS
+static void pool_trace_thread_exit(void *data)
+{
+    pool_trace_ring_t *ring = data;
+
+    ring->owned = 0;
+}
+#endif
+
+/* Get (or set up) the calling thread's ring buffer */
+static pool_trace_ring_t *pool_trace_ring_get(void)
+{
+    pool_trace_ring_t *ring;
+#if APR_HAS_THREADS
+    void *data;
+
+    if (apr_threadkey_private_get(&data, pool_trace_key) == APR_SUCCESS
+        && data != NULL)
+        return data;
+
+    apr_thread_mutex_lock(pool_trace_mutex);
+#else
+    if (pool_trace_ring)
+        return pool_trace_ring;
+#endif
+
+    for (ring = pool_trace_rings; ring; ring = ring->next) {
+        if (!ring->owned) {
+            ring->pos = 0;
+            break;
+        }
+    }
+    if (ring == NULL) {
+        ring = malloc(APR_OFFSETOF(pool_trace_ring_t, entries)
+                      + pool_trace_entries * sizeof(pool_trace_entry_t));
+        if (ring) {
+            ring->size = pool_trace_entries;
+            ring->pos = 0;
+            ring->next = pool_trace_rings;
+            pool_trace_rings = ring;
+        }
+    }
+    if (ring) {
+        ring->owned = 1;
+#if APR_HAS_THREADS
+        data = ring;
+        if (apr_threadkey_private_set(data, pool_trace_key) != APR_SUCCESS)
+            ring->owned = 0;
+#else
+        pool_trace_ring = ring;
+#endif
+    }
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(pool_trace_mutex);
+#endif
+
+    return ring;
+}
+
+/* Record an event, called when pool_tracing is set */
+static void pool_trace(apr_pool_t *pool, apr_uint32_t type,
+                       apr_size_t size, const void *pc)
+{
+    pool_trace_ring_t *ring;
+    pool_trace_entry_t *entry;
+
+    if ((ring = pool_trace_ring_get()) == NULL)
+        return;
+
+    entry = &ring->entries[ring->pos % ring->size];
+    entry->time = apr_time_now();
+    entry->pool = pool;
+    entry->pc = pc;
+    entry->tag = pool->tag;
+    entry->size = size;
+    entry->type = type;
+#ifdef POOL_TRACE_FRAMES
+    entry->nframes = backtrace(entry->frames, POOL_TRACE_FRAMES);
+#endif
+    ring->pos++;
+}
+
+/* The caller to dump for an event: the first frame outside of libapr,
+ * or the direct caller when there is none (e.g. when libapr is linked
+ * statically, or the frames of libapr are more than POOL_TRACE_FRAMES).
+ */
+static const void *pool_trace_caller(const pool_trace_entry_t *entry)
+{
+#ifdef POOL_TRACE_FRAMES
+    static void *apr_base = NULL;
+    Dl_info info;
+    int i;
+
+    if (apr_base == NULL) {
+        if (!dladdr((void *)&pool_tracing, &info))
+            return entry->pc;
+        apr_base = info.dli_fbase;
+    }
+    for (i = 0; i < entry->nframes; i++) {
+        if (!dladdr(entry->frames[i], &info))
+            break;
+        if (info.dli_fbase != apr_base)
+            return entry->frames[i];
+    }
+#endif
+
+    return entry->pc;
+}
 
-        if ((rv = apr_thread_mutex_create(&mutex,
-                                          APR_THREAD_MUTEX_DEFAULT,
-                                          global_pool)) != APR_SUCCESS) {
-            return rv;
-        }
+static apr_status_t pool_trace_cleanup(void *data)
+{
+    pool_trace_ring_t *ring;
 
-        apr_allocator_mutex_set(global_allocator, mutex);
+    pool_tracing = 0;
+    pool_trace_ready = 0;
+    while ((ring = pool_trace_rings) != NULL) {
+        pool_trace_rings = ring->next;
+        free(ring);
     }
-#endif /* APR_HAS_THREADS */
-
-    apr_allocator_owner_set(global_allocator, global_pool);
+#if !APR_HAS_THREADS
+    pool_trace_ring = NULL;
+#endif
 
     return APR_SUCCESS;
 }
 
-APR_DECLARE(void) apr_pool_terminate(void)
+APR_DECLARE(apr_status_t) apr_pool_trace_start(apr_size_t entries)
 {
-    if (!apr_pools_initialized)
-        return;
+    pool_trace_ring_t *ring;
 
-    if (--apr_pools_initialized)
-        return;
+    if (!entries || entries > APR_SIZE_MAX / sizeof(pool_trace_entry_t))
+        return APR_EINVAL;
 
-    apr_pool_destroy(global_pool); /* This will also destroy the mutex */
-    global_pool = NULL;
+    if (!pool_trace_ready) {
+#if APR_HAS_THREADS
+        apr_status_t rv;
 
-    global_allocator = NULL;
-}
+        rv = apr_thread_mutex_create(&pool_trace_mutex,
+                                     APR_THREAD_MUTEX_DEFAULT, global_pool);
+        if (rv == APR_SUCCESS)
+            rv = apr_threadkey_private_create(&pool_trace_key,
+                                              pool_trace_thread_exit,
+                                              global_pool);
+        if (rv != APR_SUCCESS)
+            return rv;
+#endif
+        /* Registered last, so run before the above are destroyed */
+        apr_pool_cleanup_register(global_pool, NULL, pool_trace_cleanup,
+                                  apr_pool_cleanup_null);
+        pool_trace_ready = 1;
+    }
 
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(pool_trace_mutex);
+#endif
 
-/* Node list management helper macros; list_insert() inserts 'node'
- * before 'point'. */
-#define list_insert(node, point) do {           \
-    node->ref = point->ref;                     \
-    *node->ref = node;                          \
-    node->next = point;                         \
-    point->ref = &node->next;                   \
-} while (0)
+    pool_trace_entries = entries;
+    for (ring = pool_trace_rings; ring; ring = ring->next)
+        ring->pos = 0;
+    pool_tracing = 1;
 
-/* list_remove() removes 'node' from its list. */
-#define list_remove(node) do {                  \
-    *node->ref = node->next;                    \
-    node->next->ref = node->ref;                \
-} while (0)
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(pool_trace_mutex);
+#endif
 
-/* Returns the amount of free space in the given node. */
-#define node_free_space(node_) ((apr_size_t)(node_->endp - node_->first_avail))
+    return APR_SUCCESS;
+}
 
-/*
- * Helpers to mark pool as in-use/free. Used for finding thread-unsafe
- * concurrent accesses from different threads.
+APR_DECLARE(void) apr_pool_trace_stop(void)
+{
+    pool_tracing = 0;
+}
+
+/* Index (from 1) of a tag in the tags of a dump, 0 if not found nor
+ * added.
  */
-#if APR_POOL_CONCURRENCY_CHECK
+static apr_uint32_t pool_trace_tag_index(const char ***tags,
+                                         apr_uint32_t *ntags,
+                                         apr_uint32_t *nalloc,
+                                         const char *tag, int add)
+{
+    apr_uint32_t i;
 
-static const char * const in_use_string[] = { "idle", "in use", "destroyed" };
+    if (tag == NULL)
+        return 0;
 
-static void pool_concurrency_abort(apr_pool_t *pool, apr_uint32_t new, apr_uint32_t old)
-{
-    fprintf(stderr, "pool concurrency check: pool %p(%s), thread cur %lx "
-                    "in use by %lx, state %s -> %s \n",
-                    pool, pool->tag, (unsigned long)apr_os_thread_current(),
-                    (unsigned long)pool->in_use_by,
-                    in_use_string[old], in_use_string[new]);
-    abort();
+    for (i = *ntags; i > 0; i--) {
+        if ((*tags)[i - 1] == tag)
+            return i;
+    }
+    if (!add)
+        return 0;
+
+    if (*ntags == *nalloc) {
+        const char **new_tags;
+
+        *nalloc = *nalloc ? *nalloc * 2 : 32;
+        if ((new_tags = realloc(*tags, *nalloc * sizeof(**tags))) == NULL)
+            return 0;
+        *tags = new_tags;
+    }
+    (*tags)[(*ntags)++] = tag;
+
+    return *ntags;
 }
 
-static APR_INLINE void pool_concurrency_set_used(apr_pool_t *pool)
+APR_DECLARE(apr_status_t) apr_pool_trace_dump(apr_file_t *file)
 {
-    apr_uint32_t old;
+    pool_trace_ring_t *ring;
+    pool_trace_entry_t *entry;
+    apr_pool_trace_header_t header;
+    apr_pool_trace_record_t records[64];
+    const char **tags = NULL;
+    apr_uint32_t ntags = 0, nalloc = 0, len, i, thread;
+    apr_size_t pos, n;
+    apr_status_t rv = APR_SUCCESS;
+
+    if (!pool_trace_ready)
+        return APR_SUCCESS;
 
-    old = apr_atomic_cas32(&pool->in_use, IN_USE, IDLE);
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(pool_trace_mutex);
+#endif
 
-    if (old != IDLE)
-        pool_concurrency_abort(pool, IN_USE, old);
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, APR_POOL_TRACE_MAGIC, sizeof(header.magic));
+    header.version = APR_POOL_TRACE_VERSION;
+    for (ring = pool_trace_rings; ring; ring = ring->next) {
+        pos = ring->dump_pos = ring->pos;
+        n = pos < ring->size ? pos : ring->size;
+        header.records += n;
+        while (n--) {
+            entry = &ring->entries[--pos % ring->size];
+            pool_trace_tag_index(&tags, &ntags, &nalloc, entry->tag, 1);
+        }
+    }
+    header.tags = ntags;
+
+    rv = apr_file_write_full(file, &header, sizeof(header), NULL);
+    for (i = 0; i < ntags && rv == APR_SUCCESS; i++) {
+        len = (apr_uint32_t)strlen(tags[i]);
+        rv = apr_file_write_full(file, &len, sizeof(len), NULL);
+        if (rv == APR_SUCCESS)
+            rv = apr_file_write_full(file, tags[i], len, NULL);
+    }
 
-    pool->in_use_by = apr_os_thread_current();
+    /* The records of each thread, oldest first */
+    for (ring = pool_trace_rings, thread = 0;
+         ring && rv == APR_SUCCESS;
+         ring = ring->next, thread++) {
+        pos = ring->dump_pos < ring->size ? 0 : ring->dump_pos - ring->size;
+        n = 0;
+        memset(records, 0, sizeof(records));
+        while (pos < ring->dump_pos) {
+            entry = &ring->entries[pos++ % ring->size];
+            records[n].time = entry->time;
+            records[n].pool = (apr_uint64_t)(apr_uintptr_t)entry->pool;
+            records[n].pc = (apr_uint64_t)(apr_uintptr_t)
+                            pool_trace_caller(entry);
+            records[n].size = entry->size;
+            records[n].tag = pool_trace_tag_index(&tags, &ntags, &nalloc,
+                                                  entry->tag, 0);
+            records[n].thread = thread;
+            records[n].type = entry->type;
+            if (++n == sizeof(records) / sizeof(records[0])
+                || pos == ring->dump_pos) {
+                rv = apr_file_write_full(file, records,
+                                         n * sizeof(records[0]), NULL);
+                if (rv != APR_SUCCESS)
+                    break;
+                n = 0;
+            }
+        }
+    }
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(pool_trace_mutex);
+#endif
+    free(tags);
+
+    return rv;
 }
 
-static APR_INLINE void pool_concurrency_set_idle(apr_pool_t *pool)
+/* Whether the allocations from a new pool must all go through
+ * apr_palloc(), instead of the inline version (see apr_pool_inline_t).
+ */
+static APR_INLINE apr_uint32_t pool_slow_init(void)
 {
-    apr_uint32_t old;
+#if APR_POOL_CONCURRENCY_CHECK
+    return 1;
+#elif HAVE_VALGRIND
+    return apr_running_on_valgrind || pool_tracing;
+#else
+    return pool_tracing;
+#endif
+}
 
-    old = apr_atomic_cas32(&pool->in_use, IDLE, IN_USE);
+/*
+ * Memory allocation
+ */
 
-    if (old != IN_USE)
-        pool_concurrency_abort(pool, IDLE, old);
+#if APR_HAS_THREADS
+/* Replacing the active node of an APR_POOL_CONCURRENT pool is rare
+ * enough for a spin lock.
+ */
+static APR_INLINE void pool_concurrent_lock(apr_pool_t *pool)
+{
+    while (apr_atomic_cas32(&pool->concurrent_lock, 1, 0) != 0)
+        apr_thread_yield();
 }
 
-static APR_INLINE void pool_concurrency_init(apr_pool_t *pool)
+static APR_INLINE void pool_concurrent_unlock(apr_pool_t *pool)
 {
-    pool->in_use = IDLE;
+    apr_atomic_xchg32(&pool->concurrent_lock, 0);
 }
 
-static APR_INLINE void pool_concurrency_set_destroyed(apr_pool_t *pool)
+/* Claim size bytes from the node, racing with the other threads. */
+static APR_INLINE char *pool_bump_concurrent(apr_memnode_t *node,
+                                             apr_size_t size)
 {
-    apr_uint32_t old;
-
-    old = apr_atomic_cas32(&pool->in_use, DESTROYED, IDLE);
+    char *mem, *avail;
 
-    if (old != IDLE)
-        pool_concurrency_abort(pool, DESTROYED, old);
-    pool->in_use_by = apr_os_thread_current();
+    mem = *(char * volatile *)&node->first_avail;
+    for (;;) {
+        if (size > (apr_size_t)(node->endp - mem))
+            return NULL;
+        avail = apr_atomic_casptr((volatile void **)&node->first_avail,
+                                  mem + size, mem);
+        if (avail == mem)
+            return mem;
+        mem = avail;
+    }
 }
-#else
-static APR_INLINE void pool_concurrency_init(apr_pool_t *pool)          { }
-static APR_INLINE void pool_concurrency_set_used(apr_pool_t *pool)      { }
-static APR_INLINE void pool_concurrency_set_idle(apr_pool_t *pool)      { }
-static APR_INLINE void pool_concurrency_set_destroyed(apr_pool_t *pool) { }
-#endif /* APR_POOL_CONCURRENCY_CHECK */
 
-/*
- * Memory allocation
+/* apr_palloc() for APR_POOL_CONCURRENT pools: the allocations are bumped
+ * atomically from the active node, and only the threads which find it
+ * full take the lock, to replace it.  The nodes are never reset before
+ * the pool is cleared, so a thread still bumping an older active node
+ * is harmless.  The ring is not ordered by free space here, the node
+ * after the active one is the only one tried before a new one.
  */
+static void *pool_palloc_concurrent(apr_pool_t *pool, apr_size_t in_size)
+{
+    apr_memnode_t *active, *node, *point;
+    apr_size_t size;
+    char *mem;
+
+    size = APR_ALIGN_DEFAULT(in_size);
+#if HAVE_VALGRIND
+    if (apr_running_on_valgrind)
+        size += 2 * REDZONE;
+#endif
+    if (size < in_size) {
+        if (pool->abort_fn)
+            pool->abort_fn(APR_ENOMEM);
+
+        return NULL;
+    }
+    /* Approximate, like the statistics of any pool used by several
+     * threads.
+     */
+    pool->stat_requested += in_size;
+
+    active = *(apr_memnode_t * volatile *)&pool->active;
+#if HAVE_VALGRIND
+    if (!apr_running_on_valgrind)
+#endif
+    if ((mem = pool_bump_concurrent(active, size)) != NULL)
+        return mem;
+
+    pool_concurrent_lock(pool);
+
+    active = pool->active;
+    if ((mem = pool_bump_concurrent(active, size)) != NULL)
+        goto have_mem;
+
+    node = active->next;
+    if (node != active && (mem = pool_bump_concurrent(node, size)) != NULL) {
+        list_remove(node);
+        pool->stat_wasted -= node_free_space(node);
+    }
+    else {
+        if ((node = allocator_alloc(pool->allocator, size)) == NULL) {
+            pool_concurrent_unlock(pool);
+            if (pool->abort_fn)
+                pool->abort_fn(APR_ENOMEM);
+
+            return NULL;
+        }
+        pool_stat_node(pool, node);
+
+        mem = node->first_avail;
+        node->first_avail += size;
+    }
+
+    /* Whichever of the two nodes has more room left becomes (or stays)
+     * the active one, the other one follows it in the ring.
+     */
+    point = active->next;
+    list_insert(node, point);
+    if (node_free_space(node) > node_free_space(active)) {
+        pool->stat_wasted += node_free_space(active);
+        apr_atomic_xchgptr((volatile void **)&pool->active, node);
+    }
+    else {
+        pool->stat_wasted += node_free_space(node);
+    }
+
+have_mem:
+#if HAVE_VALGRIND
+    if (apr_running_on_valgrind) {
+        mem += REDZONE;
+        VALGRIND_MEMPOOL_ALLOC(pool, mem, in_size);
+    }
+#endif
+    pool_concurrent_unlock(pool);
+
+    return mem;
+}
+#endif /* APR_HAS_THREADS */
 
 APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
 {
@@ -819,6 +2895,14 @@ APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
     void *mem;
     apr_size_t size, free_index;
 
+    if (pool_tracing)
+        pool_trace(pool, APR_POOL_TRACE_ALLOC, in_size, POOL_TRACE_PC());
+
+#if APR_HAS_THREADS
+    if (pool->concurrent)
+        return pool_palloc_concurrent(pool, in_size);
+#endif
+
     pool_concurrency_set_used(pool);
     size = APR_ALIGN_DEFAULT(in_size);
 #if HAVE_VALGRIND
@@ -832,6 +2916,7 @@ APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
 
         return NULL;
     }
+    pool->stat_requested += in_size;
     active = pool->active;
 
     /* If the active node has enough bytes left, use it. */
@@ -842,8 +2927,9 @@ APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
     }
 
     node = active->next;
-    if (size <= node_free_space(node)) {
+    if (!pool->marked && size <= node_free_space(node)) {
         list_remove(node);
+        pool->stat_wasted -= node_free_space(node);
     }
     else {
         if ((node = allocator_alloc(pool->allocator, size)) == NULL) {
@@ -853,6 +2939,7 @@ APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
 
             return NULL;
         }
+        pool_stat_node(pool, node);
     }
 
     node->free_index = 0;
@@ -863,13 +2950,14 @@ APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
     list_insert(node, active);
 
     pool->active = node;
+    pool->stat_wasted += node_free_space(active);
 
     free_index = (APR_ALIGN(active->endp - active->first_avail + 1,
                             BOUNDARY_SIZE) - BOUNDARY_SIZE) >> BOUNDARY_INDEX;
 
     active->free_index = (apr_uint32_t)free_index;
     node = active->next;
-    if (free_index >= node->free_index)
+    if (free_index >= node->free_index || pool->marked)
         goto have_mem;
 
     do {
@@ -892,30 +2980,209 @@ have_mem:
         pool_concurrency_set_idle(pool);
         return mem;
     }
-#else
-    pool_concurrency_set_idle(pool);
+#else
+    pool_concurrency_set_idle(pool);
+    return mem;
+#endif
+}
+
+/* Provide an implementation of apr_pcalloc for backward compatibility
+ * with code built before apr_pcalloc was a macro
+ */
+
+#ifdef apr_pcalloc
+#undef apr_pcalloc
+#endif
+
+APR_DECLARE(void *) apr_pcalloc(apr_pool_t *pool, apr_size_t size);
+APR_DECLARE(void *) apr_pcalloc(apr_pool_t *pool, apr_size_t size)
+{
+    void *mem;
+
+    if ((mem = apr_palloc(pool, size)) != NULL) {
+        memset(mem, 0, size);
+    }
+
+    return mem;
+}
+
+
+APR_DECLARE(void *) apr_prealloc(apr_pool_t *pool, void *mem,
+                                 apr_size_t old_size, apr_size_t new_size)
+{
+    apr_memnode_t *active;
+    apr_size_t size;
+    void *new_mem;
+
+    if (mem == NULL)
+        return apr_palloc(pool, new_size);
+    if (pool->concurrent)
+        goto copy;
+
+    pool_concurrency_set_used(pool);
+    size = APR_ALIGN_DEFAULT(new_size);
+    active = pool->active;
+    if ((char *)mem + APR_ALIGN_DEFAULT(old_size) == active->first_avail
+        && size >= new_size
+        && size <= (apr_size_t)(active->endp - (char *)mem)
+#if HAVE_VALGRIND
+        && !apr_running_on_valgrind
+#endif
+        ) {
+        /* The last allocation from the active node, and it fits */
+        active->first_avail = (char *)mem + size;
+        pool->stat_requested = pool->stat_requested + new_size - old_size;
+        pool_concurrency_set_idle(pool);
+        if (pool_tracing && new_size > old_size)
+            pool_trace(pool, APR_POOL_TRACE_ALLOC, new_size - old_size,
+                       POOL_TRACE_PC());
+        return mem;
+    }
+    pool_concurrency_set_idle(pool);
+
+copy:
+    if (new_size <= old_size)
+        return mem;
+
+    if ((new_mem = apr_palloc(pool, new_size)) != NULL)
+        memcpy(new_mem, mem, old_size);
+
+    return new_mem;
+}
+
+APR_DECLARE(void *) apr_palloc_aligned(apr_pool_t *pool, apr_size_t size,
+                                       apr_size_t alignment)
+{
+    apr_memnode_t *active;
+    apr_size_t in_size = size;
+    char *mem;
+
+    if (alignment == 0 || (alignment & (alignment - 1)))
+        return NULL;
+    if (alignment <= APR_ALIGN_DEFAULT(1))
+        return apr_palloc(pool, size);
+
+    if (pool->concurrent)
+        goto overallocate;
+
+    pool_concurrency_set_used(pool);
+    size = APR_ALIGN_DEFAULT(in_size);
+    active = pool->active;
+    mem = (char *)APR_ALIGN((apr_uintptr_t)active->first_avail, alignment);
+    if (mem >= active->first_avail && mem <= active->endp
+        && size >= in_size
+        && size <= (apr_size_t)(active->endp - mem)
+#if HAVE_VALGRIND
+        && !apr_running_on_valgrind
+#endif
+        ) {
+        /* Bump the active node up to the alignment, and it fits */
+        active->first_avail = mem + size;
+        pool->stat_requested += in_size;
+        pool_concurrency_set_idle(pool);
+        if (pool_tracing)
+            pool_trace(pool, APR_POOL_TRACE_ALLOC, in_size, POOL_TRACE_PC());
+        return mem;
+    }
+    pool_concurrency_set_idle(pool);
+
+overallocate:
+    /* Otherwise allocate enough to align within the block, which is
+     * itself aligned on APR_ALIGN_DEFAULT(1) already.
+     */
+    size = alignment - APR_ALIGN_DEFAULT(1);
+    if (in_size > APR_SIZE_MAX - size) {
+        if (pool->abort_fn)
+            pool->abort_fn(APR_ENOMEM);
+
+        return NULL;
+    }
+    if ((mem = apr_palloc(pool, in_size + size)) != NULL)
+        mem = (char *)APR_ALIGN((apr_uintptr_t)mem, alignment);
+
     return mem;
-#endif
 }
 
-/* Provide an implementation of apr_pcalloc for backward compatibility
- * with code built before apr_pcalloc was a macro
- */
 
-#ifdef apr_pcalloc
-#undef apr_pcalloc
-#endif
+/*
+ * Small pools
+ *
+ * An APR_POOL_SMALL pool starts with a SMALL_POOL_SIZE chunk carved out
+ * of its parent's small_nodes, instead of a MIN_ALLOC node of its own.
+ * The chunk starts with a memnode header like any node, so that the pool
+ * works the same, except that it is given back to the parent for another
+ * small pool when destroyed.  The parent's small_nodes (holding
+ * SMALL_POOL_COUNT chunks each) are freed when it is cleared or destroyed,
+ * once all its subpools are gone.
+ */
+#define SMALL_POOL_SIZE  1024
+#define SMALL_POOL_COUNT 16
 
-APR_DECLARE(void *) apr_pcalloc(apr_pool_t *pool, apr_size_t size);
-APR_DECLARE(void *) apr_pcalloc(apr_pool_t *pool, apr_size_t size)
+static apr_memnode_t *pool_small_get(apr_pool_t *parent)
 {
-    void *mem;
+    apr_memnode_t *node, *fresh = NULL;
+    char *chunk;
 
-    if ((mem = apr_palloc(pool, size)) != NULL) {
-        memset(mem, 0, size);
+    allocator_lock(parent->allocator);
+    for (;;) {
+        if ((chunk = parent->small_free) != NULL) {
+            parent->small_free = *(void **)chunk;
+            break;
+        }
+        node = parent->small_nodes;
+        if (node && node_free_space(node) >= SMALL_POOL_SIZE) {
+            chunk = node->first_avail;
+            node->first_avail += SMALL_POOL_SIZE;
+            break;
+        }
+        if (fresh) {
+            /* The new block goes first, to be carved from now on */
+            fresh->next = parent->small_nodes;
+            parent->small_nodes = fresh;
+            fresh = NULL;
+            continue;
+        }
+
+        /* Not locked while allocating (the allocator locks itself) */
+        allocator_unlock(parent->allocator);
+        fresh = allocator_alloc(parent->allocator,
+                                SMALL_POOL_SIZE * SMALL_POOL_COUNT
+                                - APR_MEMNODE_T_SIZE);
+        if (fresh == NULL)
+            return NULL;
+        allocator_lock(parent->allocator);
     }
+    allocator_unlock(parent->allocator);
 
-    return mem;
+    /* Another thread made room meanwhile */
+    if (fresh)
+        allocator_free(parent->allocator, fresh);
+
+    node = (apr_memnode_t *)chunk;
+    node->index = 0;
+    node->free_index = 0;
+    node->first_avail = chunk + APR_MEMNODE_T_SIZE;
+    node->endp = chunk + SMALL_POOL_SIZE;
+
+    return node;
+}
+
+static void pool_small_put(apr_pool_t *parent, apr_memnode_t *node)
+{
+    allocator_lock(parent->allocator);
+    *(void **)node = parent->small_free;
+    parent->small_free = node;
+    allocator_unlock(parent->allocator);
+}
+
+/* Free the blocks of the small subpools, which must all be destroyed */
+static void pool_small_release(apr_pool_t *pool)
+{
+    if (pool->small_nodes) {
+        allocator_free(pool->allocator, pool->small_nodes);
+        pool->small_nodes = NULL;
+    }
+    pool->small_free = NULL;
 }
 
 
@@ -923,9 +3190,59 @@ APR_DECLARE(void *) apr_pcalloc(apr_pool_t *pool, apr_size_t size)
  * Pool creation/destruction
  */
 
+/* Put back in the ring of the (just cleared) pool the nodes of the given
+ * list which fit its retention, reset, and return the ones to free.
+ */
+static apr_memnode_t *pool_retain(apr_pool_t *pool, apr_memnode_t *nodes)
+{
+    apr_memnode_t *node, *point, *freelist = NULL, **ref = &freelist;
+    apr_uint32_t gen = pool->allocator->reclaim_gen;
+    apr_size_t size, kept = 0;
+
+    /* The allocator wants its memory back, keep nothing this time. */
+    if (pool->retain_gen != gen) {
+        pool->retain_gen = gen;
+        return nodes;
+    }
+
+    while ((node = nodes) != NULL) {
+        nodes = node->next;
+
+        size = node->endp - (char *)node;
+        if (size > pool->retain_max - kept) {
+            *ref = node;
+            ref = &node->next;
+            continue;
+        }
+        kept += size;
+
+        node->first_avail = (char *)node + APR_MEMNODE_T_SIZE;
+        node->free_index = (apr_uint32_t)((APR_ALIGN(node_free_space(node) + 1,
+                                                     BOUNDARY_SIZE)
+                                           - BOUNDARY_SIZE) >> BOUNDARY_INDEX);
+
+        /* Keep the ring ordered by decreasing free space after the
+         * active node, as apr_palloc() expects.
+         */
+        point = pool->active->next;
+        while (point != pool->active && point->free_index > node->free_index)
+            point = point->next;
+        list_insert(node, point);
+
+        pool_stat_node(pool, node);
+        pool->stat_wasted += node_free_space(node);
+    }
+    *ref = NULL;
+
+    return freelist;
+}
+
 APR_DECLARE(void) apr_pool_clear(apr_pool_t *pool)
 {
-    apr_memnode_t *active;
+    apr_memnode_t *active, *node;
+
+    if (pool_tracing)
+        pool_trace(pool, APR_POOL_TRACE_CLEAR, 0, POOL_TRACE_PC());
 
     /* Run pre destroy cleanups */
     run_cleanups(&pool->pre_cleanups);
@@ -941,11 +3258,13 @@ APR_DECLARE(void) apr_pool_clear(apr_pool_t *pool)
         apr_pool_destroy(pool->child);
 
     /* Run cleanups */
-    run_cleanups(&pool->cleanups);
+    run_pool_cleanups(pool);
 
     pool_concurrency_set_used(pool);
+    pool_small_release(pool);
     pool->cleanups = NULL;
     pool->free_cleanups = NULL;
+    pool->cleanup_index = NULL;
 
     /* Free subprocesses */
     free_proc_chain(pool->subprocesses);
@@ -959,6 +3278,8 @@ APR_DECLARE(void) apr_pool_clear(apr_pool_t *pool)
      */
     active = pool->active = pool->self;
     active->first_avail = pool->self_first_avail;
+    pool_stat_reset(pool);
+    pool->marked = 0;
 
     APR_IF_VALGRIND(VALGRIND_MEMPOOL_TRIM(pool, pool, 1));
 
@@ -968,19 +3289,31 @@ APR_DECLARE(void) apr_pool_clear(apr_pool_t *pool)
     }
 
     *active->ref = NULL;
-    if (active->next)
-        allocator_free(pool->allocator, active->next);
+    node = active->next;
     active->next = active;
     active->ref = &active->next;
+    if (node && pool->retain_max)
+        node = pool_retain(pool, node);
+    if (node)
+        allocator_free(pool->allocator, node);
 
     pool_concurrency_set_idle(pool);
 }
 
+APR_DECLARE(void) apr_pool_retain_set(apr_pool_t *pool, apr_size_t size)
+{
+    pool->retain_max = size;
+    pool->retain_gen = pool->allocator->reclaim_gen;
+}
+
 APR_DECLARE(void) apr_pool_destroy(apr_pool_t *pool)
 {
-    apr_memnode_t *active;
+    apr_memnode_t *active, *next;
     apr_allocator_t *allocator;
 
+    if (pool_tracing)
+        pool_trace(pool, APR_POOL_TRACE_DESTROY, 0, POOL_TRACE_PC());
+
     /* Run pre destroy cleanups */
     run_cleanups(&pool->pre_cleanups);
 
@@ -995,9 +3328,11 @@ APR_DECLARE(void) apr_pool_destroy(apr_pool_t *pool)
         apr_pool_destroy(pool->child);
 
     /* Run cleanups */
-    run_cleanups(&pool->cleanups);
+    run_pool_cleanups(pool);
     pool_concurrency_set_destroyed(pool);
 
+    pool_small_release(pool);
+
     /* Free subprocesses */
     free_proc_chain(pool->subprocesses);
 
@@ -1028,9 +3363,26 @@ APR_DECLARE(void) apr_pool_destroy(apr_pool_t *pool)
 #endif /* APR_HAS_THREADS */
 
     /* Free all the nodes in the pool (including the node holding the
-     * pool struct), by giving them back to the allocator.
+     * pool struct), by giving them back to the allocator.  The latter
+     * may be kept aside for a new pool instead, or go back to the
+     * parent for a small pool.
      */
-    allocator_free(allocator, active);
+    next = active->next;
+    if (pool->small_owner) {
+        if (next)
+            allocator_free(allocator, next);
+        pool_small_put(pool->small_owner, active);
+    }
+    else if (apr_allocator_owner_get(allocator) == pool
+#if HAVE_VALGRIND
+             || apr_running_on_valgrind
+#endif
+             || !allocator_pool_node_put(allocator, active)) {
+        allocator_free(allocator, active);
+    }
+    else if (next) {
+        allocator_free(allocator, next);
+    }
 
     /* If this pool happens to be the owner of the allocator, free
      * everything in the allocator (that includes the pool struct
@@ -1043,13 +3395,102 @@ APR_DECLARE(void) apr_pool_destroy(apr_pool_t *pool)
     APR_IF_VALGRIND(VALGRIND_DESTROY_MEMPOOL(pool));
 }
 
-APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
-                                             apr_pool_t *parent,
-                                             apr_abortfunc_t abort_fn,
-                                             apr_allocator_t *allocator)
+APR_DECLARE(apr_pool_mark_t *) apr_pool_mark(apr_pool_t *pool)
+{
+    apr_pool_mark_t *mark;
+
+    if (pool->concurrent)
+        return NULL;
+    if ((mark = apr_palloc(pool, sizeof(*mark))) == NULL)
+        return NULL;
+
+    pool_concurrency_set_used(pool);
+    pool->marked = 1;
+    mark->node = pool->active;
+    mark->first_avail = pool->active->first_avail;
+    mark->stat_requested = pool->stat_requested;
+    mark->stat_reserved = pool->stat_reserved;
+    mark->stat_nodes = pool->stat_nodes;
+    mark->stat_wasted = pool->stat_wasted;
+    mark->cleanup_index = pool->cleanup_index;
+    mark->list_allocs = pool->list_allocs;
+    pool_concurrency_set_idle(pool);
+
+    return mark;
+}
+
+/* Whether some memory of the pool was allocated since the mark, and is
+ * thus given back by apr_pool_rewind().
+ */
+static int pool_rewound(const apr_pool_t *pool, const apr_pool_mark_t *mark,
+                        const void *mem)
+{
+    const char *m = mem;
+    const apr_memnode_t *node;
+
+    if (m >= mark->first_avail && m < mark->node->endp)
+        return 1;
+    for (node = pool->active; node != mark->node; node = node->next) {
+        if (m >= (const char *)node && m < node->endp)
+            return 1;
+    }
+
+    return 0;
+}
+
+APR_DECLARE(void) apr_pool_rewind(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    apr_memnode_t *active, *node, **ref;
+
+#if HAVE_VALGRIND
+    /* Handing the memory out again would overlap with the allocations
+     * valgrind knows of, keep it until the pool is cleared.
+     */
+    if (apr_running_on_valgrind)
+        return;
+#endif
+
+    pool_concurrency_set_used(pool);
+    /* A cleanups index allocated since the mark is gone, rebuild it
+     * on the next registration.
+     */
+    if (pool->cleanup_index != mark->cleanup_index)
+        pool->cleanup_index = NULL;
+    pool_rewind_lists(pool, mark);
+
+    node = mark->node;
+    active = pool->active;
+    if (active != node) {
+        /* While the pool is marked, the nodes allocated since the mark
+         * precede it in the ring, starting with the active one.  Cut
+         * them out and give them back to the allocator.
+         */
+        ref = active->ref;
+        *node->ref = NULL;
+        *ref = node;
+        node->ref = ref;
+        allocator_free(pool->allocator, active);
+
+        node->free_index = 0;
+        pool->active = node;
+    }
+    node->first_avail = mark->first_avail;
+
+    pool->stat_requested = mark->stat_requested;
+    pool->stat_reserved = mark->stat_reserved;
+    pool->stat_nodes = mark->stat_nodes;
+    pool->stat_wasted = mark->stat_wasted;
+    pool_concurrency_set_idle(pool);
+}
+
+static APR_INLINE
+apr_status_t pool_create(apr_pool_t **newpool, apr_pool_t *parent,
+                         apr_abortfunc_t abort_fn, apr_allocator_t *allocator,
+                         apr_uint32_t flags, const void *pc)
 {
     apr_pool_t *pool;
     apr_memnode_t *node;
+    apr_pool_t *small_owner = NULL;
 
     *newpool = NULL;
 
@@ -1066,8 +3507,23 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
     if (allocator == NULL)
         allocator = parent->allocator;
 
-    if ((node = allocator_alloc(allocator,
-                                MIN_ALLOC - APR_MEMNODE_T_SIZE)) == NULL) {
+    if ((flags & APR_POOL_SMALL) && parent
+#if HAVE_VALGRIND
+        && !apr_running_on_valgrind
+#endif
+        ) {
+        if ((node = pool_small_get(parent)) == NULL) {
+            if (abort_fn)
+                abort_fn(APR_ENOMEM);
+
+            return APR_ENOMEM;
+        }
+        small_owner = parent;
+    }
+    else if ((node = allocator_pool_node_get(allocator)) == NULL
+             && (node = allocator_alloc(allocator,
+                                        MIN_ALLOC - APR_MEMNODE_T_SIZE))
+                == NULL) {
         if (abort_fn)
             abort_fn(APR_ENOMEM);
 
@@ -1101,10 +3557,26 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
     pool->child = NULL;
     pool->cleanups = NULL;
     pool->free_cleanups = NULL;
+    pool->cleanup_index = NULL;
+    pool->ncleanups = 0;
     pool->pre_cleanups = NULL;
     pool->subprocesses = NULL;
+    pool->list_allocs = 0;
     pool->user_data = NULL;
     pool->tag = NULL;
+    pool->stat_peak = 0;
+    pool->marked = 0;
+    pool->small_owner = small_owner;
+    pool->small_nodes = NULL;
+    pool->small_free = NULL;
+    pool->retain_max = 0;
+#if APR_HAS_THREADS
+    pool->concurrent = (flags & APR_POOL_CONCURRENT) != 0;
+#else
+    pool->concurrent = 0;
+#endif
+    pool->concurrent_lock = 0;
+    pool_stat_reset(pool);
 
 #ifdef NETWARE
     pool->owner_proc = (apr_os_proc_t)getnlmhandle();
@@ -1126,13 +3598,36 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
         pool->ref = NULL;
     }
 
+    pool->slow = pool_slow_init() || pool->concurrent;
     pool_concurrency_init(pool);
 
+    if (pool_tracing)
+        pool_trace(pool, APR_POOL_TRACE_CREATE, 0, pc);
+
     *newpool = pool;
 
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
+                                             apr_pool_t *parent,
+                                             apr_abortfunc_t abort_fn,
+                                             apr_allocator_t *allocator)
+{
+    return pool_create(newpool, parent, abort_fn, allocator, 0,
+                       POOL_TRACE_PC());
+}
+
+APR_DECLARE(apr_status_t) apr_pool_create_flags(apr_pool_t **newpool,
+                                                apr_pool_t *parent,
+                                                apr_abortfunc_t abort_fn,
+                                                apr_allocator_t *allocator,
+                                                apr_uint32_t flags)
+{
+    return pool_create(newpool, parent, abort_fn, allocator, flags,
+                       POOL_TRACE_PC());
+}
+
 /* Deprecated. Renamed to apr_pool_create_unmanaged_ex
  */
 APR_DECLARE(apr_status_t) apr_pool_create_core_ex(apr_pool_t **newpool,
@@ -1184,13 +3679,25 @@ APR_DECLARE(apr_status_t) apr_pool_create_unmanaged_ex(apr_pool_t **newpool,
     pool->child = NULL;
     pool->cleanups = NULL;
     pool->free_cleanups = NULL;
+    pool->cleanup_index = NULL;
+    pool->ncleanups = 0;
     pool->pre_cleanups = NULL;
     pool->subprocesses = NULL;
+    pool->list_allocs = 0;
     pool->user_data = NULL;
     pool->tag = NULL;
     pool->parent = NULL;
     pool->sibling = NULL;
     pool->ref = NULL;
+    pool->stat_peak = 0;
+    pool->marked = 0;
+    pool->small_owner = NULL;
+    pool->small_nodes = NULL;
+    pool->small_free = NULL;
+    pool->retain_max = 0;
+    pool->concurrent = 0;
+    pool->concurrent_lock = 0;
+    pool_stat_reset(pool);
 
 #ifdef NETWARE
     pool->owner_proc = (apr_os_proc_t)getnlmhandle();
@@ -1198,7 +3705,12 @@ APR_DECLARE(apr_status_t) apr_pool_create_unmanaged_ex(apr_pool_t **newpool,
     if (!allocator)
         pool_allocator->owner = pool;
 
+    pool->slow = pool_slow_init();
     pool_concurrency_init(pool);
+
+    if (pool_tracing)
+        pool_trace(pool, APR_POOL_TRACE_CREATE, 0, POOL_TRACE_PC());
+
     *newpool = pool;
 
     return APR_SUCCESS;
@@ -1256,7 +3768,8 @@ static int psprintf_flush(apr_vformatter_buff_t *vbuff)
         size = APR_PSPRINTF_MIN_STRINGSIZE;
 
     node = active->next;
-    if (!ps->got_a_new_node && size <= node_free_space(node)) {
+    if (!ps->got_a_new_node && !pool->marked
+        && size <= node_free_space(node)) {
 
         list_remove(node);
         list_insert(node, active);
@@ -1264,6 +3777,7 @@ static int psprintf_flush(apr_vformatter_buff_t *vbuff)
         node->free_index = 0;
 
         pool->active = node;
+        pool->stat_wasted += node_free_space(active) - node_free_space(node);
 
         free_index = (APR_ALIGN(active->endp - active->first_avail + 1,
                                 BOUNDARY_SIZE) - BOUNDARY_SIZE) >> BOUNDARY_INDEX;
@@ -1336,6 +3850,49 @@ static int add_redzone(int (*flush_func)(apr_vformatter_buff_t *b),
 }
 #endif
 
+#if APR_HAS_THREADS
+/* apr_pvsprintf() for APR_POOL_CONCURRENT pools, whose active node can't
+ * be formatted into in place: format in nodes of our own and copy.
+ */
+static char *pool_vsprintf_concurrent(apr_pool_t *pool, const char *fmt,
+                                      va_list ap)
+{
+    struct psprintf_data ps;
+    char *strp;
+    apr_size_t size;
+
+    ps.node = allocator_alloc(pool->allocator, APR_PSPRINTF_MIN_STRINGSIZE);
+    if (ps.node == NULL) {
+        if (pool->abort_fn)
+            pool->abort_fn(APR_ENOMEM);
+
+        return NULL;
+    }
+    ps.pool = pool;
+    ps.vbuff.curpos = ps.node->first_avail;
+    ps.vbuff.endpos = ps.node->endp - 1;
+    ps.got_a_new_node = 1;
+    ps.free = NULL;
+
+    if (apr_vformatter(psprintf_flush, &ps.vbuff, fmt, ap) != -1) {
+        *ps.vbuff.curpos++ = '\0';
+        size = ps.vbuff.curpos - ps.node->first_avail;
+        if ((strp = apr_palloc(pool, size)) != NULL)
+            memcpy(strp, ps.node->first_avail, size);
+    }
+    else {
+        strp = NULL;
+        if (pool->abort_fn)
+            pool->abort_fn(APR_ENOMEM);
+    }
+
+    ps.node->next = ps.free;
+    allocator_free(pool->allocator, ps.node);
+
+    return strp;
+}
+#endif /* APR_HAS_THREADS */
+
 APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
 {
     struct psprintf_data ps;
@@ -1344,6 +3901,11 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
     apr_memnode_t *active, *node;
     apr_size_t free_index;
 
+#if APR_HAS_THREADS
+    if (pool->concurrent)
+        return pool_vsprintf_concurrent(pool, fmt, ap);
+#endif
+
     pool_concurrency_set_used(pool);
     ps.node = pool->active;
     ps.pool = pool;
@@ -1398,6 +3960,9 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
 #endif
 
     size = ps.vbuff.curpos - ps.node->first_avail;
+    pool->stat_requested += size;
+    if (pool_tracing)
+        pool_trace(pool, APR_POOL_TRACE_ALLOC, size, POOL_TRACE_PC());
     size = APR_ALIGN_DEFAULT(size);
     ps.node->first_avail += size;
 
@@ -1420,6 +3985,8 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
     list_insert(node, active);
 
     pool->active = node;
+    pool_stat_node(pool, node);
+    pool->stat_wasted += node_free_space(active);
 
     free_index = (APR_ALIGN(active->endp - active->first_avail + 1,
                             BOUNDARY_SIZE) - BOUNDARY_SIZE) >> BOUNDARY_INDEX;
@@ -1427,7 +3994,7 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
     active->free_index = (apr_uint32_t)free_index;
     node = active->next;
 
-    if (free_index >= node->free_index) {
+    if (free_index >= node->free_index || pool->marked) {
         pool_concurrency_set_idle(pool);
         return strp;
     }
@@ -1457,6 +4024,87 @@ error:
 }
 
 
+/*
+ * Statistics
+ */
+
+/* The child list of a pool is protected by the mutex of its allocator
+ * (see apr_pool_create_ex()), which is locked unless one of the pools
+ * up the walk already holds it (the mutexes need not be nested).
+ */
+typedef struct pool_walk_held_t pool_walk_held_t;
+struct pool_walk_held_t {
+    const pool_walk_held_t *up;
+    void *mutex;
+};
+
+static int pool_walk_tree(apr_pool_t *pool,
+                          int (*fn)(apr_pool_t *pool, void *data),
+                          void *data, const pool_walk_held_t *held)
+{
+    apr_pool_t *child;
+    int rv;
+#if APR_HAS_THREADS
+    pool_walk_held_t lock;
+    const pool_walk_held_t *h;
+#endif
+
+    rv = fn(pool, data);
+    if (rv)
+        return rv;
+
+#if APR_HAS_THREADS
+    lock.mutex = pool->allocator->mutex;
+    for (h = held; h && lock.mutex; h = h->up) {
+        if (h->mutex == lock.mutex)
+            lock.mutex = NULL;
+    }
+    if (lock.mutex) {
+        apr_thread_mutex_lock(lock.mutex);
+        lock.up = held;
+        held = &lock;
+    }
+#endif /* APR_HAS_THREADS */
+
+    child = pool->child;
+    while (child) {
+        rv = pool_walk_tree(child, fn, data, held);
+        if (rv)
+            break;
+
+        child = child->sibling;
+    }
+
+#if APR_HAS_THREADS
+    if (lock.mutex)
+        apr_thread_mutex_unlock(lock.mutex);
+#endif /* APR_HAS_THREADS */
+
+    return rv;
+}
+
+static int apr_pool_walk_tree(apr_pool_t *pool,
+                              int (*fn)(apr_pool_t *pool, void *data),
+                              void *data)
+{
+    return pool_walk_tree(pool, fn, data, NULL);
+}
+
+static int pool_stats(apr_pool_t *pool, void *data)
+{
+    apr_pool_stats_t *stats = data;
+
+    stats->pools++;
+    stats->requested += pool->stat_requested;
+    stats->reserved += pool->stat_reserved;
+    stats->nodes += pool->stat_nodes;
+    stats->wasted += pool->stat_wasted;
+    stats->peak += pool->stat_peak;
+
+    return 0;
+}
+
+
 #else /* APR_POOL_DEBUG */
 /*
  * Debug helper functions
@@ -1466,7 +4114,9 @@ static APR_INLINE
 void pool_lock(apr_pool_t *pool)
 {
 #if APR_HAS_THREADS
-    apr_thread_mutex_lock(pool->mutex);
+    /* No mutex while apr_pool_clear_debug() recreates it from the pool */
+    if (pool->mutex)
+        apr_thread_mutex_lock(pool->mutex);
 #endif /* APR_HAS_THREADS */
 }
 
@@ -1474,7 +4124,8 @@ static APR_INLINE
 void pool_unlock(apr_pool_t *pool)
 {
 #if APR_HAS_THREADS
-    apr_thread_mutex_unlock(pool->mutex);
+    if (pool->mutex)
+        apr_thread_mutex_unlock(pool->mutex);
 #endif /* APR_HAS_THREADS */
 }
 
@@ -1635,7 +4286,8 @@ static void apr_pool_check_owner(apr_pool_t *pool)
 {
 #if (APR_POOL_DEBUG & APR_POOL_DEBUG_OWNER)
 #if APR_HAS_THREADS
-    if (!apr_os_thread_equal(pool->owner, apr_os_thread_current())) {
+    if (!(pool->creation_flags & APR_POOL_CONCURRENT)
+        && !apr_os_thread_equal(pool->owner, apr_os_thread_current())) {
 #if (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALL)
         apr_pool_log_event(pool, "THREAD",
                            __FILE__ ":apr_pool_integrity check [owner]", 0);
@@ -1696,6 +4348,12 @@ APR_DECLARE(apr_status_t) apr_pool_initialize(void)
         return rv;
     }
 
+#if APR_HAS_THREADS
+    if ((rv = tcache_initialize(global_pool)) != APR_SUCCESS) {
+        return rv;
+    }
+#endif /* APR_HAS_THREADS */
+
 #if (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALL)
     rv = apr_env_get(&logpath, "APR_POOL_DEBUG_LOG", global_pool);
 
@@ -1770,9 +4428,14 @@ static void *pool_alloc(apr_pool_t *pool, apr_size_t size)
         return NULL;
     }
 
+    if (pool->creation_flags & APR_POOL_CONCURRENT)
+        pool_lock(pool);
+
     node = pool->nodes;
     if (node == NULL || node->index == 64) {
         if ((node = malloc(SIZEOF_DEBUG_NODE_T)) == NULL) {
+            if (pool->creation_flags & APR_POOL_CONCURRENT)
+                pool_unlock(pool);
             free(mem);
             if (pool->abort_fn)
                 pool->abort_fn(APR_ENOMEM);
@@ -1794,37 +4457,88 @@ static void *pool_alloc(apr_pool_t *pool, apr_size_t size)
     pool->stat_alloc++;
     pool->stat_total_alloc++;
 
+    if (pool->creation_flags & APR_POOL_CONCURRENT)
+        pool_unlock(pool);
+
+    return mem;
+}
+
+APR_DECLARE(void *) apr_palloc_debug(apr_pool_t *pool, apr_size_t size,
+                                     const char *file_line)
+{
+    void *mem;
+
+    apr_pool_check_integrity(pool);
+
+    mem = pool_alloc(pool, size);
+
+#if (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALLOC)
+    apr_pool_log_event(pool, "PALLOC", file_line, 1);
+#endif /* (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALLOC) */
+
+    return mem;
+}
+
+APR_DECLARE(void *) apr_pcalloc_debug(apr_pool_t *pool, apr_size_t size,
+                                      const char *file_line)
+{
+    void *mem;
+
+    apr_pool_check_integrity(pool);
+
+    mem = pool_alloc(pool, size);
+    memset(mem, 0, size);
+
+#if (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALLOC)
+    apr_pool_log_event(pool, "PCALLOC", file_line, 1);
+#endif /* (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALLOC) */
+
     return mem;
 }
 
-APR_DECLARE(void *) apr_palloc_debug(apr_pool_t *pool, apr_size_t size,
-                                     const char *file_line)
+
+APR_DECLARE(void *) apr_prealloc(apr_pool_t *pool, void *mem,
+                                 apr_size_t old_size, apr_size_t new_size)
 {
-    void *mem;
+    void *new_mem;
+
+    if (mem != NULL && new_size <= old_size)
+        return mem;
 
+    /* Always move, to help highlight the use of stale pointers */
     apr_pool_check_integrity(pool);
 
-    mem = pool_alloc(pool, size);
+    if ((new_mem = pool_alloc(pool, new_size)) != NULL && mem != NULL)
+        memcpy(new_mem, mem, old_size);
 
 #if (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALLOC)
-    apr_pool_log_event(pool, "PALLOC", file_line, 1);
+    apr_pool_log_event(pool, "PREALLOC", __FILE__ ":apr_prealloc", 1);
 #endif /* (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALLOC) */
 
-    return mem;
+    return new_mem;
 }
 
-APR_DECLARE(void *) apr_pcalloc_debug(apr_pool_t *pool, apr_size_t size,
-                                      const char *file_line)
+APR_DECLARE(void *) apr_palloc_aligned(apr_pool_t *pool, apr_size_t size,
+                                       apr_size_t alignment)
 {
-    void *mem;
+    char *mem;
+
+    if (alignment == 0 || (alignment & (alignment - 1)))
+        return NULL;
 
     apr_pool_check_integrity(pool);
 
-    mem = pool_alloc(pool, size);
-    memset(mem, 0, size);
+    if (size > APR_SIZE_MAX - (alignment - 1)) {
+        if (pool->abort_fn)
+            pool->abort_fn(APR_ENOMEM);
+
+        return NULL;
+    }
+    if ((mem = pool_alloc(pool, size + alignment - 1)) != NULL)
+        mem = (char *)APR_ALIGN((apr_uintptr_t)mem, alignment);
 
 #if (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALLOC)
-    apr_pool_log_event(pool, "PCALLOC", file_line, 1);
+    apr_pool_log_event(pool, "PALIGNED", __FILE__ ":apr_palloc_aligned", 1);
 #endif /* (APR_POOL_DEBUG & APR_POOL_DEBUG_VERBOSE_ALLOC) */
 
     return mem;
@@ -1859,9 +4573,10 @@ static void pool_clear_debug(apr_pool_t *pool, const char *file_line)
         pool_destroy_debug(pool->child, file_line);
 
     /* Run cleanups */
-    run_cleanups(&pool->cleanups);
+    run_pool_cleanups(pool);
     pool->free_cleanups = NULL;
     pool->cleanups = NULL;
+    pool->cleanup_index = NULL;
 
     /* If new child pools showed up, this is a reason to raise a flag */
     if (pool->child)
@@ -1939,6 +4654,12 @@ APR_DECLARE(void) apr_pool_clear_debug(apr_pool_t *pool,
 #endif /* APR_HAS_THREADS */
 }
 
+APR_DECLARE(void) apr_pool_retain_set(apr_pool_t *pool, apr_size_t size)
+{
+    /* Nothing to retain, the allocations are malloc()ed one by one. */
+    apr_pool_check_integrity(pool);
+}
+
 static void pool_destroy_debug(apr_pool_t *pool, const char *file_line)
 {
     pool_clear_debug(pool, file_line);
@@ -1998,6 +4719,97 @@ APR_DECLARE(void) apr_pool_destroy_debug(apr_pool_t *pool,
 #endif /* APR_HAS_THREADS */
 }
 
+APR_DECLARE(apr_pool_mark_t *) apr_pool_mark(apr_pool_t *pool)
+{
+    apr_pool_mark_t *mark;
+
+    apr_pool_check_integrity(pool);
+
+    if (pool->creation_flags & APR_POOL_CONCURRENT)
+        return NULL;
+    if ((mark = pool_alloc(pool, sizeof(*mark))) == NULL)
+        return NULL;
+
+    mark->node = pool->nodes;
+    mark->index = pool->nodes->index;
+    mark->stat_alloc = pool->stat_alloc;
+    mark->cleanup_index = pool->cleanup_index;
+    mark->list_allocs = pool->list_allocs;
+
+    return mark;
+}
+
+/* Whether some memory of the pool was allocated since the mark, and is
+ * thus freed by apr_pool_rewind().
+ */
+static int pool_rewound(const apr_pool_t *pool, const apr_pool_mark_t *mark,
+                        const void *mem)
+{
+    const char *m = mem;
+    const debug_node_t *node;
+    apr_size_t index, i;
+
+    for (node = pool->nodes; node; node = node->next) {
+        index = (node == mark->node) ? mark->index : 0;
+        for (i = index; i < node->index; i++) {
+            if (m >= (const char *)node->beginp[i]
+                && m < (const char *)node->endp[i])
+                return 1;
+        }
+        if (node == mark->node)
+            break;
+    }
+
+    return 0;
+}
+
+APR_DECLARE(void) apr_pool_rewind(apr_pool_t *pool, apr_pool_mark_t *mark)
+{
+    debug_node_t *node;
+    apr_size_t index;
+
+    apr_pool_check_integrity(pool);
+
+    if (pool->cleanup_index != mark->cleanup_index)
+        pool->cleanup_index = NULL;
+    pool_rewind_lists(pool, mark);
+
+    /* Free the blocks allocated since the mark, scribbling over them
+     * first to help highlight use-after-rewind issues. */
+    while ((node = pool->nodes) != NULL) {
+        index = (node == mark->node) ? mark->index : 0;
+        while (node->index > index) {
+            node->index--;
+            memset(node->beginp[node->index], POOL_POISON_BYTE,
+                   (char *)node->endp[node->index]
+                   - (char *)node->beginp[node->index]);
+            free(node->beginp[node->index]);
+        }
+        if (node == mark->node)
+            break;
+
+        pool->nodes = node->next;
+        memset(node, POOL_POISON_BYTE, SIZEOF_DEBUG_NODE_T);
+        free(node);
+    }
+
+    pool->stat_alloc = mark->stat_alloc;
+}
+
+APR_DECLARE(apr_status_t) apr_pool_trace_start(apr_size_t entries)
+{
+    return APR_ENOTIMPL;
+}
+
+APR_DECLARE(void) apr_pool_trace_stop(void)
+{
+}
+
+APR_DECLARE(apr_status_t) apr_pool_trace_dump(apr_file_t *file)
+{
+    return APR_ENOTIMPL;
+}
+
 APR_DECLARE(apr_status_t) apr_pool_create_ex_debug(apr_pool_t **newpool,
                                                    apr_pool_t *parent,
                                                    apr_abortfunc_t abort_fn,
@@ -2029,6 +4841,7 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex_debug(apr_pool_t **newpool,
     }
 
     memset(pool, 0, SIZEOF_POOL_T);
+    pool->slow = 1;
 
     pool->allocator = allocator;
     pool->abort_fn = abort_fn;
@@ -2090,6 +4903,25 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex_debug(apr_pool_t **newpool,
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_pool_create_flags(apr_pool_t **newpool,
+                                                apr_pool_t *parent,
+                                                apr_abortfunc_t abort_fn,
+                                                apr_allocator_t *allocator,
+                                                apr_uint32_t flags)
+{
+    apr_status_t rv;
+
+    /* Every allocation is malloc()ed anyway, but those of concurrent
+     * pools under the pool's mutex.
+     */
+    rv = apr_pool_create_ex_debug(newpool, parent, abort_fn, allocator,
+                                  __FILE__ ":apr_pool_create_flags");
+    if (rv == APR_SUCCESS)
+        (*newpool)->creation_flags = flags & APR_POOL_CONCURRENT;
+
+    return rv;
+}
+
 APR_DECLARE(apr_status_t) apr_pool_create_core_ex_debug(apr_pool_t **newpool,
                                                    apr_abortfunc_t abort_fn,
                                                    apr_allocator_t *allocator,
@@ -2117,6 +4949,7 @@ APR_DECLARE(apr_status_t) apr_pool_create_unmanaged_ex_debug(apr_pool_t **newpoo
     }
 
     memset(pool, 0, SIZEOF_POOL_T);
+    pool->slow = 1;
 
     pool->abort_fn = abort_fn;
     pool->tag = file_line;
@@ -2219,12 +5052,17 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
 
     *ps.vbuff.curpos++ = '\0';
 
+    if (pool->creation_flags & APR_POOL_CONCURRENT)
+        pool_lock(pool);
+
     /*
      * Link the node in
      */
     node = pool->nodes;
     if (node == NULL || node->index == 64) {
         if ((node = malloc(SIZEOF_DEBUG_NODE_T)) == NULL) {
+            if (pool->creation_flags & APR_POOL_CONCURRENT)
+                pool_unlock(pool);
             if (pool->abort_fn)
                 pool->abort_fn(APR_ENOMEM);
 
@@ -2240,6 +5078,9 @@ APR_DECLARE(char *) apr_pvsprintf(apr_pool_t *pool, const char *fmt, va_list ap)
     node->endp[node->index] = ps.mem + ps.size;
     node->index++;
 
+    if (pool->creation_flags & APR_POOL_CONCURRENT)
+        pool_unlock(pool);
+
     return ps.mem;
 }
 
@@ -2325,6 +5166,23 @@ APR_DECLARE(apr_size_t) apr_pool_num_bytes(apr_pool_t *pool, int recurse)
     return size;
 }
 
+static int pool_stats(apr_pool_t *pool, void *data)
+{
+    apr_pool_stats_t *stats = data;
+    debug_node_t *node;
+    apr_size_t size = 0;
+
+    pool_num_bytes(pool, &size);
+    stats->pools++;
+    stats->requested += size;
+    stats->reserved += size;
+    for (node = pool->nodes; node; node = node->next) {
+        stats->nodes += node->index;
+    }
+
+    return 0;
+}
+
 APR_DECLARE(void) apr_pool_lock(apr_pool_t *pool, int flag)
 {
 }
@@ -2351,6 +5209,60 @@ void netware_pool_proc_cleanup ()
 #endif /* defined(NETWARE) */
 
 
+/*
+ * Aligned allocation (common)
+ */
+
+APR_DECLARE(void *) apr_pcalloc_aligned(apr_pool_t *pool, apr_size_t size,
+                                        apr_size_t alignment)
+{
+    void *mem;
+
+    if ((mem = apr_palloc_aligned(pool, size, alignment)) != NULL) {
+        memset(mem, 0, size);
+    }
+
+    return mem;
+}
+
+static apr_size_t pool_cacheline_size(void)
+{
+    static apr_size_t cacheline_size = 0;
+
+    /* Racy but idempotent */
+    if (!cacheline_size) {
+        apr_size_t size = APR_CACHELINE_SIZE;
+#if APR_HAVE_UNISTD_H && defined(_SC_LEVEL1_DCACHE_LINESIZE)
+        long n = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+
+        if (n > APR_CACHELINE_SIZE && !(n & (n - 1)))
+            size = (apr_size_t)n;
+#endif
+        cacheline_size = size;
+    }
+
+    return cacheline_size;
+}
+
+APR_DECLARE(void *) apr_palloc_isolated(apr_pool_t *pool, apr_size_t size)
+{
+    apr_size_t line = pool_cacheline_size();
+    apr_size_t lines_size = APR_ALIGN(size, line);
+
+    if (lines_size < size || lines_size == 0) {
+        if (size) {
+            if (pool->abort_fn)
+                pool->abort_fn(APR_ENOMEM);
+
+            return NULL;
+        }
+        lines_size = line;
+    }
+
+    return apr_palloc_aligned(pool, lines_size, line);
+}
+
+
 /*
  * "Print" functions (common)
  */
@@ -2429,6 +5341,68 @@ APR_DECLARE(void) apr_pool_tag(apr_pool_t *pool, const char *tag)
     pool->tag = tag;
 }
 
+APR_DECLARE(void) apr_pool_stats_get(apr_pool_t *pool,
+                                     apr_pool_stats_t *stats,
+                                     int recurse)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    if (!recurse)
+        pool_stats(pool, stats);
+    else
+        apr_pool_walk_tree(pool, pool_stats, stats);
+}
+
+static int pool_stats_tag(apr_pool_t *pool, void *data)
+{
+    apr_hash_t *hash = data;
+    const char *tag = pool->tag ? pool->tag : "";
+    apr_pool_stats_t *stats;
+
+    stats = apr_hash_get(hash, tag, APR_HASH_KEY_STRING);
+    if (stats == NULL) {
+        stats = apr_pcalloc(apr_hash_pool_get(hash), sizeof(*stats));
+        apr_hash_set(hash, tag, APR_HASH_KEY_STRING, stats);
+    }
+
+    return pool_stats(pool, stats);
+}
+
+APR_DECLARE(apr_hash_t *) apr_pool_stats_by_tag(apr_pool_t *pool,
+                                                apr_pool_t *p)
+{
+    apr_pool_t *tmp;
+    apr_hash_t *hash, *stats;
+    apr_hash_index_t *hi;
+    apr_status_t rv;
+
+    /* Aggregate in a private pool (and allocator), since allocating from
+     * p might need one of the mutexes held during the walk.
+     */
+    if ((rv = apr_pool_create_unmanaged_ex(&tmp, NULL, NULL)) != APR_SUCCESS) {
+        if (p->abort_fn)
+            p->abort_fn(rv);
+
+        return NULL;
+    }
+
+    hash = apr_hash_make(tmp);
+    apr_pool_walk_tree(pool, pool_stats_tag, hash);
+
+    stats = apr_hash_make(p);
+    for (hi = apr_hash_first(tmp, hash); hi; hi = apr_hash_next(hi)) {
+        const char *tag = apr_hash_this_key(hi);
+
+        apr_hash_set(stats, apr_pstrdup(p, tag), APR_HASH_KEY_STRING,
+                     apr_pmemdup(p, apr_hash_this_val(hi),
+                                 sizeof(apr_pool_stats_t)));
+    }
+
+    apr_pool_destroy(tmp);
+
+    return stats;
+}
+
 
 /*
  * User data management
@@ -2506,8 +5480,175 @@ struct cleanup_t {
     const void *data;
     apr_status_t (*plain_cleanup_fn)(void *data);
     apr_status_t (*child_cleanup_fn)(void *data);
+    /* For the pool's cleanups list only: the pointer referencing this
+     * cleanup, and the next one in the same bucket of the index.
+     */
+    struct cleanup_t **ref;
+    struct cleanup_t *hnext;
 };
 
+/* The cleanups of a pool are indexed by data and plain_cleanup_fn once
+ * there are more than CLEANUP_INDEX_MIN of them (and until the pool is
+ * cleared), so that killing one is O(1) rather than a walk of the (LIFO)
+ * list.  The index has at least
+ * half as many buckets as cleanups, each bucket holding the cleanups in
+ * the same order as the list.
+ */
+#define CLEANUP_INDEX_MIN 32
+
+#define cleanup_bucket(p, data, fn) \
+    (&(p)->cleanup_index[cleanup_hash(data, fn) & (p)->cleanup_mask])
+
+static APR_INLINE apr_uint32_t cleanup_hash(const void *data,
+                                            apr_status_t (*fn)(void *))
+{
+    apr_uintptr_t h = (apr_uintptr_t)data ^ ((apr_uintptr_t)fn >> 4);
+
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+
+    return (apr_uint32_t)h;
+}
+
+static void cleanup_index_build(apr_pool_t *p, apr_uint32_t size)
+{
+    cleanup_t *c, **bucket;
+
+    /* Like the cleanups, the index is allocated from the pool (any
+     * previous one is simply left unused).
+     */
+    p->cleanup_index = apr_pcalloc(p, size * sizeof(cleanup_t *));
+    if (p->cleanup_index == NULL)
+        return;
+
+    p->cleanup_mask = size - 1;
+    for (c = p->cleanups; c; c = c->next) {
+        bucket = cleanup_bucket(p, c->data, c->plain_cleanup_fn);
+        while (*bucket)
+            bucket = &(*bucket)->hnext;
+        c->hnext = NULL;
+        *bucket = c;
+    }
+}
+
+static void cleanup_insert(apr_pool_t *p, cleanup_t *c)
+{
+    cleanup_t **bucket;
+
+    c->next = p->cleanups;
+    c->ref = &p->cleanups;
+    if (c->next)
+        c->next->ref = &c->next;
+    p->cleanups = c;
+
+    p->ncleanups++;
+    if (p->cleanup_index == NULL) {
+        if (p->ncleanups > CLEANUP_INDEX_MIN)
+            cleanup_index_build(p, CLEANUP_INDEX_MIN * 2);
+    }
+    else if (p->ncleanups > (p->cleanup_mask + 1) * 2) {
+        cleanup_index_build(p, (p->cleanup_mask + 1) * 4);
+    }
+    else {
+        /* Most recent first, as in the list */
+        bucket = cleanup_bucket(p, c->data, c->plain_cleanup_fn);
+        c->hnext = *bucket;
+        *bucket = c;
+    }
+}
+
+static void cleanup_remove(apr_pool_t *p, cleanup_t *c)
+{
+    cleanup_t **bucket;
+
+    *c->ref = c->next;
+    if (c->next)
+        c->next->ref = c->ref;
+    p->ncleanups--;
+
+    if (p->cleanup_index) {
+        bucket = cleanup_bucket(p, c->data, c->plain_cleanup_fn);
+        while (*bucket != c)
+            bucket = &(*bucket)->hnext;
+        *bucket = c->hnext;
+    }
+}
+
+static cleanup_t *cleanup_find(apr_pool_t *p, const void *data,
+                               apr_status_t (*cleanup_fn)(void *))
+{
+    cleanup_t *c;
+
+    if (p->cleanup_index) {
+        c = *cleanup_bucket(p, data, cleanup_fn);
+        while (c && (c->data != data || c->plain_cleanup_fn != cleanup_fn))
+            c = c->hnext;
+
+        return c;
+    }
+
+    for (c = p->cleanups; c; c = c->next) {
+#if APR_POOL_DEBUG
+        /* Some cheap loop detection to catch a corrupt list: */
+        if (c == c->next
+            || (c->next && c == c->next->next)
+            || (c->next && c->next->next && c == c->next->next->next)) {
+            abort();
+        }
+#endif
+
+        if (c->data == data && c->plain_cleanup_fn == cleanup_fn)
+            break;
+    }
+
+    return c;
+}
+
+/* Forget the cleanups and subprocesses whose records are about to be
+ * given back by apr_pool_rewind(), like the user data table if it was
+ * created since the mark.  Otherwise the next registration could reuse
+ * a (killed) cleanup record which is now part of another allocation.
+ */
+static void pool_rewind_lists(apr_pool_t *pool, const apr_pool_mark_t *mark)
+{
+    cleanup_t *c, *next, **lastp;
+    struct process_chain *pc, **lastpc;
+
+    if (pool->user_data && pool_rewound(pool, mark, pool->user_data))
+        pool->user_data = NULL;
+
+    /* Nothing to forget if no record was allocated since the mark */
+    if (pool->list_allocs == mark->list_allocs)
+        return;
+
+    for (c = pool->cleanups; c; c = next) {
+        next = c->next;
+        if (pool_rewound(pool, mark, c))
+            cleanup_remove(pool, c);
+    }
+    for (lastp = &pool->pre_cleanups; (c = *lastp) != NULL; ) {
+        if (pool_rewound(pool, mark, c))
+            *lastp = c->next;
+        else
+            lastp = &c->next;
+    }
+    for (lastp = &pool->free_cleanups; (c = *lastp) != NULL; ) {
+        if (pool_rewound(pool, mark, c))
+            *lastp = c->next;
+        else
+            lastp = &c->next;
+    }
+    for (lastpc = &pool->subprocesses; (pc = *lastpc) != NULL; ) {
+        if (pool_rewound(pool, mark, pc))
+            *lastpc = pc->next;
+        else
+            lastpc = &pc->next;
+    }
+
+    pool->list_allocs = mark->list_allocs;
+}
+
 APR_DECLARE(void) apr_pool_cleanup_register(apr_pool_t *p, const void *data,
                       apr_status_t (*plain_cleanup_fn)(void *data),
                       apr_status_t (*child_cleanup_fn)(void *data))
@@ -2525,12 +5666,12 @@ APR_DECLARE(void) apr_pool_cleanup_register(apr_pool_t *p, const void *data,
             p->free_cleanups = c->next;
         } else {
             c = apr_palloc(p, sizeof(cleanup_t));
+            p->list_allocs++;
         }
         c->data = data;
         c->plain_cleanup_fn = plain_cleanup_fn;
         c->child_cleanup_fn = child_cleanup_fn;
-        c->next = p->cleanups;
-        p->cleanups = c;
+        cleanup_insert(p, c);
     }
 
 #if APR_POOL_DEBUG
@@ -2556,6 +5697,7 @@ APR_DECLARE(void) apr_pool_pre_cleanup_register(apr_pool_t *p, const void *data,
             p->free_cleanups = c->next;
         } else {
             c = apr_palloc(p, sizeof(cleanup_t));
+            p->list_allocs++;
         }
         c->data = data;
         c->plain_cleanup_fn = plain_cleanup_fn;
@@ -2582,28 +5724,12 @@ APR_DECLARE(void) apr_pool_cleanup_kill(apr_pool_t *p, const void *data,
     if (p == NULL)
         return;
 
-    c = p->cleanups;
-    lastp = &p->cleanups;
-    while (c) {
-#if APR_POOL_DEBUG
-        /* Some cheap loop detection to catch a corrupt list: */
-        if (c == c->next
-            || (c->next && c == c->next->next)
-            || (c->next && c->next->next && c == c->next->next->next)) {
-            abort();
-        }
-#endif
-
-        if (c->data == data && c->plain_cleanup_fn == cleanup_fn) {
-            *lastp = c->next;
-            /* move to freelist */
-            c->next = p->free_cleanups;
-            p->free_cleanups = c;
-            break;
-        }
-
-        lastp = &c->next;
-        c = c->next;
+    c = cleanup_find(p, data, cleanup_fn);
+    if (c) {
+        cleanup_remove(p, c);
+        /* move to freelist */
+        c->next = p->free_cleanups;
+        p->free_cleanups = c;
     }
 
     /* Remove any pre-cleanup as well */
@@ -2646,15 +5772,9 @@ APR_DECLARE(void) apr_pool_child_cleanup_set(apr_pool_t *p, const void *data,
     if (p == NULL)
         return;
 
-    c = p->cleanups;
-    while (c) {
-        if (c->data == data && c->plain_cleanup_fn == plain_cleanup_fn) {
-            c->child_cleanup_fn = child_cleanup_fn;
-            break;
-        }
-
-        c = c->next;
-    }
+    c = cleanup_find(p, data, plain_cleanup_fn);
+    if (c)
+        c->child_cleanup_fn = child_cleanup_fn;
 }
 
 APR_DECLARE(apr_status_t) apr_pool_cleanup_run(apr_pool_t *p, void *data,
@@ -2675,22 +5795,32 @@ static void run_cleanups(cleanup_t **cref)
     }
 }
 
+/* Like run_cleanups() for the pool's (indexed) cleanups list */
+static void run_pool_cleanups(apr_pool_t *p)
+{
+    cleanup_t *c;
+
+    while ((c = p->cleanups) != NULL) {
+        cleanup_remove(p, c);
+        (*c->plain_cleanup_fn)((void *)c->data);
+    }
+}
+
 #if !defined(WIN32) && !defined(OS2)
 
-static void run_child_cleanups(cleanup_t **cref)
+static void run_child_cleanups(apr_pool_t *p)
 {
-    cleanup_t *c = *cref;
+    cleanup_t *c;
 
-    while (c) {
-        *cref = c->next;
+    while ((c = p->cleanups) != NULL) {
+        cleanup_remove(p, c);
         (*c->child_cleanup_fn)((void *)c->data);
-        c = *cref;
     }
 }
 
 static void cleanup_pool_for_exec(apr_pool_t *p)
 {
-    run_child_cleanups(&p->cleanups);
+    run_child_cleanups(p);
 
     for (p = p->child; p; p = p->sibling)
         cleanup_pool_for_exec(p);
@@ -2738,6 +5868,7 @@ APR_DECLARE(void) apr_pool_note_subprocess(apr_pool_t *pool, apr_proc_t *proc,
 {
     struct process_chain *pc = apr_palloc(pool, sizeof(struct process_chain));
 
+    pool->list_allocs++;
     pc->proc = proc;
     pc->kill_how = how;
     pc->next = pool->subprocesses;
@@ -0,0 +1,193 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_private.h"
+
+#include "apr_general.h"
+#include "apr_slab.h"
+#include "apr_thread_mutex.h"
+
+#define APR_WANT_MEMFUNC
+#include "apr_want.h"
+
+/* The default size of a slab, so that it fits a MIN_ALLOC pool node */
+#define SLAB_DEFAULT_BYTES 8000
+
+/* The free objects are linked through their first bytes */
+typedef struct slab_obj_t slab_obj_t;
+
+struct slab_obj_t {
+    slab_obj_t *next;
+};
+
+struct apr_slab_t {
+    apr_pool_t         *pool;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+#endif
+    apr_size_t          size;
+    apr_size_t          per_slab;
+    /* The free objects, reused first */
+    slab_obj_t         *free;
+    /* The rest of the last slab, carved out on demand */
+    char               *first_avail;
+    char               *endp;
+    /* Statistics, @see apr_slab_stats_get() */
+    apr_size_t          slabs;
+    apr_size_t          used;
+    apr_size_t          peak;
+    apr_size_t          nfree;
+    apr_size_t          allocs;
+};
+
+#if APR_HAS_THREADS
+#define slab_lock(slab_) do {                               \
+    if ((slab_)->mutex)                                     \
+        apr_thread_mutex_lock((slab_)->mutex);              \
+} while (0)
+
+#define slab_unlock(slab_) do {                             \
+    if ((slab_)->mutex)                                     \
+        apr_thread_mutex_unlock((slab_)->mutex);            \
+} while (0)
+#else
+#define slab_lock(slab_)
+#define slab_unlock(slab_)
+#endif /* APR_HAS_THREADS */
+
+APR_DECLARE(apr_status_t) apr_slab_create(apr_slab_t **slab,
+                                          apr_size_t size,
+                                          apr_size_t per_slab,
+                                          apr_uint32_t flags,
+                                          apr_pool_t *p)
+{
+    apr_slab_t *new_slab;
+
+    *slab = NULL;
+
+    if (size < sizeof(slab_obj_t))
+        size = sizeof(slab_obj_t);
+    size = APR_ALIGN_DEFAULT(size);
+    if (size < sizeof(slab_obj_t))
+        return APR_EINVAL;
+    if (!per_slab) {
+        per_slab = SLAB_DEFAULT_BYTES / size;
+        if (!per_slab)
+            per_slab = 1;
+    }
+    else if (per_slab > APR_SIZE_MAX / size) {
+        return APR_EINVAL;
+    }
+
+    new_slab = apr_pcalloc(p, sizeof(*new_slab));
+    new_slab->pool = p;
+    new_slab->size = size;
+    new_slab->per_slab = per_slab;
+
+    if (flags & APR_SLAB_THREADSAFE) {
+#if APR_HAS_THREADS
+        apr_status_t rv;
+
+        rv = apr_thread_mutex_create(&new_slab->mutex,
+                                     APR_THREAD_MUTEX_DEFAULT, p);
+        if (rv != APR_SUCCESS)
+            return rv;
+#else
+        return APR_ENOTIMPL;
+#endif
+    }
+
+    *slab = new_slab;
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(void *) apr_slab_alloc(apr_slab_t *slab)
+{
+    void *obj;
+
+    slab_lock(slab);
+
+    if (slab->free) {
+        obj = slab->free;
+        slab->free = slab->free->next;
+        slab->nfree--;
+    }
+    else {
+        if (slab->first_avail == slab->endp) {
+            apr_size_t len = slab->size * slab->per_slab;
+
+            if ((slab->first_avail = apr_palloc(slab->pool, len)) == NULL) {
+                slab->endp = NULL;
+                slab_unlock(slab);
+                return NULL;
+            }
+            slab->endp = slab->first_avail + len;
+            slab->slabs++;
+        }
+        obj = slab->first_avail;
+        slab->first_avail += slab->size;
+    }
+
+    slab->allocs++;
+    if (++slab->used > slab->peak)
+        slab->peak = slab->used;
+
+    slab_unlock(slab);
+
+    return obj;
+}
+
+APR_DECLARE(void *) apr_slab_calloc(apr_slab_t *slab)
+{
+    void *obj;
+
+    if ((obj = apr_slab_alloc(slab)) != NULL)
+        memset(obj, 0, slab->size);
+
+    return obj;
+}
+
+APR_DECLARE(void) apr_slab_free(apr_slab_t *slab, void *obj)
+{
+    slab_obj_t *node = obj;
+
+    slab_lock(slab);
+
+    node->next = slab->free;
+    slab->free = node;
+    slab->nfree++;
+    slab->used--;
+
+    slab_unlock(slab);
+}
+
+APR_DECLARE(void) apr_slab_stats_get(apr_slab_t *slab,
+                                     apr_slab_stats_t *stats)
+{
+    slab_lock(slab);
+
+    stats->size = slab->size;
+    stats->per_slab = slab->per_slab;
+    stats->slabs = slab->slabs;
+    stats->used = slab->used;
+    stats->peak = slab->peak;
+    stats->free = slab->nfree;
+    stats->allocs = slab->allocs;
+
+    slab_unlock(slab);
+}
@@ -0,0 +1,658 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_time.h"
+
+#include "apr_flathash.h"
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FLATHASH_SSE2 1
+#else
+#define FLATHASH_SSE2 0
+#endif
+
+/*
+ * The internal form of a flat hash table.
+ *
+ * The entries (slots) are stored in a single array whose size is a power
+ * of two, along with an array of control bytes, one per slot, which is
+ * either CTRL_EMPTY, CTRL_DELETED or (for a slot in use) the 7 low bits
+ * of the hash of its key.  The slots are probed by aligned groups of
+ * GROUP_SIZE, the group of a key first, then the next ones in triangular
+ * order (which visits all the groups), comparing the control bytes of a
+ * whole group with the hash at once and the keys only when they match.
+ * The probing stops at the first group with an empty slot, so the table
+ * is never more than 7/8 full (including the deleted slots) and the
+ * deleted slots remain until the table is rehashed, unless their group
+ * has an empty slot already.
+ */
+
+#define GROUP_SIZE      16
+
+#define CTRL_EMPTY      ((signed char)-128)
+#define CTRL_DELETED    ((signed char)-2)
+
+#define CTRL_HASH(hash) ((signed char)((hash) & 0x7f))
+
+/* The maximum number of slots used (or deleted) for a capacity */
+#define MAX_USED(capacity) ((capacity) - (capacity) / 8)
+
+/* A bitmask of the slots of a group, as returned by the group_*() */
+typedef unsigned int group_mask_t;
+
+/* The key of a slot, unless stored inline */
+typedef struct flathash_key_t {
+    const void  *key;
+    apr_ssize_t  klen;
+} flathash_key_t;
+
+/*
+ * Data structure for iterating through a flat hash table.
+ */
+struct apr_flathash_index_t {
+    apr_flathash_t     *fh;
+    apr_size_t          this, next;
+};
+
+struct apr_flathash_t {
+    apr_pool_t           *pool;
+    signed char          *ctrl;
+    char                 *slots;
+    char                 *scratch;  /* A slot, for rehashing */
+    apr_size_t            mask;     /* The capacity - 1 */
+    apr_size_t            growth_left;
+    apr_size_t            deleted;
+    apr_size_t            ksize, vsize;
+    apr_size_t            voff, slot_size;
+    apr_flathash_index_t  iterator; /* For apr_flathash_first(NULL, ...) */
+    unsigned int          count, seed;
+    apr_hashfunc_t        hash_func;
+};
+
+#define SLOT(fh, i) ((fh)->slots + (i) * (fh)->slot_size)
+
+/* Not a slot */
+#define SLOT_NONE   ((apr_size_t)-1)
+
+
+/*
+ * Groups of control bytes.
+ */
+
+#if FLATHASH_SSE2
+
+static APR_INLINE group_mask_t group_match(const signed char *ctrl,
+                                           signed char c)
+{
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(c), group));
+}
+
+static APR_INLINE group_mask_t group_match_free(const signed char *ctrl)
+{
+    /* Empty and deleted slots are the only negative control bytes */
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+}
+
+#else /* !FLATHASH_SSE2 */
+
+static APR_INLINE group_mask_t group_match(const signed char *ctrl,
+                                           signed char c)
+{
+    group_mask_t mask = 0;
+    int i;
+
+    for (i = 0; i < GROUP_SIZE; i++) {
+        mask |= (group_mask_t)(ctrl[i] == c) << i;
+    }
+    return mask;
+}
+
+static APR_INLINE group_mask_t group_match_free(const signed char *ctrl)
+{
+    group_mask_t mask = 0;
+    int i;
+
+    for (i = 0; i < GROUP_SIZE; i++) {
+        mask |= (group_mask_t)(ctrl[i] < 0) << i;
+    }
+    return mask;
+}
+
+#endif /* !FLATHASH_SSE2 */
+
+/* The first slot of a (non-zero) group mask */
+#if defined(__GNUC__)
+#define group_first(mask) ((apr_size_t)__builtin_ctz(mask))
+#else
+static APR_INLINE apr_size_t group_first(group_mask_t mask)
+{
+    apr_size_t i = 0;
+
+    while (!(mask & 1)) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+}
+#endif
+
+
+/*
+ * Hashing, probing and comparing keys.
+ */
+
+static unsigned int flathash_hash(const apr_flathash_t *fh,
+                                  const void *key, apr_ssize_t *klen)
+{
+    unsigned int hash;
+
+    if (fh->hash_func) {
+        hash = fh->hash_func(key, klen);
+    }
+    else {
+        /* The `times 33' hash of apr_hash_t, @see hashfunc_default() */
+        const unsigned char *p = key;
+        apr_ssize_t i;
+
+        hash = fh->seed;
+        if (*klen == APR_HASH_KEY_STRING) {
+            for (; *p; p++) {
+                hash = hash * 33 + *p;
+            }
+            *klen = p - (const unsigned char *)key;
+        }
+        else {
+            for (i = *klen; i; i--, p++) {
+                hash = hash * 33 + *p;
+            }
+        }
+    }
+
+    /* Both the low bits (control byte) and the high bits (group) of the
+     * hash are used, so mix them all (MurmurHash3's finalizer).
+     */
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+static unsigned int flathash_slot_hash(const apr_flathash_t *fh,
+                                       const char *slot)
+{
+    apr_ssize_t klen;
+
+    if (fh->ksize) {
+        klen = fh->ksize;
+        return flathash_hash(fh, slot, &klen);
+    }
+    klen = ((const flathash_key_t *)slot)->klen;
+    return flathash_hash(fh, ((const flathash_key_t *)slot)->key, &klen);
+}
+
+static APR_INLINE int flathash_key_equal(const apr_flathash_t *fh,
+                                         const char *slot,
+                                         const void *key,
+                                         apr_ssize_t klen)
+{
+    const flathash_key_t *k;
+
+    if (fh->ksize) {
+        /* Let the compiler inline the usual integer keys */
+        switch (fh->ksize) {
+        case 4:
+            return memcmp(slot, key, 4) == 0;
+        case 8:
+            return memcmp(slot, key, 8) == 0;
+        default:
+            return memcmp(slot, key, fh->ksize) == 0;
+        }
+    }
+    k = (const flathash_key_t *)slot;
+    return k->klen == klen
+           && (k->key == key || memcmp(k->key, key, klen) == 0);
+}
+
+/* Find the slot of a key, or SLOT_NONE */
+static apr_size_t flathash_find(const apr_flathash_t *fh,
+                                const void *key, apr_ssize_t klen,
+                                unsigned int hash)
+{
+    apr_size_t gmask = fh->mask / GROUP_SIZE;
+    apr_size_t g = (hash >> 7) & gmask;
+    apr_size_t step = 0;
+
+    for (;;) {
+        const signed char *ctrl = fh->ctrl + g * GROUP_SIZE;
+        group_mask_t match = group_match(ctrl, CTRL_HASH(hash));
+
+        while (match) {
+            apr_size_t i = g * GROUP_SIZE + group_first(match);
+
+            if (flathash_key_equal(fh, SLOT(fh, i), key, klen)) {
+                return i;
+            }
+            match &= match - 1;
+        }
+        if (group_match(ctrl, CTRL_EMPTY)) {
+            return SLOT_NONE;
+        }
+        g = (g + ++step) & gmask;
+    }
+}
+
+/* Find the first empty or deleted slot for a hash */
+static apr_size_t flathash_find_free(const apr_flathash_t *fh,
+                                     unsigned int hash)
+{
+    apr_size_t gmask = fh->mask / GROUP_SIZE;
+    apr_size_t g = (hash >> 7) & gmask;
+    apr_size_t step = 0;
+
+    for (;;) {
+        group_mask_t match = group_match_free(fh->ctrl + g * GROUP_SIZE);
+
+        if (match) {
+            return g * GROUP_SIZE + group_first(match);
+        }
+        g = (g + ++step) & gmask;
+    }
+}
+
+
+/*
+ * Hash creation and rehashing functions.
+ */
+
+static void alloc_slots(apr_flathash_t *fh, apr_size_t capacity)
+{
+    char *mem;
+
+    mem = apr_palloc(fh->pool, capacity + (capacity + 1) * fh->slot_size);
+    fh->ctrl = (signed char *)mem;
+    fh->slots = mem + capacity;
+    fh->scratch = SLOT(fh, capacity);
+    fh->mask = capacity - 1;
+    memset(fh->ctrl, CTRL_EMPTY, capacity);
+    fh->growth_left = MAX_USED(capacity);
+    fh->deleted = 0;
+}
+
+/* The largest power of two dividing size, up to 8 */
+static apr_size_t flathash_align(apr_size_t size)
+{
+    apr_size_t align = size & (0 - size);
+
+    return align > 8 ? 8 : align;
+}
+
+APR_DECLARE(apr_flathash_t *) apr_flathash_make_ex(apr_pool_t *pool,
+                                                   apr_size_t nelts,
+                                                   apr_size_t ksize,
+                                                   apr_size_t vsize,
+                                                   apr_hashfunc_t hash_func)
+{
+    apr_flathash_t *fh;
+    apr_size_t kalign, valign, capacity;
+    apr_time_t now = apr_time_now();
+
+    fh = apr_palloc(pool, sizeof(apr_flathash_t));
+    fh->pool = pool;
+    fh->count = 0;
+    fh->seed = (unsigned int)((now >> 32) ^ now ^ (apr_uintptr_t)pool ^
+                              (apr_uintptr_t)fh ^ (apr_uintptr_t)&now) - 1;
+    fh->hash_func = hash_func;
+
+    /* Lay out the slots: the key, then the value, each aligned for its
+     * size (inline) or for pointers.
+     */
+    fh->ksize = ksize;
+    fh->vsize = vsize;
+    kalign = ksize ? flathash_align(ksize) : sizeof(void *);
+    valign = vsize ? flathash_align(vsize) : sizeof(void *);
+    fh->voff = APR_ALIGN(ksize ? ksize : sizeof(flathash_key_t), valign);
+    fh->slot_size = APR_ALIGN(fh->voff + (vsize ? vsize : sizeof(void *)),
+                              kalign > valign ? kalign : valign);
+
+    capacity = GROUP_SIZE;
+    while (MAX_USED(capacity) < nelts) {
+        capacity *= 2;
+    }
+    alloc_slots(fh, capacity);
+
+    return fh;
+}
+
+APR_DECLARE(apr_flathash_t *) apr_flathash_make(apr_pool_t *pool)
+{
+    return apr_flathash_make_ex(pool, 0, 0, 0, NULL);
+}
+
+APR_DECLARE(apr_flathash_t *) apr_flathash_copy(apr_pool_t *pool,
+                                                const apr_flathash_t *orig)
+{
+    apr_flathash_t *fh;
+    apr_size_t capacity = orig->mask + 1;
+
+    fh = apr_palloc(pool, sizeof(apr_flathash_t));
+    *fh = *orig;
+    fh->pool = pool;
+    alloc_slots(fh, capacity);
+    memcpy(fh->ctrl, orig->ctrl, capacity);
+    memcpy(fh->slots, orig->slots, capacity * fh->slot_size);
+    fh->growth_left = orig->growth_left;
+    fh->deleted = orig->deleted;
+
+    return fh;
+}
+
+/*
+ * Rehash the table in place, to reclaim the deleted slots: all the slots
+ * in use are marked deleted (to be moved), then each is moved to the
+ * first free slot for its hash, unless it is in the same group already,
+ * swapping it with a slot still to be moved if need be.
+ */
+static void flathash_drop_deleted(apr_flathash_t *fh)
+{
+    apr_size_t capacity = fh->mask + 1;
+    apr_size_t i, j;
+
+    for (i = 0; i < capacity; i++) {
+        fh->ctrl[i] = fh->ctrl[i] < 0 ? CTRL_EMPTY : CTRL_DELETED;
+    }
+    for (i = 0; i < capacity; ) {
+        unsigned int hash;
+
+        if (fh->ctrl[i] != CTRL_DELETED) {
+            i++;
+            continue;
+        }
+        hash = flathash_slot_hash(fh, SLOT(fh, i));
+        j = flathash_find_free(fh, hash);
+        if (i / GROUP_SIZE == j / GROUP_SIZE) {
+            fh->ctrl[i++] = CTRL_HASH(hash);
+        }
+        else if (fh->ctrl[j] == CTRL_EMPTY) {
+            memcpy(SLOT(fh, j), SLOT(fh, i), fh->slot_size);
+            fh->ctrl[j] = CTRL_HASH(hash);
+            fh->ctrl[i++] = CTRL_EMPTY;
+        }
+        else {
+            /* Slot j is still to be moved, do it next from slot i */
+            memcpy(fh->scratch, SLOT(fh, j), fh->slot_size);
+            memcpy(SLOT(fh, j), SLOT(fh, i), fh->slot_size);
+            memcpy(SLOT(fh, i), fh->scratch, fh->slot_size);
+            fh->ctrl[j] = CTRL_HASH(hash);
+        }
+    }
+    fh->growth_left = MAX_USED(capacity) - fh->count;
+    fh->deleted = 0;
+}
+
+static void flathash_resize(apr_flathash_t *fh, apr_size_t capacity)
+{
+    signed char *old_ctrl = fh->ctrl;
+    char *old_slots = fh->slots;
+    apr_size_t old_capacity = fh->mask + 1;
+    apr_size_t i, j;
+
+    alloc_slots(fh, capacity);
+    for (i = 0; i < old_capacity; i++) {
+        const char *slot = old_slots + i * fh->slot_size;
+        unsigned int hash;
+
+        if (old_ctrl[i] < 0) {
+            continue;
+        }
+        hash = flathash_slot_hash(fh, slot);
+        j = flathash_find_free(fh, hash);
+        fh->ctrl[j] = CTRL_HASH(hash);
+        memcpy(SLOT(fh, j), slot, fh->slot_size);
+    }
+    fh->growth_left -= fh->count;
+}
+
+/* Make room for one more slot, when the table is as full as it gets */
+static void flathash_grow(apr_flathash_t *fh)
+{
+    apr_size_t capacity = fh->mask + 1;
+
+    /* Reclaiming the deleted slots is enough if they make up for more
+     * than the few last slots (3/32 of the table), otherwise double.
+     */
+    if (fh->count <= capacity * 25 / 32) {
+        flathash_drop_deleted(fh);
+    }
+    else {
+        flathash_resize(fh, capacity * 2);
+    }
+}
+
+
+/*
+ * Hash iteration functions.
+ */
+
+APR_DECLARE(apr_flathash_index_t *) apr_flathash_next(
+                                                apr_flathash_index_t *hi)
+{
+    const apr_flathash_t *fh = hi->fh;
+
+    while (hi->next <= fh->mask) {
+        if (fh->ctrl[hi->next] >= 0) {
+            hi->this = hi->next++;
+            return hi;
+        }
+        hi->next++;
+    }
+    return NULL;
+}
+
+APR_DECLARE(apr_flathash_index_t *) apr_flathash_first(apr_pool_t *p,
+                                                       apr_flathash_t *fh)
+{
+    apr_flathash_index_t *hi;
+    if (p)
+        hi = apr_palloc(p, sizeof(*hi));
+    else
+        hi = &fh->iterator;
+
+    hi->fh = fh;
+    hi->this = SLOT_NONE;
+    hi->next = 0;
+    return apr_flathash_next(hi);
+}
+
+APR_DECLARE(void) apr_flathash_this(apr_flathash_index_t *hi,
+                                    const void **key,
+                                    apr_ssize_t *klen,
+                                    void **val)
+{
+    const apr_flathash_t *fh = hi->fh;
+    char *slot = SLOT(fh, hi->this);
+
+    if (fh->ksize) {
+        if (key)  *key  = slot;
+        if (klen) *klen = fh->ksize;
+    }
+    else {
+        if (key)  *key  = ((flathash_key_t *)slot)->key;
+        if (klen) *klen = ((flathash_key_t *)slot)->klen;
+    }
+    if (val) {
+        if (fh->vsize)
+            *val = slot + fh->voff;
+        else
+            *val = *(void **)(slot + fh->voff);
+    }
+}
+
+APR_DECLARE(const void *) apr_flathash_this_key(apr_flathash_index_t *hi)
+{
+    const void *key;
+
+    apr_flathash_this(hi, &key, NULL, NULL);
+    return key;
+}
+
+APR_DECLARE(apr_ssize_t) apr_flathash_this_key_len(apr_flathash_index_t *hi)
+{
+    apr_ssize_t klen;
+
+    apr_flathash_this(hi, NULL, &klen, NULL);
+    return klen;
+}
+
+APR_DECLARE(void *) apr_flathash_this_val(apr_flathash_index_t *hi)
+{
+    void *val;
+
+    apr_flathash_this(hi, NULL, NULL, &val);
+    return val;
+}
+
+
+/*
+ * Getting and setting entries.
+ */
+
+APR_DECLARE(void *) apr_flathash_get(const apr_flathash_t *fh,
+                                     const void *key,
+                                     apr_ssize_t klen)
+{
+    unsigned int hash;
+    apr_size_t i;
+    char *slot;
+
+    if (fh->ksize) {
+        klen = fh->ksize;
+    }
+    hash = flathash_hash(fh, key, &klen);
+    i = flathash_find(fh, key, klen, hash);
+    if (i == SLOT_NONE) {
+        return NULL;
+    }
+
+    slot = SLOT(fh, i);
+    if (fh->vsize) {
+        return slot + fh->voff;
+    }
+    return *(void **)(slot + fh->voff);
+}
+
+APR_DECLARE(void) apr_flathash_set(apr_flathash_t *fh,
+                                   const void *key,
+                                   apr_ssize_t klen,
+                                   const void *val)
+{
+    unsigned int hash;
+    apr_size_t i;
+    char *slot;
+
+    if (fh->ksize) {
+        klen = fh->ksize;
+    }
+    hash = flathash_hash(fh, key, &klen);
+    i = flathash_find(fh, key, klen, hash);
+    if (i != SLOT_NONE) {
+        if (!val) {
+            /* delete entry, as an empty slot if no probing can go past
+             * its group (which has an empty slot already)
+             */
+            if (group_match(fh->ctrl + (i & ~(apr_size_t)(GROUP_SIZE - 1)),
+                            CTRL_EMPTY)) {
+                fh->ctrl[i] = CTRL_EMPTY;
+                fh->growth_left++;
+            }
+            else {
+                fh->ctrl[i] = CTRL_DELETED;
+                fh->deleted++;
+            }
+            fh->count--;
+            return;
+        }
+    }
+    else {
+        if (!val) {
+            return;
+        }
+
+        /* add a new entry */
+        i = flathash_find_free(fh, hash);
+        if (fh->ctrl[i] == CTRL_DELETED) {
+            fh->deleted--;
+        }
+        else {
+            if (!fh->growth_left) {
+                flathash_grow(fh);
+                i = flathash_find_free(fh, hash);
+            }
+            fh->growth_left--;
+        }
+        fh->ctrl[i] = CTRL_HASH(hash);
+        fh->count++;
+
+        slot = SLOT(fh, i);
+        if (fh->ksize) {
+            memcpy(slot, key, fh->ksize);
+        }
+        else {
+            ((flathash_key_t *)slot)->key = key;
+            ((flathash_key_t *)slot)->klen = klen;
+        }
+    }
+
+    /* set the value */
+    slot = SLOT(fh, i);
+    if (fh->vsize) {
+        memcpy(slot + fh->voff, val, fh->vsize);
+    }
+    else {
+        *(const void **)(slot + fh->voff) = val;
+    }
+}
+
+APR_DECLARE(unsigned int) apr_flathash_count(const apr_flathash_t *fh)
+{
+    return fh->count;
+}
+
+APR_DECLARE(void) apr_flathash_clear(apr_flathash_t *fh)
+{
+    apr_size_t capacity = fh->mask + 1;
+
+    memset(fh->ctrl, CTRL_EMPTY, capacity);
+    fh->growth_left = MAX_USED(capacity);
+    fh->deleted = 0;
+    fh->count = 0;
+}
+
+APR_POOL_IMPLEMENT_ACCESSOR(flathash)
@@ -28,6 +28,8 @@
 #include "apr_tables.h"
 #include "apr_strings.h"
 #include "apr_lib.h"
+#include "apr_thread_proc.h"
+#include "apr_atomic.h"
 #if APR_HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
@@ -110,9 +112,10 @@ APR_DECLARE(void *) apr_array_push(apr_array_header_t *arr)
         int new_size = (arr->nalloc <= 0) ? 1 : arr->nalloc * 2;
         char *new_data;
 
-        new_data = apr_palloc(arr->pool, arr->elt_size * new_size);
+        new_data = apr_prealloc(arr->pool, arr->elts,
+                                arr->elt_size * arr->nalloc,
+                                arr->elt_size * new_size);
 
-        memcpy(new_data, arr->elts, arr->nalloc * arr->elt_size);
         memset(new_data + arr->nalloc * arr->elt_size, 0,
                arr->elt_size * (new_size - arr->nalloc));
         arr->elts = new_data;
@@ -129,9 +132,10 @@ static void *apr_array_push_noclear(apr_array_header_t *arr)
         int new_size = (arr->nalloc <= 0) ? 1 : arr->nalloc * 2;
         char *new_data;
 
-        new_data = apr_palloc(arr->pool, arr->elt_size * new_size);
+        new_data = apr_prealloc(arr->pool, arr->elts,
+                                arr->elt_size * arr->nalloc,
+                                arr->elt_size * new_size);
 
-        memcpy(new_data, arr->elts, arr->nalloc * arr->elt_size);
         arr->elts = new_data;
         arr->nalloc = new_size;
     }
@@ -140,6 +144,65 @@ static void *apr_array_push_noclear(apr_array_header_t *arr)
     return arr->elts + (arr->elt_size * (arr->nelts - 1));
 }
 
+/* Grow the elements of an array to new_size, zeroing the new ones */
+static void array_resize(apr_array_header_t *arr, int new_size)
+{
+    char *new_data;
+
+    new_data = apr_prealloc(arr->pool, arr->elts,
+                            arr->elt_size * arr->nalloc,
+                            arr->elt_size * new_size);
+    memset(new_data + arr->nalloc * arr->elt_size, 0,
+           arr->elt_size * (new_size - arr->nalloc));
+    arr->elts = new_data;
+    arr->nalloc = new_size;
+}
+
+APR_DECLARE(void) apr_array_reserve(apr_array_header_t *arr, int nelts)
+{
+    if (nelts > arr->nalloc) {
+        array_resize(arr, nelts);
+    }
+}
+
+APR_DECLARE(void *) apr_array_push_n(apr_array_header_t *arr, int nelts)
+{
+    if (arr->nelts + nelts > arr->nalloc) {
+        int new_size = (arr->nalloc <= 0) ? 1 : arr->nalloc * 2;
+
+        while (arr->nelts + nelts > new_size) {
+            new_size *= 2;
+        }
+        array_resize(arr, new_size);
+    }
+
+    arr->nelts += nelts;
+    return arr->elts + (arr->elt_size * (arr->nelts - nelts));
+}
+
+APR_DECLARE(void) apr_array_move(apr_array_header_t *dst,
+                                 apr_array_header_t *src)
+{
+    if (dst == src) {
+        return;
+    }
+
+    if (!apr_pool_is_ancestor(src->pool, dst->pool)) {
+        /* The elements would not live as long as dst */
+        dst->nelts = 0;
+        apr_array_cat(dst, src);
+        src->nelts = 0;
+        return;
+    }
+
+    dst->elts = src->elts;
+    dst->nelts = src->nelts;
+    dst->nalloc = src->nalloc;
+    src->elts = NULL;
+    src->nelts = 0;
+    src->nalloc = 0;
+}
+
 APR_DECLARE(void) apr_array_cat(apr_array_header_t *dst,
 			       const apr_array_header_t *src)
 {
@@ -153,8 +216,10 @@ APR_DECLARE(void) apr_array_cat(apr_array_header_t *dst,
 	    new_size *= 2;
 	}
 
-	new_data = apr_pcalloc(dst->pool, elt_size * new_size);
-	memcpy(new_data, dst->elts, dst->nalloc * elt_size);
+	new_data = apr_prealloc(dst->pool, dst->elts, elt_size * dst->nalloc,
+	                        elt_size * new_size);
+	memset(new_data + dst->nalloc * elt_size, 0,
+	       elt_size * (new_size - dst->nalloc));
 
 	dst->elts = new_data;
 	dst->nalloc = new_size;
@@ -186,6 +251,10 @@ APR_DECLARE(apr_array_header_t *) apr_array_copy(apr_pool_t *p,
  * overhead of the full copy only where it is really needed.
  */
 
+/* Note that the elements are not grown in place by apr_prealloc() on
+ * push, which would keep them shared, since the caller allocates the
+ * new header after them.
+ */
 static APR_INLINE void copy_array_hdr_core(apr_array_header_t *res,
 					   const apr_array_header_t *arr)
 {
@@ -282,6 +351,458 @@ APR_DECLARE(char *) apr_array_pstrcat(apr_pool_t *p,
 }
 
 
+/*****************************************************************
+ *
+ * Sorting arrays: an introsort (quicksort falling back to heapsort when
+ * the partitions degenerate, and insertion sort for the small ones), a
+ * parallel version merging runs sorted by multiple threads, and an LSD
+ * radix sort for the integer keys.
+ */
+
+/* Ranges of up to this many elements are sorted by insertion */
+#define SORT_INSERTION_MAX 16
+/* The least number of elements worth a thread */
+#define SORT_THREAD_MIN 65536
+/* The most threads sorting an array */
+#define SORT_THREAD_MAX 64
+
+static APR_INLINE void sort_swap(char *a, char *b, apr_size_t size)
+{
+    /* Fixed size memcpy()s compile to plain loads and stores */
+    if (size == sizeof(apr_uint64_t)) {
+        apr_uint64_t t;
+
+        memcpy(&t, a, sizeof(t));
+        memcpy(a, b, sizeof(t));
+        memcpy(b, &t, sizeof(t));
+    }
+    else if (size == sizeof(apr_uint32_t)) {
+        apr_uint32_t t;
+
+        memcpy(&t, a, sizeof(t));
+        memcpy(a, b, sizeof(t));
+        memcpy(b, &t, sizeof(t));
+    }
+    else {
+        char t;
+
+        do {
+            t = *a;
+            *a++ = *b;
+            *b++ = t;
+        } while (--size);
+    }
+}
+
+static APR_INLINE void sort_copy(char *dst, const char *src, apr_size_t size)
+{
+    if (size == sizeof(apr_uint64_t)) {
+        memcpy(dst, src, sizeof(apr_uint64_t));
+    }
+    else if (size == sizeof(apr_uint32_t)) {
+        memcpy(dst, src, sizeof(apr_uint32_t));
+    }
+    else {
+        memcpy(dst, src, size);
+    }
+}
+
+static void sort_insertion(char *base, apr_size_t n, apr_size_t size,
+                           apr_array_cmp_fn_t *cmp)
+{
+    char *end = base + n * size, *i, *j;
+
+    for (i = base + size; i < end; i += size) {
+        for (j = i; j > base && cmp(j - size, j) > 0; j -= size) {
+            sort_swap(j - size, j, size);
+        }
+    }
+}
+
+static void sort_heap(char *base, apr_size_t n, apr_size_t size,
+                      apr_array_cmp_fn_t *cmp)
+{
+    apr_size_t i, root, child;
+
+    for (i = n / 2; i-- > 0; ) {
+        for (root = i; (child = 2 * root + 1) < n; root = child) {
+            if (child + 1 < n
+                && cmp(base + child * size, base + (child + 1) * size) < 0) {
+                child++;
+            }
+            if (cmp(base + root * size, base + child * size) >= 0) {
+                break;
+            }
+            sort_swap(base + root * size, base + child * size, size);
+        }
+    }
+    while (--n > 0) {
+        sort_swap(base, base + n * size, size);
+        for (root = 0; (child = 2 * root + 1) < n; root = child) {
+            if (child + 1 < n
+                && cmp(base + child * size, base + (child + 1) * size) < 0) {
+                child++;
+            }
+            if (cmp(base + root * size, base + child * size) >= 0) {
+                break;
+            }
+            sort_swap(base + root * size, base + child * size, size);
+        }
+    }
+}
+
+static void sort_intro(char *base, apr_size_t n, apr_size_t size,
+                       apr_array_cmp_fn_t *cmp, int depth)
+{
+    char *lo, *hi, *mid, *pivot;
+    apr_size_t nlo;
+
+    while (n > SORT_INSERTION_MAX) {
+        if (depth-- <= 0) {
+            sort_heap(base, n, size, cmp);
+            return;
+        }
+
+        /* Median of three, the smallest and largest ones serving as
+         * sentinels for the partitioning.
+         */
+        mid = base + (n / 2) * size;
+        hi = base + (n - 1) * size;
+        if (cmp(mid, base) < 0) {
+            sort_swap(mid, base, size);
+        }
+        if (cmp(hi, mid) < 0) {
+            sort_swap(hi, mid, size);
+            if (cmp(mid, base) < 0) {
+                sort_swap(mid, base, size);
+            }
+        }
+        pivot = base + size;
+        sort_swap(mid, pivot, size);
+
+        lo = pivot;
+        for (;;) {
+            do {
+                lo += size;
+            } while (cmp(lo, pivot) < 0);
+            do {
+                hi -= size;
+            } while (cmp(pivot, hi) < 0);
+            if (lo >= hi) {
+                break;
+            }
+            sort_swap(lo, hi, size);
+        }
+        sort_swap(pivot, hi, size);
+
+        /* Recurse into the smaller partition, loop on the larger one */
+        nlo = (hi - base) / size;
+        if (nlo < n - nlo - 1) {
+            sort_intro(base, nlo, size, cmp, depth);
+            base = hi + size;
+            n -= nlo + 1;
+        }
+        else {
+            sort_intro(hi + size, n - nlo - 1, size, cmp, depth);
+            n = nlo;
+        }
+    }
+
+    sort_insertion(base, n, size, cmp);
+}
+
+static void sort_run(char *base, apr_size_t n, apr_size_t size,
+                     apr_array_cmp_fn_t *cmp)
+{
+    apr_size_t m;
+    int depth = 0;
+
+    for (m = n; m > 1; m >>= 1) {
+        depth += 2;
+    }
+    sort_intro(base, n, size, cmp, depth);
+}
+
+APR_DECLARE(void) apr_array_sort(apr_array_header_t *arr,
+                                 apr_array_cmp_fn_t *cmp)
+{
+    if (arr->nelts > 1) {
+        sort_run(arr->elts, arr->nelts, arr->elt_size, cmp);
+    }
+}
+
+/* Merge the sorted runs src[0, n1) and src[n1, n1 + n2) into dst */
+static void sort_merge(char *dst, const char *src, apr_size_t n1,
+                       apr_size_t n2, apr_size_t size,
+                       apr_array_cmp_fn_t *cmp)
+{
+    const char *a = src, *a_end = src + n1 * size;
+    const char *b = a_end, *b_end = b + n2 * size;
+
+    while (a < a_end && b < b_end) {
+        /* The first run goes first on ties, for stable merges */
+        if (cmp(b, a) < 0) {
+            sort_copy(dst, b, size);
+            b += size;
+        }
+        else {
+            sort_copy(dst, a, size);
+            a += size;
+        }
+        dst += size;
+    }
+    if (a < a_end) {
+        memcpy(dst, a, a_end - a);
+    }
+    else if (b < b_end) {
+        memcpy(dst, b, b_end - b);
+    }
+}
+
+typedef struct {
+    char *base;
+    const char *src;
+    apr_size_t n1;
+    apr_size_t n2;
+    apr_size_t size;
+    apr_array_cmp_fn_t *cmp;
+} sort_job_t;
+
+/* Sort base[0, n1), or merge src into base if n2 is not zero */
+static void sort_job(sort_job_t *job)
+{
+    if (job->n2) {
+        sort_merge(job->base, job->src, job->n1, job->n2, job->size,
+                   job->cmp);
+    }
+    else {
+        sort_run(job->base, job->n1, job->size, job->cmp);
+    }
+}
+
+#if APR_HAS_THREADS
+static void * APR_THREAD_FUNC sort_thread(apr_thread_t *thd, void *data)
+{
+    sort_job(data);
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+#endif
+
+/* Run the jobs, all but the first in their own thread (if possible) */
+static void sort_jobs(sort_job_t *jobs, int njobs, apr_pool_t *p)
+{
+#if APR_HAS_THREADS
+    apr_thread_t **threads = apr_pcalloc(p, njobs * sizeof(*threads));
+    apr_status_t rv;
+    int i;
+
+    for (i = 1; i < njobs; i++) {
+        if (apr_thread_create(&threads[i], NULL, sort_thread, &jobs[i],
+                              p) != APR_SUCCESS) {
+            threads[i] = NULL;
+            sort_job(&jobs[i]);
+        }
+    }
+    sort_job(&jobs[0]);
+    for (i = 1; i < njobs; i++) {
+        if (threads[i]) {
+            apr_thread_join(&rv, threads[i]);
+        }
+    }
+#else
+    int i;
+
+    for (i = 0; i < njobs; i++) {
+        sort_job(&jobs[i]);
+    }
+#endif
+}
+
+APR_DECLARE(apr_status_t) apr_array_sort_parallel(apr_array_header_t *arr,
+                                                  apr_array_cmp_fn_t *cmp,
+                                                  int nthreads)
+{
+    const apr_size_t n = arr->nelts, size = arr->elt_size;
+    apr_size_t *runs, chunk;
+    sort_job_t *jobs;
+    char *src, *dst, *swap;
+    apr_pool_t *p;
+    apr_status_t rv;
+    int i, nruns;
+
+#if !APR_HAS_THREADS
+    nthreads = 1;
+#endif
+    if (nthreads > SORT_THREAD_MAX) {
+        nthreads = SORT_THREAD_MAX;
+    }
+    if (nthreads > 1 && (apr_size_t)nthreads > n / SORT_THREAD_MIN) {
+        nthreads = (int)(n / SORT_THREAD_MIN);
+    }
+    if (nthreads <= 1) {
+        apr_array_sort(arr, cmp);
+        return APR_SUCCESS;
+    }
+
+    if ((rv = apr_pool_create(&p, arr->pool)) != APR_SUCCESS) {
+        return rv;
+    }
+    jobs = apr_palloc(p, nthreads * sizeof(*jobs));
+    runs = apr_palloc(p, (nthreads + 1) * sizeof(*runs));
+    src = arr->elts;
+    if ((dst = apr_palloc(p, n * size)) == NULL) {
+        apr_pool_destroy(p);
+        return APR_ENOMEM;
+    }
+
+    /* Sort a chunk per thread */
+    chunk = n / nthreads;
+    for (i = 0; i < nthreads; i++) {
+        runs[i] = i * chunk;
+        jobs[i].base = src + runs[i] * size;
+        jobs[i].n1 = (i < nthreads - 1 ? chunk : n - runs[i]);
+        jobs[i].n2 = 0;
+        jobs[i].size = size;
+        jobs[i].cmp = cmp;
+    }
+    runs[nthreads] = n;
+    sort_jobs(jobs, nthreads, p);
+
+    /* Then merge the runs by pairs, back and forth between the buffers */
+    for (nruns = nthreads; nruns > 1; nruns = (nruns + 1) / 2) {
+        for (i = 0; i < nruns / 2; i++) {
+            jobs[i].base = dst + runs[2 * i] * size;
+            jobs[i].src = src + runs[2 * i] * size;
+            jobs[i].n1 = runs[2 * i + 1] - runs[2 * i];
+            jobs[i].n2 = runs[2 * i + 2] - runs[2 * i + 1];
+            runs[i] = runs[2 * i];
+        }
+        if (nruns % 2) {
+            /* The odd one out is just copied */
+            memcpy(dst + runs[nruns - 1] * size, src + runs[nruns - 1] * size,
+                   (n - runs[nruns - 1]) * size);
+            runs[i++] = runs[nruns - 1];
+        }
+        runs[i] = n;
+        sort_jobs(jobs, nruns / 2, p);
+
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != arr->elts) {
+        memcpy(arr->elts, src, n * size);
+    }
+
+    apr_pool_destroy(p);
+
+    return APR_SUCCESS;
+}
+
+/* Load a key of the given size as an unsigned integer */
+static APR_INLINE apr_uint64_t sort_key(const char *elt, apr_size_t size)
+{
+    switch (size) {
+    case 1: {
+        apr_byte_t k;
+        memcpy(&k, elt, 1);
+        return k;
+    }
+    case 2: {
+        apr_uint16_t k;
+        memcpy(&k, elt, 2);
+        return k;
+    }
+    case 4: {
+        apr_uint32_t k;
+        memcpy(&k, elt, 4);
+        return k;
+    }
+    default: {
+        apr_uint64_t k;
+        memcpy(&k, elt, 8);
+        return k;
+    }
+    }
+}
+
+APR_DECLARE(apr_status_t) apr_array_sort_int(apr_array_header_t *arr,
+                                             apr_size_t key_offset,
+                                             apr_size_t key_size,
+                                             apr_uint32_t flags)
+{
+    const apr_size_t n = arr->nelts, size = arr->elt_size;
+    apr_size_t (*counts)[256], i, d, pos, c;
+    apr_uint64_t sign;
+    char *src, *dst, *swap;
+    apr_pool_t *p;
+    apr_status_t rv;
+
+    if ((key_size != 1 && key_size != 2 && key_size != 4 && key_size != 8)
+        || key_offset + key_size > size) {
+        return APR_EINVAL;
+    }
+    if (n < 2) {
+        return APR_SUCCESS;
+    }
+
+    if ((rv = apr_pool_create(&p, arr->pool)) != APR_SUCCESS) {
+        return rv;
+    }
+    counts = apr_pcalloc(p, key_size * sizeof(*counts));
+    src = arr->elts;
+    if ((dst = apr_palloc(p, n * size)) == NULL) {
+        apr_pool_destroy(p);
+        return APR_ENOMEM;
+    }
+
+    /* Signed keys are ordered as unsigned ones with the sign bit flipped */
+    sign = (flags & APR_ARRAY_SORT_SIGNED) ? (apr_uint64_t)1 << (key_size * 8 - 1)
+                                           : 0;
+
+    /* Count the digits of all the passes at once */
+    for (i = 0; i < n; i++) {
+        apr_uint64_t k = sort_key(src + i * size + key_offset, key_size) ^ sign;
+
+        for (d = 0; d < key_size; d++) {
+            counts[d][(k >> (d * 8)) & 0xff]++;
+        }
+    }
+
+    for (d = 0; d < key_size; d++) {
+        /* Skip the passes where all the keys have the same digit */
+        if (counts[d][((sort_key(src + key_offset, key_size) ^ sign)
+                       >> (d * 8)) & 0xff] == n) {
+            continue;
+        }
+        for (pos = 0, c = 0; c < 256; c++) {
+            apr_size_t count = counts[d][c];
+
+            counts[d][c] = pos;
+            pos += count;
+        }
+        for (i = 0; i < n; i++) {
+            const char *elt = src + i * size;
+            apr_uint64_t k = sort_key(elt + key_offset, key_size) ^ sign;
+
+            sort_copy(dst + counts[d][(k >> (d * 8)) & 0xff]++ * size, elt,
+                      size);
+        }
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != arr->elts) {
+        memcpy(arr->elts, src, n * size);
+    }
+
+    apr_pool_destroy(p);
+
+    return APR_SUCCESS;
+}
+
+
 /*****************************************************************
  *
  * The "table" functions.
@@ -328,6 +849,25 @@ APR_DECLARE(char *) apr_array_pstrcat(apr_pool_t *p,
     checksum &= CASE_MASK;                     \
 }
 
+/* Number of entries past which a table is also indexed by the whole
+ * key, see table_index_build().
+ */
+#define TABLE_INDEX_FULL_MIN 32
+
+/* A slot of the full-key index */
+typedef struct {
+    /* The hash of the key, see table_key_hash() */
+    apr_uint32_t hash;
+    /* The offset + 1 of the first entry with the key, 0 if free */
+    int elt;
+} table_slot_t;
+
+/* The entries of the tables sharing them, see apr_table_copy_shared() */
+typedef struct {
+    /* How many tables use the entries, updated atomically */
+    volatile apr_uint32_t refs;
+} table_share_t;
+
 /** The opaque string-content table type */
 struct apr_table_t {
     /* This has to be first to promote backwards compatibility with
@@ -355,6 +895,27 @@ struct apr_table_t {
     apr_uint32_t index_initialized;
     int index_first[TABLE_HASH_SIZE];
     int index_last[TABLE_HASH_SIZE];
+    /* A second index for the larger tables, where many keys may share
+     * their first character (e.g. "Content-*" headers):
+     *   - If index_full is set, index_slots is an open addressing hash
+     *     table (of index_mask + 1 slots) of the offset of the first
+     *     entry of each of the index_keys distinct keys, by the
+     *     case-insensitive hash of the whole key.
+     *   - The slots are kept (with index_full unset) for reuse when the
+     *     table is cleared or shrinks below TABLE_INDEX_FULL_MIN entries.
+     */
+    table_slot_t *index_slots;
+    apr_uint32_t index_mask;
+    apr_uint32_t index_keys;
+    int index_full;
+    /* The count of the tables using the entries (and index_slots),
+     * shared by apr_table_copy_shared() until either table changes them,
+     * see table_unshare().  It points to own_share unless the entries were
+     * shared from another table, or copied away from their sharers.
+     */
+    table_share_t *share;
+    /* Must be last, see table_share() */
+    table_share_t own_share;
 };
 
 /* keep state for apr_table_getm() */
@@ -387,6 +948,190 @@ static apr_table_entry_t *do_table_push(const char *func, apr_table_t *t)
 #define table_push(t)	((apr_table_entry_t *) apr_array_push_noclear(&(t)->a))
 #endif /* MAKE_TABLE_PROFILE */
 
+/* The case-insensitive hash of a whole key, masking the case bit like
+ * COMPUTE_KEY_CHECKSUM() does.
+ */
+static APR_INLINE apr_uint32_t table_key_hash(const char *key)
+{
+    const unsigned char *k = (const unsigned char *)key;
+    apr_uint32_t hash = 0;
+
+    while (*k) {
+        hash = hash * 33 + (*k++ & (CASE_MASK & 0xff));
+    }
+
+    return hash ^ (hash >> 16);
+}
+
+/* Find the offset of the first entry with the key in the full-key index,
+ * or -1.
+ */
+static int table_index_find(const apr_table_t *t, const char *key,
+                            apr_uint32_t hash)
+{
+    const apr_table_entry_t *elts = (const apr_table_entry_t *)t->a.elts;
+    const table_slot_t *slot;
+    apr_uint32_t i;
+
+    for (i = hash & t->index_mask; ; i = (i + 1) & t->index_mask) {
+        slot = &t->index_slots[i];
+        if (!slot->elt) {
+            return -1;
+        }
+        if (slot->hash == hash
+            && (elts[slot->elt - 1].key == key
+                || !strcasecmp(elts[slot->elt - 1].key, key))) {
+            return slot->elt - 1;
+        }
+    }
+}
+
+static void table_index_build(apr_table_t *t);
+
+/* Add the entry at the given offset to the full-key index, unless an
+ * older one has the same key.
+ */
+static void table_index_add(apr_table_t *t, int elt, apr_uint32_t hash)
+{
+    const apr_table_entry_t *elts = (const apr_table_entry_t *)t->a.elts;
+    table_slot_t *slot;
+    apr_uint32_t i;
+
+    for (i = hash & t->index_mask; ; i = (i + 1) & t->index_mask) {
+        slot = &t->index_slots[i];
+        if (!slot->elt) {
+            break;
+        }
+        if (slot->hash == hash
+            && !strcasecmp(elts[slot->elt - 1].key, elts[elt].key)) {
+            return;
+        }
+    }
+    slot->hash = hash;
+    slot->elt = elt + 1;
+
+    /* Keep the slots at most half used */
+    if (++t->index_keys * 2 > t->index_mask + 1) {
+        table_index_build(t);
+    }
+}
+
+/* (Re)build the full-key index of all the entries, with at least twice
+ * as many slots.
+ */
+static void table_index_build(apr_table_t *t)
+{
+    const apr_table_entry_t *elts = (const apr_table_entry_t *)t->a.elts;
+    apr_uint32_t nslots = TABLE_INDEX_FULL_MIN * 2;
+    int i;
+
+    while (nslots < (apr_uint32_t)t->a.nelts * 2) {
+        nslots <<= 1;
+    }
+    if (!t->index_slots || nslots > t->index_mask + 1) {
+        t->index_slots = apr_palloc(t->a.pool, nslots * sizeof(table_slot_t));
+        t->index_mask = nslots - 1;
+    }
+    memset(t->index_slots, 0, (t->index_mask + 1) * sizeof(table_slot_t));
+    t->index_keys = 0;
+    t->index_full = 1;
+
+    for (i = 0; i < t->a.nelts; i++) {
+        table_index_add(t, i, table_key_hash(elts[i].key));
+    }
+}
+
+/* Account for the entry just pushed in the full-key index, building it
+ * once the table is large enough.
+ */
+static APR_INLINE void table_index_pushed(apr_table_t *t)
+{
+    if (t->index_full) {
+        int elt = t->a.nelts - 1;
+
+        table_index_add(t, elt,
+                        table_key_hash(((apr_table_entry_t *)
+                                        t->a.elts)[elt].key));
+    }
+    else if (t->a.nelts >= TABLE_INDEX_FULL_MIN) {
+        table_index_build(t);
+    }
+}
+
+static APR_INLINE void table_index_init(apr_table_t *t)
+{
+    t->index_slots = NULL;
+    t->index_mask = 0;
+    t->index_keys = 0;
+    t->index_full = 0;
+}
+
+static APR_INLINE void table_share_init(apr_table_t *t)
+{
+    t->own_share.refs = 1;
+    t->share = &t->own_share;
+}
+
+/* Stop using the shared entries of a table whose pool is cleared */
+static apr_status_t table_share_cleanup(void *data)
+{
+    apr_table_t *t = data;
+
+    apr_atomic_dec32(&t->share->refs);
+    return APR_SUCCESS;
+}
+
+/* Make a copy of a table sharing its entries and indexes, until either
+ * table changes them.  The keys and values are not copied either, so
+ * the pool of the table must outlive p.  The table itself is not
+ * changed, only the count of its sharers (atomically), so copies can be
+ * made concurrently by multiple threads.
+ */
+static apr_table_t *table_share(apr_pool_t *p, const apr_table_t *t)
+{
+    apr_table_t *new = apr_palloc(p, sizeof(apr_table_t));
+
+    /* All but own_share, which the sharers may be updating */
+    memcpy(new, t, APR_OFFSETOF(apr_table_t, own_share));
+    new->a.pool = p;
+    apr_atomic_inc32(&new->share->refs);
+    apr_pool_cleanup_register(p, new, table_share_cleanup,
+                              apr_pool_cleanup_null);
+    return new;
+}
+
+/* Give a table its own copy of the entries (and index_slots) shared
+ * with other tables, before changing them.
+ */
+static void table_unshare(apr_table_t *t)
+{
+    char *elts = apr_palloc(t->a.pool, t->a.nalloc * t->a.elt_size);
+    table_share_t *share = apr_palloc(t->a.pool, sizeof(table_share_t));
+
+    memcpy(elts, t->a.elts, t->a.nelts * t->a.elt_size);
+    t->a.elts = elts;
+    if (t->index_full) {
+        t->index_slots = apr_pmemdup(t->a.pool, t->index_slots,
+                                     (t->index_mask + 1)
+                                     * sizeof(table_slot_t));
+    }
+    else {
+        t->index_slots = NULL;
+        t->index_mask = 0;
+    }
+
+    /* The copy is done before the sharers may see the last one left */
+    apr_atomic_dec32(&t->share->refs);
+    share->refs = 1;
+    t->share = share;
+}
+
+/* The last table left using the entries can change them in place */
+#define TABLE_UNSHARE(t) do {                           \
+    if (apr_atomic_read32(&(t)->share->refs) > 1)       \
+        table_unshare(t);                               \
+} while (0)
+
 APR_DECLARE(const apr_array_header_t *) apr_table_elts(const apr_table_t *t)
 {
     return (const apr_array_header_t *)t;
@@ -406,12 +1151,14 @@ APR_DECLARE(apr_table_t *) apr_table_make(apr_pool_t *p, int nelts)
     t->creator = __builtin_return_address(0);
 #endif
     t->index_initialized = 0;
+    table_index_init(t);
+    table_share_init(t);
     return t;
 }
 
 APR_DECLARE(apr_table_t *) apr_table_copy(apr_pool_t *p, const apr_table_t *t)
 {
-    apr_table_t *new = apr_palloc(p, sizeof(apr_table_t));
+    apr_table_t *new;
 
 #if APR_POOL_DEBUG
     /* we don't copy keys and values, so it's necessary that t->a.pool
@@ -422,15 +1169,37 @@ APR_DECLARE(apr_table_t *) apr_table_copy(apr_pool_t *p, const apr_table_t *t)
 	abort();
     }
 #endif
+    new = apr_palloc(p, sizeof(apr_table_t));
     make_array_core(&new->a, p, t->a.nalloc, sizeof(apr_table_entry_t), 0);
     memcpy(new->a.elts, t->a.elts, t->a.nelts * sizeof(apr_table_entry_t));
     new->a.nelts = t->a.nelts;
     memcpy(new->index_first, t->index_first, sizeof(int) * TABLE_HASH_SIZE);
     memcpy(new->index_last, t->index_last, sizeof(int) * TABLE_HASH_SIZE);
     new->index_initialized = t->index_initialized;
+    table_index_init(new);
+    if (t->index_full) {
+        apr_size_t size = (t->index_mask + 1) * sizeof(table_slot_t);
+
+        new->index_slots = apr_pmemdup(p, t->index_slots, size);
+        new->index_mask = t->index_mask;
+        new->index_keys = t->index_keys;
+        new->index_full = 1;
+    }
+    table_share_init(new);
     return new;
 }
 
+APR_DECLARE(apr_table_t *) apr_table_copy_shared(apr_pool_t *p,
+                                                 const apr_table_t *t)
+{
+    /* Share the entries until either table changes */
+    if (apr_pool_is_ancestor(t->a.pool, p)) {
+        return table_share(p, t);
+    }
+
+    return apr_table_copy(p, t);
+}
+
 APR_DECLARE(apr_table_t *) apr_table_clone(apr_pool_t *p, const apr_table_t *t)
 {
     const apr_array_header_t *array = apr_table_elts(t);
@@ -460,36 +1229,55 @@ static void table_reindex(apr_table_t *t)
             TABLE_SET_INDEX_INITIALIZED(t, hash);
         }
     }
+
+    if (t->a.nelts >= TABLE_INDEX_FULL_MIN) {
+        table_index_build(t);
+    }
+    else {
+        t->index_full = 0;
+    }
 }
 
 APR_DECLARE(void) apr_table_clear(apr_table_t *t)
 {
     t->a.nelts = 0;
     t->index_initialized = 0;
+    t->index_full = 0;
+    TABLE_UNSHARE(t);
 }
 
-APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
+/* Whether an entry has the given key, of the given checksum */
+#define TABLE_ENTRY_IS_KEY(elt, key, checksum)          \
+    ((checksum) == (elt)->key_checksum                  \
+     && ((elt)->key == (key) || !strcasecmp((elt)->key, (key))))
+
+/* The full-key hash of a key, unless given (by an apr_table_key_t) */
+#define TABLE_KEY_HASH(key, khash) \
+    ((khash) ? *(khash) : table_key_hash(key))
+
+static APR_INLINE const char *table_get(const apr_table_t *t,
+                                        const char *key,
+                                        apr_uint32_t checksum,
+                                        const apr_uint32_t *khash)
 {
     apr_table_entry_t *next_elt;
     apr_table_entry_t *end_elt;
-    apr_uint32_t checksum;
     int hash;
 
-    if (key == NULL) {
-	return NULL;
-    }
-
     hash = TABLE_HASH(key);
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
         return NULL;
     }
-    COMPUTE_KEY_CHECKSUM(key, checksum);
+    if (t->index_full) {
+        int i = table_index_find(t, key, TABLE_KEY_HASH(key, khash));
+
+        return i < 0 ? NULL : ((apr_table_entry_t *) t->a.elts)[i].val;
+    }
     next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
 
     for (; next_elt <= end_elt; next_elt++) {
-	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+	if (TABLE_ENTRY_IS_KEY(next_elt, key, checksum)) {
 	    return next_elt->val;
 	}
     }
@@ -497,6 +1285,18 @@ APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
     return NULL;
 }
 
+APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
+{
+    apr_uint32_t checksum;
+
+    if (key == NULL) {
+	return NULL;
+    }
+
+    COMPUTE_KEY_CHECKSUM(key, checksum);
+    return table_get(t, key, checksum, NULL);
+}
+
 APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
                                 const char *val)
 {
@@ -506,6 +1306,7 @@ APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
     apr_uint32_t checksum;
     int hash;
 
+    TABLE_UNSHARE(t);
     COMPUTE_KEY_CHECKSUM(key, checksum);
     hash = TABLE_HASH(key);
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
@@ -515,6 +1316,14 @@ APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
     }
     next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (t->index_full) {
+        int i = table_index_find(t, key, table_key_hash(key));
+
+        if (i < 0) {
+            goto add_new_elt;
+        }
+        next_elt = ((apr_table_entry_t *) t->a.elts) + i;
+    }
     table_end =((apr_table_entry_t *) t->a.elts) + t->a.nelts;
 
     for (; next_elt <= end_elt; next_elt++) {
@@ -567,18 +1376,20 @@ add_new_elt:
     next_elt->key = apr_pstrdup(t->a.pool, key);
     next_elt->val = apr_pstrdup(t->a.pool, val);
     next_elt->key_checksum = checksum;
+    table_index_pushed(t);
 }
 
-APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
-                                 const char *val)
+static APR_INLINE void table_setn(apr_table_t *t, const char *key,
+                                  apr_uint32_t checksum,
+                                  const apr_uint32_t *khash,
+                                  const char *val)
 {
     apr_table_entry_t *next_elt;
     apr_table_entry_t *end_elt;
     apr_table_entry_t *table_end;
-    apr_uint32_t checksum;
     int hash;
 
-    COMPUTE_KEY_CHECKSUM(key, checksum);
+    TABLE_UNSHARE(t);
     hash = TABLE_HASH(key);
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
         t->index_first[hash] = t->a.nelts;
@@ -587,11 +1398,18 @@ APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
     }
     next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (t->index_full) {
+        int i = table_index_find(t, key, TABLE_KEY_HASH(key, khash));
+
+        if (i < 0) {
+            goto add_new_elt;
+        }
+        next_elt = ((apr_table_entry_t *) t->a.elts) + i;
+    }
     table_end =((apr_table_entry_t *) t->a.elts) + t->a.nelts;
 
     for (; next_elt <= end_elt; next_elt++) {
-	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+	if (TABLE_ENTRY_IS_KEY(next_elt, key, checksum)) {
 
             /* Found an existing entry with the same key, so overwrite it */
 
@@ -602,8 +1420,7 @@ APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
 
             /* Remove any other instances of this key */
             for (next_elt++; next_elt <= end_elt; next_elt++) {
-                if ((checksum == next_elt->key_checksum) &&
-                    !strcasecmp(next_elt->key, key)) {
+                if (TABLE_ENTRY_IS_KEY(next_elt, key, checksum)) {
                     t->a.nelts--;
                     if (!dst_elt) {
                         dst_elt = next_elt;
@@ -639,14 +1456,25 @@ add_new_elt:
     next_elt->key = (char *)key;
     next_elt->val = (char *)val;
     next_elt->key_checksum = checksum;
+    table_index_pushed(t);
 }
 
-APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
+APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
+                                 const char *val)
+{
+    apr_uint32_t checksum;
+
+    COMPUTE_KEY_CHECKSUM(key, checksum);
+    table_setn(t, key, checksum, NULL, val);
+}
+
+static APR_INLINE void table_unset(apr_table_t *t, const char *key,
+                                   apr_uint32_t checksum,
+                                   const apr_uint32_t *khash)
 {
     apr_table_entry_t *next_elt;
     apr_table_entry_t *end_elt;
     apr_table_entry_t *dst_elt;
-    apr_uint32_t checksum;
     int hash;
     int must_reindex;
 
@@ -654,13 +1482,20 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
         return;
     }
-    COMPUTE_KEY_CHECKSUM(key, checksum);
+    TABLE_UNSHARE(t);
     next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (t->index_full) {
+        int i = table_index_find(t, key, TABLE_KEY_HASH(key, khash));
+
+        if (i < 0) {
+            return;
+        }
+        next_elt = ((apr_table_entry_t *) t->a.elts) + i;
+    }
     must_reindex = 0;
     for (; next_elt <= end_elt; next_elt++) {
-	if ((checksum == next_elt->key_checksum) &&
-            !strcasecmp(next_elt->key, key)) {
+	if (TABLE_ENTRY_IS_KEY(next_elt, key, checksum)) {
 
             /* Found a match: remove this entry, plus any additional
              * matches for the same key that might follow
@@ -670,8 +1505,7 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
             t->a.nelts--;
             dst_elt = next_elt;
             for (next_elt++; next_elt <= end_elt; next_elt++) {
-                if ((checksum == next_elt->key_checksum) &&
-                    !strcasecmp(next_elt->key, key)) {
+                if (TABLE_ENTRY_IS_KEY(next_elt, key, checksum)) {
                     t->a.nelts--;
                 }
                 else {
@@ -695,6 +1529,14 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
     }
 }
 
+APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
+{
+    apr_uint32_t checksum;
+
+    COMPUTE_KEY_CHECKSUM(key, checksum);
+    table_unset(t, key, checksum, NULL);
+}
+
 APR_DECLARE(void) apr_table_merge(apr_table_t *t, const char *key,
 				 const char *val)
 {
@@ -703,6 +1545,7 @@ APR_DECLARE(void) apr_table_merge(apr_table_t *t, const char *key,
     apr_uint32_t checksum;
     int hash;
 
+    TABLE_UNSHARE(t);
     COMPUTE_KEY_CHECKSUM(key, checksum);
     hash = TABLE_HASH(key);
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
@@ -712,6 +1555,14 @@ APR_DECLARE(void) apr_table_merge(apr_table_t *t, const char *key,
     }
     next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (t->index_full) {
+        int i = table_index_find(t, key, table_key_hash(key));
+
+        if (i < 0) {
+            goto add_new_elt;
+        }
+        next_elt = ((apr_table_entry_t *) t->a.elts) + i;
+    }
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
@@ -730,6 +1581,7 @@ add_new_elt:
     next_elt->key = apr_pstrdup(t->a.pool, key);
     next_elt->val = apr_pstrdup(t->a.pool, val);
     next_elt->key_checksum = checksum;
+    table_index_pushed(t);
 }
 
 APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
@@ -758,6 +1610,7 @@ APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
     }
 #endif
 
+    TABLE_UNSHARE(t);
     COMPUTE_KEY_CHECKSUM(key, checksum);
     hash = TABLE_HASH(key);
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
@@ -767,6 +1620,14 @@ APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
     }
     next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
     end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (t->index_full) {
+        int i = table_index_find(t, key, table_key_hash(key));
+
+        if (i < 0) {
+            goto add_new_elt;
+        }
+        next_elt = ((apr_table_entry_t *) t->a.elts) + i;
+    }
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
@@ -785,6 +1646,7 @@ add_new_elt:
     next_elt->key = (char *)key;
     next_elt->val = (char *)val;
     next_elt->key_checksum = checksum;
+    table_index_pushed(t);
 }
 
 APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
@@ -794,6 +1656,7 @@ APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
     apr_uint32_t checksum;
     int hash;
 
+    TABLE_UNSHARE(t);
     hash = TABLE_HASH(key);
     t->index_last[hash] = t->a.nelts;
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
@@ -805,6 +1668,7 @@ APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
     elts->key = apr_pstrdup(t->a.pool, key);
     elts->val = apr_pstrdup(t->a.pool, val);
     elts->key_checksum = checksum;
+    table_index_pushed(t);
 }
 
 APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
@@ -827,6 +1691,7 @@ APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
     }
 #endif
 
+    TABLE_UNSHARE(t);
     hash = TABLE_HASH(key);
     t->index_last[hash] = t->a.nelts;
     if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
@@ -838,6 +1703,34 @@ APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
     elts->key = (char *)key;
     elts->val = (char *)val;
     elts->key_checksum = checksum;
+    table_index_pushed(t);
+}
+
+APR_DECLARE(void) apr_table_key_init(apr_table_key_t *k, const char *key)
+{
+    apr_uint32_t checksum;
+
+    COMPUTE_KEY_CHECKSUM(key, checksum);
+    k->key = key;
+    k->checksum = checksum;
+    k->hash = table_key_hash(key);
+}
+
+APR_DECLARE(const char *) apr_table_getk(const apr_table_t *t,
+                                         const apr_table_key_t *k)
+{
+    return table_get(t, k->key, k->checksum, &k->hash);
+}
+
+APR_DECLARE(void) apr_table_setk(apr_table_t *t, const apr_table_key_t *k,
+                                 const char *val)
+{
+    table_setn(t, k->key, k->checksum, &k->hash, apr_pstrdup(t->a.pool, val));
+}
+
+APR_DECLARE(void) apr_table_unsetk(apr_table_t *t, const apr_table_key_t *k)
+{
+    table_unset(t, k->key, k->checksum, &k->hash);
 }
 
 APR_DECLARE(apr_table_t *) apr_table_overlay(apr_pool_t *p,
@@ -868,6 +1761,8 @@ APR_DECLARE(apr_table_t *) apr_table_overlay(apr_pool_t *p,
     res->a.pool = p;
     copy_array_hdr_core(&res->a, &overlay->a);
     apr_array_cat(&res->a, &base->a);
+    table_index_init(res);
+    table_share_init(res);
     table_reindex(res);
     return res;
 }
@@ -974,8 +1869,15 @@ APR_DECLARE(int) apr_table_vdo(apr_table_do_callback_fn_t *comp,
             if (TABLE_INDEX_IS_INITIALIZED(t, hash)) {
                 apr_uint32_t checksum;
                 COMPUTE_KEY_CHECKSUM(argp, checksum);
-                for (i = t->index_first[hash];
-                     rv && (i <= t->index_last[hash]); ++i) {
+                i = t->index_first[hash];
+                if (t->index_full) {
+                    /* Skip to the first match, or past the last entry */
+                    i = table_index_find(t, argp, table_key_hash(argp));
+                    if (i < 0) {
+                        i = t->index_last[hash] + 1;
+                    }
+                }
+                for (; rv && (i <= t->index_last[hash]); ++i) {
                     if (elts[i].key && (checksum == elts[i].key_checksum) &&
                                         !strcasecmp(elts[i].key, argp)) {
                         rv = (*comp) (rec, elts[i].key, elts[i].val);
@@ -1111,6 +2013,8 @@ APR_DECLARE(void) apr_table_compress(apr_table_t *t, unsigned flags)
         return;
     }
 
+    TABLE_UNSHARE(t);
+
     /* Copy pointers to all the table elements into an
      * array and sort to allow for easy detection of
      * duplicate keys
@@ -1215,6 +2119,9 @@ static void apr_table_cat(apr_table_t *t, const apr_table_t *s)
         memcpy(t->index_first,s->index_first,sizeof(int) * TABLE_HASH_SIZE);
         memcpy(t->index_last, s->index_last, sizeof(int) * TABLE_HASH_SIZE);
         t->index_initialized = s->index_initialized;
+        if (t->a.nelts >= TABLE_INDEX_FULL_MIN) {
+            table_index_build(t);
+        }
         return;
     }
 
@@ -1228,6 +2135,17 @@ static void apr_table_cat(apr_table_t *t, const apr_table_t *s)
     }
 
     t->index_initialized |= s->index_initialized;
+
+    if (t->index_full) {
+        const apr_table_entry_t *elts = (const apr_table_entry_t *)t->a.elts;
+
+        for (idx = n; idx < t->a.nelts; ++idx) {
+            table_index_add(t, idx, table_key_hash(elts[idx].key));
+        }
+    }
+    else if (t->a.nelts >= TABLE_INDEX_FULL_MIN) {
+        table_index_build(t);
+    }
 }
 
 APR_DECLARE(void) apr_table_overlap(apr_table_t *a, const apr_table_t *b,
@@ -1246,6 +2164,7 @@ APR_DECLARE(void) apr_table_overlap(apr_table_t *a, const apr_table_t *b,
     }
 #endif
 
+    TABLE_UNSHARE(a);
     apr_table_cat(a, b);
 
     apr_table_compress(a, flags);
@@ -1298,3 +2217,340 @@ APR_DECLARE(const char *) apr_table_getm(apr_pool_t *p, const apr_table_t *t,
         return apr_array_pstrcat(p, state.merged, ',');
     }
 }
+
+/*****************************************************************
+ *
+ * The frozen tables: read-only snapshots of a table, whose distinct
+ * keys are placed by a minimal perfect hash ("hash and displace"):
+ * the hash of a key selects a bucket, whose displacement gives the
+ * slot of the key.  A lookup thus hashes the key once and compares it
+ * with the one key of its slot, everything living in a single block.
+ */
+
+/* Displacements with this bit set are the slot of the bucket's one key */
+#define FROZEN_DIRECT   0x80000000U
+/* The displacements tried before hashing with another seed */
+#define FROZEN_MAX_DISP 0x10000U
+/* The seeds tried before giving up (e.g. on colliding 64-bit hashes) */
+#define FROZEN_MAX_SEED 64
+/* An unused slot while placing the keys */
+#define FROZEN_FREE     0xffffffffU
+/* Set in the klen of a record whose value is NULL (and not stored) */
+#define FROZEN_NOVAL    0x80000000U
+
+/* Map a 32-bit value to [0, n) */
+#define FROZEN_RANGE(v, n) \
+    ((apr_uint32_t)(((apr_uint64_t)(apr_uint32_t)(v) * (n)) >> 32))
+
+#define FROZEN_BUCKET(h, n) FROZEN_RANGE((h) >> 32, n)
+
+#define FROZEN_SLOT(h, d, n) \
+    FROZEN_RANGE((apr_uint32_t)(h) + \
+                 (d) * ((apr_uint32_t)((h) >> 32) | 1), n)
+
+/* The record of a distinct key, followed by the key and its (first)
+ * value, both NUL terminated, unless the value is NULL.
+ */
+typedef struct {
+    /* The low bits of the key's hash, to skip most of the mismatches */
+    apr_uint32_t hash;
+    apr_uint32_t klen;
+} frozen_rec_t;
+
+#define FROZEN_REC_KEY(rec) ((char *)((frozen_rec_t *)(rec) + 1))
+#define FROZEN_REC_VAL(rec) \
+    (FROZEN_REC_KEY(rec) + ((rec)->klen & ~FROZEN_NOVAL) + 1)
+
+/* The size of a value with its NUL, nothing for NULL */
+#define FROZEN_VSIZE(val) ((val) ? strlen(val) + 1 : 0)
+
+struct apr_table_frozen_t {
+    /** The entries, in the order of the table */
+    apr_array_header_t a;
+    /** The seed of the hash */
+    apr_uint32_t seed;
+    /** The number of distinct keys, of buckets and of slots */
+    apr_uint32_t nkeys;
+    /** The displacement of each bucket */
+    const apr_uint32_t *disp;
+    /** The offset of the record of each slot, in records */
+    const apr_uint32_t *slots;
+    /** The records of the distinct keys */
+    const frozen_rec_t *recs;
+};
+
+/* The hash of a key, ignoring the case of the ASCII letters (keys
+ * equal for strcasecmp() in any locale have the same hash, which is
+ * all the placement needs).
+ */
+static APR_INLINE apr_uint64_t frozen_hash(const char *key,
+                                           apr_uint32_t seed)
+{
+    const unsigned char *k = (const unsigned char *)key;
+    apr_uint64_t h = APR_UINT64_C(0xcbf29ce484222325) ^ seed;
+    unsigned int c;
+
+    /* FNV-1a, mixed for the high bits to be usable too */
+    while ((c = *k++) != 0) {
+        h ^= c + ((unsigned int)(c - 'A' < 26U) << 5);
+        h *= APR_UINT64_C(0x100000001b3);
+    }
+    h ^= h >> 33;
+    h *= APR_UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+
+    return h;
+}
+
+/* Place the n distinct keys of the given hashes, setting the
+ * displacement of each bucket and the key of each slot.  Returns
+ * zero if no displacement was found for some bucket.
+ */
+static int frozen_place(apr_pool_t *tmp, apr_uint32_t n,
+                        const apr_uint64_t *hashes,
+                        apr_uint32_t *disp, apr_uint32_t *keyof)
+{
+    apr_uint32_t *start, *next, *keys, *count, *order;
+    apr_uint32_t b, d, i, j, s, size, max = 0, nused = 0, free_slot = 0;
+
+    /* Group the keys by bucket */
+    start = apr_pcalloc(tmp, (n + 1) * sizeof(*start));
+    next = apr_palloc(tmp, n * sizeof(*next));
+    keys = apr_palloc(tmp, n * sizeof(*keys));
+    for (i = 0; i < n; i++) {
+        start[FROZEN_BUCKET(hashes[i], n) + 1]++;
+    }
+    for (b = 0; b < n; b++) {
+        if (start[b + 1] > max) {
+            max = start[b + 1];
+        }
+        start[b + 1] += start[b];
+        next[b] = start[b];
+    }
+    for (i = 0; i < n; i++) {
+        keys[next[FROZEN_BUCKET(hashes[i], n)]++] = i;
+    }
+
+    /* Place the larger buckets first, while most slots are free */
+    count = apr_pcalloc(tmp, (max + 1) * sizeof(*count));
+    order = next;
+    for (b = 0; b < n; b++) {
+        count[start[b + 1] - start[b]]++;
+    }
+    for (size = max; size > 0; size--) {
+        i = count[size];
+        count[size] = nused;
+        nused += i;
+    }
+    for (b = 0; b < n; b++) {
+        if ((size = start[b + 1] - start[b]) != 0) {
+            order[count[size]++] = b;
+        }
+    }
+
+    memset(disp, 0, n * sizeof(*disp));
+    memset(keyof, 0xff, n * sizeof(*keyof));
+    for (i = 0; i < nused; i++) {
+        b = order[i];
+        if (start[b + 1] - start[b] == 1) {
+            /* Only single keys left, which go to the free slots */
+            break;
+        }
+        for (d = 0; d < FROZEN_MAX_DISP; d++) {
+            for (j = start[b]; j < start[b + 1]; j++) {
+                s = FROZEN_SLOT(hashes[keys[j]], d, n);
+                if (keyof[s] != FROZEN_FREE) {
+                    break;
+                }
+                keyof[s] = keys[j];
+            }
+            if (j == start[b + 1]) {
+                break;
+            }
+            while (j-- > start[b]) {
+                keyof[FROZEN_SLOT(hashes[keys[j]], d, n)] = FROZEN_FREE;
+            }
+        }
+        if (d == FROZEN_MAX_DISP) {
+            return 0;
+        }
+        disp[b] = d;
+    }
+    for (; i < nused; i++) {
+        b = order[i];
+        while (keyof[free_slot] != FROZEN_FREE) {
+            free_slot++;
+        }
+        keyof[free_slot] = keys[start[b]];
+        disp[b] = FROZEN_DIRECT | free_slot;
+    }
+
+    return 1;
+}
+
+APR_DECLARE(apr_table_frozen_t *) apr_table_freeze(apr_pool_t *p,
+                                                   const apr_table_t *t)
+{
+    const apr_table_entry_t *elts = (const apr_table_entry_t *)t->a.elts;
+    const int nelts = t->a.nelts;
+    apr_table_frozen_t *f;
+    apr_table_entry_t *entries;
+    frozen_rec_t *rec;
+    apr_uint32_t *disp, *keyof, *first, *seen, *slots;
+    apr_uint32_t seed = 0, n = 0, nseen = 64, i, j, s;
+    apr_uint64_t *hashes;
+    apr_size_t size = 0, dsize = 0, klen, vsize;
+    apr_pool_t *tmp;
+    char *data;
+
+    if (apr_pool_create(&tmp, p) != APR_SUCCESS) {
+        return NULL;
+    }
+
+    /* Find the first entry of each distinct key */
+    while (nseen < (apr_uint32_t)nelts * 2) {
+        nseen <<= 1;
+    }
+    seen = apr_pcalloc(tmp, nseen * sizeof(*seen));
+    first = apr_palloc(tmp, (nelts + 1) * sizeof(*first));
+    hashes = apr_palloc(tmp, (nelts + 1) * sizeof(*hashes));
+    for (i = 0; i < (apr_uint32_t)nelts; i++) {
+        apr_uint64_t h = frozen_hash(elts[i].key, seed);
+
+        klen = strlen(elts[i].key);
+        vsize = FROZEN_VSIZE(elts[i].val);
+        for (s = (apr_uint32_t)h & (nseen - 1); seen[s];
+             s = (s + 1) & (nseen - 1)) {
+            if (hashes[seen[s] - 1] == h
+                && !strcasecmp(elts[first[seen[s] - 1]].key, elts[i].key)) {
+                break;
+            }
+        }
+        if (!seen[s]) {
+            first[n] = i;
+            hashes[n] = h;
+            seen[s] = ++n;
+            size += APR_ALIGN(sizeof(frozen_rec_t) + klen + 1 + vsize,
+                              sizeof(frozen_rec_t));
+        }
+        else {
+            /* The duplicates' strings go after the records */
+            dsize += klen + 1 + vsize;
+        }
+    }
+
+    disp = apr_palloc(tmp, (n + 1) * sizeof(*disp));
+    keyof = apr_palloc(tmp, (n + 1) * sizeof(*keyof));
+    while (n && !frozen_place(tmp, n, hashes, disp, keyof)) {
+        if (++seed == FROZEN_MAX_SEED) {
+            apr_pool_destroy(tmp);
+            return NULL;
+        }
+        for (j = 0; j < n; j++) {
+            hashes[j] = frozen_hash(elts[first[j]].key, seed);
+        }
+    }
+
+    /* Everything in one block: the entries, the displacements, the
+     * slots, the records and the duplicates' strings.
+     */
+    f = apr_palloc(p, APR_ALIGN_DEFAULT(sizeof(*f))
+                      + APR_ALIGN_DEFAULT(nelts * sizeof(*entries))
+                      + APR_ALIGN_DEFAULT(n * sizeof(*disp) * 2)
+                      + size + dsize);
+    entries = (apr_table_entry_t *)((char *)f + APR_ALIGN_DEFAULT(sizeof(*f)));
+    f->disp = (apr_uint32_t *)((char *)entries
+                               + APR_ALIGN_DEFAULT(nelts * sizeof(*entries)));
+    memcpy((apr_uint32_t *)f->disp, disp, n * sizeof(*disp));
+    f->slots = slots = (apr_uint32_t *)f->disp + n;
+    f->recs = (frozen_rec_t *)((char *)f->disp
+                               + APR_ALIGN_DEFAULT(n * sizeof(*disp) * 2));
+    data = (char *)f->recs + size;
+
+    /* Lay the records out by slot, for the lookups of neighbouring
+     * slots to share cache lines.
+     */
+    rec = (frozen_rec_t *)f->recs;
+    for (s = 0; s < n; s++) {
+        i = first[keyof[s]];
+        klen = strlen(elts[i].key);
+        vsize = FROZEN_VSIZE(elts[i].val);
+        rec->hash = (apr_uint32_t)hashes[keyof[s]];
+        rec->klen = (apr_uint32_t)klen;
+        entries[i].key = memcpy(FROZEN_REC_KEY(rec), elts[i].key, klen + 1);
+        if (vsize) {
+            entries[i].val = memcpy(FROZEN_REC_VAL(rec), elts[i].val, vsize);
+        }
+        else {
+            rec->klen |= FROZEN_NOVAL;
+            entries[i].val = NULL;
+        }
+        slots[s] = (apr_uint32_t)(rec - f->recs);
+        rec += APR_ALIGN(sizeof(frozen_rec_t) + klen + 1 + vsize,
+                         sizeof(frozen_rec_t)) / sizeof(frozen_rec_t);
+    }
+    for (j = 0, i = 0; i < (apr_uint32_t)nelts; i++) {
+        if (j < n && first[j] == i) {
+            /* Already in its record */
+            j++;
+        }
+        else {
+            klen = strlen(elts[i].key) + 1;
+            entries[i].key = memcpy(data, elts[i].key, klen);
+            data += klen;
+            if ((vsize = FROZEN_VSIZE(elts[i].val)) != 0) {
+                entries[i].val = memcpy(data, elts[i].val, vsize);
+                data += vsize;
+            }
+            else {
+                entries[i].val = NULL;
+            }
+        }
+        entries[i].key_checksum = elts[i].key_checksum;
+    }
+
+    f->a.pool = p;
+    f->a.elt_size = sizeof(apr_table_entry_t);
+    f->a.nelts = f->a.nalloc = nelts;
+    f->a.elts = (char *)entries;
+    f->seed = seed;
+    f->nkeys = n;
+
+    apr_pool_destroy(tmp);
+
+    return f;
+}
+
+APR_DECLARE(const char *) apr_table_frozen_get(const apr_table_frozen_t *f,
+                                               const char *key)
+{
+    const frozen_rec_t *rec;
+    apr_uint64_t h;
+    apr_uint32_t d, s;
+
+    if (!f->nkeys) {
+        return NULL;
+    }
+
+    h = frozen_hash(key, f->seed);
+    d = f->disp[FROZEN_BUCKET(h, f->nkeys)];
+    if (d & FROZEN_DIRECT) {
+        s = d & ~FROZEN_DIRECT;
+    }
+    else {
+        s = FROZEN_SLOT(h, d, f->nkeys);
+    }
+    rec = f->recs + f->slots[s];
+    if (rec->hash != (apr_uint32_t)h || strcasecmp(FROZEN_REC_KEY(rec), key)
+        || (rec->klen & FROZEN_NOVAL)) {
+        return NULL;
+    }
+
+    return FROZEN_REC_VAL(rec);
+}
+
+APR_DECLARE(const apr_array_header_t *) apr_table_frozen_elts(
+                                                const apr_table_frozen_t *f)
+{
+    return &f->a;
+}
@@ -52,6 +52,7 @@ const struct testlist {
     {testpipe},
     {testpoll},
     {testpool},
+    {testpoolinline},
     {testproc},
     {testprocmutex},
     {testrand},
@@ -69,7 +70,9 @@ const struct testlist {
     {testud},
     {testuser},
     {testvsn},
-    {testskiplist}
+    {testskiplist},
+    {testslab},
+    {testflathash}
 };
 
 #endif /* APR_TEST_INCLUDES */
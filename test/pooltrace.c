@@ -0,0 +1,403 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* pooltrace.c
+ * Analyze a pool trace written by apr_pool_trace_dump().
+ *
+ *   ./pooltrace [-f | -r [-m max_free] [-c pool_cache] [-H]] tracefile
+ *
+ * Without options, print a summary of the trace and of the memory
+ * requested per pool tag.
+ *
+ *   -f   print the bytes requested per pool tag and calling address as
+ *        folded stacks ("tag;address bytes" lines), to be fed to e.g.
+ *        flamegraph.pl.  The addresses can be resolved with addr2line
+ *        against the traced program (and its load address when PIE).
+ *   -r   replay the trace, in time order, against an allocator set up
+ *        with the following options and report its use of the system
+ *        memory:
+ *          -m max_free    apr_allocator_max_free_set() (in bytes)
+ *          -c pool_cache  apr_allocator_pool_cache_set()
+ *          -H             APR_ALLOCATOR_HUGEPAGES
+ *
+ * The trace must be analyzed on a machine of the same byte order and
+ * address size as the one which wrote it.
+ */
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_allocator.h"
+#include "apr_file_io.h"
+#include "apr_getopt.h"
+#include "apr_hash.h"
+#include "apr_strings.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Replay: how often (in records) the allocator statistics are sampled */
+#define REPLAY_SAMPLE 1024
+
+typedef struct {
+    apr_uint32_t ntags;
+    const char **tags;          /* [0] is "" (untagged) */
+    apr_uint64_t nrecords;
+    apr_pool_trace_record_t *records;
+} trace_t;
+
+typedef struct {
+    const char *tag;
+    apr_uint64_t bytes;
+    apr_uint64_t allocs;
+} tag_total_t;
+
+static void fail(const char *what, apr_status_t rv)
+{
+    char errmsg[200];
+
+    fprintf(stderr, "%s: [%d] %s\n", what, rv,
+            apr_strerror(rv, errmsg, sizeof errmsg));
+    exit(-1);
+}
+
+static void trace_read(trace_t *trace, const char *fname, apr_pool_t *pool)
+{
+    apr_file_t *file;
+    apr_pool_trace_header_t header;
+    apr_uint64_t n;
+    apr_uint32_t i, len;
+    apr_size_t size;
+    char *tag;
+    apr_status_t rv;
+
+    if ((rv = apr_file_open(&file, fname, APR_FOPEN_READ|APR_FOPEN_BUFFERED,
+                            APR_FPROT_OS_DEFAULT, pool)) != APR_SUCCESS)
+        fail(fname, rv);
+
+    if ((rv = apr_file_read_full(file, &header, sizeof(header),
+                                 NULL)) != APR_SUCCESS)
+        fail("Could not read the trace header", rv);
+    if (memcmp(header.magic, APR_POOL_TRACE_MAGIC, sizeof(header.magic))
+        || header.version != APR_POOL_TRACE_VERSION) {
+        fprintf(stderr, "%s: not a pool trace (of version %d)\n",
+                fname, APR_POOL_TRACE_VERSION);
+        exit(-1);
+    }
+
+    trace->ntags = header.tags + 1;
+    trace->tags = apr_palloc(pool, trace->ntags * sizeof(char *));
+    trace->tags[0] = "";
+    for (i = 1; i < trace->ntags; i++) {
+        if ((rv = apr_file_read_full(file, &len, sizeof(len),
+                                     NULL)) != APR_SUCCESS)
+            fail("Could not read the trace tags", rv);
+        tag = apr_palloc(pool, (apr_size_t)len + 1);
+        if ((rv = apr_file_read_full(file, tag, len, NULL)) != APR_SUCCESS)
+            fail("Could not read the trace tags", rv);
+        tag[len] = '\0';
+        trace->tags[i] = tag;
+    }
+
+    trace->nrecords = header.records;
+    size = (apr_size_t)header.records * sizeof(apr_pool_trace_record_t);
+    if (size / sizeof(apr_pool_trace_record_t) != header.records) {
+        fprintf(stderr, "%s: too many records\n", fname);
+        exit(-1);
+    }
+    trace->records = apr_palloc(pool, size);
+    if ((rv = apr_file_read_full(file, trace->records, size,
+                                 NULL)) != APR_SUCCESS)
+        fail("Could not read the trace records", rv);
+
+    for (n = 0; n < trace->nrecords; n++) {
+        if (trace->records[n].tag >= trace->ntags)
+            trace->records[n].tag = 0;
+    }
+
+    apr_file_close(file);
+}
+
+static const char *type_name(apr_uint32_t type)
+{
+    switch (type) {
+    case APR_POOL_TRACE_CREATE:
+        return "create";
+    case APR_POOL_TRACE_ALLOC:
+        return "alloc";
+    case APR_POOL_TRACE_CLEAR:
+        return "clear";
+    case APR_POOL_TRACE_DESTROY:
+        return "destroy";
+    }
+    return "unknown";
+}
+
+static int tag_total_cmp(const void *a, const void *b)
+{
+    const tag_total_t *ta = a, *tb = b;
+
+    if (ta->bytes != tb->bytes)
+        return ta->bytes < tb->bytes ? 1 : -1;
+    return strcmp(ta->tag, tb->tag);
+}
+
+static void summary(const trace_t *trace, apr_pool_t *pool)
+{
+    tag_total_t *totals;
+    apr_uint64_t types[APR_POOL_TRACE_DESTROY + 1] = { 0 };
+    apr_uint64_t i;
+    apr_uint32_t threads = 0, t;
+    apr_int64_t first = 0, last = 0;
+
+    totals = apr_pcalloc(pool, trace->ntags * sizeof(*totals));
+    for (t = 0; t < trace->ntags; t++) {
+        totals[t].tag = trace->tags[t][0] ? trace->tags[t] : "(untagged)";
+    }
+
+    for (i = 0; i < trace->nrecords; i++) {
+        const apr_pool_trace_record_t *rec = &trace->records[i];
+
+        if (rec->type <= APR_POOL_TRACE_DESTROY)
+            types[rec->type]++;
+        if (rec->thread >= threads)
+            threads = rec->thread + 1;
+        if (!i || rec->time < first)
+            first = rec->time;
+        if (!i || rec->time > last)
+            last = rec->time;
+
+        if (rec->type == APR_POOL_TRACE_ALLOC) {
+            totals[rec->tag].bytes += rec->size;
+            totals[rec->tag].allocs++;
+        }
+    }
+
+    printf("Records: %" APR_UINT64_T_FMT " from %u thread(s) over %.3f sec\n",
+           trace->nrecords, threads, (double)(last - first) / APR_USEC_PER_SEC);
+    for (t = APR_POOL_TRACE_CREATE; t <= APR_POOL_TRACE_DESTROY; t++) {
+        printf("    %-10s %12" APR_UINT64_T_FMT "\n", type_name(t), types[t]);
+    }
+
+    printf("\nRequested per tag:\n");
+    qsort(totals, trace->ntags, sizeof(*totals), tag_total_cmp);
+    for (t = 0; t < trace->ntags; t++) {
+        if (!totals[t].allocs)
+            continue;
+        printf("    %-32s %14" APR_UINT64_T_FMT " bytes %10"
+               APR_UINT64_T_FMT " allocs\n",
+               totals[t].tag, totals[t].bytes, totals[t].allocs);
+    }
+}
+
+/* Folded stacks, aggregated by tag and address */
+static void folded(const trace_t *trace, apr_pool_t *pool)
+{
+    apr_hash_t *stacks = apr_hash_make(pool);
+    apr_hash_index_t *hi;
+    apr_uint64_t i;
+
+    for (i = 0; i < trace->nrecords; i++) {
+        const apr_pool_trace_record_t *rec = &trace->records[i];
+        apr_uint64_t *bytes;
+        char *stack, *c;
+
+        if (rec->type != APR_POOL_TRACE_ALLOC)
+            continue;
+
+        stack = apr_psprintf(pool, "%s;0x%" APR_UINT64_T_HEX_FMT,
+                             trace->tags[rec->tag][0] ? trace->tags[rec->tag]
+                                                      : "(untagged)",
+                             rec->pc);
+        /* The tag is a single frame */
+        for (c = stack; *c != ';'; c++) {
+            if (*c == ' ')
+                *c = '_';
+        }
+        if ((bytes = apr_hash_get(stacks, stack,
+                                  APR_HASH_KEY_STRING)) == NULL) {
+            bytes = apr_pcalloc(pool, sizeof(*bytes));
+            apr_hash_set(stacks, stack, APR_HASH_KEY_STRING, bytes);
+        }
+        *bytes += rec->size;
+    }
+
+    for (hi = apr_hash_first(pool, stacks); hi; hi = apr_hash_next(hi)) {
+        printf("%s %" APR_UINT64_T_FMT "\n", (const char *)apr_hash_this_key(hi),
+               *(apr_uint64_t *)apr_hash_this_val(hi));
+    }
+}
+
+/* Time order, the order of the dump (per thread) for the same time */
+static int record_cmp(const void *a, const void *b)
+{
+    const apr_pool_trace_record_t *ra = *(apr_pool_trace_record_t **)a;
+    const apr_pool_trace_record_t *rb = *(apr_pool_trace_record_t **)b;
+
+    if (ra->time != rb->time)
+        return ra->time < rb->time ? -1 : 1;
+    return ra < rb ? -1 : ra > rb;
+}
+
+static void replay(const trace_t *trace, apr_size_t max_free,
+                   apr_size_t pool_cache, apr_uint32_t flags,
+                   apr_pool_t *pool)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t stats;
+    apr_pool_t *root, *p;
+    apr_hash_t *pools = apr_hash_make(pool);
+    apr_pool_trace_record_t **order;
+    apr_size_t peak = 0, peak_used = 0;
+    apr_uint64_t i;
+    apr_time_t start;
+    apr_status_t rv;
+
+    order = apr_palloc(pool, trace->nrecords * sizeof(*order));
+    for (i = 0; i < trace->nrecords; i++) {
+        order[i] = &trace->records[i];
+    }
+    qsort(order, trace->nrecords, sizeof(*order), record_cmp);
+
+    if ((rv = apr_allocator_create_ex(&allocator, flags)) != APR_SUCCESS)
+        fail("Could not create the allocator", rv);
+    if ((rv = apr_pool_create_ex(&root, NULL, NULL,
+                                 allocator)) != APR_SUCCESS)
+        fail("Could not create the replay pool", rv);
+    apr_allocator_owner_set(allocator, root);
+    if (max_free)
+        apr_allocator_max_free_set(allocator, max_free);
+    apr_allocator_pool_cache_set(allocator, pool_cache);
+
+    start = apr_time_now();
+    for (i = 0; i < trace->nrecords; i++) {
+        const apr_pool_trace_record_t *rec = order[i];
+
+        p = apr_hash_get(pools, &rec->pool, sizeof(rec->pool));
+        switch (rec->type) {
+        case APR_POOL_TRACE_CREATE:
+            if (p)
+                apr_pool_destroy(p);
+            p = NULL;
+            /* Fall through */
+        case APR_POOL_TRACE_ALLOC:
+            /* The pools created before the trace appear with an alloc */
+            if (p == NULL) {
+                if ((rv = apr_pool_create(&p, root)) != APR_SUCCESS)
+                    fail("Could not create a pool", rv);
+                apr_hash_set(pools, &rec->pool, sizeof(rec->pool), p);
+            }
+            if (rec->type == APR_POOL_TRACE_ALLOC)
+                apr_palloc(p, (apr_size_t)rec->size);
+            break;
+        case APR_POOL_TRACE_CLEAR:
+            if (p)
+                apr_pool_clear(p);
+            break;
+        case APR_POOL_TRACE_DESTROY:
+            if (p) {
+                apr_pool_destroy(p);
+                apr_hash_set(pools, &rec->pool, sizeof(rec->pool), NULL);
+            }
+            break;
+        }
+
+        if (i % REPLAY_SAMPLE == 0 || i + 1 == trace->nrecords) {
+            apr_allocator_stats_get(allocator, &stats);
+            if (stats.sys_bytes > peak)
+                peak = stats.sys_bytes;
+            if (stats.sys_bytes - stats.free_bytes > peak_used)
+                peak_used = stats.sys_bytes - stats.free_bytes;
+        }
+    }
+
+    printf("Replayed %" APR_UINT64_T_FMT " records in %" APR_TIME_T_FMT
+           " usec (max_free %" APR_SIZE_T_FMT ", pool cache %"
+           APR_SIZE_T_FMT "%s)\n",
+           trace->nrecords, apr_time_now() - start, max_free, pool_cache,
+           (flags & APR_ALLOCATOR_HUGEPAGES) ? ", huge pages" : "");
+    printf("    %-24s %14" APR_SIZE_T_FMT " bytes\n", "peak system memory",
+           peak);
+    printf("    %-24s %14" APR_SIZE_T_FMT " bytes\n", "peak used memory",
+           peak_used);
+    printf("    %-24s %14" APR_SIZE_T_FMT " bytes\n", "final system memory",
+           stats.sys_bytes);
+    printf("    %-24s %14" APR_SIZE_T_FMT "\n", "system allocations",
+           stats.sys_allocs);
+    printf("    %-24s %14" APR_SIZE_T_FMT "\n", "system releases",
+           stats.sys_frees);
+
+    apr_pool_destroy(root);
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_getopt_t *opt;
+    apr_status_t rv;
+    trace_t trace;
+    char optchar;
+    const char *optarg;
+    apr_size_t max_free = 0, pool_cache = 0;
+    apr_uint32_t flags = 0;
+    int do_folded = 0, do_replay = 0;
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS)
+        fail("Could not set up to parse options", rv);
+
+    while ((rv = apr_getopt(opt, "frm:c:H", &optchar,
+                            &optarg)) == APR_SUCCESS) {
+        switch (optchar) {
+        case 'f':
+            do_folded = 1;
+            break;
+        case 'r':
+            do_replay = 1;
+            break;
+        case 'm':
+            max_free = (apr_size_t)apr_atoi64(optarg);
+            break;
+        case 'c':
+            pool_cache = (apr_size_t)apr_atoi64(optarg);
+            break;
+        case 'H':
+            flags |= APR_ALLOCATOR_HUGEPAGES;
+            break;
+        }
+    }
+    if ((rv != APR_SUCCESS && rv != APR_EOF) || opt->ind + 1 != argc
+        || (do_folded && do_replay)) {
+        fprintf(stderr, "Usage: %s [-f | -r [-m max_free] [-c pool_cache] "
+                "[-H]] tracefile\n", argv[0]);
+        exit(-1);
+    }
+
+    trace_read(&trace, argv[opt->ind], pool);
+
+    if (do_folded)
+        folded(&trace, pool);
+    else if (do_replay)
+        replay(&trace, max_free, pool_cache, flags, pool);
+    else
+        summary(&trace, pool);
+
+    return 0;
+}
@@ -0,0 +1,253 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_strings.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_flathash.h"
+
+#define NUM_KEYS 100000
+
+static void flathash_set_get(abts_case *tc, void *data)
+{
+    apr_flathash_t *fh;
+    char *key;
+
+    fh = apr_flathash_make(p);
+    ABTS_PTR_NOTNULL(tc, fh);
+    ABTS_PTR_EQUAL(tc, p, apr_flathash_pool_get(fh));
+    ABTS_INT_EQUAL(tc, 0, apr_flathash_count(fh));
+    ABTS_PTR_EQUAL(tc, NULL, apr_flathash_get(fh, "key", APR_HASH_KEY_STRING));
+
+    apr_flathash_set(fh, "key", APR_HASH_KEY_STRING, "value");
+    ABTS_STR_EQUAL(tc, "value", apr_flathash_get(fh, "key",
+                                                 APR_HASH_KEY_STRING));
+    apr_flathash_set(fh, "key", APR_HASH_KEY_STRING, "new");
+    ABTS_INT_EQUAL(tc, 1, apr_flathash_count(fh));
+
+    /* Keys are compared by value, for their length */
+    key = apr_pstrdup(p, "keyboard");
+    ABTS_STR_EQUAL(tc, "new", apr_flathash_get(fh, key, 3));
+    ABTS_PTR_EQUAL(tc, NULL, apr_flathash_get(fh, key, APR_HASH_KEY_STRING));
+    apr_flathash_set(fh, key, APR_HASH_KEY_STRING, "board");
+    ABTS_INT_EQUAL(tc, 2, apr_flathash_count(fh));
+    ABTS_STR_EQUAL(tc, "board", apr_flathash_get(fh, "keyboard",
+                                                 APR_HASH_KEY_STRING));
+
+    apr_flathash_set(fh, "key", 3, NULL);
+    ABTS_PTR_EQUAL(tc, NULL, apr_flathash_get(fh, "key", APR_HASH_KEY_STRING));
+    ABTS_INT_EQUAL(tc, 1, apr_flathash_count(fh));
+    apr_flathash_set(fh, "nokey", APR_HASH_KEY_STRING, NULL);
+    ABTS_INT_EQUAL(tc, 1, apr_flathash_count(fh));
+}
+
+static void flathash_inline(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_flathash_t *fh;
+    apr_uint64_t *v;
+    int i, k;
+
+    apr_pool_create(&pool, p);
+    fh = apr_flathash_make_ex(pool, 0, sizeof(int), sizeof(apr_uint64_t),
+                              NULL);
+
+    for (i = 0; i < NUM_KEYS; i++) {
+        apr_uint64_t val = (apr_uint64_t)i * 3;
+
+        apr_flathash_set(fh, &i, 0, &val);
+    }
+    ABTS_INT_EQUAL(tc, NUM_KEYS, apr_flathash_count(fh));
+    for (i = 0; i < NUM_KEYS; i++) {
+        v = apr_flathash_get(fh, &i, 0);
+        ABTS_PTR_NOTNULL(tc, v);
+        ABTS_INT_EQUAL(tc, 0, (int)((apr_uintptr_t)v % sizeof(*v)));
+        if (*v != (apr_uint64_t)i * 3) {
+            ABTS_FAIL(tc, "bad inline value");
+            break;
+        }
+    }
+    k = NUM_KEYS;
+    ABTS_PTR_EQUAL(tc, NULL, apr_flathash_get(fh, &k, 0));
+
+    /* Remove the odd keys, the even ones must remain */
+    for (i = 1; i < NUM_KEYS; i += 2) {
+        apr_flathash_set(fh, &i, 0, NULL);
+    }
+    ABTS_INT_EQUAL(tc, NUM_KEYS / 2, apr_flathash_count(fh));
+    for (i = 0; i < NUM_KEYS; i++) {
+        v = apr_flathash_get(fh, &i, 0);
+        if ((v == NULL) != (i % 2)
+            || (v && *v != (apr_uint64_t)i * 3)) {
+            ABTS_FAIL(tc, "bad inline value after removal");
+            break;
+        }
+    }
+
+    apr_pool_destroy(pool);
+}
+
+/* All the keys collide, so that they are probed across all the groups */
+static unsigned int hash_collide(const char *key, apr_ssize_t *klen)
+{
+    if (*klen == APR_HASH_KEY_STRING)
+        *klen = strlen(key);
+    return 42;
+}
+
+static void flathash_churn(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_flathash_t *fh[2];
+    char **keys;
+    int i, j, n;
+
+    apr_pool_create(&pool, p);
+    fh[0] = apr_flathash_make(pool);
+    fh[1] = apr_flathash_make_ex(pool, 0, 0, 0, hash_collide);
+
+    keys = apr_palloc(pool, 2000 * sizeof(char *));
+    for (i = 0; i < 2000; i++) {
+        keys[i] = apr_psprintf(pool, "key-%d", i);
+    }
+
+    /* Keep 100 keys in the table, while adding and removing 2000 of them,
+     * which has to reclaim the removed slots.
+     */
+    for (n = 0; n < 2; n++) {
+        for (i = 0; i < 2000; i++) {
+            apr_flathash_set(fh[n], keys[i], APR_HASH_KEY_STRING, keys[i]);
+            if (i >= 100) {
+                apr_flathash_set(fh[n], keys[i - 100], APR_HASH_KEY_STRING,
+                                 NULL);
+            }
+            if (i % 97 == 0) {
+                for (j = 0; j < 2000; j++) {
+                    const char *val = apr_flathash_get(fh[n], keys[j],
+                                                       APR_HASH_KEY_STRING);
+                    if ((j <= i && j > i - 100) ? val != keys[j] : val != NULL) {
+                        ABTS_FAIL(tc, "bad value while churning");
+                        break;
+                    }
+                }
+            }
+        }
+        ABTS_INT_EQUAL(tc, 100, apr_flathash_count(fh[n]));
+    }
+
+    apr_pool_destroy(pool);
+}
+
+static void flathash_iterate(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_flathash_t *fh;
+    apr_flathash_index_t *hi;
+    int keys[1000], vals[1000];
+    int i, count, ksum, vsum;
+
+    apr_pool_create(&pool, p);
+    fh = apr_flathash_make_ex(pool, 1000, 0, 0, NULL);
+    for (i = 0; i < 1000; i++) {
+        keys[i] = i;
+        vals[i] = i * 2;
+        apr_flathash_set(fh, &keys[i], sizeof(int), &vals[i]);
+    }
+
+    count = ksum = vsum = 0;
+    for (hi = apr_flathash_first(pool, fh); hi; hi = apr_flathash_next(hi)) {
+        const void *key;
+        apr_ssize_t klen;
+        void *val;
+
+        apr_flathash_this(hi, &key, &klen, &val);
+        ABTS_INT_EQUAL(tc, sizeof(int), (int)klen);
+        ksum += *(const int *)key;
+        vsum += *(int *)val;
+        count++;
+
+        /* Deleting the current entry is fine */
+        if (*(const int *)key % 2) {
+            apr_flathash_set(fh, key, klen, NULL);
+        }
+    }
+    ABTS_INT_EQUAL(tc, 1000, count);
+    ABTS_INT_EQUAL(tc, 999 * 1000 / 2, ksum);
+    ABTS_INT_EQUAL(tc, 999 * 1000, vsum);
+    ABTS_INT_EQUAL(tc, 500, apr_flathash_count(fh));
+
+    count = 0;
+    for (hi = apr_flathash_first(NULL, fh); hi; hi = apr_flathash_next(hi)) {
+        const int *key = apr_flathash_this_key(hi);
+
+        ABTS_INT_EQUAL(tc, 0, *key % 2);
+        ABTS_INT_EQUAL(tc, *key * 2, *(int *)apr_flathash_this_val(hi));
+        count++;
+    }
+    ABTS_INT_EQUAL(tc, 500, count);
+
+    apr_pool_destroy(pool);
+}
+
+static void flathash_copy_clear(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_flathash_t *fh, *c;
+    int i, val;
+
+    apr_pool_create(&pool, p);
+    fh = apr_flathash_make_ex(pool, 0, sizeof(int), sizeof(int), NULL);
+    for (i = 0; i < 100; i++) {
+        val = -i;
+        apr_flathash_set(fh, &i, 0, &val);
+    }
+
+    c = apr_flathash_copy(pool, fh);
+    ABTS_INT_EQUAL(tc, 100, apr_flathash_count(c));
+    i = 10;
+    val = 42;
+    apr_flathash_set(c, &i, 0, &val);
+    ABTS_INT_EQUAL(tc, 42, *(int *)apr_flathash_get(c, &i, 0));
+    ABTS_INT_EQUAL(tc, -10, *(int *)apr_flathash_get(fh, &i, 0));
+
+    apr_flathash_clear(fh);
+    ABTS_INT_EQUAL(tc, 0, apr_flathash_count(fh));
+    ABTS_PTR_EQUAL(tc, NULL, apr_flathash_get(fh, &i, 0));
+    ABTS_PTR_EQUAL(tc, NULL, apr_flathash_first(NULL, fh));
+    ABTS_INT_EQUAL(tc, 100, apr_flathash_count(c));
+    i = 99;
+    ABTS_INT_EQUAL(tc, -99, *(int *)apr_flathash_get(c, &i, 0));
+
+    apr_flathash_set(fh, &i, 0, &val);
+    ABTS_INT_EQUAL(tc, 1, apr_flathash_count(fh));
+
+    apr_pool_destroy(pool);
+}
+
+abts_suite *testflathash(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, flathash_set_get, NULL);
+    abts_run_test(suite, flathash_inline, NULL);
+    abts_run_test(suite, flathash_churn, NULL);
+    abts_run_test(suite, flathash_iterate, NULL);
+    abts_run_test(suite, flathash_copy_clear, NULL);
+
+    return suite;
+}
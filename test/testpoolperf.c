@@ -0,0 +1,948 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* testpoolperf.c
+ * Pool and allocator benchmarks, each one run with the default settings
+ * and then with the feature it measures, printing the time taken (and
+ * the dTLB load misses where Linux perf events are available).
+ *
+ *   ./testpoolperf [-s megabytes] [-n passes] [benchmark ...]
+ *
+ * Benchmarks:
+ *   hugepages   walk a pool full of small objects linked in random order,
+ *               with the allocator's nodes carved out of huge page backed
+ *               regions (APR_ALLOCATOR_HUGEPAGES) or not.
+ *   palloc      small allocations and clears, calling apr_palloc() or
+ *               with the inline version (APR_POOL_INLINE).
+ *   mark        scratch allocations in a loop, reclaimed with a subpool
+ *               or with apr_pool_mark() and apr_pool_rewind().
+ *   cleanups    register cleanups and kill them oldest first, with few
+ *               of them per pool or with many (indexed) ones.
+ *   create      create, use and destroy subpools, with or without the
+ *               allocator keeping the destroyed pools for reuse
+ *               (apr_allocator_pool_cache_set()).
+ *   small       keep many idle subpools holding a few hundred bytes,
+ *               created normally or with APR_POOL_SMALL, and print the
+ *               memory they take from the allocator.
+ *   retain      request-like cycles of a few node sized allocations and
+ *               a clear, with the nodes given back to the (mutex
+ *               protected) allocator or kept by the pool
+ *               (apr_pool_retain_set()).
+ *   arena       build a tree of pools and tear it down by destroying the
+ *               root pool (and allocator), with the allocator's blocks
+ *               malloc()ed or carved out of an arena (arena_set()).
+ *   contention  1 to 64 threads creating, using and destroying pools of
+ *               a shared allocator, whose free lists are protected by its
+ *               mutex or lock-free (APR_ALLOCATOR_LOCKFREE).
+ *   concurrent  1 to 64 threads allocating results of the same lifetime,
+ *               in a subpool per thread or all in one pool created with
+ *               apr_pool_create_concurrent(), and print the memory used.
+ *
+ * The TLB misses can also be observed with e.g.
+ *   perf stat -e dTLB-load-misses ./testpoolperf hugepages
+ */
+
+/* For the palloc benchmark, apr_palloc() is still called explicitly
+ * with (apr_palloc)().
+ */
+#define APR_POOL_INLINE
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_allocator.h"
+#include "apr_getopt.h"
+#include "apr_strings.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define DEFAULT_MEGABYTES 256
+#define DEFAULT_PASSES 4
+
+static apr_size_t megabytes = DEFAULT_MEGABYTES;
+static int passes = DEFAULT_PASSES;
+
+/*
+ * dTLB load misses counter, -1 when not available
+ */
+#if defined(__linux__) && defined(__NR_perf_event_open)
+static int tlb_open(void)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB
+                  | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                  | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void tlb_start(int fd)
+{
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+static apr_int64_t tlb_stop(int fd)
+{
+    apr_int64_t count;
+
+    if (fd < 0)
+        return -1;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+        return -1;
+
+    return count;
+}
+
+static void tlb_close(int fd)
+{
+    if (fd >= 0)
+        close(fd);
+}
+#else
+#define tlb_open() (-1)
+#define tlb_start(fd)
+#define tlb_stop(fd) (-1)
+#define tlb_close(fd)
+#endif
+
+static void report(const char *name, apr_time_t usecs, apr_int64_t misses,
+                   apr_size_t ops)
+{
+    printf("    %-32s %10" APR_INT64_T_FMT " usec  %8.2f ns/op",
+           name, usecs, (double)usecs * 1000 / (ops ? ops : 1));
+    if (misses >= 0)
+        printf("  %12" APR_INT64_T_FMT " dTLB misses", misses);
+    printf("\n");
+}
+
+static apr_uint32_t xorshift(apr_uint32_t *state)
+{
+    apr_uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return *state = x;
+}
+
+/*
+ * hugepages
+ */
+typedef struct chase_t chase_t;
+
+struct chase_t {
+    chase_t *next;
+    char     payload[56];
+};
+
+static apr_status_t chase(const char *name, apr_uint32_t flags)
+{
+    apr_allocator_t *allocator;
+    apr_pool_t *pool;
+    apr_size_t n, i, count = megabytes * 1024 * 1024 / sizeof(chase_t);
+    chase_t **objs, *obj;
+    apr_uint32_t seed = 2463534242u;
+    apr_time_t start;
+    apr_status_t rv;
+    int fd, pass;
+
+    if ((rv = apr_allocator_create_ex(&allocator, flags)) != APR_SUCCESS)
+        return rv;
+    if ((rv = apr_pool_create_ex(&pool, NULL, NULL,
+                                 allocator)) != APR_SUCCESS) {
+        apr_allocator_destroy(allocator);
+        return rv;
+    }
+    apr_allocator_owner_set(allocator, pool);
+
+    if ((objs = malloc(count * sizeof(chase_t *))) == NULL) {
+        apr_pool_destroy(pool);
+        return APR_ENOMEM;
+    }
+    for (i = 0; i < count; i++) {
+        objs[i] = apr_palloc(pool, sizeof(chase_t));
+    }
+    for (i = count - 1; i > 0; i--) {
+        n = xorshift(&seed) % (i + 1);
+        obj = objs[i];
+        objs[i] = objs[n];
+        objs[n] = obj;
+    }
+    for (i = 0; i < count; i++) {
+        objs[i]->next = objs[(i + 1) % count];
+    }
+    obj = objs[0];
+    free(objs);
+
+    fd = tlb_open();
+    tlb_start(fd);
+    start = apr_time_now();
+    for (pass = 0; pass < passes; pass++) {
+        for (i = 0; i < count; i++) {
+            obj = obj->next;
+        }
+    }
+    report(name, apr_time_now() - start, tlb_stop(fd),
+           count * passes + (obj == NULL));
+    tlb_close(fd);
+
+    apr_pool_destroy(pool);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t bench_hugepages(void)
+{
+    apr_status_t rv;
+
+    printf("Random walk of %" APR_SIZE_T_FMT "MB of pool objects\n",
+           megabytes);
+    if ((rv = chase("default allocator", 0)) != APR_SUCCESS)
+        return rv;
+    return chase("APR_ALLOCATOR_HUGEPAGES", APR_ALLOCATOR_HUGEPAGES);
+}
+
+/*
+ * palloc
+ */
+#define PALLOC_BATCH 1000
+
+#define PALLOC_LOOP(alloc_) do {                                    \
+    for (pass = 0; pass < passes; pass++) {                         \
+        for (i = 0; i < count; i++) {                               \
+            for (j = 0; j < PALLOC_BATCH; j++) {                    \
+                sum += (apr_uintptr_t)alloc_(pool, 8 + (j & 7) * 8);\
+            }                                                       \
+            apr_pool_clear(pool);                                   \
+        }                                                           \
+    }                                                               \
+} while (0)
+
+static apr_status_t palloc_run(const char *name, int inline_alloc)
+{
+    apr_pool_t *pool;
+    apr_size_t i, j, count = megabytes * 64;
+    volatile apr_uintptr_t result;
+    apr_uintptr_t sum = 0;
+    apr_time_t start;
+    apr_status_t rv;
+    int pass;
+
+    if ((rv = apr_pool_create(&pool, NULL)) != APR_SUCCESS)
+        return rv;
+
+    start = apr_time_now();
+    if (inline_alloc)
+        PALLOC_LOOP(apr_palloc);
+    else
+        PALLOC_LOOP((apr_palloc));
+    report(name, apr_time_now() - start, -1,
+           count * PALLOC_BATCH * passes);
+    result = sum;
+    (void)result;
+
+    apr_pool_destroy(pool);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t bench_palloc(void)
+{
+    apr_status_t rv;
+
+    printf("Allocation of %" APR_SIZE_T_FMT " x %d objects of 8 to 64 "
+           "bytes\n", megabytes * 64 * PALLOC_BATCH, passes);
+    if ((rv = palloc_run("apr_palloc()", 0)) != APR_SUCCESS)
+        return rv;
+    return palloc_run("APR_POOL_INLINE", 1);
+}
+
+/*
+ * mark
+ */
+#define MARK_ALLOCS 16
+
+static apr_status_t mark_run(const char *name, int use_mark)
+{
+    apr_pool_t *pool, *scratch;
+    apr_pool_mark_t *mark;
+    apr_size_t i, j, count = megabytes * 4096;
+    volatile apr_uintptr_t result;
+    apr_uintptr_t sum = 0;
+    apr_time_t start;
+    apr_status_t rv;
+    int pass;
+
+    if ((rv = apr_pool_create(&pool, NULL)) != APR_SUCCESS)
+        return rv;
+    if ((mark = apr_pool_mark(pool)) == NULL) {
+        apr_pool_destroy(pool);
+        return APR_ENOMEM;
+    }
+
+    start = apr_time_now();
+    for (pass = 0; pass < passes; pass++) {
+        for (i = 0; i < count; i++) {
+            if (use_mark) {
+                for (j = 0; j < MARK_ALLOCS; j++) {
+                    sum += (apr_uintptr_t)apr_palloc(pool, 16 + j * 8);
+                }
+                apr_pool_rewind(pool, mark);
+            }
+            else {
+                if ((rv = apr_pool_create(&scratch, pool)) != APR_SUCCESS) {
+                    apr_pool_destroy(pool);
+                    return rv;
+                }
+                for (j = 0; j < MARK_ALLOCS; j++) {
+                    sum += (apr_uintptr_t)apr_palloc(scratch, 16 + j * 8);
+                }
+                apr_pool_destroy(scratch);
+            }
+        }
+    }
+    report(name, apr_time_now() - start, -1, count * passes);
+    result = sum;
+    (void)result;
+
+    apr_pool_destroy(pool);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t bench_mark(void)
+{
+    apr_status_t rv;
+
+    printf("Scratch allocation of %d objects, %" APR_SIZE_T_FMT
+           " x %d times\n", MARK_ALLOCS, megabytes * 4096, passes);
+    if ((rv = mark_run("subpool", 0)) != APR_SUCCESS)
+        return rv;
+    return mark_run("apr_pool_rewind()", 1);
+}
+
+/*
+ * cleanups
+ */
+static apr_status_t cleanups_run(const char *name, apr_size_t per_pool)
+{
+    apr_pool_t *pool;
+    apr_size_t i, j, count = megabytes * 16384 / per_pool;
+    char *data;
+    apr_time_t start;
+    apr_status_t rv;
+    int pass;
+
+    if ((rv = apr_pool_create(&pool, NULL)) != APR_SUCCESS)
+        return rv;
+    data = apr_palloc(pool, per_pool);
+
+    start = apr_time_now();
+    for (pass = 0; pass < passes; pass++) {
+        for (i = 0; i < count; i++) {
+            for (j = 0; j < per_pool; j++) {
+                apr_pool_cleanup_register(pool, data + j,
+                                          apr_pool_cleanup_null,
+                                          apr_pool_cleanup_null);
+            }
+            /* The oldest ones are the farthest in the LIFO list */
+            for (j = 0; j < per_pool; j++) {
+                apr_pool_cleanup_kill(pool, data + j,
+                                      apr_pool_cleanup_null);
+            }
+        }
+    }
+    report(name, apr_time_now() - start, -1, count * per_pool * passes);
+
+    apr_pool_destroy(pool);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t bench_cleanups(void)
+{
+    apr_status_t rv;
+
+    printf("Registering and killing %" APR_SIZE_T_FMT
+           " cleanups x %d times\n", megabytes * 16384, passes);
+    if ((rv = cleanups_run("16 per pool", 16)) != APR_SUCCESS)
+        return rv;
+    return cleanups_run("4096 per pool", 4096);
+}
+
+/*
+ * create
+ */
+#define CREATE_CACHE 16
+
+static apr_status_t create_run(const char *name, apr_size_t cache)
+{
+    apr_allocator_t *allocator;
+    apr_pool_t *pool, *subpool;
+    apr_size_t i, count = megabytes * 16384;
+    volatile apr_uintptr_t result;
+    apr_uintptr_t sum = 0;
+    apr_time_t start, usecs;
+    apr_status_t rv;
+    int pass;
+
+    if ((rv = apr_allocator_create(&allocator)) != APR_SUCCESS)
+        return rv;
+    if ((rv = apr_pool_create_ex(&pool, NULL, NULL,
+                                 allocator)) != APR_SUCCESS) {
+        apr_allocator_destroy(allocator);
+        return rv;
+    }
+    apr_allocator_owner_set(allocator, pool);
+    apr_allocator_pool_cache_set(allocator, cache);
+
+    start = apr_time_now();
+    for (pass = 0; pass < passes; pass++) {
+        for (i = 0; i < count; i++) {
+            if ((rv = apr_pool_create(&subpool, pool)) != APR_SUCCESS) {
+                apr_pool_destroy(pool);
+                return rv;
+            }
+            sum += (apr_uintptr_t)apr_palloc(subpool, 64);
+            apr_pool_destroy(subpool);
+        }
+    }
+    usecs = apr_time_now() - start;
+    report(name, usecs, -1, count * passes);
+    printf("    %-32s %10.0f creates/sec\n", "",
+           (double)count * passes * APR_USEC_PER_SEC / (usecs ? usecs : 1));
+    result = sum;
+    (void)result;
+
+    apr_pool_destroy(pool);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t bench_create(void)
+{
+    apr_status_t rv;
+
+    printf("Creating and destroying %" APR_SIZE_T_FMT
+           " subpools x %d times\n", megabytes * 16384, passes);
+    if ((rv = create_run("no pool cache", 0)) != APR_SUCCESS)
+        return rv;
+    return create_run("apr_allocator_pool_cache_set()", CREATE_CACHE);
+}
+
+/*
+ * small
+ */
+static apr_status_t small_run(const char *name, apr_uint32_t flags)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t stats;
+    apr_pool_t *pool, *subpool;
+    apr_size_t i, count = megabytes * 1024;
+    apr_time_t start, usecs;
+    apr_status_t rv;
+
+    if ((rv = apr_allocator_create(&allocator)) != APR_SUCCESS)
+        return rv;
+    if ((rv = apr_pool_create_ex(&pool, NULL, NULL,
+                                 allocator)) != APR_SUCCESS) {
+        apr_allocator_destroy(allocator);
+        return rv;
+    }
+    apr_allocator_owner_set(allocator, pool);
+
+    start = apr_time_now();
+    for (i = 0; i < count; i++) {
+        if ((rv = apr_pool_create_flags(&subpool, pool, NULL, NULL,
+                                        flags)) != APR_SUCCESS)
+            break;
+        memset(apr_palloc(subpool, 300), 0, 300);
+    }
+    usecs = apr_time_now() - start;
+    apr_allocator_stats_get(allocator, &stats);
+    apr_pool_destroy(pool);
+    if (rv != APR_SUCCESS)
+        return rv;
+
+    report(name, usecs, -1, count);
+    printf("    %-32s %10" APR_SIZE_T_FMT " KB, %" APR_SIZE_T_FMT
+           " bytes/pool\n", "", stats.sys_bytes / 1024,
+           stats.sys_bytes / count);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t bench_small(void)
+{
+    apr_status_t rv;
+
+    printf("Keeping %" APR_SIZE_T_FMT " idle subpools\n", megabytes * 1024);
+    if ((rv = small_run("apr_pool_create()", 0)) != APR_SUCCESS)
+        return rv;
+    return small_run("APR_POOL_SMALL", APR_POOL_SMALL);
+}
+
+/*
+ * retain
+ */
+#define RETAIN_ALLOCS 4
+#define RETAIN_SIZE   10000
+
+static apr_status_t retain_run(const char *name, int retain)
+{
+    apr_allocator_t *allocator;
+    apr_pool_t *pool, *req;
+    apr_size_t i, count = megabytes * 1024;
+    apr_time_t start;
+    apr_status_t rv;
+    int j;
+
+    if ((rv = apr_allocator_create(&allocator)) != APR_SUCCESS)
+        return rv;
+    if ((rv = apr_pool_create_ex(&pool, NULL, NULL,
+                                 allocator)) != APR_SUCCESS) {
+        apr_allocator_destroy(allocator);
+        return rv;
+    }
+    apr_allocator_owner_set(allocator, pool);
+#if APR_HAS_THREADS
+    {
+        apr_thread_mutex_t *mutex;
+
+        if ((rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT,
+                                          pool)) != APR_SUCCESS) {
+            apr_pool_destroy(pool);
+            return rv;
+        }
+        apr_allocator_mutex_set(allocator, mutex);
+    }
+#endif
+    if ((rv = apr_pool_create(&req, pool)) != APR_SUCCESS) {
+        apr_pool_destroy(pool);
+        return rv;
+    }
+    if (retain)
+        apr_pool_retain_set(req, RETAIN_ALLOCS
+                                 * apr_allocator_align(allocator,
+                                                       RETAIN_SIZE));
+
+    start = apr_time_now();
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < RETAIN_ALLOCS; j++) {
+            *(char *)apr_palloc(req, RETAIN_SIZE) = (char)j;
+        }
+        apr_pool_clear(req);
+    }
+    report(name, apr_time_now() - start, -1, count);
+
+    apr_pool_destroy(pool);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t bench_retain(void)
+{
+    apr_status_t rv;
+
+    printf("Clearing a pool of %d nodes %" APR_SIZE_T_FMT " times\n",
+           RETAIN_ALLOCS + 1, megabytes * 1024);
+    if ((rv = retain_run("no retention", 0)) != APR_SUCCESS)
+        return rv;
+    return retain_run("apr_pool_retain_set()", 1);
+}
+
+/*
+ * arena
+ */
+#define ARENA_SUBPOOLS 64
+
+static apr_status_t arena_run(const char *name, int use_arena)
+{
+    apr_allocator_t *allocator;
+    apr_pool_t *pool, *subpool, *leaf;
+    apr_size_t i, j, count = megabytes * 32 / ARENA_SUBPOOLS;
+    apr_time_t start, build = 0, teardown = 0;
+    char label[64];
+    apr_status_t rv;
+    int pass;
+
+    for (pass = 0; pass < passes; pass++) {
+        start = apr_time_now();
+        if ((rv = apr_allocator_create(&allocator)) != APR_SUCCESS)
+            return rv;
+        if (use_arena
+            && (rv = apr_allocator_arena_set(allocator,
+                                             2 * megabytes * 1024 * 1024))
+                != APR_SUCCESS) {
+            apr_allocator_destroy(allocator);
+            return rv;
+        }
+        if ((rv = apr_pool_create_ex(&pool, NULL, NULL,
+                                     allocator)) != APR_SUCCESS) {
+            apr_allocator_destroy(allocator);
+            return rv;
+        }
+        apr_allocator_owner_set(allocator, pool);
+
+        for (i = 0; i < count; i++) {
+            if ((rv = apr_pool_create(&subpool, pool)) != APR_SUCCESS)
+                break;
+            for (j = 0; j < ARENA_SUBPOOLS; j++) {
+                if ((rv = apr_pool_create(&leaf, subpool)) != APR_SUCCESS)
+                    break;
+                memset(apr_palloc(leaf, 20000), 0, 64);
+                memset(apr_palloc(leaf, 1000), 0, 64);
+            }
+        }
+        build += apr_time_now() - start;
+
+        start = apr_time_now();
+        apr_pool_destroy(pool);
+        teardown += apr_time_now() - start;
+        if (rv != APR_SUCCESS)
+            return rv;
+    }
+
+    apr_snprintf(label, sizeof(label), "%s, build", name);
+    report(label, build, -1, count * ARENA_SUBPOOLS * passes);
+    apr_snprintf(label, sizeof(label), "%s, teardown", name);
+    report(label, teardown, -1, count * ARENA_SUBPOOLS * passes);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t bench_arena(void)
+{
+    apr_status_t rv;
+
+    printf("Building and tearing down trees of %" APR_SIZE_T_FMT
+           " pools x %d times\n", megabytes * 32, passes);
+    if ((rv = arena_run("malloc()", 0)) != APR_SUCCESS)
+        return rv;
+    return arena_run("apr_allocator_arena_set()", 1);
+}
+
+/*
+ * contention
+ */
+#if APR_HAS_THREADS
+#define CONTENTION_MAX_THREADS 64
+
+typedef struct contention_t {
+    apr_allocator_t *allocator;
+    apr_size_t count;
+} contention_t;
+
+static void * APR_THREAD_FUNC contention_thread(apr_thread_t *thd,
+                                                void *data)
+{
+    contention_t *ctx = data;
+    apr_pool_t *pool;
+    apr_size_t i;
+    apr_status_t rv = APR_SUCCESS;
+
+    for (i = 0; i < ctx->count; i++) {
+        if ((rv = apr_pool_create_unmanaged_ex(&pool, NULL,
+                                               ctx->allocator))
+                != APR_SUCCESS)
+            break;
+        /* Three nodes of two sizes */
+        memset(apr_palloc(pool, 6000), 0, 64);
+        memset(apr_palloc(pool, 6000), 0, 64);
+        memset(apr_palloc(pool, 10000), 0, 64);
+        apr_pool_destroy(pool);
+    }
+
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static apr_status_t contention_run(const char *name, apr_uint32_t flags,
+                                   int nthreads, apr_pool_t *p)
+{
+    apr_thread_t *threads[CONTENTION_MAX_THREADS];
+    apr_thread_mutex_t *mutex;
+    contention_t ctx;
+    apr_time_t start, usecs;
+    apr_status_t rv, retval;
+    char *label;
+    int i;
+
+    if ((rv = apr_allocator_create_ex(&ctx.allocator, flags))
+            != APR_SUCCESS)
+        return rv;
+    if ((rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT,
+                                      p)) != APR_SUCCESS) {
+        apr_allocator_destroy(ctx.allocator);
+        return rv;
+    }
+    apr_allocator_mutex_set(ctx.allocator, mutex);
+    ctx.count = megabytes * 4096 / nthreads;
+
+    start = apr_time_now();
+    for (i = 0; i < nthreads; i++) {
+        if ((rv = apr_thread_create(&threads[i], NULL, contention_thread,
+                                    &ctx, p)) != APR_SUCCESS) {
+            nthreads = i;
+            break;
+        }
+    }
+    for (i = 0; i < nthreads; i++) {
+        apr_thread_join(&retval, threads[i]);
+        if (retval != APR_SUCCESS && rv == APR_SUCCESS)
+            rv = retval;
+    }
+    usecs = apr_time_now() - start;
+
+    if (rv == APR_SUCCESS) {
+        label = apr_psprintf(p, "%s, %d threads", name, nthreads);
+        report(label, usecs, -1, ctx.count * nthreads);
+    }
+
+    apr_allocator_destroy(ctx.allocator);
+
+    return rv;
+}
+
+static apr_status_t bench_contention(void)
+{
+    apr_pool_t *p;
+    apr_status_t rv = APR_SUCCESS;
+    int nthreads;
+
+    printf("Creating and destroying %" APR_SIZE_T_FMT
+           " pools of a shared allocator\n", megabytes * 4096);
+    if ((rv = apr_pool_create(&p, NULL)) != APR_SUCCESS)
+        return rv;
+    for (nthreads = 1; nthreads <= CONTENTION_MAX_THREADS && !rv;
+         nthreads *= 2) {
+        apr_pool_clear(p);
+        if ((rv = contention_run("mutex", 0, nthreads, p)) == APR_SUCCESS)
+            rv = contention_run("lock-free", APR_ALLOCATOR_LOCKFREE,
+                                nthreads, p);
+    }
+    apr_pool_destroy(p);
+
+    return rv;
+}
+
+/*
+ * concurrent
+ */
+#define CONCURRENT_SIZE 48
+
+typedef struct concurrent_t {
+    apr_pool_t *pool;
+    int subpools;
+    apr_size_t count;
+} concurrent_t;
+
+static void * APR_THREAD_FUNC concurrent_thread(apr_thread_t *thd,
+                                                void *data)
+{
+    concurrent_t *ctx = data;
+    apr_pool_t *pool = ctx->pool;
+    apr_size_t i;
+    apr_status_t rv = APR_SUCCESS;
+
+    if (ctx->subpools)
+        rv = apr_pool_create(&pool, ctx->pool);
+    for (i = 0; i < ctx->count && rv == APR_SUCCESS; i++) {
+        memset(apr_palloc(pool, CONCURRENT_SIZE), 0, CONCURRENT_SIZE);
+    }
+
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static apr_status_t concurrent_run(const char *name, int subpools,
+                                   int nthreads, apr_pool_t *p)
+{
+    apr_thread_t *threads[CONTENTION_MAX_THREADS];
+    apr_pool_stats_t stats;
+    concurrent_t ctx;
+    apr_time_t start, usecs;
+    apr_status_t rv, retval;
+    char label[64];
+    int i;
+
+    if (subpools)
+        rv = apr_pool_create(&ctx.pool, p);
+    else
+        rv = apr_pool_create_concurrent(&ctx.pool, p);
+    if (rv != APR_SUCCESS)
+        return rv;
+    ctx.subpools = subpools;
+    ctx.count = megabytes * 16384 / nthreads;
+
+    start = apr_time_now();
+    for (i = 0; i < nthreads; i++) {
+        if ((rv = apr_thread_create(&threads[i], NULL, concurrent_thread,
+                                    &ctx, p)) != APR_SUCCESS) {
+            nthreads = i;
+            break;
+        }
+    }
+    for (i = 0; i < nthreads; i++) {
+        apr_thread_join(&retval, threads[i]);
+        if (retval != APR_SUCCESS && rv == APR_SUCCESS)
+            rv = retval;
+    }
+    usecs = apr_time_now() - start;
+
+    if (rv == APR_SUCCESS) {
+        apr_pool_stats_get(ctx.pool, &stats, 1);
+        apr_snprintf(label, sizeof(label), "%s, %d threads", name, nthreads);
+        report(label, usecs, -1, ctx.count * nthreads);
+        printf("    %-32s %10" APR_SIZE_T_FMT " KB reserved\n", "",
+               stats.reserved / 1024);
+    }
+
+    apr_pool_destroy(ctx.pool);
+
+    return rv;
+}
+
+static apr_status_t bench_concurrent(void)
+{
+    apr_pool_t *p;
+    apr_status_t rv = APR_SUCCESS;
+    int nthreads;
+
+    printf("Allocating %" APR_SIZE_T_FMT " x %d bytes from threads\n",
+           megabytes * 16384, CONCURRENT_SIZE);
+    if ((rv = apr_pool_create(&p, NULL)) != APR_SUCCESS)
+        return rv;
+    for (nthreads = 1; nthreads <= CONTENTION_MAX_THREADS && !rv;
+         nthreads *= 2) {
+        apr_pool_clear(p);
+        if ((rv = concurrent_run("subpool per thread", 1, nthreads,
+                                 p)) == APR_SUCCESS)
+            rv = concurrent_run("APR_POOL_CONCURRENT", 0, nthreads, p);
+    }
+    apr_pool_destroy(p);
+
+    return rv;
+}
+#endif /* APR_HAS_THREADS */
+
+static const struct {
+    const char *name;
+    apr_status_t (*func)(void);
+} benchmarks[] = {
+    { "hugepages", bench_hugepages },
+    { "palloc", bench_palloc },
+    { "mark", bench_mark },
+    { "cleanups", bench_cleanups },
+    { "create", bench_create },
+    { "small", bench_small },
+    { "retain", bench_retain },
+    { "arena", bench_arena },
+#if APR_HAS_THREADS
+    { "contention", bench_contention },
+    { "concurrent", bench_concurrent },
+#endif
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_getopt_t *opt;
+    apr_status_t rv;
+    char errmsg[200];
+    char optchar;
+    const char *optarg;
+    apr_size_t i;
+    int j;
+
+    printf("APR Pool Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "s:n:", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 's') {
+            megabytes = (apr_size_t)apr_atoi64(optarg);
+        }
+        else if (optchar == 'n') {
+            passes = atoi(optarg);
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+    if (!megabytes || passes <= 0) {
+        fprintf(stderr, "Invalid size or number of passes\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < NUM_BENCHMARKS; i++) {
+        if (opt->ind < argc) {
+            for (j = opt->ind; j < argc; j++) {
+                if (!strcmp(argv[j], benchmarks[i].name))
+                    break;
+            }
+            if (j == argc)
+                continue;
+        }
+
+        if ((rv = benchmarks[i].func()) != APR_SUCCESS) {
+            fprintf(stderr, "%s benchmark failed: [%d] %s\n",
+                    benchmarks[i].name, rv,
+                    apr_strerror(rv, errmsg, sizeof errmsg));
+            exit(-2);
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
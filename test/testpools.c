@@ -14,11 +14,17 @@
  * limitations under the License.
  */
 
-
 #include "apr_general.h"
 #include "apr_pools.h"
 #include "apr_errno.h"
 #include "apr_file_io.h"
+#include "apr_allocator.h"
+#include "apr_atomic.h"
+#include "apr_hash.h"
+#include "apr_strings.h"
+#include "apr_thread_proc.h"
+#include "apr_thread_mutex.h"
+#include "apr_time.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -139,6 +145,1297 @@ static void test_cleanups(abts_case *tc, void *data)
     }
 }
 
+#define ORDER_CLEANUPS 2000
+
+static char order_data[ORDER_CLEANUPS];
+static int order_seq[ORDER_CLEANUPS * 2];
+static int order_count;
+
+static apr_status_t order_cleanup(void *data)
+{
+    order_seq[order_count++] = (int)((char *)data - order_data);
+    return APR_SUCCESS;
+}
+
+static apr_status_t order_cleanup_dup(void *data)
+{
+    order_seq[order_count++] = ORDER_CLEANUPS + (int)((char *)data
+                                                      - order_data);
+    return APR_SUCCESS;
+}
+
+/* Many cleanups are indexed, but still killed and run as a LIFO list */
+static void test_cleanups_many(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    int i, n;
+
+    apr_pool_create(&pool, p);
+
+    for (i = 0; i < ORDER_CLEANUPS; i++) {
+        apr_pool_cleanup_register(pool, &order_data[i], order_cleanup,
+                                  apr_pool_cleanup_null);
+        if (i % 10 == 0) {
+            apr_pool_cleanup_register(pool, &order_data[i], order_cleanup_dup,
+                                      apr_pool_cleanup_null);
+            apr_pool_cleanup_register(pool, &order_data[i], order_cleanup_dup,
+                                      apr_pool_cleanup_null);
+        }
+    }
+
+    /* Kill every third cleanup, and one of each duplicate */
+    for (i = 0; i < ORDER_CLEANUPS; i += 3) {
+        apr_pool_cleanup_kill(pool, &order_data[i], order_cleanup);
+    }
+    for (i = 0; i < ORDER_CLEANUPS; i += 10) {
+        apr_pool_cleanup_kill(pool, &order_data[i], order_cleanup_dup);
+    }
+
+    /* Run (and unregister) some of the others */
+    order_count = 0;
+    for (i = 1; i < ORDER_CLEANUPS; i += 7) {
+        if (i % 3 != 0) {
+            apr_pool_cleanup_run(pool, &order_data[i], order_cleanup);
+        }
+    }
+    for (i = 1, n = 0; i < ORDER_CLEANUPS; i += 7) {
+        if (i % 3 != 0) {
+            ABTS_INT_EQUAL(tc, i, order_seq[n]);
+            n++;
+        }
+    }
+    ABTS_INT_EQUAL(tc, n, order_count);
+
+    /* The remaining ones run in the reverse order of registration */
+    order_count = 0;
+    apr_pool_clear(pool);
+    for (i = ORDER_CLEANUPS - 1, n = 0; i >= 0 && n < order_count; i--) {
+        if (i % 10 == 0) {
+            ABTS_INT_EQUAL(tc, ORDER_CLEANUPS + i, order_seq[n]);
+            n++;
+        }
+        if (i % 3 != 0 && i % 7 != 1) {
+            ABTS_INT_EQUAL(tc, i, order_seq[n]);
+            n++;
+        }
+    }
+    ABTS_INT_EQUAL(tc, -1, i);
+    ABTS_INT_EQUAL(tc, n, order_count);
+
+    /* Fewer cleanups than when the index was built */
+    for (i = 0; i < ORDER_CLEANUPS / 2; i++) {
+        apr_pool_cleanup_register(pool, &order_data[i], order_cleanup,
+                                  apr_pool_cleanup_null);
+        if (i >= 50) {
+            apr_pool_cleanup_kill(pool, &order_data[i - 50], order_cleanup);
+        }
+    }
+    for (i -= 50; i < ORDER_CLEANUPS / 2; i++) {
+        apr_pool_cleanup_kill(pool, &order_data[i], order_cleanup);
+    }
+    for (; i < ORDER_CLEANUPS / 2 + 10; i++) {
+        apr_pool_cleanup_register(pool, &order_data[i], order_cleanup,
+                                  apr_pool_cleanup_null);
+    }
+    apr_pool_cleanup_kill(pool, &order_data[i - 5], order_cleanup);
+    order_count = 0;
+    apr_pool_destroy(pool);
+    ABTS_INT_EQUAL(tc, 9, order_count);
+    for (n = 0; n < 4; n++) {
+        ABTS_INT_EQUAL(tc, i - 1 - n, order_seq[n]);
+    }
+    for (; n < order_count; n++) {
+        ABTS_INT_EQUAL(tc, i - 2 - n, order_seq[n]);
+    }
+}
+
+#define FIT_NODES 64
+#define FIT_SIZE(k) (100000 + (k) * 5000)
+
+/* Free nodes are reused best fit first, from the bins and the sink */
+static void test_allocator_fit(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_memnode_t *nodes[FIT_NODES], *node, *used = NULL;
+    apr_size_t size, best;
+    apr_status_t rv;
+    int i, j;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* The smallest non-empty bin that fits */
+    node = apr_allocator_alloc(allocator, 20000);
+    ABTS_PTR_NOTNULL(tc, node);
+    size = node->endp - (char *)node;
+    apr_allocator_free(allocator, node);
+    node = apr_allocator_alloc(allocator, 100);
+    ABTS_INT_EQUAL(tc, size, node->endp - (char *)node);
+    apr_allocator_free(allocator, node);
+
+    /* Oversized nodes, every size twice, freed in some random order */
+    for (i = 0; i < FIT_NODES; i++) {
+        nodes[i] = apr_allocator_alloc(allocator, FIT_SIZE(i / 2));
+        ABTS_PTR_NOTNULL(tc, nodes[i]);
+    }
+    for (i = 0; i < FIT_NODES; i++) {
+        j = (i * 37) % FIT_NODES;
+        nodes[j]->next = NULL;
+        apr_allocator_free(allocator, nodes[j]);
+    }
+
+    for (i = 0; i < FIT_NODES; i++) {
+        size = FIT_SIZE((i * 13) % (FIT_NODES / 2 + 4)) - 2500;
+        best = 0;
+        for (j = 0; j < FIT_NODES; j++) {
+            apr_size_t nsize;
+            if (!nodes[j])
+                continue;
+            nsize = nodes[j]->endp - (char *)nodes[j];
+            if (nsize >= apr_allocator_align(allocator, size)
+                && (!best || nsize < best))
+                best = nsize;
+        }
+        node = apr_allocator_alloc(allocator, size);
+        ABTS_PTR_NOTNULL(tc, node);
+        if (best) {
+            ABTS_INT_EQUAL(tc, best, node->endp - (char *)node);
+        }
+        for (j = 0; j < FIT_NODES; j++) {
+            if (nodes[j] == node)
+                nodes[j] = NULL;
+        }
+        node->next = used;
+        used = node;
+    }
+    apr_allocator_free(allocator, used);
+
+    apr_allocator_destroy(allocator);
+}
+
+/* Nodes carved out of huge page regions, reused and given back */
+static void test_allocator_hugepages(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_pool_t *pool, *subp;
+    char *mem[256];
+    apr_status_t rv;
+    int i, j;
+
+    rv = apr_allocator_create_ex(&allocator, APR_ALLOCATOR_HUGEPAGES);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_max_free_set(allocator, 64 * 1024);
+    rv = apr_pool_create_ex(&pool, NULL, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, pool);
+
+    for (j = 0; j < 3; j++) {
+        rv = apr_pool_create(&subp, pool);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+        /* About 6MB, spanning several regions */
+        for (i = 0; i < 256; i++) {
+            apr_size_t size = (i * 2903) % 60000 + 1;
+            mem[i] = apr_palloc(subp, size);
+            ABTS_PTR_NOTNULL(tc, mem[i]);
+            mem[i][0] = mem[i][size - 1] = (char)i;
+        }
+        for (i = 0; i < 256; i++) {
+            apr_size_t size = (i * 2903) % 60000 + 1;
+            ABTS_INT_EQUAL(tc, (char)i, mem[i][0]);
+            ABTS_INT_EQUAL(tc, (char)i, mem[i][size - 1]);
+        }
+
+        /* Oversized allocations are not carved */
+        ABTS_PTR_NOTNULL(tc, apr_palloc(subp, 3 * 1024 * 1024));
+
+        apr_pool_destroy(subp);
+    }
+
+    apr_pool_destroy(pool);
+}
+
+/* Unused nodes are released or purged after the decay time */
+static void test_allocator_arena(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t stats;
+    apr_memnode_t *node[64], *big;
+    apr_size_t committed;
+    apr_status_t rv;
+    int i, pass;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_allocator_arena_set(allocator, 8 * 1024 * 1024);
+    if (rv == APR_ENOTIMPL) {
+        apr_allocator_destroy(allocator);
+        ABTS_NOT_IMPL(tc, "allocator arenas");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, apr_allocator_arena_set(allocator,
+                                                           1024 * 1024));
+    apr_allocator_max_free_set(allocator, 1);
+
+    for (pass = 0; pass < 2; pass++) {
+        /* Contiguous nodes */
+        for (i = 0; i < 64; i++) {
+            node[i] = apr_allocator_alloc(allocator, (i % 4) * 5000);
+            ABTS_PTR_NOTNULL(tc, node[i]);
+            memset(node[i]->first_avail, i,
+                   node[i]->endp - node[i]->first_avail);
+            if (i) {
+                ABTS_PTR_EQUAL(tc, node[i - 1]->endp, node[i]);
+            }
+        }
+        big = apr_allocator_alloc(allocator, 2 * 1024 * 1024);
+        ABTS_PTR_EQUAL(tc, node[63]->endp, big);
+
+        /* Exhausted */
+        ABTS_PTR_EQUAL(tc, NULL, apr_allocator_alloc(allocator,
+                                                     8 * 1024 * 1024));
+
+        for (i = 0; i < 64; i++) {
+            ABTS_INT_EQUAL(tc, (char)i, node[i]->endp[-1]);
+            apr_allocator_free(allocator, node[i]);
+        }
+        apr_allocator_free(allocator, big);
+
+        /* Kept despite max_free, and reused */
+        apr_allocator_stats_get(allocator, &stats);
+        ABTS_INT_EQUAL(tc, 0, (int)stats.sys_frees - pass);
+        ABTS_PTR_EQUAL(tc, node[63], apr_allocator_alloc(allocator, 15000));
+        committed = stats.sys_bytes;
+        ABTS_ASSERT(tc, "committed on demand",
+                    committed >= 3 * 1024 * 1024
+                    && committed < 8 * 1024 * 1024);
+
+        /* Everything goes at once, and is carved anew */
+        rv = apr_allocator_arena_reset(allocator);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        apr_allocator_stats_get(allocator, &stats);
+        ABTS_INT_EQUAL(tc, pass + 1, (int)stats.sys_frees);
+        ABTS_INT_EQUAL(tc, 0, (int)stats.free_bytes);
+        ABTS_INT_EQUAL(tc, (int)committed, (int)stats.sys_bytes);
+    }
+
+    apr_allocator_destroy(allocator);
+}
+
+static void test_allocator_decay(abts_case *tc, void *data)
+{
+    static const apr_uint32_t flags[] = { 0, APR_ALLOCATOR_HUGEPAGES };
+    apr_allocator_t *allocator;
+    apr_memnode_t *node, *list;
+    apr_size_t size;
+    apr_status_t rv;
+    int i, f;
+
+    for (f = 0; f < sizeof(flags) / sizeof(flags[0]); f++) {
+        rv = apr_allocator_create_ex(&allocator, flags[f]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        apr_allocator_decay_set(allocator, apr_time_from_msec(500));
+
+        list = NULL;
+        for (i = 0; i < 32; i++) {
+            node = apr_allocator_alloc(allocator, (i % 4) ? i * 4000
+                                                          : i * 40000);
+            ABTS_PTR_NOTNULL(tc, node);
+            node->next = list;
+            list = node;
+        }
+        apr_allocator_free(allocator, list);
+
+        /* Let them expire, then have them looked for */
+        apr_sleep(apr_time_from_msec(1100));
+        node = apr_allocator_alloc(allocator, 100);
+        apr_allocator_free(allocator, node);
+
+        /* Whatever remains is usable */
+        for (i = 0; i < 32; i++) {
+            node = apr_allocator_alloc(allocator, (i % 4) ? i * 4000
+                                                          : i * 40000);
+            ABTS_PTR_NOTNULL(tc, node);
+            size = node->endp - node->first_avail;
+            memset(node->first_avail, i, size);
+            ABTS_INT_EQUAL(tc, (char)i, node->first_avail[size - 1]);
+            apr_allocator_free(allocator, node);
+        }
+
+        apr_allocator_destroy(allocator);
+    }
+}
+
+static void test_pool_stats(abts_case *tc, void *data)
+{
+    apr_pool_t *pool, *subp[4];
+    apr_pool_stats_t stats, all;
+    apr_hash_t *tags;
+    apr_pool_stats_t *st;
+    apr_size_t requested = 0;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_pool_tag(pool, "stats");
+
+    for (i = 0; i < 100; i++) {
+        ABTS_PTR_NOTNULL(tc, apr_palloc(pool, i * 97 + 1));
+        requested += i * 97 + 1;
+    }
+    ABTS_PTR_NOTNULL(tc, apr_psprintf(pool, "%s", "0123456789"));
+    requested += 11;
+
+    apr_pool_stats_get(pool, &stats, 0);
+    ABTS_INT_EQUAL(tc, 1, stats.pools);
+    ABTS_ASSERT(tc, "requested", stats.requested >= requested);
+    ABTS_ASSERT(tc, "reserved", stats.reserved >= stats.requested);
+    ABTS_ASSERT(tc, "nodes", stats.nodes > 1);
+    ABTS_ASSERT(tc, "wasted", stats.wasted < stats.reserved);
+
+    for (i = 0; i < 4; i++) {
+        rv = apr_pool_create(&subp[i], pool);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        apr_pool_tag(subp[i], (i % 2) ? "odd" : NULL);
+        ABTS_PTR_NOTNULL(tc, apr_palloc(subp[i], 20000));
+    }
+
+    apr_pool_stats_get(pool, &all, 1);
+    ABTS_INT_EQUAL(tc, 5, all.pools);
+    ABTS_ASSERT(tc, "recursive requested",
+                all.requested >= stats.requested + 4 * 20000);
+
+    tags = apr_pool_stats_by_tag(pool, p);
+    ABTS_INT_EQUAL(tc, 3, apr_hash_count(tags));
+    st = apr_hash_get(tags, "odd", APR_HASH_KEY_STRING);
+    ABTS_PTR_NOTNULL(tc, st);
+    ABTS_INT_EQUAL(tc, 2, st->pools);
+    ABTS_ASSERT(tc, "odd requested", st->requested >= 2 * 20000);
+    st = apr_hash_get(tags, "", APR_HASH_KEY_STRING);
+    ABTS_PTR_NOTNULL(tc, st);
+    ABTS_INT_EQUAL(tc, 2, st->pools);
+    st = apr_hash_get(tags, "stats", APR_HASH_KEY_STRING);
+    ABTS_PTR_NOTNULL(tc, st);
+    ABTS_INT_EQUAL(tc, 1, st->pools);
+
+    apr_pool_clear(pool);
+    apr_pool_stats_get(pool, &all, 1);
+    ABTS_INT_EQUAL(tc, 1, all.pools);
+    ABTS_ASSERT(tc, "cleared", all.requested < requested);
+
+#if APR_HAS_THREADS
+    /* The (non-nested) mutex of an allocator is locked once when its
+     * pools are found again below another allocator's.
+     */
+    {
+        apr_allocator_t *allocator[2];
+        apr_thread_mutex_t *mutex;
+
+        for (i = 0; i < 2; i++) {
+            rv = apr_allocator_create(&allocator[i]);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT,
+                                         pool);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            apr_allocator_mutex_set(allocator[i], mutex);
+        }
+        for (i = 0; i < 3; i++) {
+            rv = apr_pool_create_ex(&subp[i], i ? subp[i - 1] : pool, NULL,
+                                    allocator[i % 2]);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        }
+        apr_pool_stats_get(subp[0], &all, 1);
+        ABTS_INT_EQUAL(tc, 3, all.pools);
+
+        apr_pool_destroy(subp[0]);
+        apr_allocator_destroy(allocator[0]);
+        apr_allocator_destroy(allocator[1]);
+    }
+#endif
+
+    apr_pool_destroy(pool);
+}
+
+static void test_pool_mark(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_pool_mark_t *mark, *inner;
+    apr_pool_stats_t marked, stats;
+    char *mem, *keep;
+    apr_status_t rv;
+    int i, j;
+
+    rv = apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    keep = apr_pstrdup(pool, "kept");
+    mark = apr_pool_mark(pool);
+    ABTS_PTR_NOTNULL(tc, mark);
+    apr_pool_stats_get(pool, &marked, 0);
+
+    for (i = 0; i < 10; i++) {
+        /* Enough scratch memory to need a few more nodes each time */
+        for (j = 0; j < 50; j++) {
+            mem = apr_palloc(pool, j * 37 + 1);
+            ABTS_PTR_NOTNULL(tc, mem);
+            memset(mem, 'x', j * 37 + 1);
+        }
+        mem = apr_psprintf(pool, "%0*d", 20000, i);
+        ABTS_INT_EQUAL(tc, 20000, (int)strlen(mem));
+
+        apr_pool_rewind(pool, mark);
+        apr_pool_stats_get(pool, &stats, 0);
+        ABTS_INT_EQUAL(tc, (int)marked.nodes, (int)stats.nodes);
+        ABTS_INT_EQUAL(tc, (int)marked.requested, (int)stats.requested);
+        ABTS_INT_EQUAL(tc, (int)marked.reserved, (int)stats.reserved);
+    }
+    ABTS_STR_EQUAL(tc, "kept", keep);
+
+    /* Nested marks */
+    ABTS_PTR_NOTNULL(tc, apr_palloc(pool, 10000));
+    inner = apr_pool_mark(pool);
+    ABTS_PTR_NOTNULL(tc, inner);
+    keep = apr_pstrdup(pool, "inner");
+    ABTS_PTR_NOTNULL(tc, apr_palloc(pool, 50000));
+    apr_pool_rewind(pool, inner);
+    ABTS_PTR_NOTNULL(tc, apr_palloc(pool, 50000));
+    apr_pool_rewind(pool, mark);
+    apr_pool_stats_get(pool, &stats, 0);
+    ABTS_INT_EQUAL(tc, (int)marked.nodes, (int)stats.nodes);
+    ABTS_INT_EQUAL(tc, (int)marked.reserved, (int)stats.reserved);
+
+    /* Back to normal after a clear */
+    apr_pool_clear(pool);
+    for (j = 0; j < 50; j++) {
+        ABTS_PTR_NOTNULL(tc, apr_palloc(pool, j * 37 + 1));
+    }
+
+    apr_pool_destroy(pool);
+}
+
+static apr_status_t count_cleanup(void *data)
+{
+    (*(int *)data)++;
+    return APR_SUCCESS;
+}
+
+/* The cleanup records given back by a rewind are not reused */
+static void test_pool_rewind_cleanups(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_pool_mark_t *mark;
+    char *mem;
+    int count = 0, other = 0, i;
+    apr_status_t rv;
+
+    rv = apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_pool_cleanup_register(pool, &other, count_cleanup,
+                              apr_pool_cleanup_null);
+
+    mark = apr_pool_mark(pool);
+    ABTS_PTR_NOTNULL(tc, mark);
+    apr_pool_cleanup_register(pool, &count, count_cleanup,
+                              apr_pool_cleanup_null);
+    apr_pool_cleanup_kill(pool, &count, count_cleanup);
+    apr_pool_rewind(pool, mark);
+
+    mem = apr_palloc(pool, 64);
+    memset(mem, 'A', 64);
+    apr_pool_cleanup_register(pool, &count, count_cleanup,
+                              apr_pool_cleanup_null);
+    for (i = 0; i < 64 && mem[i] == 'A'; i++)
+        ;
+    ABTS_INT_EQUAL(tc, 64, i);
+
+    /* Those not killed before the rewind are forgotten */
+    apr_pool_rewind(pool, mark);
+    apr_pool_pre_cleanup_register(pool, &count, count_cleanup);
+    apr_pool_rewind(pool, mark);
+    mem = apr_palloc(pool, 64);
+    memset(mem, 'A', 64);
+    apr_pool_clear(pool);
+    ABTS_INT_EQUAL(tc, 0, count);
+    ABTS_INT_EQUAL(tc, 1, other);
+
+    apr_pool_destroy(pool);
+}
+
+static void test_prealloc(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_pool_stats_t stats;
+    char *buf, *mem, *other;
+    apr_size_t size;
+    apr_status_t rv;
+
+    rv = apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    buf = apr_prealloc(pool, NULL, 0, 10);
+    ABTS_PTR_NOTNULL(tc, buf);
+    memcpy(buf, "0123456789", 10);
+
+    /* Doubling a buffer up to 64K keeps its contents */
+    for (size = 10; size < 65536; size *= 2) {
+        mem = apr_prealloc(pool, buf, size, size * 2);
+        ABTS_PTR_NOTNULL(tc, mem);
+        ABTS_ASSERT(tc, "contents", !memcmp(mem, buf, 10));
+        memset(mem + size, 'x', size);
+        buf = mem;
+    }
+    ABTS_ASSERT(tc, "contents", !memcmp(buf, "0123456789", 10));
+    ABTS_INT_EQUAL(tc, 'x', buf[size - 1]);
+    apr_pool_stats_get(pool, &stats, 0);
+    ABTS_ASSERT(tc, "requested", stats.requested >= size);
+
+    /* Shrinking never moves */
+    ABTS_PTR_EQUAL(tc, buf, apr_prealloc(pool, buf, size, 100));
+
+    /* Not the last allocation any more */
+    mem = apr_prealloc(pool, buf, 100, 200);
+    ABTS_PTR_NOTNULL(tc, mem);
+    other = apr_palloc(pool, 16);
+    ABTS_PTR_NOTNULL(tc, other);
+    buf = apr_prealloc(pool, mem, 200, 300);
+    ABTS_PTR_NOTNULL(tc, buf);
+    ABTS_ASSERT(tc, "moved", buf != mem);
+    ABTS_ASSERT(tc, "contents", !memcmp(buf, "0123456789", 10));
+
+    apr_pool_destroy(pool);
+}
+
+static void test_palloc_aligned(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_size_t alignment;
+    char *mem, *next;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    ABTS_PTR_EQUAL(tc, NULL, apr_palloc_aligned(pool, 16, 0));
+    ABTS_PTR_EQUAL(tc, NULL, apr_palloc_aligned(pool, 16, 24));
+
+    for (alignment = 1; alignment <= 16384; alignment *= 2) {
+        /* Misalign the pool first */
+        apr_palloc(pool, 8);
+        mem = apr_palloc_aligned(pool, 100, alignment);
+        ABTS_PTR_NOTNULL(tc, mem);
+        ABTS_INT_EQUAL(tc, 0, (int)((apr_uintptr_t)mem % alignment));
+        memset(mem, 'x', 100);
+
+        mem = apr_pcalloc_aligned(pool, 100, alignment);
+        ABTS_PTR_NOTNULL(tc, mem);
+        ABTS_INT_EQUAL(tc, 0, (int)((apr_uintptr_t)mem % alignment));
+        for (i = 0; i < 100; i++) {
+            ABTS_INT_EQUAL(tc, 0, mem[i]);
+        }
+    }
+
+    /* Larger than the pool's blocks */
+    mem = apr_palloc_aligned(pool, 100000, 4096);
+    ABTS_PTR_NOTNULL(tc, mem);
+    ABTS_INT_EQUAL(tc, 0, (int)((apr_uintptr_t)mem % 4096));
+    memset(mem, 'x', 100000);
+
+    /* Nothing else on the cache lines of an isolated allocation */
+    for (i = 1; i < 200; i += 13) {
+        apr_palloc(pool, 1);
+        mem = apr_palloc_isolated(pool, i);
+        ABTS_PTR_NOTNULL(tc, mem);
+        ABTS_INT_EQUAL(tc, 0, (int)((apr_uintptr_t)mem % APR_CACHELINE_SIZE));
+        next = apr_palloc(pool, 1);
+        ABTS_ASSERT(tc, "separate cache line",
+                    next >= mem + APR_ALIGN(i, APR_CACHELINE_SIZE)
+                    || next + 1 <= mem);
+    }
+
+    apr_pool_destroy(pool);
+}
+
+#define SMALL_POOLS 100
+
+static void test_pool_small(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t astats;
+    apr_pool_t *pool, *small[SMALL_POOLS];
+#if !APR_POOL_DEBUG
+    apr_size_t sys_bytes;
+#endif
+    char *mem, *big;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_create_ex(&pool, NULL, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, pool);
+
+    for (i = 0; i < SMALL_POOLS; i++) {
+        rv = apr_pool_create_flags(&small[i], pool, NULL, NULL,
+                                   APR_POOL_SMALL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_PTR_EQUAL(tc, pool, apr_pool_parent_get(small[i]));
+        mem = apr_pstrdup(small[i], "small");
+        ABTS_STR_EQUAL(tc, "small", mem);
+    }
+    apr_allocator_stats_get(allocator, &astats);
+#if !APR_POOL_DEBUG
+    ABTS_ASSERT(tc, "small footprint",
+                astats.sys_bytes
+                < SMALL_POOLS * apr_allocator_align(allocator, 1) / 4);
+#endif
+
+    /* Outgrowing the first chunk */
+    mem = apr_pstrdup(small[0], "first");
+    big = apr_palloc(small[0], 100000);
+    ABTS_PTR_NOTNULL(tc, big);
+    memset(big, 'x', 100000);
+    ABTS_STR_EQUAL(tc, "first", mem);
+    apr_pool_clear(small[0]);
+    mem = apr_pstrdup(small[0], "cleared");
+    ABTS_STR_EQUAL(tc, "cleared", mem);
+
+    /* The chunks of the destroyed pools are reused */
+    apr_allocator_stats_get(allocator, &astats);
+#if !APR_POOL_DEBUG
+    sys_bytes = astats.sys_bytes;
+#endif
+    for (i = 0; i < SMALL_POOLS; i += 2) {
+        apr_pool_destroy(small[i]);
+    }
+    for (i = 0; i < SMALL_POOLS; i += 2) {
+        rv = apr_pool_create_flags(&small[i], pool, NULL, NULL,
+                                   APR_POOL_SMALL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    apr_allocator_stats_get(allocator, &astats);
+#if !APR_POOL_DEBUG
+    ABTS_INT_EQUAL(tc, (int)sys_bytes, (int)astats.sys_bytes);
+#endif
+
+    /* Nested small pools */
+    rv = apr_pool_create_flags(&small[0], small[1], NULL, NULL,
+                               APR_POOL_SMALL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_STR_EQUAL(tc, "nested", apr_pstrdup(small[0], "nested"));
+    apr_pool_clear(small[1]);
+
+    apr_pool_clear(pool);
+    rv = apr_pool_create_flags(&small[0], pool, NULL, NULL, APR_POOL_SMALL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    apr_pool_destroy(pool);
+}
+
+#define RETAIN_ALLOCS 4
+#define RETAIN_SIZE   10000
+
+static void retain_cycle(abts_case *tc, apr_pool_t *pool)
+{
+    char *mem[RETAIN_ALLOCS];
+    int i;
+
+    for (i = 0; i < RETAIN_ALLOCS; i++) {
+        mem[i] = apr_palloc(pool, RETAIN_SIZE);
+        ABTS_PTR_NOTNULL(tc, mem[i]);
+        memset(mem[i], 'a' + i, RETAIN_SIZE);
+    }
+    for (i = 0; i < RETAIN_ALLOCS; i++) {
+        ABTS_INT_EQUAL(tc, 'a' + i, mem[i][0]);
+        ABTS_INT_EQUAL(tc, 'a' + i, mem[i][RETAIN_SIZE - 1]);
+    }
+    apr_pool_clear(pool);
+}
+
+static void test_pool_retain(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t astats;
+    apr_pool_stats_t stats;
+    apr_pool_t *pool, *req;
+#if !APR_POOL_DEBUG
+    apr_size_t free_bytes;
+#endif
+    apr_size_t sys_allocs, node_size;
+    apr_status_t rv;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_create_ex(&pool, NULL, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, pool);
+    rv = apr_pool_create(&req, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    node_size = apr_allocator_align(allocator, RETAIN_SIZE);
+    apr_pool_retain_set(req, RETAIN_ALLOCS * node_size);
+
+    /* The nodes stay in the pool across clears */
+    retain_cycle(tc, req);
+    apr_pool_stats_get(req, &stats, 0);
+#if !APR_POOL_DEBUG
+    ABTS_INT_EQUAL(tc, RETAIN_ALLOCS + 1, (int)stats.nodes);
+#endif
+    apr_allocator_stats_get(allocator, &astats);
+#if !APR_POOL_DEBUG
+    free_bytes = astats.free_bytes;
+#endif
+    sys_allocs = astats.sys_allocs;
+    retain_cycle(tc, req);
+    retain_cycle(tc, req);
+    apr_allocator_stats_get(allocator, &astats);
+    ABTS_INT_EQUAL(tc, (int)sys_allocs, (int)astats.sys_allocs);
+#if !APR_POOL_DEBUG
+    ABTS_INT_EQUAL(tc, (int)free_bytes, (int)astats.free_bytes);
+    apr_pool_stats_get(req, &stats, 0);
+    ABTS_INT_EQUAL(tc, RETAIN_ALLOCS + 1, (int)stats.nodes);
+#endif
+
+    /* Until the allocator wants them back */
+    apr_allocator_reclaim(allocator);
+    retain_cycle(tc, req);
+    apr_pool_stats_get(req, &stats, 0);
+    apr_allocator_stats_get(allocator, &astats);
+#if !APR_POOL_DEBUG
+    ABTS_INT_EQUAL(tc, 1, (int)stats.nodes);
+    ABTS_INT_EQUAL(tc, (int)(free_bytes + RETAIN_ALLOCS * node_size),
+                   (int)astats.free_bytes);
+#endif
+    retain_cycle(tc, req);
+    apr_pool_stats_get(req, &stats, 0);
+#if !APR_POOL_DEBUG
+    ABTS_INT_EQUAL(tc, RETAIN_ALLOCS + 1, (int)stats.nodes);
+#endif
+
+    /* Lowering the retention gives the nodes above it back */
+    apr_pool_retain_set(req, 2 * node_size);
+    retain_cycle(tc, req);
+    apr_pool_stats_get(req, &stats, 0);
+#if !APR_POOL_DEBUG
+    ABTS_INT_EQUAL(tc, 3, (int)stats.nodes);
+#endif
+    apr_pool_retain_set(req, 0);
+    retain_cycle(tc, req);
+    apr_pool_stats_get(req, &stats, 0);
+#if !APR_POOL_DEBUG
+    ABTS_INT_EQUAL(tc, 1, (int)stats.nodes);
+#endif
+
+    apr_pool_destroy(pool);
+}
+
+static void test_allocator_stats(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t stats;
+    apr_memnode_t *small, *big;
+    apr_status_t rv;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    small = apr_allocator_alloc(allocator, 100);
+    big = apr_allocator_alloc(allocator, 1000000);
+    ABTS_PTR_NOTNULL(tc, small);
+    ABTS_PTR_NOTNULL(tc, big);
+
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_INT_EQUAL(tc, 2, stats.sys_allocs);
+    ABTS_INT_EQUAL(tc, 0, stats.sys_frees);
+    ABTS_INT_EQUAL(tc, 0, stats.free_bytes);
+    ABTS_ASSERT(tc, "sys bytes", stats.sys_bytes >= 1000000 + 100);
+
+    small->next = big;
+    apr_allocator_free(allocator, small);
+
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_INT_EQUAL(tc, 1, stats.free_nodes[0]);
+    ABTS_INT_EQUAL(tc, 1, stats.free_nodes[(small->endp - (char *)small)
+                                            / stats.boundary - 1]);
+    ABTS_INT_EQUAL(tc, stats.sys_bytes, stats.free_bytes);
+
+    /* Above the max free, the big one goes back to the system */
+    apr_allocator_max_free_set(allocator, 100000);
+    big = apr_allocator_alloc(allocator, 1000000);
+    big->next = NULL;
+    apr_allocator_free(allocator, big);
+
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_INT_EQUAL(tc, 1, stats.sys_frees);
+    ABTS_INT_EQUAL(tc, 0, stats.free_nodes[0]);
+
+    apr_allocator_destroy(allocator);
+}
+
+static void test_pool_cache(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t stats;
+    apr_pool_stats_t pstats;
+    apr_pool_t *pool, *subpools[3];
+    char *mem;
+    int i;
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_allocator_create(&allocator));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_pool_create_ex(&pool, NULL, NULL, allocator));
+    apr_allocator_owner_set(allocator, pool);
+    apr_allocator_pool_cache_set(allocator, 2);
+
+    for (i = 0; i < 3; i++) {
+        ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                       apr_pool_create(&subpools[i], pool));
+        /* Some more blocks, not kept with the pool */
+        ABTS_PTR_NOTNULL(tc, apr_palloc(subpools[i], 100000));
+    }
+    for (i = 0; i < 3; i++) {
+        apr_pool_destroy(subpools[i]);
+    }
+
+    apr_allocator_stats_get(allocator, &stats);
+#if !APR_POOL_DEBUG
+    ABTS_INT_EQUAL(tc, 2, (int)stats.cached_pools);
+    ABTS_ASSERT(tc, "big blocks freed", stats.free_nodes[0] > 0);
+#endif
+
+    /* A cached pool is as good as new */
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_pool_create(&subpools[0], pool));
+    apr_allocator_stats_get(allocator, &stats);
+    apr_pool_stats_get(subpools[0], &pstats, 0);
+    ABTS_INT_EQUAL(tc, 0, (int)pstats.requested);
+#if !APR_POOL_DEBUG
+    ABTS_INT_EQUAL(tc, 1, (int)stats.cached_pools);
+    ABTS_INT_EQUAL(tc, 1, (int)pstats.nodes);
+    ABTS_PTR_EQUAL(tc, allocator, apr_pool_allocator_get(subpools[0]));
+    ABTS_PTR_EQUAL(tc, pool, apr_pool_parent_get(subpools[0]));
+#endif
+    mem = apr_pcalloc(subpools[0], 1000);
+    ABTS_PTR_NOTNULL(tc, mem);
+    ABTS_INT_EQUAL(tc, 0, mem[999]);
+    apr_pool_cleanup_register(subpools[0], NULL, success_cleanup,
+                              apr_pool_cleanup_null);
+    apr_pool_destroy(subpools[0]);
+
+    /* Lowering the limit frees the pools above it */
+    apr_allocator_pool_cache_set(allocator, 0);
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_INT_EQUAL(tc, 0, (int)stats.cached_pools);
+
+    /* The cached pools go with the allocator */
+    apr_allocator_pool_cache_set(allocator, 4);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_pool_create(&subpools[0], pool));
+    apr_pool_destroy(subpools[0]);
+    apr_pool_destroy(pool);
+}
+
+static void test_pool_trace(abts_case *tc, void *data)
+{
+    static const apr_uint32_t types[] = {
+        APR_POOL_TRACE_CREATE, APR_POOL_TRACE_ALLOC, APR_POOL_TRACE_ALLOC,
+        APR_POOL_TRACE_ALLOC, APR_POOL_TRACE_CLEAR, APR_POOL_TRACE_DESTROY
+    };
+    static const apr_uint64_t sizes[] = { 0, 10, 20, 6, 0, 0 };
+    apr_pool_t *pool;
+    apr_file_t *file;
+    apr_pool_trace_header_t header;
+    apr_pool_trace_record_t record;
+    apr_uint64_t id;
+    apr_uint32_t i, len, tag = 0;
+    apr_off_t offset = 0;
+    char buf[64];
+    int n = 0;
+    apr_status_t rv;
+
+    rv = apr_pool_trace_start(1000);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "Pool tracing with APR_POOL_DEBUG");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    apr_pool_create(&pool, p);
+    apr_pool_tag(pool, "test_pool_trace");
+    apr_palloc(pool, 10);
+    apr_pcalloc(pool, 20);
+    apr_psprintf(pool, "%s", "trace");
+    apr_pool_clear(pool);
+    apr_pool_destroy(pool);
+    apr_pool_trace_stop();
+    id = (apr_uint64_t)(apr_uintptr_t)pool;
+
+    rv = apr_file_open(&file, "data/testpools.trace",
+                       APR_FOPEN_READ | APR_FOPEN_WRITE | APR_FOPEN_CREATE
+                       | APR_FOPEN_TRUNCATE | APR_FOPEN_DELONCLOSE,
+                       APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "open the trace file", rv);
+    APR_ASSERT_SUCCESS(tc, "dump the trace", apr_pool_trace_dump(file));
+    apr_file_seek(file, APR_SET, &offset);
+
+    APR_ASSERT_SUCCESS(tc, "read the trace header",
+                       apr_file_read_full(file, &header, sizeof(header),
+                                          NULL));
+    ABTS_ASSERT(tc, "trace magic", !memcmp(header.magic, APR_POOL_TRACE_MAGIC,
+                                           sizeof(header.magic)));
+    ABTS_INT_EQUAL(tc, APR_POOL_TRACE_VERSION, header.version);
+    ABTS_ASSERT(tc, "trace records", header.records >= 6);
+
+    for (i = 1; i <= header.tags; i++) {
+        apr_file_read_full(file, &len, sizeof(len), NULL);
+        ABTS_ASSERT(tc, "tag length", len < sizeof(buf));
+        apr_file_read_full(file, buf, len, NULL);
+        buf[len] = '\0';
+        if (!strcmp(buf, "test_pool_trace"))
+            tag = i;
+    }
+    ABTS_ASSERT(tc, "tag dumped", tag != 0);
+
+    /* The events of our pool, in order */
+    while (apr_file_read_full(file, &record, sizeof(record),
+                              NULL) == APR_SUCCESS) {
+        if (record.pool != id)
+            continue;
+        ABTS_ASSERT(tc, "no extra events", n < 6);
+        if (n >= 6)
+            break;
+        ABTS_INT_EQUAL(tc, types[n], record.type);
+        ABTS_INT_EQUAL(tc, (int)sizes[n], (int)record.size);
+        if (types[n] == APR_POOL_TRACE_ALLOC)
+            ABTS_INT_EQUAL(tc, tag, record.tag);
+        n++;
+    }
+    ABTS_INT_EQUAL(tc, 6, n);
+
+    apr_file_close(file);
+}
+
+#if APR_HAS_THREADS
+#define TCACHE_THREADS 4
+#define TCACHE_LOOPS 500
+
+static apr_pool_t *tcache_pool;
+
+static void *APR_THREAD_FUNC tcache_thread(apr_thread_t *thd, void *data)
+{
+    static const apr_size_t sizes[] = { 100, 5000, 20000, 70000, 200000 };
+    apr_status_t rv = APR_SUCCESS;
+    int i, j;
+
+    for (i = 0; i < TCACHE_LOOPS && rv == APR_SUCCESS; i++) {
+        apr_pool_t *subp;
+        char *mem[sizeof(sizes) / sizeof(sizes[0])];
+
+        if ((rv = apr_pool_create(&subp, tcache_pool)) != APR_SUCCESS)
+            break;
+
+        for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+            mem[j] = apr_palloc(subp, sizes[j]);
+            memset(mem[j], i + j, sizes[j]);
+        }
+        for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+            if (mem[j][0] != (char)(i + j)
+                || mem[j][sizes[j] - 1] != (char)(i + j)) {
+                rv = APR_EGENERAL;
+            }
+        }
+
+        if (i % 2)
+            apr_pool_clear(subp);
+        apr_pool_destroy(subp);
+    }
+
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static void test_thread_cache(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_thread_mutex_t *mutex;
+    apr_thread_t *t[TCACHE_THREADS];
+    apr_status_t rv;
+    int i;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_create_ex(&tcache_pool, NULL, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, tcache_pool);
+    rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT,
+                                 tcache_pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_mutex_set(allocator, mutex);
+
+    rv = apr_allocator_thread_cache_set(allocator, 256 * 1024, tcache_pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < TCACHE_THREADS; i++) {
+        rv = apr_thread_create(&t[i], NULL, tcache_thread, NULL, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < TCACHE_THREADS; i++) {
+        apr_status_t retval;
+
+        rv = apr_thread_join(&retval, t[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, retval);
+    }
+
+    /* Shrink, then disable the caches while still in use by this thread */
+    rv = apr_allocator_thread_cache_set(allocator, 16 * 1024, tcache_pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_PTR_NOTNULL(tc, apr_palloc(tcache_pool, 100000));
+    rv = apr_allocator_thread_cache_set(allocator, 0, tcache_pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_PTR_NOTNULL(tc, apr_palloc(tcache_pool, 100000));
+
+    apr_pool_destroy(tcache_pool);
+}
+
+static volatile apr_uint32_t tcache_step;
+
+static void tcache_wait(apr_uint32_t step)
+{
+    while (apr_atomic_read32(&tcache_step) != step)
+        apr_thread_yield();
+}
+
+static void *APR_THREAD_FUNC tcache_thread_live(apr_thread_t *thd,
+                                                void *data)
+{
+    apr_allocator_t *allocator;
+    apr_pool_t *pool, *subp;
+    apr_status_t rv;
+
+    /* Fill this thread's cache of the allocator being destroyed */
+    if ((rv = apr_pool_create(&subp, tcache_pool)) == APR_SUCCESS) {
+        apr_palloc(subp, 20000);
+        apr_pool_destroy(subp);
+    }
+    apr_atomic_set32(&tcache_step, 1);
+    tcache_wait(2);
+
+    /* Then use another allocator, maybe at the same address */
+    if (rv == APR_SUCCESS)
+        rv = apr_allocator_create(&allocator);
+    if (rv == APR_SUCCESS) {
+        if ((rv = apr_pool_create_ex(&pool, NULL, NULL,
+                                     allocator)) != APR_SUCCESS) {
+            apr_allocator_destroy(allocator);
+        }
+    }
+    if (rv == APR_SUCCESS) {
+        apr_allocator_owner_set(allocator, pool);
+        rv = apr_allocator_thread_cache_set(allocator, 64 * 1024, pool);
+        if (rv == APR_SUCCESS
+                && (rv = apr_pool_create(&subp, pool)) == APR_SUCCESS) {
+            apr_palloc(subp, 20000);
+            apr_pool_destroy(subp);
+        }
+        apr_pool_destroy(pool);
+    }
+
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+/* The caches of the threads still running when the allocator is destroyed
+ * are freed on their exit (leak checkers will tell).
+ */
+static void test_thread_cache_live(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_thread_mutex_t *mutex;
+    apr_thread_t *t;
+    apr_status_t rv, retval;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pool_create_ex(&tcache_pool, NULL, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_owner_set(allocator, tcache_pool);
+    rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT,
+                                 tcache_pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_mutex_set(allocator, mutex);
+    rv = apr_allocator_thread_cache_set(allocator, 64 * 1024, tcache_pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_PTR_NOTNULL(tc, apr_palloc(tcache_pool, 20000));
+
+    apr_atomic_set32(&tcache_step, 0);
+    rv = apr_thread_create(&t, NULL, tcache_thread_live, NULL, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    tcache_wait(1);
+    apr_pool_destroy(tcache_pool);
+    apr_atomic_set32(&tcache_step, 2);
+
+    rv = apr_thread_join(&retval, t);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, retval);
+}
+
+static void test_allocator_lockfree(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_allocator_stats_t stats;
+    apr_thread_mutex_t *mutex;
+    apr_thread_t *t[TCACHE_THREADS];
+    apr_size_t index, nodes;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_allocator_create_ex(&allocator, APR_ALLOCATOR_LOCKFREE);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_mutex_set(allocator, mutex);
+    rv = apr_pool_create_ex(&tcache_pool, NULL, NULL, allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < TCACHE_THREADS; i++) {
+        rv = apr_thread_create(&t[i], NULL, tcache_thread, NULL, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < TCACHE_THREADS; i++) {
+        apr_status_t retval;
+
+        rv = apr_thread_join(&retval, t[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, retval);
+    }
+    apr_pool_destroy(tcache_pool);
+
+    /* All the nodes are accounted for once given back */
+    apr_allocator_stats_get(allocator, &stats);
+    ABTS_INT_EQUAL(tc, 0, (int)stats.sys_frees);
+    ABTS_ASSERT(tc, "all free", stats.free_bytes == stats.sys_bytes);
+    for (nodes = 0, index = 0; index < APR_ALLOCATOR_STATS_BINS; index++) {
+        nodes += stats.free_nodes[index];
+    }
+    ABTS_INT_EQUAL(tc, (int)stats.sys_allocs, (int)nodes);
+
+    apr_allocator_destroy(allocator);
+}
+
+#define CONCURRENT_ALLOCS 5000
+
+static apr_pool_t *concurrent_pool;
+
+static void * APR_THREAD_FUNC concurrent_thread(apr_thread_t *thd,
+                                                void *data)
+{
+    char **mem = data, fill = (char)(apr_uintptr_t)mem[0];
+    apr_size_t i, size;
+    apr_status_t rv = APR_SUCCESS;
+
+    for (i = 0; i < CONCURRENT_ALLOCS; i++) {
+        size = 1 + (i * 37) % 500;
+        if (i % 100 == 99)
+            size = 20000;
+        if (i % 10 == 5) {
+            mem[i] = apr_psprintf(concurrent_pool, "%c%*s", fill,
+                                  (int)size - 1, "");
+            if (mem[i])
+                memset(mem[i], fill, size);
+        }
+        else if ((mem[i] = apr_palloc(concurrent_pool, size)) != NULL)
+            memset(mem[i], fill, size);
+        if (mem[i] == NULL)
+            rv = APR_ENOMEM;
+    }
+
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+#if !APR_POOL_DEBUG
+/* Whether all the memory of the allocator is back in its free lists */
+static int allocator_all_free(apr_allocator_t *allocator)
+{
+    apr_allocator_stats_t stats;
+
+    apr_allocator_stats_get(allocator, &stats);
+    return stats.sys_bytes == stats.free_bytes + stats.cached_bytes;
+}
+#endif
+
+static void test_pool_concurrent(abts_case *tc, void *data)
+{
+    char **mem[TCACHE_THREADS];
+    apr_thread_t *t[TCACHE_THREADS];
+    apr_allocator_t *allocator;
+    apr_thread_mutex_t *mutex;
+    apr_size_t i, size;
+    apr_status_t rv;
+    int j, ok;
+
+    rv = apr_allocator_create(&allocator);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_allocator_mutex_set(allocator, mutex);
+
+    /* A new node must be linked to the pool to be given back */
+    rv = apr_pool_create_flags(&concurrent_pool, p, NULL, allocator,
+                               APR_POOL_CONCURRENT);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_PTR_NOTNULL(tc, apr_palloc(concurrent_pool, 20000));
+    apr_pool_destroy(concurrent_pool);
+#if !APR_POOL_DEBUG
+    ABTS_ASSERT(tc, "nodes given back", allocator_all_free(allocator));
+#endif
+
+    rv = apr_pool_create_flags(&concurrent_pool, p, NULL, allocator,
+                               APR_POOL_CONCURRENT);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_PTR_EQUAL(tc, NULL, apr_pool_mark(concurrent_pool));
+
+    for (j = 0; j < TCACHE_THREADS; j++) {
+        mem[j] = apr_pcalloc(p, CONCURRENT_ALLOCS * sizeof(char *));
+        mem[j][0] = (char *)(apr_uintptr_t)('a' + j);
+    }
+    for (j = 0; j < TCACHE_THREADS; j++) {
+        rv = apr_thread_create(&t[j], NULL, concurrent_thread, mem[j], p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (j = 0; j < TCACHE_THREADS; j++) {
+        apr_status_t retval;
+
+        rv = apr_thread_join(&retval, t[j]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, retval);
+    }
+
+    /* No allocation overlaps another one */
+    for (j = 0, ok = 1; j < TCACHE_THREADS && ok; j++) {
+        for (i = 0; i < CONCURRENT_ALLOCS && ok; i++) {
+            size = 1 + (i * 37) % 500;
+            if (i % 100 == 99)
+                size = 20000;
+            ok = mem[j][i][0] == 'a' + j && mem[j][i][size - 1] == 'a' + j;
+        }
+    }
+    ABTS_ASSERT(tc, "allocations intact", ok);
+
+    /* Reusable once cleared, all the nodes are given back */
+    apr_pool_clear(concurrent_pool);
+    ABTS_STR_EQUAL(tc, "cleared", apr_pstrdup(concurrent_pool, "cleared"));
+    apr_pool_destroy(concurrent_pool);
+#if !APR_POOL_DEBUG
+    ABTS_ASSERT(tc, "nodes given back", allocator_all_free(allocator));
+#endif
+    apr_allocator_destroy(allocator);
+}
+#endif /* APR_HAS_THREADS */
+
 abts_suite *testpool(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -150,6 +1447,27 @@ abts_suite *testpool(abts_suite *suite)
     abts_run_test(suite, alloc_bytes, NULL);
     abts_run_test(suite, calloc_bytes, NULL);
     abts_run_test(suite, test_cleanups, NULL);
+    abts_run_test(suite, test_cleanups_many, NULL);
+    abts_run_test(suite, test_allocator_fit, NULL);
+    abts_run_test(suite, test_allocator_hugepages, NULL);
+    abts_run_test(suite, test_allocator_arena, NULL);
+    abts_run_test(suite, test_allocator_decay, NULL);
+    abts_run_test(suite, test_pool_stats, NULL);
+    abts_run_test(suite, test_pool_mark, NULL);
+    abts_run_test(suite, test_pool_rewind_cleanups, NULL);
+    abts_run_test(suite, test_prealloc, NULL);
+    abts_run_test(suite, test_palloc_aligned, NULL);
+    abts_run_test(suite, test_pool_small, NULL);
+    abts_run_test(suite, test_pool_retain, NULL);
+    abts_run_test(suite, test_allocator_stats, NULL);
+    abts_run_test(suite, test_pool_cache, NULL);
+    abts_run_test(suite, test_pool_trace, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_thread_cache, NULL);
+    abts_run_test(suite, test_thread_cache_live, NULL);
+    abts_run_test(suite, test_allocator_lockfree, NULL);
+    abts_run_test(suite, test_pool_concurrent, NULL);
+#endif
 
     return suite;
 }
@@ -0,0 +1,109 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The inline apr_palloc() of APR_POOL_INLINE, testpools.c tests the
+ * library one.
+ */
+#define APR_POOL_INLINE
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_strings.h"
+#include <string.h>
+#include "testutil.h"
+
+static void palloc_inline(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_pool_stats_t stats;
+    char *mem, *prev = NULL;
+    apr_size_t requested = 0;
+    apr_status_t rv;
+    int i;
+
+    rv = apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* Enough to fill a few nodes, switching between the inline path
+     * and apr_palloc() itself.
+     */
+    for (i = 0; i < 1000; i++) {
+        mem = apr_palloc(pool, i % 61 + 1);
+        ABTS_PTR_NOTNULL(tc, mem);
+        ABTS_INT_EQUAL(tc, 0, (int)((apr_uintptr_t)mem % 8));
+        memset(mem, i, i % 61 + 1);
+        if (prev) {
+            ABTS_ASSERT(tc, "overlap", mem >= prev + (i - 1) % 61 + 1
+                                       || mem + i % 61 + 1 <= prev);
+        }
+        prev = mem;
+        requested += i % 61 + 1;
+    }
+    mem = apr_pcalloc(pool, 100);
+    ABTS_PTR_NOTNULL(tc, mem);
+    ABTS_INT_EQUAL(tc, 0, mem[0] | mem[99]);
+    requested += 100;
+
+    apr_pool_stats_get(pool, &stats, 0);
+    ABTS_ASSERT(tc, "requested", stats.requested >= requested);
+    ABTS_ASSERT(tc, "reserved", stats.reserved >= stats.requested);
+
+    apr_pool_destroy(pool);
+}
+
+static void palloc_inline_rewind(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_pool_mark_t *mark;
+    char *mem, *first = NULL;
+    apr_status_t rv;
+    int i, j;
+
+    rv = apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    mark = apr_pool_mark(pool);
+    ABTS_PTR_NOTNULL(tc, mark);
+
+    /* The inline path allocates from where the pool was rewound to */
+    for (i = 0; i < 10; i++) {
+        for (j = 0; j < 500; j++) {
+            mem = apr_palloc(pool, j % 61 + 1);
+            ABTS_PTR_NOTNULL(tc, mem);
+            memset(mem, j, j % 61 + 1);
+#if !APR_POOL_DEBUG
+            if (j == 0) {
+                if (i == 0)
+                    first = mem;
+                ABTS_PTR_EQUAL(tc, first, mem);
+            }
+#endif
+        }
+        ABTS_STR_EQUAL(tc, "inline", apr_pstrdup(pool, "inline"));
+        apr_pool_rewind(pool, mark);
+    }
+
+    apr_pool_destroy(pool);
+}
+
+abts_suite *testpoolinline(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, palloc_inline, NULL);
+    abts_run_test(suite, palloc_inline_rewind, NULL);
+
+    return suite;
+}
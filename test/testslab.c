@@ -0,0 +1,194 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "testutil.h"
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_slab.h"
+#include "apr_thread_proc.h"
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+#define NUM_OBJS 1000
+
+typedef struct {
+    int  id;
+    char data[20];
+} obj_t;
+
+static void slab_alloc_free(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_slab_t *slab;
+    apr_slab_stats_t stats;
+    obj_t *objs[NUM_OBJS];
+    int i;
+
+    apr_pool_create(&pool, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_slab_create(&slab, sizeof(obj_t),
+                                                    0, 0, pool));
+
+    for (i = 0; i < NUM_OBJS; i++) {
+        objs[i] = apr_slab_alloc(slab);
+        ABTS_PTR_NOTNULL(tc, objs[i]);
+        ABTS_INT_EQUAL(tc, 0, (int)((apr_uintptr_t)objs[i] % 8));
+        objs[i]->id = i;
+        memset(objs[i]->data, i, sizeof(objs[i]->data));
+    }
+    for (i = 0; i < NUM_OBJS; i++) {
+        ABTS_INT_EQUAL(tc, i, objs[i]->id);
+        ABTS_INT_EQUAL(tc, (char)i, objs[i]->data[19]);
+    }
+
+    apr_slab_stats_get(slab, &stats);
+    ABTS_INT_EQUAL(tc, (int)APR_ALIGN_DEFAULT(sizeof(obj_t)),
+                   (int)stats.size);
+    ABTS_INT_EQUAL(tc, NUM_OBJS, (int)stats.used);
+    ABTS_INT_EQUAL(tc, NUM_OBJS, (int)stats.peak);
+    ABTS_INT_EQUAL(tc, 0, (int)stats.free);
+    ABTS_INT_EQUAL(tc, (int)((NUM_OBJS + stats.per_slab - 1)
+                             / stats.per_slab), (int)stats.slabs);
+
+    /* Churning objects must not grow the slabs */
+    for (i = 0; i < NUM_OBJS; i += 2) {
+        apr_slab_free(slab, objs[i]);
+    }
+    for (i = 0; i < NUM_OBJS; i += 2) {
+        objs[i] = apr_slab_calloc(slab);
+        ABTS_PTR_NOTNULL(tc, objs[i]);
+        ABTS_INT_EQUAL(tc, 0, objs[i]->id | objs[i]->data[19]);
+    }
+    for (i = 1; i < NUM_OBJS; i += 2) {
+        ABTS_INT_EQUAL(tc, i, objs[i]->id);
+    }
+
+    apr_slab_stats_get(slab, &stats);
+    ABTS_INT_EQUAL(tc, NUM_OBJS, (int)stats.used);
+    ABTS_INT_EQUAL(tc, 0, (int)stats.free);
+    ABTS_INT_EQUAL(tc, NUM_OBJS + NUM_OBJS / 2, (int)stats.allocs);
+    ABTS_INT_EQUAL(tc, (int)((NUM_OBJS + stats.per_slab - 1)
+                             / stats.per_slab), (int)stats.slabs);
+
+    for (i = 0; i < NUM_OBJS; i++) {
+        apr_slab_free(slab, objs[i]);
+    }
+    apr_slab_stats_get(slab, &stats);
+    ABTS_INT_EQUAL(tc, 0, (int)stats.used);
+    ABTS_INT_EQUAL(tc, NUM_OBJS, (int)stats.free);
+    ABTS_INT_EQUAL(tc, NUM_OBJS, (int)stats.peak);
+
+    apr_pool_destroy(pool);
+}
+
+static void slab_small(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_slab_t *slab;
+    apr_slab_stats_t stats;
+    void *a, *b;
+
+    apr_pool_create(&pool, p);
+
+    /* Objects smaller than a pointer, one per slab */
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_slab_create(&slab, 1, 1, 0, pool));
+    a = apr_slab_alloc(slab);
+    b = apr_slab_alloc(slab);
+    ABTS_PTR_NOTNULL(tc, a);
+    ABTS_PTR_NOTNULL(tc, b);
+    ABTS_ASSERT(tc, "distinct objects", a != b);
+    apr_slab_free(slab, a);
+    ABTS_PTR_EQUAL(tc, a, apr_slab_alloc(slab));
+
+    apr_slab_stats_get(slab, &stats);
+    ABTS_INT_EQUAL(tc, (int)APR_ALIGN_DEFAULT(sizeof(void *)),
+                   (int)stats.size);
+    ABTS_INT_EQUAL(tc, 1, (int)stats.per_slab);
+    ABTS_INT_EQUAL(tc, 2, (int)stats.slabs);
+
+    apr_pool_destroy(pool);
+}
+
+#if APR_HAS_THREADS
+
+#define NUM_THREADS 4
+
+static void * APR_THREAD_FUNC slab_thread(apr_thread_t *thd, void *data)
+{
+    apr_slab_t *slab = data;
+    void *objs[100];
+    int i, j;
+
+    for (i = 0; i < 100; i++) {
+        for (j = 0; j < 100; j++) {
+            objs[j] = apr_slab_alloc(slab);
+            memset(objs[j], j, sizeof(obj_t));
+        }
+        for (j = 0; j < 100; j++) {
+            apr_slab_free(slab, objs[j]);
+        }
+    }
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void slab_threadsafe(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_slab_t *slab;
+    apr_slab_stats_t stats;
+    apr_thread_t *threads[NUM_THREADS];
+    apr_status_t rv, retval;
+    int i;
+
+    apr_pool_create(&pool, p);
+    rv = apr_slab_create(&slab, sizeof(obj_t), 0, APR_SLAB_THREADSAFE, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        rv = apr_thread_create(&threads[i], NULL, slab_thread, slab, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        apr_thread_join(&retval, threads[i]);
+    }
+
+    apr_slab_stats_get(slab, &stats);
+    ABTS_INT_EQUAL(tc, 0, (int)stats.used);
+    ABTS_INT_EQUAL(tc, NUM_THREADS * 100 * 100, (int)stats.allocs);
+    ABTS_ASSERT(tc, "bounded peak", stats.peak <= NUM_THREADS * 100);
+    /* New objects are only carved out when none is free */
+    ABTS_INT_EQUAL(tc, (int)stats.peak, (int)stats.free);
+
+    apr_pool_destroy(pool);
+}
+
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testslab(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite)
+
+    abts_run_test(suite, slab_alloc_free, NULL);
+    abts_run_test(suite, slab_small, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, slab_threadsafe, NULL);
+#endif
+
+    return suite;
+}
@@ -0,0 +1,299 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* testsortperf.c
+ * Array sorting benchmarks, each one sorting the same elements with
+ * qsort() and then with the apr_array_sort*() functions, printing the
+ * time taken.
+ *
+ *   ./testsortperf [-n elements] [-t threads] [benchmark ...]
+ *
+ * Benchmarks:
+ *   ints      random ints, with qsort(), apr_array_sort(),
+ *             apr_array_sort_parallel() and apr_array_sort_int().
+ *   sorted    already sorted ints, with qsort() and apr_array_sort().
+ *   strings   random strings compared with strcmp(), with qsort(),
+ *             apr_array_sort() and apr_array_sort_parallel().
+ */
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_tables.h"
+#include "apr_getopt.h"
+#include "apr_strings.h"
+#include "apr_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_ELEMENTS 1000000
+#define DEFAULT_THREADS 4
+
+static int elements = DEFAULT_ELEMENTS;
+static int threads = DEFAULT_THREADS;
+
+static void report(const char *name, apr_time_t usecs, apr_size_t ops)
+{
+    printf("    %-32s %10" APR_INT64_T_FMT " usec  %8.2f ns/element\n",
+           name, usecs, (double)usecs * 1000 / (ops ? ops : 1));
+}
+
+static apr_uint32_t xorshift(apr_uint32_t *state)
+{
+    apr_uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return *state = x;
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int cmp_str(const void *a, const void *b)
+{
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+typedef enum {
+    SORT_QSORT,
+    SORT_APR,
+    SORT_PARALLEL,
+    SORT_RADIX
+} sort_kind_e;
+
+/* Sort a copy of the elements the given way, and check the result */
+static apr_status_t sort_run(const char *name,
+                             const apr_array_header_t *orig,
+                             apr_array_cmp_fn_t *cmp, sort_kind_e kind)
+{
+    apr_pool_t *pool;
+    apr_array_header_t *arr;
+    apr_time_t start;
+    apr_status_t rv = APR_SUCCESS;
+    int i;
+
+    if ((rv = apr_pool_create(&pool, NULL)) != APR_SUCCESS)
+        return rv;
+    arr = apr_array_copy(pool, orig);
+
+    start = apr_time_now();
+    switch (kind) {
+    case SORT_QSORT:
+        qsort(arr->elts, arr->nelts, arr->elt_size, cmp);
+        break;
+    case SORT_APR:
+        apr_array_sort(arr, cmp);
+        break;
+    case SORT_PARALLEL:
+        rv = apr_array_sort_parallel(arr, cmp, threads);
+        break;
+    case SORT_RADIX:
+        rv = apr_array_sort_int(arr, 0, sizeof(int), APR_ARRAY_SORT_SIGNED);
+        break;
+    }
+    report(name, apr_time_now() - start, arr->nelts);
+
+    for (i = 1; rv == APR_SUCCESS && i < arr->nelts; i++) {
+        if (cmp(arr->elts + (i - 1) * arr->elt_size,
+                arr->elts + i * arr->elt_size) > 0) {
+            fprintf(stderr, "%s: not sorted at %d\n", name, i);
+            rv = APR_EGENERAL;
+        }
+    }
+
+    apr_pool_destroy(pool);
+
+    return rv;
+}
+
+/*
+ * ints
+ */
+static apr_status_t bench_ints(void)
+{
+    apr_pool_t *pool;
+    apr_array_header_t *arr;
+    apr_uint32_t seed = 2463534242u;
+    apr_status_t rv;
+    int i;
+
+    printf("Sorting %d random ints\n", elements);
+
+    if ((rv = apr_pool_create(&pool, NULL)) != APR_SUCCESS)
+        return rv;
+    arr = apr_array_make(pool, elements, sizeof(int));
+    for (i = 0; i < elements; i++) {
+        APR_ARRAY_PUSH(arr, int) = (int)xorshift(&seed);
+    }
+
+    if ((rv = sort_run("qsort", arr, cmp_int, SORT_QSORT)) == APR_SUCCESS
+        && (rv = sort_run("apr_array_sort", arr, cmp_int,
+                          SORT_APR)) == APR_SUCCESS
+        && (rv = sort_run(apr_psprintf(pool, "apr_array_sort_parallel (%d)",
+                                       threads), arr, cmp_int,
+                          SORT_PARALLEL)) == APR_SUCCESS) {
+        rv = sort_run("apr_array_sort_int", arr, cmp_int, SORT_RADIX);
+    }
+
+    apr_pool_destroy(pool);
+
+    return rv;
+}
+
+/*
+ * sorted
+ */
+static apr_status_t bench_sorted(void)
+{
+    apr_pool_t *pool;
+    apr_array_header_t *arr;
+    apr_status_t rv;
+    int i;
+
+    printf("Sorting %d sorted ints\n", elements);
+
+    if ((rv = apr_pool_create(&pool, NULL)) != APR_SUCCESS)
+        return rv;
+    arr = apr_array_make(pool, elements, sizeof(int));
+    for (i = 0; i < elements; i++) {
+        APR_ARRAY_PUSH(arr, int) = i;
+    }
+
+    if ((rv = sort_run("qsort", arr, cmp_int, SORT_QSORT)) == APR_SUCCESS) {
+        rv = sort_run("apr_array_sort", arr, cmp_int, SORT_APR);
+    }
+
+    apr_pool_destroy(pool);
+
+    return rv;
+}
+
+/*
+ * strings
+ */
+static apr_status_t bench_strings(void)
+{
+    apr_pool_t *pool;
+    apr_array_header_t *arr;
+    apr_uint32_t seed = 2463534242u;
+    apr_status_t rv;
+    int i;
+
+    printf("Sorting %d random strings\n", elements);
+
+    if ((rv = apr_pool_create(&pool, NULL)) != APR_SUCCESS)
+        return rv;
+    arr = apr_array_make(pool, elements, sizeof(char *));
+    for (i = 0; i < elements; i++) {
+        APR_ARRAY_PUSH(arr, char *) = apr_psprintf(pool, "X-Key-%08x",
+                                                   xorshift(&seed));
+    }
+
+    if ((rv = sort_run("qsort", arr, cmp_str, SORT_QSORT)) == APR_SUCCESS
+        && (rv = sort_run("apr_array_sort", arr, cmp_str,
+                          SORT_APR)) == APR_SUCCESS) {
+        rv = sort_run(apr_psprintf(pool, "apr_array_sort_parallel (%d)",
+                                   threads), arr, cmp_str, SORT_PARALLEL);
+    }
+
+    apr_pool_destroy(pool);
+
+    return rv;
+}
+
+static const struct {
+    const char *name;
+    apr_status_t (*func)(void);
+} benchmarks[] = {
+    { "ints", bench_ints },
+    { "sorted", bench_sorted },
+    { "strings", bench_strings },
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_getopt_t *opt;
+    apr_status_t rv;
+    char errmsg[200];
+    char optchar;
+    const char *optarg;
+    apr_size_t i;
+    int j;
+
+    printf("APR Sort Performance Test\n==============\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "n:t:", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'n') {
+            elements = atoi(optarg);
+        }
+        else if (optchar == 't') {
+            threads = atoi(optarg);
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+    if (elements <= 0 || threads <= 0) {
+        fprintf(stderr, "Invalid number of elements or threads\n");
+        exit(-1);
+    }
+
+    for (i = 0; i < NUM_BENCHMARKS; i++) {
+        if (opt->ind < argc) {
+            for (j = opt->ind; j < argc; j++) {
+                if (!strcmp(argv[j], benchmarks[i].name))
+                    break;
+            }
+            if (j == argc)
+                continue;
+        }
+
+        if ((rv = benchmarks[i].func()) != APR_SUCCESS) {
+            fprintf(stderr, "%s benchmark failed: [%d] %s\n",
+                    benchmarks[i].name, rv,
+                    apr_strerror(rv, errmsg, sizeof errmsg));
+            exit(-2);
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -42,6 +42,281 @@ static void array_clear(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, 0, a1->nelts);
 }
 
+static void array_grow(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_array_header_t *arr, *hdr, *cat;
+    int i;
+
+    apr_pool_create(&pool, p);
+
+    arr = apr_array_make(pool, 1, sizeof(int));
+    for (i = 0; i < 1000; i++) {
+        APR_ARRAY_PUSH(arr, int) = i;
+    }
+    cat = apr_array_make(pool, 1, sizeof(int));
+    apr_array_cat(cat, arr);
+    apr_array_cat(cat, arr);
+    ABTS_INT_EQUAL(tc, 2000, cat->nelts);
+    for (i = 0; i < 1000; i++) {
+        ABTS_INT_EQUAL(tc, i, APR_ARRAY_IDX(arr, i, int));
+        ABTS_INT_EQUAL(tc, i, APR_ARRAY_IDX(cat, i, int));
+        ABTS_INT_EQUAL(tc, i, APR_ARRAY_IDX(cat, 1000 + i, int));
+    }
+    for (i = cat->nelts; i < cat->nalloc; i++) {
+        ABTS_INT_EQUAL(tc, 0, ((int *)cat->elts)[i]);
+    }
+
+    /* The elements of a copied header are still copied on push */
+    arr = apr_array_make(pool, 2, sizeof(int));
+    APR_ARRAY_PUSH(arr, int) = 1;
+    APR_ARRAY_PUSH(arr, int) = 2;
+    hdr = apr_array_copy_hdr(pool, arr);
+    APR_ARRAY_PUSH(hdr, int) = 3;
+    APR_ARRAY_IDX(hdr, 0, int) = 4;
+    ABTS_INT_EQUAL(tc, 1, APR_ARRAY_IDX(arr, 0, int));
+    ABTS_INT_EQUAL(tc, 2, APR_ARRAY_IDX(hdr, 1, int));
+    ABTS_INT_EQUAL(tc, 3, APR_ARRAY_IDX(hdr, 2, int));
+
+    apr_pool_destroy(pool);
+}
+
+static void array_bulk(abts_case *tc, void *data)
+{
+    apr_pool_t *pool, *subp;
+    apr_array_header_t *arr, *dst;
+    int *elts;
+    int i;
+
+    apr_pool_create(&pool, p);
+
+    arr = apr_array_make(pool, 1, sizeof(int));
+    apr_array_reserve(arr, 100);
+    ABTS_INT_EQUAL(tc, 100, arr->nalloc);
+    ABTS_INT_EQUAL(tc, 0, arr->nelts);
+    apr_array_reserve(arr, 10);
+    ABTS_INT_EQUAL(tc, 100, arr->nalloc);
+    elts = (int *)arr->elts;
+    for (i = 0; i < 100; i++) {
+        ABTS_INT_EQUAL(tc, 0, elts[i]);
+        APR_ARRAY_PUSH(arr, int) = i;
+    }
+    ABTS_PTR_EQUAL(tc, elts, arr->elts);
+
+    elts = apr_array_push_n(arr, 1000);
+    ABTS_PTR_EQUAL(tc, arr->elts + 100 * sizeof(int), elts);
+    ABTS_INT_EQUAL(tc, 1100, arr->nelts);
+    ABTS_ASSERT(tc, "room for the new elements", arr->nalloc >= 1100);
+    for (i = 0; i < 1000; i++) {
+        ABTS_INT_EQUAL(tc, 0, elts[i]);
+        elts[i] = 100 + i;
+    }
+    ABTS_PTR_EQUAL(tc, arr->elts + 1100 * sizeof(int),
+                   apr_array_push_n(arr, 0));
+    for (i = 0; i < 1100; i++) {
+        ABTS_INT_EQUAL(tc, i, APR_ARRAY_IDX(arr, i, int));
+    }
+
+    /* Moved within the pool, copied to a longer lived one */
+    dst = apr_array_make(pool, 1, sizeof(int));
+    elts = (int *)arr->elts;
+    apr_array_move(dst, arr);
+    ABTS_PTR_EQUAL(tc, elts, dst->elts);
+    ABTS_INT_EQUAL(tc, 1100, dst->nelts);
+    ABTS_INT_EQUAL(tc, 0, arr->nelts);
+    APR_ARRAY_PUSH(arr, int) = 1;
+    ABTS_INT_EQUAL(tc, 1, APR_ARRAY_IDX(arr, 0, int));
+    ABTS_INT_EQUAL(tc, 0, APR_ARRAY_IDX(dst, 0, int));
+
+    apr_pool_create(&subp, pool);
+    arr = apr_array_make(subp, 1, sizeof(int));
+    apr_array_move(arr, dst);
+    ABTS_PTR_EQUAL(tc, elts, arr->elts);
+    apr_array_move(dst, arr);
+    ABTS_ASSERT(tc, "elements copied", dst->elts != (char *)elts);
+    ABTS_INT_EQUAL(tc, 0, arr->nelts);
+    apr_pool_destroy(subp);
+    ABTS_INT_EQUAL(tc, 1100, dst->nelts);
+    for (i = 0; i < 1100; i++) {
+        ABTS_INT_EQUAL(tc, i, APR_ARRAY_IDX(dst, i, int));
+    }
+
+    apr_pool_destroy(pool);
+}
+
+typedef struct {
+    apr_int32_t key;
+    apr_uint32_t pos;
+    char pad[4];
+} sort_elt_t;
+
+static int sort_cmp_int(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int sort_cmp_elt(const void *a, const void *b)
+{
+    const sort_elt_t *x = a, *y = b;
+
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+static apr_uint32_t sort_random(apr_uint32_t *state)
+{
+    apr_uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+
+    return *state = x;
+}
+
+static void sort_check_ints(abts_case *tc, const apr_array_header_t *arr,
+                            apr_int64_t sum)
+{
+    int i;
+
+    for (i = 1; i < arr->nelts; i++) {
+        if (APR_ARRAY_IDX(arr, i - 1, int) > APR_ARRAY_IDX(arr, i, int)) {
+            break;
+        }
+        sum -= APR_ARRAY_IDX(arr, i, int);
+    }
+    ABTS_ASSERT(tc, "sorted", i >= arr->nelts);
+    if (arr->nelts) {
+        sum -= APR_ARRAY_IDX(arr, 0, int);
+    }
+    ABTS_ASSERT(tc, "same elements", sum == 0);
+}
+
+static void array_sort(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_array_header_t *arr;
+    apr_uint32_t seed = 2463534242u;
+    apr_int64_t sum;
+    int n, i, kind;
+
+    apr_pool_create(&pool, p);
+
+    for (n = 0; n <= 3000; n = n ? n * 3 : 1) {
+        for (kind = 0; kind < 5; kind++) {
+            arr = apr_array_make(pool, n, sizeof(int));
+            sum = 0;
+            for (i = 0; i < n; i++) {
+                int v;
+
+                switch (kind) {
+                case 0: v = (int)sort_random(&seed); break;
+                case 1: v = i; break;
+                case 2: v = n - i; break;
+                case 3: v = 42; break;
+                default: v = (int)(sort_random(&seed) % 4); break;
+                }
+                APR_ARRAY_PUSH(arr, int) = v;
+                sum += v;
+            }
+            apr_array_sort(arr, sort_cmp_int);
+            sort_check_ints(tc, arr, sum);
+        }
+    }
+
+    /* Elements of another size */
+    arr = apr_array_make(pool, 1000, sizeof(sort_elt_t));
+    for (i = 0; i < 1000; i++) {
+        sort_elt_t *elt = apr_array_push(arr);
+
+        elt->key = (apr_int32_t)(sort_random(&seed) % 100);
+        elt->pos = i;
+    }
+    apr_array_sort(arr, sort_cmp_elt);
+    for (i = 1; i < 1000; i++) {
+        ABTS_ASSERT(tc, "sorted", APR_ARRAY_IDX(arr, i - 1, sort_elt_t).key
+                                  <= APR_ARRAY_IDX(arr, i, sort_elt_t).key);
+    }
+
+    /* Chunks sorted by threads and merged (400K elements, at least
+     * 64K per thread).
+     */
+    arr = apr_array_make(pool, 400000, sizeof(int));
+    sum = 0;
+    for (i = 0; i < 400000; i++) {
+        int v = (int)sort_random(&seed);
+
+        APR_ARRAY_PUSH(arr, int) = v;
+        sum += v;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_array_sort_parallel(arr, sort_cmp_int, 5));
+    sort_check_ints(tc, arr, sum);
+
+    apr_pool_destroy(pool);
+}
+
+static void array_sort_int(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_array_header_t *arr;
+    apr_uint32_t seed = 2463534242u;
+    apr_int64_t sum = 0;
+    void *ptrs[3];
+    int i;
+
+    apr_pool_create(&pool, p);
+
+    arr = apr_array_make(pool, 10000, sizeof(int));
+    for (i = 0; i < 10000; i++) {
+        int v = (int)sort_random(&seed) >> (i % 20);
+
+        APR_ARRAY_PUSH(arr, int) = v;
+        sum += v;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_array_sort_int(arr, 0, sizeof(int),
+                                      APR_ARRAY_SORT_SIGNED));
+    sort_check_ints(tc, arr, sum);
+
+    /* Stable, by a key within the elements */
+    arr = apr_array_make(pool, 1000, sizeof(sort_elt_t));
+    for (i = 0; i < 1000; i++) {
+        sort_elt_t *elt = apr_array_push(arr);
+
+        elt->key = (apr_int32_t)(sort_random(&seed) % 100) - 50;
+        elt->pos = i;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_array_sort_int(arr, APR_OFFSETOF(sort_elt_t, key),
+                                      sizeof(apr_int32_t),
+                                      APR_ARRAY_SORT_SIGNED));
+    for (i = 1; i < 1000; i++) {
+        sort_elt_t *prev = &APR_ARRAY_IDX(arr, i - 1, sort_elt_t);
+        sort_elt_t *elt = &APR_ARRAY_IDX(arr, i, sort_elt_t);
+
+        ABTS_ASSERT(tc, "sorted", prev->key < elt->key
+                                  || (prev->key == elt->key
+                                      && prev->pos < elt->pos));
+    }
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_array_sort_int(arr, 0, 3, 0));
+    ABTS_INT_EQUAL(tc, APR_EINVAL,
+                   apr_array_sort_int(arr, sizeof(sort_elt_t) - 2, 4, 0));
+
+    arr = apr_array_make(pool, 3, sizeof(void *));
+    APR_ARRAY_PUSH(arr, void *) = &ptrs[2];
+    APR_ARRAY_PUSH(arr, void *) = &ptrs[0];
+    APR_ARRAY_PUSH(arr, void *) = &ptrs[1];
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, apr_array_sort_ptr(arr));
+    ABTS_PTR_EQUAL(tc, &ptrs[0], APR_ARRAY_IDX(arr, 0, void *));
+    ABTS_PTR_EQUAL(tc, &ptrs[1], APR_ARRAY_IDX(arr, 1, void *));
+    ABTS_PTR_EQUAL(tc, &ptrs[2], APR_ARRAY_IDX(arr, 2, void *));
+
+    apr_pool_destroy(pool);
+}
+
 static void table_make(abts_case *tc, void *data)
 {
     t1 = apr_table_make(p, 5);
@@ -222,11 +497,338 @@ static void table_overlap3(abts_case *tc, void *data)
 
 }
 
+static void table_index_full(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_table_t *t, *c, *o;
+    const apr_array_header_t *arr;
+    char key[32];
+    const char *val;
+    int i;
+
+    apr_pool_create(&pool, p);
+
+    /* Enough keys sharing their first character to get the full-key
+     * index built and grown.
+     */
+    t = apr_table_make(pool, 1);
+    for (i = 0; i < 200; i++) {
+        sprintf(key, "X-Header-%d", i);
+        apr_table_set(t, key, apr_psprintf(pool, "%d", i));
+    }
+    ABTS_INT_EQUAL(tc, 200, apr_table_elts(t)->nelts);
+    for (i = 0; i < 200; i++) {
+        sprintf(key, "x-HEADER-%d", i);
+        val = apr_table_get(t, key);
+        ABTS_PTR_NOTNULL(tc, val);
+        ABTS_INT_EQUAL(tc, i, atoi(val));
+    }
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "X-Header-200"));
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "X-Header"));
+
+    /* Duplicates are only found from the first one */
+    apr_table_add(t, "X-Header-7", "dup");
+    ABTS_INT_EQUAL(tc, 201, apr_table_elts(t)->nelts);
+    ABTS_STR_EQUAL(tc, "7", apr_table_get(t, "X-Header-7"));
+    ABTS_STR_EQUAL(tc, "7,dup", apr_table_getm(pool, t, "X-Header-7"));
+    apr_table_set(t, "X-HEADER-7", "seven");
+    ABTS_INT_EQUAL(tc, 200, apr_table_elts(t)->nelts);
+    ABTS_STR_EQUAL(tc, "seven", apr_table_get(t, "X-Header-7"));
+
+    apr_table_merge(t, "X-Header-8", "eight");
+    ABTS_STR_EQUAL(tc, "8, eight", apr_table_get(t, "X-Header-8"));
+    apr_table_mergen(t, "X-Header-new", "new");
+    ABTS_INT_EQUAL(tc, 201, apr_table_elts(t)->nelts);
+    ABTS_STR_EQUAL(tc, "new", apr_table_get(t, "x-header-new"));
+
+    /* Removals shift the entries behind */
+    apr_table_unset(t, "X-Header-0");
+    apr_table_unset(t, "X-Header-missing");
+    ABTS_INT_EQUAL(tc, 200, apr_table_elts(t)->nelts);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "X-Header-0"));
+    for (i = 1; i < 200; i++) {
+        sprintf(key, "X-Header-%d", i);
+        ABTS_PTR_NOTNULL(tc, apr_table_get(t, key));
+    }
+    ABTS_STR_EQUAL(tc, "199", apr_table_get(t, "X-Header-199"));
+    ABTS_STR_EQUAL(tc, "new", apr_table_get(t, "X-Header-new"));
+
+    /* Copies have their own index */
+    c = apr_table_copy(pool, t);
+    apr_table_set(c, "X-Header-1", "one");
+    ABTS_STR_EQUAL(tc, "one", apr_table_get(c, "X-Header-1"));
+    ABTS_STR_EQUAL(tc, "1", apr_table_get(t, "X-Header-1"));
+
+    /* Overlays and overlaps keep the first key of the overlay */
+    o = apr_table_make(pool, 1);
+    apr_table_set(o, "X-Header-2", "two");
+    c = apr_table_overlay(pool, o, t);
+    ABTS_INT_EQUAL(tc, 201, apr_table_elts(c)->nelts);
+    ABTS_STR_EQUAL(tc, "two", apr_table_get(c, "X-Header-2"));
+    ABTS_STR_EQUAL(tc, "two,2", apr_table_getm(pool, c, "X-Header-2"));
+    apr_table_overlap(t, o, APR_OVERLAP_TABLES_SET);
+    ABTS_INT_EQUAL(tc, 200, apr_table_elts(t)->nelts);
+    ABTS_STR_EQUAL(tc, "two", apr_table_get(t, "X-Header-2"));
+    ABTS_STR_EQUAL(tc, "199", apr_table_get(t, "X-Header-199"));
+
+    /* Cleared tables reuse the index once large again */
+    apr_table_clear(t);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "X-Header-1"));
+    for (i = 0; i < 100; i++) {
+        sprintf(key, "X-Other-%d", i);
+        apr_table_addn(t, apr_pstrdup(pool, key), "other");
+    }
+    arr = apr_table_elts(t);
+    ABTS_INT_EQUAL(tc, 100, arr->nelts);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "X-Header-1"));
+    ABTS_STR_EQUAL(tc, "other", apr_table_get(t, "X-Other-99"));
+
+    apr_pool_destroy(pool);
+}
+
+static void table_freeze(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_table_t *t;
+    apr_table_frozen_t *f;
+    const apr_array_header_t *arr;
+    const apr_table_entry_t *elts;
+    char key[32];
+    const char *val;
+    int i;
+
+    apr_pool_create(&pool, p);
+
+    t = apr_table_make(pool, 1);
+    f = apr_table_freeze(pool, t);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_frozen_get(f, "foo"));
+    ABTS_INT_EQUAL(tc, 0, apr_table_frozen_elts(f)->nelts);
+
+    for (i = 0; i < 500; i++) {
+        sprintf(key, "Key-%d", i);
+        apr_table_set(t, key, apr_psprintf(pool, "%d", i));
+    }
+    apr_table_add(t, "KEY-1", "dup");
+    apr_table_add(t, "", "empty");
+    f = apr_table_freeze(pool, t);
+
+    /* The snapshot does not change with the table */
+    apr_table_set(t, "Key-2", "changed");
+    apr_table_set(t, "Key-500", "new");
+
+    for (i = 0; i < 500; i++) {
+        sprintf(key, "kEY-%d", i);
+        val = apr_table_frozen_get(f, key);
+        ABTS_PTR_NOTNULL(tc, val);
+        ABTS_INT_EQUAL(tc, i, atoi(val));
+    }
+    ABTS_STR_EQUAL(tc, "1", apr_table_frozen_get(f, "Key-1"));
+    ABTS_STR_EQUAL(tc, "empty", apr_table_frozen_get(f, ""));
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_frozen_get(f, "Key-500"));
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_frozen_get(f, "Key-"));
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_frozen_get(f, "Key-10 "));
+
+    arr = apr_table_frozen_elts(f);
+    elts = (const apr_table_entry_t *)arr->elts;
+    ABTS_INT_EQUAL(tc, 502, arr->nelts);
+    ABTS_STR_EQUAL(tc, "Key-0", elts[0].key);
+    ABTS_STR_EQUAL(tc, "KEY-1", elts[500].key);
+    ABTS_STR_EQUAL(tc, "dup", elts[500].val);
+    ABTS_STR_EQUAL(tc, "empty", elts[501].val);
+
+    apr_pool_destroy(pool);
+}
+
+static void table_freeze_null(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_table_t *t;
+    apr_table_frozen_t *f;
+    const apr_array_header_t *arr;
+    const apr_table_entry_t *elts;
+
+    apr_pool_create(&pool, p);
+
+    t = apr_table_make(pool, 5);
+    apr_table_addn(t, "Null", NULL);
+    apr_table_addn(t, "Empty", "");
+    apr_table_addn(t, "Dup", "first");
+    apr_table_addn(t, "NULL", NULL);
+    apr_table_addn(t, "dup", NULL);
+    f = apr_table_freeze(pool, t);
+    ABTS_PTR_NOTNULL(tc, f);
+
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_frozen_get(f, "null"));
+    ABTS_STR_EQUAL(tc, "", apr_table_frozen_get(f, "Empty"));
+    ABTS_STR_EQUAL(tc, "first", apr_table_frozen_get(f, "DUP"));
+
+    arr = apr_table_frozen_elts(f);
+    elts = (const apr_table_entry_t *)arr->elts;
+    ABTS_INT_EQUAL(tc, 5, arr->nelts);
+    ABTS_STR_EQUAL(tc, "Null", elts[0].key);
+    ABTS_PTR_EQUAL(tc, NULL, elts[0].val);
+    ABTS_STR_EQUAL(tc, "", elts[1].val);
+    ABTS_STR_EQUAL(tc, "NULL", elts[3].key);
+    ABTS_PTR_EQUAL(tc, NULL, elts[3].val);
+    ABTS_STR_EQUAL(tc, "dup", elts[4].key);
+    ABTS_PTR_EQUAL(tc, NULL, elts[4].val);
+
+    apr_pool_destroy(pool);
+}
+
+static void table_copy_on_write(abts_case *tc, void *data)
+{
+    apr_pool_t *pool, *subpool;
+    apr_table_t *t, *c1, *c2;
+    const char *elts;
+    char key[32];
+    int i;
+
+    apr_pool_create(&pool, p);
+
+    t = apr_table_make(pool, 2);
+    apr_table_set(t, "a", "1");
+    apr_table_set(t, "b", "2");
+
+    /* Plain copies do not share the entries */
+    c1 = apr_table_copy(pool, t);
+    ABTS_ASSERT(tc, "not shared",
+                apr_table_elts(t)->elts != apr_table_elts(c1)->elts);
+
+    /* Shared copies share the entries until changed */
+    c1 = apr_table_copy_shared(pool, t);
+    c2 = apr_table_copy_shared(pool, t);
+    ABTS_PTR_EQUAL(tc, apr_table_elts(t)->elts, apr_table_elts(c1)->elts);
+    ABTS_PTR_EQUAL(tc, apr_table_elts(t)->elts, apr_table_elts(c2)->elts);
+
+    apr_table_set(c1, "a", "c1");
+    apr_table_add(c1, "c", "3");
+    ABTS_STR_EQUAL(tc, "c1", apr_table_get(c1, "a"));
+    ABTS_STR_EQUAL(tc, "3", apr_table_get(c1, "c"));
+    ABTS_STR_EQUAL(tc, "1", apr_table_get(t, "a"));
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "c"));
+    ABTS_STR_EQUAL(tc, "1", apr_table_get(c2, "a"));
+    ABTS_INT_EQUAL(tc, 2, apr_table_elts(t)->nelts);
+
+    apr_table_unset(t, "b");
+    apr_table_add(t, "d", "4");
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "b"));
+    ABTS_STR_EQUAL(tc, "2", apr_table_get(c2, "b"));
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(c2, "d"));
+    ABTS_INT_EQUAL(tc, 2, apr_table_elts(c2)->nelts);
+
+    apr_table_clear(c2);
+    apr_table_set(c2, "e", "5");
+    ABTS_INT_EQUAL(tc, 1, apr_table_elts(c2)->nelts);
+    ABTS_STR_EQUAL(tc, "4", apr_table_get(t, "d"));
+    ABTS_INT_EQUAL(tc, 2, apr_table_elts(t)->nelts);
+
+    /* Shared copies are changed like any other */
+    c1 = apr_table_copy_shared(pool, t);
+    c2 = apr_table_copy_shared(pool, t);
+    apr_table_merge(c1, "a", "x");
+    apr_table_overlap(c2, c1, APR_OVERLAP_TABLES_SET);
+    ABTS_STR_EQUAL(tc, "1, x", apr_table_get(c2, "a"));
+    ABTS_STR_EQUAL(tc, "1", apr_table_get(t, "a"));
+
+    /* Until the pool of the copy is cleared */
+    apr_pool_create(&subpool, pool);
+    c1 = apr_table_copy_shared(subpool, t);
+    elts = apr_table_elts(t)->elts;
+    ABTS_PTR_EQUAL(tc, elts, apr_table_elts(c1)->elts);
+    apr_pool_destroy(subpool);
+    apr_table_set(t, "a", "2");
+    ABTS_PTR_EQUAL(tc, elts, apr_table_elts(t)->elts);
+    ABTS_STR_EQUAL(tc, "2", apr_table_get(t, "a"));
+
+    /* Including their full-key index */
+    for (i = 0; i < 100; i++) {
+        sprintf(key, "X-Header-%d", i);
+        apr_table_set(t, key, "t");
+    }
+    c1 = apr_table_copy_shared(pool, t);
+    for (i = 0; i < 100; i += 2) {
+        sprintf(key, "X-Header-%d", i);
+        apr_table_unset(c1, key);
+        apr_table_set(c1, key, "c1");
+    }
+    for (i = 100; i < 200; i++) {
+        sprintf(key, "X-Header-%d", i);
+        apr_table_set(t, key, "t");
+    }
+    for (i = 0; i < 200; i++) {
+        sprintf(key, "X-Header-%d", i);
+        ABTS_STR_EQUAL(tc, "t", apr_table_get(t, key));
+        if (i >= 100) {
+            ABTS_PTR_EQUAL(tc, NULL, apr_table_get(c1, key));
+        }
+        else {
+            ABTS_STR_EQUAL(tc, i % 2 ? "t" : "c1", apr_table_get(c1, key));
+        }
+    }
+
+    apr_pool_destroy(pool);
+}
+
+static void table_keys(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_table_t *t;
+    apr_table_key_t ct, xh;
+    char key[32];
+    int i;
+
+    apr_pool_create(&pool, p);
+    apr_table_key_init(&ct, "Content-Type");
+    apr_table_key_init(&xh, "X-Header-42");
+
+    /* Small tables, searched by the first character index */
+    t = apr_table_make(pool, 2);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_getk(t, &ct));
+    apr_table_unsetk(t, &ct);
+    apr_table_set(t, "content-type", "text/plain");
+    apr_table_set(t, "Content-Length", "42");
+    ABTS_STR_EQUAL(tc, "text/plain", apr_table_getk(t, &ct));
+    apr_table_setk(t, &ct, "text/html");
+    ABTS_INT_EQUAL(tc, 2, apr_table_elts(t)->nelts);
+    ABTS_STR_EQUAL(tc, "text/html", apr_table_get(t, "CONTENT-TYPE"));
+    apr_table_unsetk(t, &ct);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_getk(t, &ct));
+    ABTS_STR_EQUAL(tc, "42", apr_table_get(t, "Content-Length"));
+    apr_table_setk(t, &ct, "text/css");
+    ABTS_STR_EQUAL(tc, "text/css", apr_table_get(t, "content-type"));
+    ABTS_INT_EQUAL(tc, 2, apr_table_elts(t)->nelts);
+
+    /* Large tables, searched by the full-key index */
+    for (i = 0; i < 100; i++) {
+        sprintf(key, "x-header-%d", i);
+        apr_table_set(t, key, key);
+    }
+    ABTS_STR_EQUAL(tc, "x-header-42", apr_table_getk(t, &xh));
+    apr_table_setk(t, &xh, "42");
+    apr_table_add(t, "X-HEADER-42", "dup");
+    ABTS_STR_EQUAL(tc, "42", apr_table_getk(t, &xh));
+    apr_table_unsetk(t, &xh);
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_getk(t, &xh));
+    ABTS_PTR_EQUAL(tc, NULL, apr_table_get(t, "x-header-42"));
+    ABTS_STR_EQUAL(tc, "x-header-43", apr_table_get(t, "X-Header-43"));
+    ABTS_STR_EQUAL(tc, "text/css", apr_table_getk(t, &ct));
+    ABTS_INT_EQUAL(tc, 101, apr_table_elts(t)->nelts);
+    apr_table_setk(t, &xh, "again");
+    ABTS_STR_EQUAL(tc, "again", apr_table_get(t, "X-HEADER-42"));
+
+    apr_pool_destroy(pool);
+}
+
 abts_suite *testtable(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
 
     abts_run_test(suite, array_clear, NULL);
+    abts_run_test(suite, array_grow, NULL);
+    abts_run_test(suite, array_bulk, NULL);
+    abts_run_test(suite, array_sort, NULL);
+    abts_run_test(suite, array_sort_int, NULL);
     abts_run_test(suite, table_make, NULL);
     abts_run_test(suite, table_get, NULL);
     abts_run_test(suite, table_getm, NULL);
@@ -239,6 +841,11 @@ abts_suite *testtable(abts_suite *suite)
     abts_run_test(suite, table_overlap, NULL);
     abts_run_test(suite, table_overlap2, NULL);
     abts_run_test(suite, table_overlap3, NULL);
+    abts_run_test(suite, table_index_full, NULL);
+    abts_run_test(suite, table_freeze, NULL);
+    abts_run_test(suite, table_freeze_null, NULL);
+    abts_run_test(suite, table_copy_on_write, NULL);
+    abts_run_test(suite, table_keys, NULL);
 
     return suite;
 }
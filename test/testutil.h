@@ -87,6 +87,7 @@ abts_suite *testpath(abts_suite *suite);
 abts_suite *testpipe(abts_suite *suite);
 abts_suite *testpoll(abts_suite *suite);
 abts_suite *testpool(abts_suite *suite);
+abts_suite *testpoolinline(abts_suite *suite);
 abts_suite *testproc(abts_suite *suite);
 abts_suite *testprocmutex(abts_suite *suite);
 abts_suite *testrand(abts_suite *suite);
@@ -105,5 +106,7 @@ abts_suite *testud(abts_suite *suite);
 abts_suite *testuser(abts_suite *suite);
 abts_suite *testvsn(abts_suite *suite);
 abts_suite *testskiplist(abts_suite *suite);
+abts_suite *testslab(abts_suite *suite);
+abts_suite *testflathash(abts_suite *suite);
 
 #endif /* APR_TEST_INCLUDES */